@@ -0,0 +1,262 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/transform.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+Skeleton::Skeleton(const aiScene* scene)
+{
+	addNode(scene->mRootNode, -1);
+	globalInverse = glm::inverse(toGlm(scene->mRootNode->mTransformation));
+}
+
+void Skeleton::addNode(const aiNode* node, int parent)
+{
+	int index = (int)names.size();
+	names.push_back(node->mName.C_Str());
+	parents.push_back(parent);
+	bindLocals.push_back(toGlm(node->mTransformation));
+	nodeLookup[names.back()] = index;
+
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		addNode(node->mChildren[i], index);
+}
+
+int Skeleton::findNode(const std::string& name) const
+{
+	std::map<std::string, int>::const_iterator it = nodeLookup.find(name);
+	return it == nodeLookup.end() ? -1 : it->second;
+}
+
+int Skeleton::addBone(const std::string& name, glm::mat4 offset)
+{
+	int node = findNode(name);
+	if (node < 0)
+	{
+		std::cerr << "Bone without a node: " << name << std::endl;
+		return -1;
+	}
+
+	std::map<int, int>::iterator it = boneLookup.find(node);
+	if (it != boneLookup.end())
+		return it->second;
+
+	int slot = (int)boneNodes.size();
+	boneNodes.push_back(node);
+	offsets.push_back(offset);
+	boneLookup[node] = slot;
+	return slot;
+}
+
+// assimp matrices are row major
+glm::mat4 Skeleton::toGlm(const aiMatrix4x4& m)
+{
+	return glm::transpose(glm::make_mat4(&m.a1));
+}
+
+AnimationClip::AnimationClip(const aiAnimation* anim, const Skeleton* skeleton)
+{
+	name = anim->mName.C_Str();
+
+	// files without a tick rate are in ticks of 1/25 s by convention
+	double ticksPerSecond = anim->mTicksPerSecond != 0 ? anim->mTicksPerSecond : 25.0;
+	duration = (float)(anim->mDuration / ticksPerSecond);
+
+	for (unsigned int c = 0; c < anim->mNumChannels; c++)
+	{
+		const aiNodeAnim* channel = anim->mChannels[c];
+
+		NodeTrack track;
+		track.node = skeleton->findNode(channel->mNodeName.C_Str());
+		if (track.node < 0)
+			continue;
+
+		for (unsigned int i = 0; i < channel->mNumPositionKeys; i++)
+		{
+			const aiVectorKey& k = channel->mPositionKeys[i];
+			track.positionTimes.push_back((float)(k.mTime / ticksPerSecond));
+			track.positions.push_back(glm::vec3(k.mValue.x, k.mValue.y, k.mValue.z));
+		}
+		for (unsigned int i = 0; i < channel->mNumRotationKeys; i++)
+		{
+			const aiQuatKey& k = channel->mRotationKeys[i];
+			track.rotationTimes.push_back((float)(k.mTime / ticksPerSecond));
+			track.rotations.push_back(glm::quat(k.mValue.w, k.mValue.x, k.mValue.y, k.mValue.z));
+		}
+		for (unsigned int i = 0; i < channel->mNumScalingKeys; i++)
+		{
+			const aiVectorKey& k = channel->mScalingKeys[i];
+			track.scaleTimes.push_back((float)(k.mTime / ticksPerSecond));
+			track.scales.push_back(glm::vec3(k.mValue.x, k.mValue.y, k.mValue.z));
+		}
+
+		tracks.push_back(track);
+	}
+}
+
+// index of the key before time and how far it is to the next one
+static unsigned int findKey(const std::vector<float>& times, float time, float& t)
+{
+	t = 0;
+	if (times.size() < 2 || time <= times[0])
+		return 0;
+	if (time >= times.back())
+		return (unsigned int)times.size() - 1;
+
+	unsigned int i = (unsigned int)(std::upper_bound(times.begin(), times.end(), time)
+		- times.begin()) - 1;
+	t = (time - times[i]) / (times[i + 1] - times[i]);
+	return i;
+}
+
+// shortest path slerp with the 4 components in one register
+static glm::quat slerp(const glm::quat& a, const glm::quat& b, float t)
+{
+#ifdef ANIMATION_SSE
+	__m128 qa = _mm_set_ps(a.w, a.z, a.y, a.x);
+	__m128 qb = _mm_set_ps(b.w, b.z, b.y, b.x);
+
+	// horizontal add of the products leaves the dot product in every lane
+	__m128 m = _mm_mul_ps(qa, qb);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	float cosTheta = _mm_cvtss_f32(m);
+
+	if (cosTheta < 0)
+	{
+		qb = _mm_sub_ps(_mm_setzero_ps(), qb);
+		cosTheta = -cosTheta;
+	}
+
+	// nearly parallel, a plain lerp is accurate and avoids dividing by ~0
+	float wa = 1 - t, wb = t;
+	if (cosTheta < 0.9995f)
+	{
+		float theta = std::acos(cosTheta);
+		float sinTheta = std::sin(theta);
+		wa = std::sin(wa * theta) / sinTheta;
+		wb = std::sin(wb * theta) / sinTheta;
+	}
+	__m128 r = _mm_add_ps(_mm_mul_ps(qa, _mm_set1_ps(wa)), _mm_mul_ps(qb, _mm_set1_ps(wb)));
+
+	// renormalize, the lerp path shortens the quaternion slightly
+	m = _mm_mul_ps(r, r);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	r = _mm_div_ps(r, _mm_sqrt_ps(m));
+
+	float out[4];
+	_mm_storeu_ps(out, r);
+	return glm::quat(out[3], out[0], out[1], out[2]);
+#else
+	glm::quat c = glm::dot(a, b) < 0 ? -b : b;
+	return glm::normalize(glm::slerp(a, c, t));
+#endif
+}
+
+void AnimationClip::sample(float time, std::vector<glm::mat4>& locals) const
+{
+	for (const NodeTrack& track : tracks)
+	{
+		float t;
+		unsigned int i;
+
+		glm::vec3 pos(0);
+		if (!track.positions.empty())
+		{
+			i = findKey(track.positionTimes, time, t);
+			pos = t > 0 ? glm::mix(track.positions[i], track.positions[i + 1], t)
+				: track.positions[i];
+		}
+
+		glm::quat rot(1, 0, 0, 0);
+		if (!track.rotations.empty())
+		{
+			i = findKey(track.rotationTimes, time, t);
+			rot = t > 0 ? slerp(track.rotations[i], track.rotations[i + 1], t)
+				: track.rotations[i];
+		}
+
+		glm::vec3 scale(1);
+		if (!track.scales.empty())
+		{
+			i = findKey(track.scaleTimes, time, t);
+			scale = t > 0 ? glm::mix(track.scales[i], track.scales[i + 1], t)
+				: track.scales[i];
+		}
+
+		locals[track.node] = glm::translate(pos) * glm::mat4_cast(rot) * glm::scale(scale);
+	}
+}
+
+AnimationInstance::AnimationInstance(const Skeleton* skeleton, const AnimationClip* clip)
+{
+	AnimationInstance::skeleton = skeleton;
+	AnimationInstance::clip = clip;
+	time = 0;
+	speed = 1;
+	version = 0;
+
+	locals = skeleton->bindLocals;
+	globals.resize(locals.size());
+	palette.assign(skeleton->boneNodes.size(), glm::mat4(1));
+}
+
+// advances the clip and rebuilds the bone palette
+void AnimationInstance::evaluate(float dt)
+{
+	if (clip != nullptr && clip->duration > 0)
+	{
+		time = std::fmod(time + dt * speed, clip->duration);
+		if (time < 0)
+			time += clip->duration;
+		clip->sample(time, locals);
+	}
+
+	// parents come first, so one pass builds every global transform
+	for (unsigned int i = 0; i < locals.size(); i++)
+	{
+		int p = skeleton->parents[i];
+		globals[i] = p >= 0 ? globals[p] * locals[i] : locals[i];
+	}
+
+	for (unsigned int b = 0; b < palette.size(); b++)
+	{
+		palette[b] = skeleton->globalInverse * globals[skeleton->boneNodes[b]] *
+			skeleton->offsets[b];
+	}
+	version++;
+}
+
+void Animator::add(AnimationInstance* instance)
+{
+	instances.push_back(instance);
+}
+
+void Animator::remove(AnimationInstance* instance)
+{
+	instances.erase(std::remove(instances.begin(), instances.end(), instance),
+		instances.end());
+}
+
+// instances are independent, so they are evaluated in parallel batches
+void Animator::update(JobSystem* jobs, float dt)
+{
+	jobs->parallelFor((unsigned int)instances.size(), 16,
+		[this, dt](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+			instances[i]->evaluate(dt);
+	});
+}
+
+unsigned int Animator::size()
+{
+	return (unsigned int)instances.size();
+}
@@ -0,0 +1,105 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <assimp/scene.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <iostream>
+
+#include "JobSystem.h"
+
+// The node hierarchy of an imported model, in depth first order so a
+// parent always comes before its children, and the nodes meshes are
+// skinned to.
+class Skeleton
+{
+public:
+	std::vector<std::string> names;
+	std::vector<int> parents;
+	std::vector<glm::mat4> bindLocals; // node transforms from the file
+
+	// bone slot -> node, and the mesh to bone space matrix of each bone
+	std::vector<int> boneNodes;
+	std::vector<glm::mat4> offsets;
+
+	glm::mat4 globalInverse;
+
+	Skeleton(const aiScene* scene);
+
+	int findNode(const std::string& name) const;
+	// returns the bone slot of the node, adding it on first use
+	int addBone(const std::string& name, glm::mat4 offset);
+
+	static glm::mat4 toGlm(const aiMatrix4x4& m);
+
+private:
+	std::map<std::string, int> nodeLookup;
+	std::map<int, int> boneLookup;
+
+	void addNode(const aiNode* node, int parent);
+};
+
+// Keyframes of one node, times in seconds.
+struct NodeTrack
+{
+	int node;
+	std::vector<float> positionTimes, rotationTimes, scaleTimes;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+};
+
+// An imported aiAnimation. Clips are read only after loading and can be
+// shared by any number of instances of the same skeleton.
+class AnimationClip
+{
+public:
+	std::string name;
+	float duration; // seconds
+	std::vector<NodeTrack> tracks;
+
+	AnimationClip(const aiAnimation* anim, const Skeleton* skeleton);
+
+	// writes the local transform of every animated node, others are untouched
+	void sample(float time, std::vector<glm::mat4>& locals) const;
+};
+
+// The playback state and pose of one animated character.
+class AnimationInstance
+{
+public:
+	const Skeleton* skeleton;
+	const AnimationClip* clip;
+	float time;
+	float speed;
+
+	std::vector<glm::mat4> locals, globals;
+	// final bone matrices, mesh space to posed mesh space
+	std::vector<glm::mat4> palette;
+	// bumped every evaluation, lets the cpu skinning fallback skip work
+	unsigned long long version;
+
+	AnimationInstance(const Skeleton* skeleton, const AnimationClip* clip);
+
+	void evaluate(float dt);
+};
+
+// Evaluates all registered instances as a batch spread over the job system.
+class Animator
+{
+private:
+	std::vector<AnimationInstance*> instances;
+
+public:
+	void add(AnimationInstance* instance);
+	void remove(AnimationInstance* instance);
+	void update(JobSystem* jobs, float dt);
+	unsigned int size();
+};
+
+#endif
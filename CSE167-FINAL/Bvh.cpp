@@ -0,0 +1,991 @@
+#include "Bvh.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BVH_SSE
+#endif
+
+// the cost of visiting a node against testing one primitive
+static const float TRAVERSAL_COST = 0.125f;
+static const int BINS = 12;
+static const unsigned int MAX_LEAF = 4;
+// below this depth splits are at the median, so the traversal stacks of
+// 64 always do
+static const int MAX_DEPTH = 32;
+// subtrees with at least this many primitives are built as jobs
+static const unsigned int PARALLEL_PRIMITIVES = 4096;
+// floats in a leaf's block of four triangles
+static const int LEAF_FLOATS = 36;
+
+// boxes and centroids of what a tree is built over
+struct BuildInput
+{
+	std::vector<glm::vec3> lo, hi, centroid;
+};
+
+static float surfaceArea(glm::vec3 lo, glm::vec3 hi)
+{
+	glm::vec3 d = glm::max(hi - lo, glm::vec3(0));
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// adds a subtree built on its own, its child links are made absolute
+static void appendNodes(std::vector<BvhNode>& nodes, const std::vector<BvhNode>& subtree)
+{
+	unsigned int base = (unsigned int)nodes.size();
+	for (BvhNode node : subtree)
+	{
+		if (node.count == 0)
+			node.offset += base;
+		nodes.push_back(node);
+	}
+}
+
+// Builds the node over order[begin, end) and everything below it depth
+// first into nodes. Each split is the cheapest of BINS buckets of the
+// centroids along every axis by the surface area heuristic.
+static void buildNode(JobSystem* jobs, const BuildInput& in, unsigned int* order,
+	unsigned int begin, unsigned int end, int depth, std::vector<BvhNode>& nodes)
+{
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(BvhNode());
+
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), centerLo(FLT_MAX), centerHi(-FLT_MAX);
+	for (unsigned int i = begin; i < end; i++)
+	{
+		lo = glm::min(lo, in.lo[order[i]]);
+		hi = glm::max(hi, in.hi[order[i]]);
+		centerLo = glm::min(centerLo, in.centroid[order[i]]);
+		centerHi = glm::max(centerHi, in.centroid[order[i]]);
+	}
+	nodes[index].min = lo;
+	nodes[index].max = hi;
+
+	unsigned int count = end - begin;
+	float parentArea = surfaceArea(lo, hi);
+	int bestAxis = -1, bestBin = 0;
+	float bestCost = (float)count; // of making this a leaf
+	if (count > 1 && depth < MAX_DEPTH && parentArea > 0)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centerHi[axis] - centerLo[axis];
+			if (extent <= 0)
+				continue;
+			float scale = BINS * 0.9999f / extent;
+
+			glm::vec3 binLo[BINS], binHi[BINS];
+			unsigned int binCount[BINS] = {};
+			for (int b = 0; b < BINS; b++)
+			{
+				binLo[b] = glm::vec3(FLT_MAX);
+				binHi[b] = glm::vec3(-FLT_MAX);
+			}
+			for (unsigned int i = begin; i < end; i++)
+			{
+				unsigned int p = order[i];
+				int b = (int)((in.centroid[p][axis] - centerLo[axis]) * scale);
+				binLo[b] = glm::min(binLo[b], in.lo[p]);
+				binHi[b] = glm::max(binHi[b], in.hi[p]);
+				binCount[b]++;
+			}
+
+			// areas and counts left of every split, then sweep in from the right
+			float leftArea[BINS];
+			unsigned int leftCount[BINS];
+			glm::vec3 runLo(FLT_MAX), runHi(-FLT_MAX);
+			unsigned int run = 0;
+			for (int b = 0; b < BINS - 1; b++)
+			{
+				runLo = glm::min(runLo, binLo[b]);
+				runHi = glm::max(runHi, binHi[b]);
+				run += binCount[b];
+				leftArea[b] = run ? surfaceArea(runLo, runHi) : 0;
+				leftCount[b] = run;
+			}
+			runLo = glm::vec3(FLT_MAX);
+			runHi = glm::vec3(-FLT_MAX);
+			run = 0;
+			for (int b = BINS - 1; b > 0; b--)
+			{
+				runLo = glm::min(runLo, binLo[b]);
+				runHi = glm::max(runHi, binHi[b]);
+				run += binCount[b];
+				if (run == 0 || leftCount[b - 1] == 0)
+					continue;
+				float cost = TRAVERSAL_COST + (leftArea[b - 1] * leftCount[b - 1] +
+					surfaceArea(runLo, runHi) * run) / parentArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b - 1;
+				}
+			}
+		}
+	}
+
+	if (count <= MAX_LEAF && bestAxis < 0)
+	{
+		nodes[index].offset = begin;
+		nodes[index].count = (unsigned short)count;
+		nodes[index].axis = 0;
+		return;
+	}
+
+	unsigned int mid;
+	if (bestAxis >= 0)
+	{
+		float scale = BINS * 0.9999f / (centerHi[bestAxis] - centerLo[bestAxis]);
+		float start = centerLo[bestAxis];
+		int axis = bestAxis, split = bestBin;
+		mid = (unsigned int)(std::partition(order + begin, order + end, [&](unsigned int p)
+		{
+			return (int)((in.centroid[p][axis] - start) * scale) <= split;
+		}) - order);
+	}
+	else
+	{
+		// too deep, or the centroids are all in one place: halve along the
+		// widest axis
+		glm::vec3 extent = centerHi - centerLo;
+		bestAxis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+		mid = begin + count / 2;
+		int axis = bestAxis;
+		std::nth_element(order + begin, order + mid, order + end, [&](unsigned int a, unsigned int b)
+		{
+			return in.centroid[a][axis] < in.centroid[b][axis];
+		});
+	}
+	nodes[index].count = 0;
+	nodes[index].axis = (unsigned short)bestAxis;
+
+	if (jobs && count >= PARALLEL_PRIMITIVES)
+	{
+		// the halves are disjoint ranges of order, so they can be split
+		// at the same time into their own node lists
+		std::vector<BvhNode> left, right;
+		JobCounter counter;
+		jobs->run(counter, [&]()
+		{
+			buildNode(jobs, in, order, begin, mid, depth + 1, left);
+		});
+		buildNode(jobs, in, order, mid, end, depth + 1, right);
+		jobs->wait(counter);
+
+		appendNodes(nodes, left);
+		nodes[index].offset = (unsigned int)nodes.size();
+		appendNodes(nodes, right);
+	}
+	else
+	{
+		buildNode(jobs, in, order, begin, mid, depth + 1, nodes);
+		nodes[index].offset = (unsigned int)nodes.size();
+		buildNode(jobs, in, order, mid, end, depth + 1, nodes);
+	}
+}
+
+// a ray set up for the box tests
+struct BoxRay
+{
+#ifdef BVH_SSE
+	__m128 origin, inverseDir;
+#else
+	glm::vec3 origin, inverseDir;
+#endif
+};
+
+static BoxRay makeBoxRay(glm::vec3 origin, glm::vec3 dir)
+{
+	BoxRay ray;
+	glm::vec3 inverseDir = 1.f / dir;
+#ifdef BVH_SSE
+	ray.origin = _mm_setr_ps(origin.x, origin.y, origin.z, 0.f);
+	ray.inverseDir = _mm_setr_ps(inverseDir.x, inverseDir.y, inverseDir.z, 0.f);
+#else
+	ray.origin = origin;
+	ray.inverseDir = inverseDir;
+#endif
+	return ray;
+}
+
+// slab test, true if the ray enters the box before tMax
+static bool hitsBox(const BvhNode& node, const BoxRay& ray, float tMax)
+{
+#ifdef BVH_SSE
+	// min and max are loaded with the word after them, which is masked off
+	// so its bits are never read as a float
+	const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 lo = _mm_and_ps(_mm_loadu_ps(&node.min.x), mask);
+	__m128 hi = _mm_and_ps(_mm_loadu_ps(&node.max.x), mask);
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, ray.origin), ray.inverseDir);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, ray.origin), ray.inverseDir);
+	// the fourth lane is replaced by the first before the reductions
+	__m128 near = _mm_min_ps(t0, t1), far = _mm_max_ps(t0, t1);
+	near = _mm_shuffle_ps(near, near, _MM_SHUFFLE(0, 2, 1, 0));
+	far = _mm_shuffle_ps(far, far, _MM_SHUFFLE(0, 2, 1, 0));
+	near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 0, 3, 2)));
+	far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 0, 3, 2)));
+	near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 3, 0, 1)));
+	far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_comile_ss(_mm_max_ss(near, _mm_setzero_ps()), _mm_min_ss(far, _mm_set_ss(tMax))) != 0;
+#else
+	glm::vec3 t0 = (node.min - ray.origin) * ray.inverseDir;
+	glm::vec3 t1 = (node.max - ray.origin) * ray.inverseDir;
+	glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+	float enter = glm::max(glm::max(near.x, near.y), glm::max(near.z, 0.f));
+	float exit = glm::min(glm::min(far.x, far.y), glm::min(far.z, tMax));
+	return enter <= exit;
+#endif
+}
+
+static bool overlapsBox(const BvhNode& node, glm::vec3 lo, glm::vec3 hi)
+{
+	return node.min.x <= hi.x && node.max.x >= lo.x && node.min.y <= hi.y && node.max.y >= lo.y &&
+		node.min.z <= hi.z && node.max.z >= lo.z;
+}
+
+// box around the eight corners of lo to hi moved by m
+static void transformBox(const glm::mat4& m, glm::vec3 lo, glm::vec3 hi, glm::vec3& outLo, glm::vec3& outHi)
+{
+	outLo = glm::vec3(FLT_MAX);
+	outHi = glm::vec3(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z);
+		glm::vec3 p = glm::vec3(m * glm::vec4(corner, 1.f));
+		outLo = glm::min(outLo, p);
+		outHi = glm::max(outHi, p);
+	}
+}
+
+MeshBvh::MeshBvh(const Mesh* mesh, JobSystem* jobs)
+{
+	unsigned int n = (unsigned int)(mesh->indices.size() / 3);
+	BuildInput in;
+	in.lo.resize(n);
+	in.hi.resize(n);
+	in.centroid.resize(n);
+	std::vector<unsigned int> order(n);
+	for (unsigned int t = 0; t < n; t++)
+	{
+		glm::vec3 a = mesh->vertices[mesh->indices[t * 3]].Position;
+		glm::vec3 b = mesh->vertices[mesh->indices[t * 3 + 1]].Position;
+		glm::vec3 c = mesh->vertices[mesh->indices[t * 3 + 2]].Position;
+		in.lo[t] = glm::min(a, glm::min(b, c));
+		in.hi[t] = glm::max(a, glm::max(b, c));
+		in.centroid[t] = (in.lo[t] + in.hi[t]) * 0.5f;
+		order[t] = t;
+	}
+	if (n > 0)
+		buildNode(jobs, in, order.data(), 0, n, 0, nodes);
+	numTriangles = n;
+
+	// the leaves are at most MAX_LEAF triangles, one block each
+	for (BvhNode& node : nodes)
+	{
+		if (node.count == 0)
+			continue;
+		unsigned int block = (unsigned int)ids.size() / 4;
+		blocks.resize(blocks.size() + LEAF_FLOATS, 0.f);
+		float* lanes = &blocks[block * LEAF_FLOATS];
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			if (k >= node.count)
+			{
+				ids.push_back(~0u);
+				continue;
+			}
+			unsigned int t = order[node.offset + k];
+			glm::vec3 a = mesh->vertices[mesh->indices[t * 3]].Position;
+			glm::vec3 corner[3] = { a, mesh->vertices[mesh->indices[t * 3 + 1]].Position - a,
+				mesh->vertices[mesh->indices[t * 3 + 2]].Position - a };
+			for (int v = 0; v < 3; v++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+					lanes[(v * 3 + axis) * 4 + k] = corner[v][axis];
+			}
+			ids.push_back(t);
+		}
+		node.offset = block;
+	}
+
+	bytes = nodes.capacity() * sizeof(BvhNode) + blocks.capacity() * sizeof(float) +
+		ids.capacity() * sizeof(unsigned int);
+	MemoryStats::allocate(MemoryTag::COLLISION, bytes);
+}
+
+MeshBvh::~MeshBvh()
+{
+	MemoryStats::release(MemoryTag::COLLISION, bytes);
+}
+
+// nearer child first by the sign of the ray along the split axis
+bool MeshBvh::raycast(glm::vec3 origin, glm::vec3 dir, float& tMax, unsigned int& triangle) const
+{
+	if (nodes.empty())
+		return false;
+
+	BoxRay ray = makeBoxRay(origin, dir);
+	bool negative[3] = { dir.x < 0, dir.y < 0, dir.z < 0 };
+#ifdef BVH_SSE
+	__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	__m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+#endif
+	unsigned int stack[64];
+	int top = 0;
+	unsigned int current = 0;
+	bool hit = false;
+	while (true)
+	{
+		const BvhNode& node = nodes[current];
+		if (hitsBox(node, ray, tMax))
+		{
+			if (node.count > 0)
+			{
+				// Moller-Trumbore against the whole block, both sides count.
+				// Unused lanes have a zero determinant and never hit.
+				const float* lanes = &blocks[node.offset * LEAF_FLOATS];
+				float t[4];
+				int mask;
+#ifdef BVH_SSE
+				__m128 ax = _mm_loadu_ps(lanes), ay = _mm_loadu_ps(lanes + 4), az = _mm_loadu_ps(lanes + 8);
+				__m128 e1x = _mm_loadu_ps(lanes + 12), e1y = _mm_loadu_ps(lanes + 16), e1z = _mm_loadu_ps(lanes + 20);
+				__m128 e2x = _mm_loadu_ps(lanes + 24), e2y = _mm_loadu_ps(lanes + 28), e2z = _mm_loadu_ps(lanes + 32);
+				__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+				__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				__m128 inverseDet = _mm_div_ps(one, det);
+				__m128 sx = _mm_sub_ps(ox, ax), sy = _mm_sub_ps(oy, ay), sz = _mm_sub_ps(oz, az);
+				__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+					_mm_mul_ps(sz, pz)), inverseDet);
+				__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+				__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+					_mm_mul_ps(dz, qz)), inverseDet);
+				__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+					_mm_mul_ps(e2z, qz)), inverseDet);
+				// comparisons with the nan of a zero determinant are false
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+					_mm_and_ps(_mm_cmple_ps(_mm_add_ps(u, v), one), _mm_cmpneq_ps(det, zero)));
+				inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(tt, zero), _mm_cmplt_ps(tt, _mm_set1_ps(tMax))));
+				mask = _mm_movemask_ps(inside);
+				_mm_storeu_ps(t, tt);
+#else
+				mask = 0;
+				for (int k = 0; k < 4; k++)
+				{
+					glm::vec3 a(lanes[k], lanes[4 + k], lanes[8 + k]);
+					glm::vec3 e1(lanes[12 + k], lanes[16 + k], lanes[20 + k]);
+					glm::vec3 e2(lanes[24 + k], lanes[28 + k], lanes[32 + k]);
+					glm::vec3 p = glm::cross(dir, e2);
+					float det = glm::dot(e1, p);
+					if (det == 0)
+						continue;
+					float inverseDet = 1.f / det;
+					glm::vec3 s = origin - a;
+					float u = glm::dot(s, p) * inverseDet;
+					glm::vec3 q = glm::cross(s, e1);
+					float v = glm::dot(dir, q) * inverseDet;
+					t[k] = glm::dot(e2, q) * inverseDet;
+					if (u >= 0 && v >= 0 && u + v <= 1 && t[k] > 0 && t[k] < tMax)
+						mask |= 1 << k;
+				}
+#endif
+				for (int k = 0; k < 4; k++)
+				{
+					if ((mask >> k & 1) && t[k] < tMax)
+					{
+						tMax = t[k];
+						triangle = ids[node.offset * 4 + k];
+						hit = true;
+					}
+				}
+			}
+			else if (negative[node.axis])
+			{
+				stack[top++] = current + 1;
+				current = node.offset;
+				continue;
+			}
+			else
+			{
+				stack[top++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+		if (top == 0)
+			break;
+		current = stack[--top];
+	}
+	return hit;
+}
+
+void MeshBvh::overlap(glm::vec3 lo, glm::vec3 hi, std::vector<unsigned int>& found) const
+{
+	if (nodes.empty())
+		return;
+
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode& node = nodes[stack[--top]];
+		if (!overlapsBox(node, lo, hi))
+			continue;
+		if (node.count > 0)
+		{
+			for (unsigned int k = 0; k < node.count; k++)
+				found.push_back(node.offset * 4 + k);
+		}
+		else
+		{
+			stack[top++] = node.offset;
+			stack[top++] = (unsigned int)(&node - nodes.data()) + 1;
+		}
+	}
+}
+
+void MeshBvh::getTriangle(unsigned int index, glm::vec3& a, glm::vec3& b, glm::vec3& c) const
+{
+	const float* lanes = &blocks[index / 4 * LEAF_FLOATS + index % 4];
+	a = glm::vec3(lanes[0], lanes[4], lanes[8]);
+	b = a + glm::vec3(lanes[12], lanes[16], lanes[20]);
+	c = a + glm::vec3(lanes[24], lanes[28], lanes[32]);
+}
+
+glm::vec3 MeshBvh::getMin() const
+{
+	return nodes[0].min;
+}
+
+glm::vec3 MeshBvh::getMax() const
+{
+	return nodes[0].max;
+}
+
+size_t MeshBvh::getNumTriangles() const
+{
+	return numTriangles;
+}
+
+size_t MeshBvh::getNumNodes() const
+{
+	return nodes.size();
+}
+
+SceneBvh::SceneBvh()
+{
+	frame = 0;
+	meshBuilds = trianglesBuilt = topBuilds = 0;
+	buildTime = topTime = 0;
+}
+
+SceneBvh::~SceneBvh()
+{
+	for (auto& entry : meshes)
+		delete entry.second.bvh;
+}
+
+void SceneBvh::update(JobSystem* jobs, const std::vector<DrawItem>& items)
+{
+	frame++;
+	double start = glfwGetTime();
+
+	std::vector<const Mesh*> fresh;
+	instances.clear();
+	for (const DrawItem& item : items)
+	{
+		if (item.pose != nullptr)
+			continue;
+		std::unordered_map<unsigned long long, Entry>::iterator found = meshes.find(item.mesh->uid);
+		if (found == meshes.end())
+		{
+			Entry entry = { nullptr, frame };
+			meshes[item.mesh->uid] = entry;
+			fresh.push_back(item.mesh);
+		}
+		else
+			found->second.frame = frame;
+
+		Instance instance;
+		instance.mesh = item.mesh;
+		instance.bvh = nullptr;
+		instance.model = item.model;
+		instances.push_back(instance);
+	}
+
+	// meshes new this frame in parallel, big ones split further inside
+	if (!fresh.empty())
+	{
+		std::vector<MeshBvh*> built(fresh.size());
+		jobs->parallelFor((unsigned int)fresh.size(), 1, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				built[i] = new MeshBvh(fresh[i], jobs);
+		});
+		for (size_t i = 0; i < fresh.size(); i++)
+		{
+			meshes[fresh[i]->uid].bvh = built[i];
+			trianglesBuilt += built[i]->getNumTriangles();
+		}
+		meshBuilds += fresh.size();
+		buildTime += glfwGetTime() - start;
+	}
+
+	// a mesh no item has anymore was unloaded
+	for (std::unordered_map<unsigned long long, Entry>::iterator it = meshes.begin(); it != meshes.end(); )
+	{
+		if (it->second.frame != frame)
+		{
+			delete it->second.bvh;
+			it = meshes.erase(it);
+		}
+		else
+			++it;
+	}
+
+	// the top level is over the world boxes of the instances
+	double topStart = glfwGetTime();
+	std::vector<Instance> placed;
+	BuildInput in;
+	for (Instance& instance : instances)
+	{
+		instance.bvh = meshes[instance.mesh->uid].bvh;
+		if (instance.bvh->getNumTriangles() == 0)
+			continue;
+		instance.inverse = glm::inverse(instance.model);
+		glm::vec3 lo, hi;
+		transformBox(instance.model, instance.bvh->getMin(), instance.bvh->getMax(), lo, hi);
+		in.lo.push_back(lo);
+		in.hi.push_back(hi);
+		in.centroid.push_back((lo + hi) * 0.5f);
+		placed.push_back(instance);
+	}
+
+	std::vector<unsigned int> order(placed.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	nodes.clear();
+	if (!placed.empty())
+		buildNode(nullptr, in, order.data(), 0, (unsigned int)placed.size(), 0, nodes);
+	instances.clear();
+	for (unsigned int i : order)
+		instances.push_back(placed[i]);
+
+	topTime += glfwGetTime() - topStart;
+	topBuilds++;
+}
+
+bool SceneBvh::raycast(glm::vec3 origin, glm::vec3 dir, float maxDistance, RayHit& hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	BoxRay ray = makeBoxRay(origin, dir);
+	bool negative[3] = { dir.x < 0, dir.y < 0, dir.z < 0 };
+	unsigned int stack[64];
+	int top = 0;
+	unsigned int current = 0;
+	float tMax = maxDistance;
+	const Instance* closest = nullptr;
+	while (true)
+	{
+		const BvhNode& node = nodes[current];
+		if (hitsBox(node, ray, tMax))
+		{
+			if (node.count > 0)
+			{
+				// into the mesh's space, t means the same there
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++)
+				{
+					const Instance& instance = instances[i];
+					glm::vec3 localOrigin = glm::vec3(instance.inverse * glm::vec4(origin, 1.f));
+					glm::vec3 localDir = glm::mat3(instance.inverse) * dir;
+					if (instance.bvh->raycast(localOrigin, localDir, tMax, hit.triangle))
+						closest = &instance;
+				}
+			}
+			else if (negative[node.axis])
+			{
+				stack[top++] = current + 1;
+				current = node.offset;
+				continue;
+			}
+			else
+			{
+				stack[top++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+		if (top == 0)
+			break;
+		current = stack[--top];
+	}
+	if (!closest)
+		return false;
+
+	// the normal of the triangle as it was drawn, facing the ray
+	const Mesh* mesh = closest->mesh;
+	glm::vec3 p[3];
+	for (int k = 0; k < 3; k++)
+	{
+		glm::vec3 local = mesh->vertices[mesh->indices[hit.triangle * 3 + k]].Position;
+		p[k] = glm::vec3(closest->model * glm::vec4(local, 1.f));
+	}
+	glm::vec3 normal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+	hit.mesh = mesh;
+	hit.distance = tMax;
+	hit.position = origin + dir * tMax;
+	hit.normal = glm::dot(normal, dir) > 0 ? -normal : normal;
+	return true;
+}
+
+// closest point of the triangle to p, from Ericson's Real-Time Collision
+// Detection
+static glm::vec3 closestPoint(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0 && d2 <= 0)
+		return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0 && d4 <= d3)
+		return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+		return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0 && d5 <= d6)
+		return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+		return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denom = 1.f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// smallest root of a t^2 + b t + c in [0, tMax)
+static bool lowestRoot(float a, float b, float c, float tMax, float& root)
+{
+	if (a <= 0)
+		return false;
+	float discriminant = b * b - 4.f * a * c;
+	if (discriminant < 0)
+		return false;
+	float t = (-b - glm::sqrt(discriminant)) / (2.f * a);
+	if (t < 0 || t >= tMax)
+		return false;
+	root = t;
+	return true;
+}
+
+// First time in [0, tMax) the moving sphere touches the triangle: the face
+// if it lands on the inside, else the first vertex or edge it runs into
+// (Fauerby, Improved Collision Detection and Response).
+static bool sweepTriangle(glm::vec3 center, glm::vec3 move, float radius, glm::vec3 a, glm::vec3 b,
+	glm::vec3 c, float tMax, float& t, glm::vec3& normal)
+{
+	glm::vec3 n = glm::cross(b - a, c - a);
+	float length = glm::length(n);
+	if (length == 0)
+		return false;
+	n /= length;
+	// both sides are solid, face the sphere
+	float dist = glm::dot(center - a, n);
+	if (dist < 0)
+	{
+		n = -n;
+		dist = -dist;
+	}
+
+	// already touching, it can move anywhere but further in
+	glm::vec3 away = center - closestPoint(center, a, b, c);
+	float awaySquared = glm::dot(away, away);
+	if (awaySquared < radius * radius)
+	{
+		glm::vec3 out = awaySquared > 0 ? away / glm::sqrt(awaySquared) : n;
+		if (glm::dot(move, out) >= 0)
+			return false;
+		t = 0;
+		normal = out;
+		return true;
+	}
+
+	float speed = glm::dot(move, n);
+	if (speed < 0)
+	{
+		float landing = (dist - radius) / -speed;
+		glm::vec3 p = center + move * landing - n * radius;
+		glm::vec3 edges = glm::vec3(glm::dot(glm::cross(b - a, p - a), n * length),
+			glm::dot(glm::cross(c - b, p - b), n * length), glm::dot(glm::cross(a - c, p - c), n * length));
+		bool inside = (edges.x >= 0 && edges.y >= 0 && edges.z >= 0) ||
+			(edges.x <= 0 && edges.y <= 0 && edges.z <= 0);
+		if (landing >= 0 && landing < tMax && inside)
+		{
+			t = landing;
+			normal = n;
+			return true;
+		}
+	}
+
+	float best = tMax;
+	glm::vec3 contact;
+	float moveSquared = glm::dot(move, move);
+	glm::vec3 corners[3] = { a, b, c };
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec3 w = center - corners[i];
+		float root;
+		if (lowestRoot(moveSquared, 2.f * glm::dot(w, move), glm::dot(w, w) - radius * radius, best, root))
+		{
+			best = root;
+			contact = corners[i];
+		}
+
+		// the line through the edge, then if the touching point is on it
+		glm::vec3 edge = corners[(i + 1) % 3] - corners[i];
+		float edgeSquared = glm::dot(edge, edge);
+		float edgeMove = glm::dot(edge, move), edgeW = glm::dot(edge, w);
+		if (lowestRoot(moveSquared * edgeSquared - edgeMove * edgeMove,
+			2.f * (glm::dot(w, move) * edgeSquared - edgeW * edgeMove),
+			glm::dot(w, w) * edgeSquared - edgeW * edgeW - radius * radius * edgeSquared, best, root))
+		{
+			float s = (edgeW + root * edgeMove) / edgeSquared;
+			if (s >= 0 && s <= 1)
+			{
+				best = root;
+				contact = corners[i] + edge * s;
+			}
+		}
+	}
+	if (best >= tMax)
+		return false;
+	t = best;
+	normal = glm::normalize(center + move * best - contact);
+	return true;
+}
+
+bool SceneBvh::occluded(glm::vec3 origin, glm::vec3 dir, float maxDistance) const
+{
+	if (nodes.empty())
+		return false;
+
+	BoxRay ray = makeBoxRay(origin, dir);
+	bool negative[3] = { dir.x < 0, dir.y < 0, dir.z < 0 };
+	unsigned int stack[64];
+	int top = 0;
+	unsigned int current = 0;
+	while (true)
+	{
+		const BvhNode& node = nodes[current];
+		if (hitsBox(node, ray, maxDistance))
+		{
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++)
+				{
+					const Instance& instance = instances[i];
+					glm::vec3 localOrigin = glm::vec3(instance.inverse * glm::vec4(origin, 1.f));
+					glm::vec3 localDir = glm::mat3(instance.inverse) * dir;
+					float t = maxDistance;
+					unsigned int triangle;
+					if (instance.bvh->raycast(localOrigin, localDir, t, triangle))
+						return true;
+				}
+			}
+			else if (negative[node.axis])
+			{
+				stack[top++] = current + 1;
+				current = node.offset;
+				continue;
+			}
+			else
+			{
+				stack[top++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+		if (top == 0)
+			break;
+		current = stack[--top];
+	}
+	return false;
+}
+
+bool SceneBvh::sweepSphere(glm::vec3 center, glm::vec3 move, float radius, SweepHit& hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 lo = glm::min(center, center + move) - glm::vec3(radius);
+	glm::vec3 hi = glm::max(center, center + move) + glm::vec3(radius);
+
+	std::vector<unsigned int> found;
+	float best = 1.f;
+	bool touched = false;
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		unsigned int current = stack[--top];
+		const BvhNode& node = nodes[current];
+		if (!overlapsBox(node, lo, hi))
+			continue;
+		if (node.count == 0)
+		{
+			stack[top++] = node.offset;
+			stack[top++] = current + 1;
+			continue;
+		}
+
+		// the swept box in the mesh's space picks the triangles, they're
+		// tested in world space where the sphere is still round
+		for (unsigned int i = node.offset; i < node.offset + node.count; i++)
+		{
+			const Instance& instance = instances[i];
+			glm::vec3 localLo, localHi;
+			transformBox(instance.inverse, lo, hi, localLo, localHi);
+			found.clear();
+			instance.bvh->overlap(localLo, localHi, found);
+			for (unsigned int index : found)
+			{
+				glm::vec3 p[3];
+				instance.bvh->getTriangle(index, p[0], p[1], p[2]);
+				for (int k = 0; k < 3; k++)
+					p[k] = glm::vec3(instance.model * glm::vec4(p[k], 1.f));
+				float t;
+				glm::vec3 normal;
+				if (sweepTriangle(center, move, radius, p[0], p[1], p[2], best, t, normal))
+				{
+					best = t;
+					hit.t = t;
+					hit.normal = normal;
+					touched = true;
+				}
+			}
+		}
+	}
+	if (touched)
+		hit.position = center + move * hit.t;
+	return touched;
+}
+
+// collide and slide: up to the first contact, then what's left of the move
+// along the surface
+glm::vec3 SceneBvh::slide(glm::vec3 center, glm::vec3 move, float radius) const
+{
+	// stop short of contact so the next step doesn't start touching
+	float skin = radius * 0.05f;
+	for (int i = 0; i < SLIDE_STEPS; i++)
+	{
+		float length = glm::length(move);
+		if (length < 1e-6f)
+			break;
+		SweepHit hit;
+		if (!sweepSphere(center, move, radius, hit))
+		{
+			center += move;
+			break;
+		}
+		float t = glm::max(hit.t - skin / length, 0.f);
+		center += move * t;
+		move *= 1.f - t;
+		move -= hit.normal * glm::dot(move, hit.normal);
+	}
+	return center;
+}
+
+void SceneBvh::benchmark(JobSystem* jobs, glm::vec3 origin, float maxDistance)
+{
+	if (nodes.empty())
+	{
+		std::cerr << "bvh: nothing to cast rays at" << std::endl;
+		return;
+	}
+
+	// the same directions every run, uniform over the sphere
+	const unsigned int NUM_RAYS = 1 << 20;
+	std::vector<glm::vec3> dirs(NUM_RAYS);
+	std::mt19937 rng(167);
+	std::normal_distribution<float> gaussian;
+	for (glm::vec3& d : dirs)
+	{
+		do
+			d = glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng));
+		while (glm::dot(d, d) < 1e-6f);
+		d = glm::normalize(d);
+	}
+
+	std::vector<char> hits(NUM_RAYS);
+	auto cast = [&](unsigned int begin, unsigned int end)
+	{
+		RayHit hit;
+		for (unsigned int i = begin; i < end; i++)
+			hits[i] = raycast(origin, dirs[i], maxDistance, hit);
+	};
+
+	// every ray on this thread, then the same rays spread over the jobs
+	double start = glfwGetTime();
+	cast(0, NUM_RAYS);
+	double single = glfwGetTime() - start;
+	start = glfwGetTime();
+	jobs->parallelFor(NUM_RAYS, 4096, cast);
+	double all = glfwGetTime() - start;
+	unsigned int hitCount = 0;
+	for (char h : hits)
+		hitCount += h;
+
+	// camera sized spheres moving a few units
+	const unsigned int NUM_SWEEPS = 1 << 14;
+	unsigned int touched = 0;
+	start = glfwGetTime();
+	for (unsigned int i = 0; i < NUM_SWEEPS; i++)
+	{
+		SweepHit hit;
+		touched += sweepSphere(origin, dirs[i] * 5.f, 0.5f, hit);
+	}
+	double sweeps = glfwGetTime() - start;
+
+	char line[256];
+	snprintf(line, sizeof(line), "bvh: %u rays, %.1f%% hit, %.2f Mrays/s on one thread, %.2f Mrays/s on %u; "
+		"%.0f sphere sweeps/s, %.1f%% touched", NUM_RAYS, hitCount * 100.0 / NUM_RAYS,
+		NUM_RAYS / single / 1e6, NUM_RAYS / all / 1e6, jobs->getNumThreads(),
+		NUM_SWEEPS / sweeps, touched * 100.0 / NUM_SWEEPS);
+	std::cerr << line << std::endl;
+}
+
+void SceneBvh::report()
+{
+	size_t nodeCount = 0;
+	for (auto& entry : meshes)
+		nodeCount += entry.second.bvh->getNumNodes();
+
+	char line[256];
+	snprintf(line, sizeof(line), "bvh: %llu mesh builds, %llu triangles in %.1f ms (%.2f Mtris/s), "
+		"%zu meshes live with %zu nodes, top level %.3f ms per frame over %zu draws",
+		meshBuilds, trianglesBuilt, buildTime * 1000.0,
+		buildTime > 0 ? trianglesBuilt / buildTime / 1e6 : 0.0, meshes.size(), nodeCount,
+		topBuilds ? topTime * 1000.0 / topBuilds : 0.0, instances.size());
+	std::cerr << line << std::endl;
+}
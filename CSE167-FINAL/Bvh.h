@@ -0,0 +1,128 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
+#include "MemoryStats.h"
+
+// 32 bytes, stored depth first so an interior node's first child is the
+// node right after it
+struct BvhNode
+{
+	glm::vec3 min;
+	unsigned int offset; // first primitive of a leaf, second child of an interior node
+	glm::vec3 max;
+	unsigned short count; // primitives in a leaf, 0 for an interior node
+	unsigned short axis; // of the split, the child on the ray's side goes first
+};
+
+// The triangles of one mesh in its local space, in a binned SAH tree.
+// Subtrees of big meshes are built as jobs. A leaf's triangles are stored
+// together so a ray tests all of them at once with SSE.
+class MeshBvh
+{
+public:
+	// jobs may be null to build on this thread
+	MeshBvh(const Mesh* mesh, JobSystem* jobs);
+	~MeshBvh();
+
+	// closest triangle along origin + t * dir with t below tMax, tMax
+	// becomes its t. triangle is its index in the mesh's indices / 3.
+	bool raycast(glm::vec3 origin, glm::vec3 dir, float& tMax, unsigned int& triangle) const;
+
+	// triangles in leaves whose boxes overlap the box lo to hi, by their
+	// index here
+	void overlap(glm::vec3 lo, glm::vec3 hi, std::vector<unsigned int>& found) const;
+	void getTriangle(unsigned int index, glm::vec3& a, glm::vec3& b, glm::vec3& c) const;
+
+	glm::vec3 getMin() const;
+	glm::vec3 getMax() const;
+	size_t getNumTriangles() const;
+	size_t getNumNodes() const;
+
+private:
+	std::vector<BvhNode> nodes; // a leaf's offset is its block
+	// four triangles per leaf, each a corner and the two edges leaving it,
+	// with the four values of every coordinate next to each other. Unused
+	// lanes are all zero.
+	std::vector<float> blocks;
+	std::vector<unsigned int> ids; // index in the mesh of each lane
+	size_t numTriangles;
+	size_t bytes; // as told to MemoryStats
+};
+
+struct RayHit
+{
+	const Mesh* mesh;
+	unsigned int triangle; // in the mesh's indices / 3
+	float distance;
+	glm::vec3 position, normal;
+};
+
+struct SweepHit
+{
+	float t; // fraction of the move done at first contact
+	glm::vec3 position; // of the sphere's center then
+	glm::vec3 normal; // from the touching point towards the center
+};
+
+// Ray and sphere queries against what's drawn. Each mesh gets a bvh the
+// first frame it's seen and keeps it until it's unloaded, a small tree over
+// the draw items' world boxes is rebuilt every frame on top of them.
+// Skinned meshes move away from their bind pose and are left out.
+class SceneBvh
+{
+public:
+	SceneBvh();
+	~SceneBvh();
+
+	// off the render thread is fine, but not during queries
+	void update(JobSystem* jobs, const std::vector<DrawItem>& items);
+
+	// dir needn't be normalized, distances are in units of it
+	bool raycast(glm::vec3 origin, glm::vec3 dir, float maxDistance, RayHit& hit) const;
+	// whether anything is in the way, stops at the first instance hit
+	bool occluded(glm::vec3 origin, glm::vec3 dir, float maxDistance) const;
+
+	// first contact of a sphere moving from center to center + move.
+	// Triangles it already overlaps only stop it if it moves further in.
+	bool sweepSphere(glm::vec3 center, glm::vec3 move, float radius, SweepHit& hit) const;
+
+	// where the sphere ends up moving by move, sliding along what it hits
+	glm::vec3 slide(glm::vec3 center, glm::vec3 move, float radius) const;
+
+	// rays in every direction from origin on one thread and on all of them
+	void benchmark(JobSystem* jobs, glm::vec3 origin, float maxDistance);
+	void report();
+
+private:
+	static const int SLIDE_STEPS = 4;
+
+	struct Entry
+	{
+		MeshBvh* bvh;
+		unsigned long long frame; // last seen
+	};
+
+	struct Instance
+	{
+		const Mesh* mesh;
+		const MeshBvh* bvh;
+		glm::mat4 model, inverse;
+	};
+
+	std::unordered_map<unsigned long long, Entry> meshes; // by mesh uid
+	std::vector<Instance> instances; // in leaf order
+	std::vector<BvhNode> nodes;
+	unsigned long long frame;
+
+	unsigned long long meshBuilds, trianglesBuilt, topBuilds;
+	double buildTime, topTime;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "DepthQuad.h"
+#include "MemoryStats.h"
 
 DepthQuad::DepthQuad()
 {
@@ -14,7 +15,8 @@ DepthQuad::DepthQuad()
 	glGenBuffers(1, &vbo);
 	glBindVertexArray(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+	MemoryStats::bufferData(GL_ARRAY_BUFFER, vbo, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW,
+		MemoryTag::OTHER);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(1);
@@ -23,7 +25,7 @@ DepthQuad::DepthQuad()
 
 DepthQuad::~DepthQuad()
 {
-	glDeleteBuffers(1, &vbo);
+	MemoryStats::deleteBuffers(1, &vbo);
 	glDeleteVertexArrays(1, &vao);
 }
 
@@ -0,0 +1,511 @@
+#include "FrameCapture.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+struct CrcTable
+{
+	unsigned int table[256];
+
+	CrcTable()
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+};
+
+static const CrcTable crcTable;
+
+static unsigned int crc32(unsigned int crc, const unsigned char* data, size_t size)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = crcTable.table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, unsigned int v)
+{
+	out.push_back(v >> 24);
+	out.push_back((v >> 16) & 0xFF);
+	out.push_back((v >> 8) & 0xFF);
+	out.push_back(v & 0xFF);
+}
+
+static void writeChunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data)
+{
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+	out.write((const char*)chunk.data(), chunk.size());
+}
+
+// png with stored deflate blocks, no compression keeps the worker ahead of
+// the frame rate. rows are top to bottom, each rowBytes long.
+static bool writePng(const std::string& path, int width, int height, int channels, int bitDepth,
+	const std::vector<unsigned char>& rows)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	out.write((const char*)signature, 8);
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	header.push_back((unsigned char)bitDepth);
+	header.push_back(channels == 1 ? 0 : 2); // grey or rgb
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	writeChunk(out, "IHDR", header);
+
+	// every row starts with filter type 0
+	size_t rowBytes = (size_t)width * channels * bitDepth / 8;
+	std::vector<unsigned char> raw;
+	raw.reserve((rowBytes + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rows.begin() + y * rowBytes, rows.begin() + (y + 1) * rowBytes);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t pos = 0;
+	do
+	{
+		size_t size = std::min(raw.size() - pos, (size_t)65535);
+		zlib.push_back(pos + size == raw.size() ? 1 : 0);
+		zlib.push_back(size & 0xFF);
+		zlib.push_back(size >> 8);
+		zlib.push_back(~size & 0xFF);
+		zlib.push_back((~size >> 8) & 0xFF);
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+		pos += size;
+	} while (pos < raw.size());
+
+	unsigned int a = 1, b = 0;
+	for (unsigned char c : raw)
+	{
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(zlib, (b << 16) | a);
+	writeChunk(out, "IDAT", zlib);
+	writeChunk(out, "IEND", std::vector<unsigned char>());
+	return (bool)out;
+}
+
+FrameCapture::FrameCapture(const std::string& directory, int width, int height, CaptureFormat format)
+{
+	FrameCapture::directory = directory;
+	FrameCapture::width = width;
+	FrameCapture::height = height;
+	FrameCapture::format = format;
+	makeDirectory(directory);
+
+#ifdef __APPLE__
+	persistent = false;
+#else
+	persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+
+	for (Stream& s : streams)
+	{
+		s.open = false;
+		s.next = 0;
+		s.frames = s.written = 0;
+	}
+
+	renderTime = waitTime = 0;
+	stalls = 0;
+	firstColorTime = lastColorTime = 0;
+	running = true;
+	worker = std::thread(&FrameCapture::workerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	// hand over everything still on the gpu, oldest first
+	for (Stream& s : streams)
+	{
+		if (!s.open)
+			continue;
+		for (int i = 0; i < RING_SIZE; i++)
+		{
+			int slot = (s.next + i) % RING_SIZE;
+			if (s.slots[slot].state == READING)
+				finishRead(s, slot, true);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+	wake.notify_all();
+	worker.join();
+
+	// every frame is written, now the rate they came at is known
+	Stream& color = streams[(int)CaptureSource::COLOR];
+	if (color.open && format == CaptureFormat::Y4M && color.frames > 1 &&
+		lastColorTime > firstColorTime)
+		writeY4mHeader(color, (color.frames - 1) / (lastColorTime - firstColorTime));
+
+	report();
+
+	for (Stream& s : streams)
+	{
+		if (!s.open)
+			continue;
+		for (Slot& slot : s.slots)
+		{
+			if (slot.mapped)
+			{
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			MemoryStats::deleteBuffers(1, &slot.pbo);
+			MemoryStats::release(MemoryTag::STAGING, slot.copy.size());
+		}
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCapture::openStream(Stream& s, CaptureSource source)
+{
+	s.source = source;
+	switch (source)
+	{
+	case CaptureSource::COLOR:
+		s.format = GL_RGBA;
+		s.type = GL_UNSIGNED_BYTE;
+		s.pixelSize = 4;
+		break;
+	case CaptureSource::DEPTH:
+		s.format = GL_DEPTH_COMPONENT;
+		s.type = GL_FLOAT;
+		s.pixelSize = 4;
+		break;
+	default:
+		s.format = GL_RGB;
+		s.type = GL_HALF_FLOAT;
+		s.pixelSize = 6;
+		break;
+	}
+
+	size_t size = (size_t)width * height * s.pixelSize;
+	for (Slot& slot : s.slots)
+	{
+		glGenBuffers(1, &slot.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		slot.fence = 0;
+		slot.mapped = nullptr;
+		slot.state = FREE;
+
+#ifndef __APPLE__
+		if (persistent)
+		{
+			// coherent, so the fence alone makes the pixels visible
+			GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			MemoryStats::bufferStorage(GL_PIXEL_PACK_BUFFER, slot.pbo, size, nullptr,
+				flags | GL_CLIENT_STORAGE_BIT, MemoryTag::STAGING);
+			slot.mapped = (char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+		}
+#endif
+		if (!slot.mapped)
+		{
+			if (persistent)
+			{
+				// the storage is immutable now, start over with a new buffer
+				MemoryStats::deleteBuffers(1, &slot.pbo);
+				glGenBuffers(1, &slot.pbo);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			}
+			MemoryStats::bufferData(GL_PIXEL_PACK_BUFFER, slot.pbo, size, nullptr, GL_STREAM_READ,
+				MemoryTag::STAGING);
+			slot.copy.resize(size);
+			MemoryStats::allocate(MemoryTag::STAGING, size);
+		}
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	const char* names[NUM_SOURCES] = { "color", "depth", "hdr", "bright" };
+	std::string base = directory + "/" + names[(int)source];
+	if (source == CaptureSource::COLOR && format == CaptureFormat::Y4M)
+	{
+		// a guess until the capture stops and the real rate is known
+		s.out.open(base + ".y4m", std::ios::binary | std::ios::trunc);
+		writeY4mHeader(s, 60.0);
+	}
+	else if (source == CaptureSource::COLOR && format == CaptureFormat::RAW)
+		s.out.open(base + ".rgba", std::ios::binary | std::ios::trunc);
+	else if (source == CaptureSource::DEPTH && format != CaptureFormat::PNG)
+		s.out.open(base + ".f32", std::ios::binary | std::ios::trunc);
+	else if (source == CaptureSource::HDR || source == CaptureSource::BRIGHT)
+		s.out.open(base + ".rgb16f", std::ios::binary | std::ios::trunc);
+
+	s.open = true;
+}
+
+// the rate is in thousandths with a fixed number of digits, so the header
+// keeps its length and can be written again over the first one
+void FrameCapture::writeY4mHeader(Stream& s, double fps)
+{
+	unsigned int milli = (unsigned int)std::min(std::max(fps * 1000.0 + 0.5, 1.0), 9999999.0);
+	char header[64];
+	snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%07u:1000 Ip A1:1 C444\n",
+		width, height, milli);
+
+	std::streampos end = s.out.tellp();
+	s.out.seekp(0);
+	s.out << header;
+	if (end > s.out.tellp())
+		s.out.seekp(end);
+}
+
+void FrameCapture::capture(CaptureSource source, GLuint framebuffer, GLenum attachment)
+{
+	double start = glfwGetTime();
+
+	Stream& s = streams[(int)source];
+	if (!s.open)
+		openStream(s, source);
+
+	collect(s);
+
+	// the ring is full when the encoder falls behind, wait for the oldest
+	Slot& slot = s.slots[s.next];
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		if (slot.state != FREE)
+		{
+			double waitStart = glfwGetTime();
+			stalls++;
+			if (slot.state == READING)
+			{
+				// only the render thread moves a slot out of READING
+				guard.unlock();
+				finishRead(s, s.next, true);
+				guard.lock();
+			}
+			freed.wait(guard, [&slot]() { return slot.state == FREE; });
+			waitTime += glfwGetTime() - waitStart;
+		}
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, source == CaptureSource::COLOR ? 0 : framebuffer);
+	if (source == CaptureSource::COLOR)
+	{
+		glReadBuffer(GL_BACK);
+		lastColorTime = start;
+		if (s.frames == 0)
+			firstColorTime = start;
+	}
+	else if (source != CaptureSource::DEPTH)
+		glReadBuffer(attachment);
+
+	// with a pack buffer bound this only queues the copy
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, s.format, s.type, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = READING;
+	s.next = (s.next + 1) % RING_SIZE;
+	s.frames++;
+
+	renderTime += glfwGetTime() - start;
+}
+
+// hands finished reads to the worker in frame order without waiting
+void FrameCapture::collect(Stream& s)
+{
+	for (int i = 0; i < RING_SIZE; i++)
+	{
+		int slot = (s.next + i) % RING_SIZE;
+		if (s.slots[slot].state != READING)
+			continue;
+
+		GLenum result = glClientWaitSync(s.slots[slot].fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			break;
+		finishRead(s, slot, false);
+	}
+}
+
+void FrameCapture::finishRead(Stream& s, int index, bool wait)
+{
+	Slot& slot = s.slots[index];
+	if (wait)
+	{
+		// a second at most, a lost context shouldn't hang the program
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	if (!slot.mapped)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.copy.size(), GL_MAP_READ_BIT);
+		if (data)
+		{
+			memcpy(slot.copy.data(), data, slot.copy.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		slot.state = ENCODING;
+		jobs.push_back({ &s, index });
+	}
+	wake.notify_one();
+}
+
+void FrameCapture::workerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return !jobs.empty() || !running; });
+			if (jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		Slot& slot = job.stream->slots[job.slot];
+		encode(*job.stream, slot.mapped ? slot.mapped : slot.copy.data());
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			slot.state = FREE;
+		}
+		freed.notify_all();
+	}
+}
+
+// gl rows start at the bottom, every output is written top to bottom
+void FrameCapture::encode(Stream& s, const char* pixels)
+{
+	size_t rowBytes = (size_t)width * s.pixelSize;
+	char number[16];
+	snprintf(number, sizeof(number), "_%06llu", s.written);
+	std::string base = directory + "/" + (s.source == CaptureSource::COLOR ? "color" : "depth") + number;
+
+	if (s.source == CaptureSource::COLOR && format == CaptureFormat::Y4M)
+	{
+		// bt.601 studio range, the y4m default
+		std::vector<unsigned char> planes((size_t)width * height * 3);
+		unsigned char* yPlane = planes.data();
+		unsigned char* uPlane = yPlane + (size_t)width * height;
+		unsigned char* vPlane = uPlane + (size_t)width * height;
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* row = (const unsigned char*)pixels + (height - 1 - y) * rowBytes;
+			for (int x = 0; x < width; x++)
+			{
+				int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+				size_t i = (size_t)y * width + x;
+				yPlane[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+				uPlane[i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				vPlane[i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+		s.out << "FRAME\n";
+		s.out.write((const char*)planes.data(), planes.size());
+	}
+	else if (format == CaptureFormat::PNG &&
+		(s.source == CaptureSource::COLOR || s.source == CaptureSource::DEPTH))
+	{
+		std::vector<unsigned char> rows;
+		if (s.source == CaptureSource::COLOR)
+		{
+			rows.resize((size_t)width * height * 3);
+			for (int y = 0; y < height; y++)
+			{
+				const char* row = pixels + (height - 1 - y) * rowBytes;
+				for (int x = 0; x < width; x++)
+					memcpy(&rows[((size_t)y * width + x) * 3], row + x * 4, 3);
+			}
+			writePng(base + ".png", width, height, 3, 8, rows);
+		}
+		else
+		{
+			// 16 bit grey, big endian
+			rows.resize((size_t)width * height * 2);
+			for (int y = 0; y < height; y++)
+			{
+				const float* row = (const float*)(pixels + (height - 1 - y) * rowBytes);
+				for (int x = 0; x < width; x++)
+				{
+					unsigned int d = (unsigned int)(row[x] * 65535.f + 0.5f);
+					rows[((size_t)y * width + x) * 2] = d >> 8;
+					rows[((size_t)y * width + x) * 2 + 1] = d & 0xFF;
+				}
+			}
+			writePng(base + ".png", width, height, 1, 16, rows);
+		}
+	}
+	else
+	{
+		for (int y = height - 1; y >= 0; y--)
+			s.out.write(pixels + y * rowBytes, rowBytes);
+	}
+	s.written++;
+}
+
+void FrameCapture::report()
+{
+	unsigned long long frames = 0, written = 0;
+	for (const Stream& s : streams)
+	{
+		frames += s.frames;
+		written += s.written;
+	}
+	if (frames == 0)
+		return;
+
+	char line[192];
+	snprintf(line, sizeof(line),
+		"capture: %llu frames, %llu written to %s, %.3f ms per frame on the render thread, %llu stalls (%.1f ms)",
+		frames, written, directory.c_str(), renderTime * 1000.0 / frames, stalls, waitTime * 1000.0);
+	std::cerr << line << std::endl;
+}
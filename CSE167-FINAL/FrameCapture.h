@@ -0,0 +1,115 @@
+#ifndef _FRAME_CAPTURE_H_
+#define _FRAME_CAPTURE_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "MemoryStats.h"
+
+enum class CaptureFormat {
+	Y4M,
+	PNG,
+	RAW
+};
+
+enum class CaptureSource {
+	COLOR, // final 8 bit colors of the default framebuffer
+	DEPTH, // depth of a framebuffer as floats
+	HDR, // half float colors of an attachment, before tone mapping
+	BRIGHT // same for the bloom bright pass, a second hdr attachment
+};
+
+// Records frames without stalling the render thread. Every source reads
+// into a ring of pixel buffer objects, so the copy happens on the gpu and a
+// fence tells when it's done a few frames later. Finished frames go to a
+// worker thread that flips and writes them: colors as a y4m video, png
+// images or raw rgba, depth as 16 bit png or raw floats and hdr always as
+// raw half floats. The video's frame rate is measured while recording and
+// written into its header at the end.
+class FrameCapture
+{
+public:
+	FrameCapture(const std::string& directory, int width, int height, CaptureFormat format);
+	// waits for every frame in flight to be written
+	~FrameCapture();
+
+	// call after the frame is drawn and before swapping, framebuffer and
+	// attachment are ignored for COLOR
+	void capture(CaptureSource source, GLuint framebuffer, GLenum attachment);
+
+	void report();
+
+private:
+	static const int RING_SIZE = 4;
+	static const int NUM_SOURCES = 4;
+
+	enum SlotState { FREE, READING, ENCODING };
+
+	struct Slot
+	{
+		GLuint pbo;
+		GLsync fence;
+		char* mapped; // persistently mapped, else the pixels are copied
+		std::vector<char> copy;
+		// changed under lock so the condition variables see it, atomic since
+		// the render thread also reads it without the lock
+		std::atomic<SlotState> state;
+	};
+
+	struct Stream
+	{
+		bool open;
+		CaptureSource source;
+		GLenum format, type;
+		size_t pixelSize;
+		Slot slots[RING_SIZE];
+		int next; // slot the next frame goes to, the oldest one in flight
+		unsigned long long frames, written;
+		std::ofstream out; // y4m and raw streams are one file
+	};
+
+	struct Job
+	{
+		Stream* stream;
+		int slot;
+	};
+
+	std::string directory;
+	int width, height;
+	CaptureFormat format;
+	bool persistent;
+
+	Stream streams[NUM_SOURCES];
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake, freed;
+	std::deque<Job> jobs;
+	bool running;
+
+	double renderTime, waitTime; // spent on the render thread, seconds
+	unsigned long long stalls;
+	double firstColorTime, lastColorTime; // of the color captures, for the rate
+
+	void openStream(Stream& s, CaptureSource source);
+	void writeY4mHeader(Stream& s, double fps);
+	void collect(Stream& s);
+	void finishRead(Stream& s, int slot, bool wait);
+	void workerLoop();
+	void encode(Stream& s, const char* pixels);
+};
+
+#endif
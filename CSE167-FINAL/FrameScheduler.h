@@ -0,0 +1,70 @@
+#ifndef _FRAME_SCHEDULER_H_
+#define _FRAME_SCHEDULER_H_
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+enum class PresentMode {
+	VSYNC,
+	ADAPTIVE_VSYNC,
+	CAPPED,
+	UNCAPPED
+};
+
+// Runs the simulation at a fixed tick rate independent of how fast frames
+// are rendered, paces frames according to the present mode and keeps a
+// histogram of frame times that is printed on exit.
+class FrameScheduler
+{
+private:
+	// histogram buckets are 0.1 ms wide, everything past the last goes in it
+	static const int NUM_BUCKETS = 1000;
+	static const double BUCKET_WIDTH;
+
+	double tickDelta; // length of one simulation tick in seconds
+	double maxFrameDelta; // clamp so a long stall doesn't cause a tick spiral
+	double targetFps;
+
+	double accumulator;
+	double frameStart, lastFrameStart;
+
+	PresentMode mode;
+
+	std::vector<unsigned int> histogram;
+	unsigned long long frameCount, tickCount;
+	double totalTime, minTime, maxTime;
+
+	void waitUntil(double time);
+	double percentile(double p);
+
+public:
+	FrameScheduler(double tickRate, double targetFps, PresentMode mode);
+	~FrameScheduler();
+
+	// right before the first frame, so the time spent loading isn't one
+	void start();
+	void beginFrame();
+	bool tick();
+	void endFrame();
+
+	float getTickDelta();
+	float getAlpha();
+
+	void setPresentMode(PresentMode m);
+	void setTargetFps(double fps);
+	void cycleMode();
+	std::string getModeName();
+
+	void report();
+};
+
+#endif
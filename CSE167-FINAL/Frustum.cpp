@@ -0,0 +1,44 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	set(glm::mat4(1));
+}
+
+Frustum::Frustum(glm::mat4 viewProj)
+{
+	set(viewProj);
+}
+
+// pulls the planes straight out of the rows of the matrix (Gribb-Hartmann)
+void Frustum::set(glm::mat4 viewProj)
+{
+	glm::mat4 m = glm::transpose(viewProj);
+
+	planes[0] = m[3] + m[0]; // left
+	planes[1] = m[3] - m[0]; // right
+	planes[2] = m[3] + m[1]; // bottom
+	planes[3] = m[3] - m[1]; // top
+	planes[4] = m[3] + m[2]; // near
+	planes[5] = m[3] - m[2]; // far
+
+	// normalize so the plane distance is in world units
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// true if any part of the sphere is inside all 6 planes
+bool Frustum::checkSphere(glm::vec3 center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+const glm::vec4* Frustum::getPlanes() const
+{
+	return planes;
+}
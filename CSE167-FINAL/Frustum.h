@@ -0,0 +1,25 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+// The 6 clip planes of a view projection matrix, used to throw away
+// objects that can't be seen before they get drawn.
+class Frustum
+{
+private:
+	// xyz is the inward facing normal, w the distance
+	glm::vec4 planes[6];
+
+public:
+	Frustum();
+	Frustum(glm::mat4 viewProj);
+
+	void set(glm::mat4 viewProj);
+	bool checkSphere(glm::vec3 center, float radius) const;
+
+	// the 6 planes, for culling on the gpu
+	const glm::vec4* getPlanes() const;
+};
+
+#endif
@@ -0,0 +1,657 @@
+#include "GpuCulling.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Frustum.h"
+#include "TextureCache.h"
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawCommand
+{
+	GLuint count, instanceCount, firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// what cull.comp writes for each draw of the camera pass, must match it
+static const GLuint CULLED_OBJECT = 0;
+static const GLuint VISIBLE = 1;
+static const GLuint CULLED_OUTSIDE = 2;
+static const GLuint CULLED_BACKFACING = 3;
+static const GLuint CULLED_OCCLUDED = 4;
+
+// smallest shared buffers, in vertices and indices
+static const size_t MIN_VERTICES = 1 << 16;
+static const size_t MIN_INDICES = 1 << 18;
+
+bool GpuCulling::isSupported()
+{
+#ifdef __APPLE__
+	// macOS stops at GL 4.1
+	return false;
+#else
+	return GLEW_VERSION_4_3;
+#endif
+}
+
+GpuCulling::GpuCulling(ShaderManager* shaders)
+{
+	GpuCulling::shaders = shaders;
+	cullId = shaders->addCompute("shaders/cull.comp", {});
+	hizId = shaders->addCompute("shaders/hiz.comp", {});
+	cullProgram = hizProgram = 0;
+#ifdef __APPLE__
+	indirectCount = false;
+#else
+	indirectCount = GLEW_ARB_indirect_parameters;
+#endif
+
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+	glGenBuffers(1, &drawIdBuffer);
+	glGenBuffers(1, &recordBuffer);
+	glGenBuffers(1, &matrixBuffer);
+	glGenBuffers(1, &batchBuffer);
+	glGenBuffers(1, &visibleBuffer);
+	glGenBuffers(1, &lightmapBuffer);
+	for (PassBuffers& p : passes)
+	{
+		glGenBuffers(1, &p.commands);
+		glGenBuffers(1, &p.counts);
+		p.commandCapacity = p.countCapacity = 0;
+	}
+	for (Readback& r : readbacks)
+	{
+		glGenBuffers(1, &r.buffer);
+		r.fence = 0;
+		r.capacity = 0;
+	}
+	vertexCapacity = indexCapacity = drawIdCapacity = 0;
+	vertexCount = indexCount = 0;
+	recordCapacity = matrixCapacity = batchCapacity = visibleCapacity = lightmapCapacity = 0;
+
+	// the same vertex layout as Mesh, plus the draw index as an instanced
+	// attribute so the base instance of a command picks its matrix
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
+	glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glEnableVertexAttribArray(5);
+	glVertexAttribIPointer(5, 1, GL_INT, sizeof(GLint), (void*)0);
+	glVertexAttribDivisor(5, 1);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the vertex shaders read the matrices as a buffer texture
+	glGenTextures(1, &matrixTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, matrixBuffer);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrixBuffer);
+	// and the lightmap squares the same way
+	glGenTextures(1, &lightmapTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, lightmapTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightmapBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	glGenFramebuffers(1, &depthCopyFbo);
+	hiz = depthCopy = 0;
+	hizWidth = hizHeight = hizLevels = 0;
+	prevViewProj = glm::mat4(1);
+	frame = hizFrame = 0;
+
+	frames = draws = kept = keptOf = arenaRebuilds = 0;
+	clusterStats = ClusterStats();
+}
+
+GpuCulling::~GpuCulling()
+{
+	GLuint buffers[8] = { vertexBuffer, indexBuffer, drawIdBuffer, recordBuffer, matrixBuffer,
+		batchBuffer, visibleBuffer, lightmapBuffer };
+	MemoryStats::deleteBuffers(8, buffers);
+	for (PassBuffers& p : passes)
+	{
+		MemoryStats::deleteBuffers(1, &p.commands);
+		MemoryStats::deleteBuffers(1, &p.counts);
+	}
+	for (Readback& r : readbacks)
+	{
+		if (r.fence)
+			glDeleteSync(r.fence);
+		MemoryStats::deleteBuffers(1, &r.buffer);
+	}
+	glDeleteVertexArrays(1, &vao);
+	glDeleteTextures(1, &matrixTexture);
+	glDeleteTextures(1, &lightmapTexture);
+	if (hiz)
+	{
+		MemoryStats::deleteTextures(1, &hiz);
+		MemoryStats::deleteTextures(1, &depthCopy);
+	}
+	glDeleteFramebuffers(1, &depthCopyFbo);
+}
+
+void GpuCulling::updatePrograms()
+{
+	cullProgram = shaders->get(cullId);
+	hizProgram = shaders->get(hizId);
+}
+
+// grows the buffer to hold bytes and orphans it, so filling it doesn't wait
+// for last frame's draws to finish reading it
+void GpuCulling::ensureBuffer(GLuint buffer, size_t& capacity, size_t bytes, GLenum usage)
+{
+	if (bytes > capacity)
+		capacity = std::max(bytes, capacity * 2);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	MemoryStats::bufferData(GL_COPY_WRITE_BUFFER, buffer, capacity, nullptr, usage, MemoryTag::OTHER);
+}
+
+// copies a mesh into the shared buffers if it isn't there yet, false if
+// there's no room left
+bool GpuCulling::place(Mesh* mesh)
+{
+	if (ranges.find(mesh->uid) != ranges.end())
+		return true;
+	if (vertexCount + mesh->vertices.size() > vertexCapacity ||
+		indexCount + mesh->indices.size() > indexCapacity)
+		return false;
+
+	Range r;
+	r.baseVertex = (GLint)vertexCount;
+	r.firstIndex = (GLuint)indexCount;
+	r.indexCount = (GLuint)mesh->indices.size();
+	ranges[mesh->uid] = r;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(Vertex),
+		mesh->vertices.size() * sizeof(Vertex), mesh->vertices.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(GLuint),
+		mesh->indices.size() * sizeof(GLuint), mesh->indices.data());
+
+	vertexCount += mesh->vertices.size();
+	indexCount += mesh->indices.size();
+	return true;
+}
+
+// drops every mesh that isn't drawn anymore and makes room for as much again
+void GpuCulling::rebuildArena(const std::vector<Mesh*>& meshes)
+{
+	ranges.clear();
+	vertexCount = indexCount = 0;
+
+	size_t vertices = 0, indices = 0;
+	std::vector<Mesh*> unique;
+	for (Mesh* mesh : meshes)
+	{
+		if (ranges.find(mesh->uid) != ranges.end())
+			continue;
+		ranges[mesh->uid] = Range();
+		unique.push_back(mesh);
+		vertices += mesh->vertices.size();
+		indices += mesh->indices.size();
+	}
+	ranges.clear();
+
+	vertexCapacity = std::max(vertices * 2, MIN_VERTICES);
+	indexCapacity = std::max(indices * 2, MIN_INDICES);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	MemoryStats::bufferData(GL_COPY_WRITE_BUFFER, vertexBuffer, vertexCapacity * sizeof(Vertex),
+		nullptr, GL_STATIC_DRAW, MemoryTag::MESHES);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	MemoryStats::bufferData(GL_COPY_WRITE_BUFFER, indexBuffer, indexCapacity * sizeof(GLuint),
+		nullptr, GL_STATIC_DRAW, MemoryTag::MESHES);
+
+	for (Mesh* mesh : unique)
+		place(mesh);
+	arenaRebuilds++;
+}
+
+void GpuCulling::prepare(const std::vector<DrawItem>& scene, std::vector<DrawItem>& rest,
+	glm::vec3 viewPos, glm::vec3 viewDir, float pixelsPerUnit)
+{
+	frame++;
+
+	// what the camera saw NUM_FRAMES ago, this slot is filled again below
+	Readback& readback = readbacks[frame % NUM_FRAMES];
+	readFeedback(readback);
+
+	// skinned meshes change their vertices, they stay on the render queues
+	std::vector<unsigned int> order;
+	rest.clear();
+	for (unsigned int i = 0; i < scene.size(); i++)
+	{
+		if (scene[i].mesh->isSkinned())
+			rest.push_back(scene[i]);
+		else
+			order.push_back(i);
+	}
+
+	bool placed = true;
+	for (unsigned int i : order)
+	{
+		if (!place(scene[i].mesh))
+		{
+			placed = false;
+			break;
+		}
+	}
+	if (!placed)
+	{
+		std::vector<Mesh*> meshes;
+		for (unsigned int i : order)
+			meshes.push_back(scene[i].mesh);
+		rebuildArena(meshes);
+	}
+
+	// lit before unlit, baked or not, then by material, so a batch is a
+	// range of draws
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+	{
+		if (scene[a].unlit != scene[b].unlit)
+			return scene[b].unlit;
+		bool bakedA = scene[a].lightmap.x > 0, bakedB = scene[b].lightmap.x > 0;
+		if (bakedA != bakedB)
+			return bakedB;
+		return scene[a].mesh->materialId < scene[b].mesh->materialId;
+	});
+
+	records.clear();
+	matrices.clear();
+	lightmapRects.clear();
+	batches.clear();
+	batchFirst.clear();
+	readback.pixelsPerUV.clear();
+	readback.textureFirst.clear();
+	readback.textures.clear();
+	readback.clusterTriangles.clear();
+	for (unsigned int i : order)
+	{
+		const DrawItem& item = scene[i];
+		bool baked = item.lightmap.x > 0;
+		if (batches.empty() || batches.back().unlit != item.unlit || batches.back().baked != baked ||
+			batches.back().material->materialId != item.mesh->materialId)
+		{
+			Batch b;
+			b.material = item.mesh;
+			b.unlit = item.unlit;
+			b.baked = baked;
+			b.first = (GLuint)records.size();
+			b.count = 0;
+			batches.push_back(b);
+			batchFirst.push_back(b.first);
+		}
+
+		// the same texture detail estimate as RenderQueue::cull, it's only
+		// requested once the gpu says the draw was seen
+		float pixelsPerUV = 0;
+		if (item.mesh->uvDensity > 0)
+		{
+			float depth = glm::dot(item.center - viewPos, viewDir);
+			float scale = item.radius / glm::max(item.mesh->radius, 1e-6f);
+			float pixels = pixelsPerUnit / glm::max(depth - item.radius, 0.1f);
+			pixelsPerUV = pixels / (item.mesh->uvDensity * scale);
+		}
+
+		// a draw per cluster sharing the item's matrix, or one for all of it
+		const Range& range = ranges[item.mesh->uid];
+		const std::vector<Meshlet>& clusters = item.mesh->meshlets.clusters;
+		if (!clusters.empty())
+			item.mesh->meshlets.worldBounds(item.model, clusterSpheres, clusterCones);
+		size_t numDraws = clusters.empty() ? 1 : clusters.size();
+		for (size_t c = 0; c < numDraws; c++)
+		{
+			DrawRecord r = {};
+			r.object = glm::vec4(item.center, item.radius);
+			if (clusters.empty())
+			{
+				r.sphere = r.object;
+				r.cone = glm::vec4(0, 0, 0, 1);
+				r.indexCount = range.indexCount;
+				r.firstIndex = range.firstIndex;
+			}
+			else
+			{
+				r.sphere = clusterSpheres[c];
+				r.cone = clusterCones[c];
+				r.indexCount = clusters[c].indexCount;
+				r.firstIndex = range.firstIndex + clusters[c].firstIndex;
+			}
+			r.baseVertex = range.baseVertex;
+			r.batch = (GLuint)batches.size() - 1;
+			r.castShadow = item.castShadow;
+			r.matrix = (GLuint)matrices.size();
+			records.push_back(r);
+			batches.back().count++;
+
+			readback.pixelsPerUV.push_back(pixelsPerUV);
+			readback.textureFirst.push_back((GLuint)readback.textures.size());
+			for (const Texture& t : item.mesh->textures)
+				readback.textures.push_back(t.id);
+			readback.clusterTriangles.push_back(clusters.empty() ? 0 : r.indexCount / 3);
+		}
+		matrices.push_back(item.model);
+		lightmapRects.push_back(item.lightmap);
+	}
+	readback.textureFirst.push_back((GLuint)readback.textures.size());
+
+	size_t n = records.size();
+	frames++;
+	draws += n;
+	if (n == 0)
+		return;
+
+	ensureBuffer(recordBuffer, recordCapacity, n * sizeof(DrawRecord), GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, n * sizeof(DrawRecord), records.data());
+	ensureBuffer(matrixBuffer, matrixCapacity, matrices.size() * sizeof(glm::mat4), GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, matrices.size() * sizeof(glm::mat4), matrices.data());
+	ensureBuffer(lightmapBuffer, lightmapCapacity, lightmapRects.size() * sizeof(glm::vec4), GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, lightmapRects.size() * sizeof(glm::vec4), lightmapRects.data());
+	ensureBuffer(batchBuffer, batchCapacity, batchFirst.size() * sizeof(GLuint), GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, batchFirst.size() * sizeof(GLuint), batchFirst.data());
+
+	// draw indices only change when there are more matrices than ever
+	if (matrices.size() > drawIdCapacity)
+	{
+		drawIdCapacity = std::max(matrices.size(), drawIdCapacity * 2);
+		std::vector<GLint> ids(drawIdCapacity);
+		for (size_t i = 0; i < ids.size(); i++)
+			ids[i] = (GLint)i;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, drawIdBuffer);
+		MemoryStats::bufferData(GL_COPY_WRITE_BUFFER, drawIdBuffer, ids.size() * sizeof(GLint),
+			ids.data(), GL_STATIC_DRAW, MemoryTag::OTHER);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuCulling::cull(CullPass pass, glm::mat4 viewProj, glm::vec3 viewPos, glm::vec3 viewDir,
+	float pixelsPerUnit, float minPixels)
+{
+#ifndef __APPLE__
+	GLuint n = (GLuint)records.size();
+	if (n == 0 || !cullProgram)
+		return;
+
+	bool shadowPass = pass == CullPass::SHADOW;
+	PassBuffers& p = passes[(int)pass];
+	size_t numCounts = shadowPass ? 1 : batches.size();
+	ensureBuffer(p.commands, p.commandCapacity, n * sizeof(DrawCommand), GL_STREAM_DRAW);
+	ensureBuffer(p.counts, p.countCapacity, numCounts * sizeof(GLuint), GL_STREAM_DRAW);
+	GLuint zero = 0;
+	glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (!shadowPass)
+		ensureBuffer(visibleBuffer, visibleCapacity, n * sizeof(GLuint), GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// the pyramid is only used the frame after it was built
+	bool occlusion = !shadowPass && hizFrame != 0 && hizFrame + 1 == frame;
+
+	glUseProgram(cullProgram);
+	Frustum frustum(viewProj);
+	glUniform4fv(glGetUniformLocation(cullProgram, "planes"), 6, glm::value_ptr(frustum.getPlanes()[0]));
+	glUniform1ui(glGetUniformLocation(cullProgram, "numDraws"), n);
+	glUniform1i(glGetUniformLocation(cullProgram, "shadowPass"), shadowPass);
+	glUniform1i(glGetUniformLocation(cullProgram, "compact"), indirectCount);
+	glUniform3fv(glGetUniformLocation(cullProgram, "viewPos"), 1, glm::value_ptr(viewPos));
+	glUniform3fv(glGetUniformLocation(cullProgram, "viewDir"), 1, glm::value_ptr(viewDir));
+	glUniform1f(glGetUniformLocation(cullProgram, "pixelsPerUnit"), pixelsPerUnit);
+	glUniform1f(glGetUniformLocation(cullProgram, "minPixels"), minPixels);
+	glUniform1i(glGetUniformLocation(cullProgram, "occlusion"), occlusion);
+	glUniform1i(glGetUniformLocation(cullProgram, "hiz"), HIZ_UNIT);
+	glUniformMatrix4fv(glGetUniformLocation(cullProgram, "prevViewProj"), 1, GL_FALSE,
+		glm::value_ptr(prevViewProj));
+	if (occlusion)
+	{
+		glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+		glBindTexture(GL_TEXTURE_2D, hiz);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, recordBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, batchBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, p.commands);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, p.counts);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, visibleBuffer);
+	glDispatchCompute((n + 63) / 64, 1, 1);
+
+	// the draws read the commands and counts, the copy below the visibility
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (!shadowPass)
+	{
+		Readback& r = readbacks[frame % NUM_FRAMES];
+		if (n * sizeof(GLuint) > r.capacity)
+		{
+			r.capacity = std::max(n * sizeof(GLuint), r.capacity * 2);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, r.buffer);
+			MemoryStats::bufferData(GL_COPY_WRITE_BUFFER, r.buffer, r.capacity, nullptr, GL_STREAM_READ,
+				MemoryTag::STAGING);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, visibleBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, r.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, n * sizeof(GLuint));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+#endif
+}
+
+void GpuCulling::draw(CullPass pass, const GLuint* programs, ShaderVariant litVariant, bool bindMaterials)
+{
+#ifndef __APPLE__
+	if (records.empty() || !cullProgram)
+		return;
+
+	PassBuffers& p = passes[(int)pass];
+	bool shadowPass = pass == CullPass::SHADOW;
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, p.commands);
+	if (indirectCount)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, p.counts);
+	glActiveTexture(GL_TEXTURE0 + MATRIX_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+	glActiveTexture(GL_TEXTURE0 + LIGHTMAP_RECT_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, lightmapTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// the shadow pass has no materials, everything is one batch
+	Batch all;
+	all.material = nullptr;
+	all.unlit = all.baked = false;
+	all.first = 0;
+	all.count = (GLuint)records.size();
+	const Batch* list = shadowPass ? &all : batches.data();
+	size_t numBatches = shadowPass ? 1 : batches.size();
+
+	GLuint program = 0;
+	for (size_t b = 0; b < numBatches; b++)
+	{
+		const Batch& batch = list[b];
+		ShaderVariant variant = shadowPass ? VARIANT_DEPTH :
+			RenderQueue::pickVariant(batch.unlit, batch.baked, litVariant);
+		if (programs[variant] != program)
+		{
+			program = programs[variant];
+			glUseProgram(program);
+			glUniform1i(glGetUniformLocation(program, "modelMatrices"), MATRIX_UNIT);
+			glUniform1i(glGetUniformLocation(program, "lightmapRects"), LIGHTMAP_RECT_UNIT);
+		}
+		if (bindMaterials && batch.material)
+			batch.material->bindTextures(program);
+
+		const void* offset = (const void*)(batch.first * sizeof(DrawCommand));
+		if (indirectCount)
+		{
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, offset,
+				(GLintptr)(b * sizeof(GLuint)), (GLsizei)batch.count, 0);
+		}
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, (GLsizei)batch.count, 0);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (indirectCount)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+#endif
+}
+
+// level 0 of the pyramid is half the frame, every level halves it again
+void GpuCulling::createHiZ(int width, int height)
+{
+	if (hiz)
+	{
+		MemoryStats::deleteTextures(1, &hiz);
+		MemoryStats::deleteTextures(1, &depthCopy);
+	}
+	hizWidth = width;
+	hizHeight = height;
+
+	// the same unsized format as the depth renderbuffers, a blit needs them to match
+	glGenTextures(1, &depthCopy);
+	glBindTexture(GL_TEXTURE_2D, depthCopy);
+	MemoryStats::texImage2D(depthCopy, MemoryTag::RENDER_TARGETS, GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
+		width, height, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, depthCopyFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthCopy, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// halved the way gl expects mips to be or the texture isn't complete,
+	// hiz.comp takes care of the odd sizes
+	glGenTextures(1, &hiz);
+	glBindTexture(GL_TEXTURE_2D, hiz);
+	int w = std::max(1, width / 2), h = std::max(1, height / 2);
+	for (hizLevels = 0; ; hizLevels++)
+	{
+		MemoryStats::texImage2D(hiz, MemoryTag::RENDER_TARGETS, GL_TEXTURE_2D, hizLevels, GL_R32F,
+			w, h, GL_RED, GL_FLOAT, nullptr);
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	hizLevels++;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hizLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GpuCulling::buildHiZ(GLuint fbo, int width, int height, glm::mat4 viewProj)
+{
+#ifndef __APPLE__
+	if (!hizProgram || width <= 0 || height <= 0)
+		return;
+	if (width != hizWidth || height != hizHeight)
+		createHiZ(width, height);
+
+	// compute shaders can't read a renderbuffer, copy the depth out first
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthCopyFbo);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glUseProgram(hizProgram);
+	glUniform1i(glGetUniformLocation(hizProgram, "source"), HIZ_UNIT);
+	GLint sourceLevelLoc = glGetUniformLocation(hizProgram, "sourceLevel");
+	glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+
+	// each level reads the one above it, level 0 reads the depth
+	int w = std::max(1, width / 2), h = std::max(1, height / 2);
+	for (int level = 0; level < hizLevels; level++)
+	{
+		glBindTexture(GL_TEXTURE_2D, level == 0 ? depthCopy : hiz);
+		glUniform1i(sourceLevelLoc, level == 0 ? 0 : level - 1);
+		glBindImageTexture(0, hiz, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	prevViewProj = viewProj;
+	hizFrame = frame;
+#endif
+}
+
+// turns a camera pass's visibility into texture requests
+void GpuCulling::readFeedback(Readback& r)
+{
+	if (!r.fence)
+		return;
+
+	// NUM_FRAMES old, it's done unless the gpu is far behind. A second at
+	// most, a lost context shouldn't hang the program.
+	glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	glDeleteSync(r.fence);
+	r.fence = 0;
+
+	size_t n = r.pixelsPerUV.size();
+	std::vector<GLuint> visible(n);
+	glBindBuffer(GL_COPY_READ_BUFFER, r.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, n * sizeof(GLuint), visible.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	GLuint seen = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		// what the clusters of meshes that passed as a whole dropped
+		GLuint triangles = r.clusterTriangles[i];
+		if (triangles && visible[i] != CULLED_OBJECT)
+		{
+			clusterStats.triangles += triangles;
+			if (visible[i] == CULLED_OUTSIDE)
+				clusterStats.outside += triangles;
+			else if (visible[i] == CULLED_BACKFACING)
+				clusterStats.backfacing += triangles;
+			else if (visible[i] == CULLED_OCCLUDED)
+				clusterStats.occluded += triangles;
+		}
+
+		if (visible[i] != VISIBLE)
+			continue;
+		seen++;
+		if (r.pixelsPerUV[i] <= 0)
+			continue;
+		for (GLuint t = r.textureFirst[i]; t < r.textureFirst[i + 1]; t++)
+			TextureCache::request(r.textures[t], r.pixelsPerUV[i]);
+	}
+
+	kept += seen;
+	keptOf += n;
+}
+
+void GpuCulling::report()
+{
+	if (frames == 0)
+		return;
+
+	char line[192];
+	snprintf(line, sizeof(line), "gpu culling: %.1f draws per frame, camera kept %.1f%%, %llu arena rebuilds, %s",
+		(double)draws / frames, keptOf ? kept * 100.0 / keptOf : 0.0, arenaRebuilds,
+		indirectCount ? "indirect count" : "zero instance commands");
+	std::cerr << line << std::endl;
+	Meshlets::report("gpu culling", clusterStats);
+}
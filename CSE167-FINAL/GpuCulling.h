@@ -0,0 +1,169 @@
+#ifndef _GPU_CULLING_H_
+#define _GPU_CULLING_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+#include "MemoryStats.h"
+
+enum class CullPass {
+	SHADOW,
+	CAMERA,
+	NUM_PASSES
+};
+
+// Culls and draws the static meshes on the gpu with GL 4.3. Their geometry
+// is copied into one vertex and index buffer and their bounds, matrices
+// and lightmap squares are uploaded once a frame. A compute shader then
+// culls each pass against the frustum, and the camera pass against a max
+// depth pyramid of last frame, and writes the commands of what is left
+// grouped by material, so each group is one
+// glMultiDrawElementsIndirectCount. Without
+// ARB_indirect_parameters culled commands get zero instances instead.
+// Something coming out from behind an occluder shows up a frame late.
+//
+// Meshes split into clusters are a draw per cluster, the camera pass also
+// drops the clusters facing away. Skinned meshes stay on the render queues.
+// Which textures the camera saw comes back a few frames later and drives
+// the texture streaming.
+class GpuCulling
+{
+public:
+	// of the camera pass, as seen a few frames late
+	ClusterStats clusterStats;
+
+	// compute shaders and storage buffers, false before GL 4.3
+	static bool isSupported();
+
+	// adds its compute programs to shaders, they're built with the others
+	GpuCulling(ShaderManager* shaders);
+	~GpuCulling();
+
+	// after every build or reload of the shaders
+	void updatePrograms();
+
+	// uploads the scene items it can draw and gives back the others. view
+	// is the camera, for texture streaming.
+	void prepare(const std::vector<DrawItem>& scene, std::vector<DrawItem>& rest,
+		glm::vec3 viewPos, glm::vec3 viewDir, float pixelsPerUnit);
+
+	// same arguments as RenderQueue::cull, the camera pass also tests
+	// against the depth pyramid if one was built last frame
+	void cull(CullPass pass, glm::mat4 viewProj, glm::vec3 viewPos, glm::vec3 viewDir,
+		float pixelsPerUnit, float minPixels);
+
+	// programs are the GPU_DRIVEN builds of every variant
+	void draw(CullPass pass, const GLuint* programs, ShaderVariant litVariant, bool bindMaterials);
+
+	// reduces fbo's depth buffer into the pyramid the next camera pass
+	// is tested against, viewProj is the camera that drew it
+	void buildHiZ(GLuint fbo, int width, int height, glm::mat4 viewProj);
+
+	// draws per frame and how many the camera kept
+	void report();
+
+private:
+	static const int NUM_FRAMES = 3;
+	static const int MATRIX_UNIT = 7;
+	static const int HIZ_UNIT = 6;
+	static const int LIGHTMAP_RECT_UNIT = 8;
+
+	// one per draw, must match cull.comp
+	struct DrawRecord
+	{
+		glm::vec4 sphere, object, cone;
+		GLuint indexCount, firstIndex;
+		GLint baseVertex;
+		GLuint batch, castShadow, matrix;
+		GLuint pad[2];
+	};
+
+	// draws sharing a program and textures, a range of the records
+	struct Batch
+	{
+		Mesh* material; // any mesh with the batch's textures
+		bool unlit, baked;
+		GLuint first, count;
+	};
+
+	// where a mesh is in the shared buffers
+	struct Range
+	{
+		GLint baseVertex;
+		GLuint firstIndex, indexCount;
+	};
+
+	// commands and per batch counts written by one pass
+	struct PassBuffers
+	{
+		GLuint commands, counts;
+		size_t commandCapacity, countCapacity;
+	};
+
+	// visibility of a camera pass on its way back, with what it needs to
+	// turn into texture requests
+	struct Readback
+	{
+		GLuint buffer;
+		GLsync fence;
+		size_t capacity;
+		std::vector<float> pixelsPerUV; // per draw
+		std::vector<GLuint> textureFirst; // per draw and one past the end
+		std::vector<GLuint> textures;
+		std::vector<GLuint> clusterTriangles; // per draw, 0 unless it's a cluster
+	};
+
+	ShaderManager* shaders;
+	ShaderId cullId, hizId;
+	GLuint cullProgram, hizProgram;
+	bool indirectCount;
+
+	// the shared geometry, meshes are appended until it's full and then
+	// it's rebuilt from the meshes of the current frame
+	GLuint vao, vertexBuffer, indexBuffer, drawIdBuffer;
+	size_t vertexCapacity, indexCapacity, drawIdCapacity;
+	size_t vertexCount, indexCount;
+	std::unordered_map<unsigned long long, Range> ranges; // by mesh uid
+
+	// this frame's draws
+	std::vector<DrawRecord> records;
+	std::vector<glm::mat4> matrices;
+	std::vector<glm::vec4> lightmapRects; // per matrix
+	std::vector<Batch> batches;
+	std::vector<GLuint> batchFirst;
+	std::vector<glm::vec4> clusterSpheres, clusterCones;
+	GLuint recordBuffer, matrixBuffer, matrixTexture, batchBuffer, visibleBuffer;
+	GLuint lightmapBuffer, lightmapTexture;
+	size_t recordCapacity, matrixCapacity, batchCapacity, visibleCapacity, lightmapCapacity;
+	PassBuffers passes[(int)CullPass::NUM_PASSES];
+
+	// max depth pyramid and the depth copied out of the frame to build it
+	GLuint hiz, depthCopy, depthCopyFbo;
+	int hizWidth, hizHeight, hizLevels;
+	glm::mat4 prevViewProj;
+	unsigned long long frame, hizFrame;
+
+	Readback readbacks[NUM_FRAMES];
+
+	unsigned long long frames, draws, kept, keptOf, arenaRebuilds;
+
+	void ensureBuffer(GLuint buffer, size_t& capacity, size_t bytes, GLenum usage);
+	bool place(Mesh* mesh);
+	void rebuildArena(const std::vector<Mesh*>& meshes);
+	void createHiZ(int width, int height);
+	void readFeedback(Readback& r);
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "JobSystem.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// index of the queue owned by the current thread, the main thread owns 0
+static thread_local unsigned int currentThread = 0;
+
+JobSystem::JobSystem(unsigned int numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+
+	running = true;
+	queued = 0;
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+
+	// the calling thread is worker 0, spawn the rest
+	for (unsigned int i = 1; i < numThreads; i++)
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		running = false;
+	}
+	wake.notify_all();
+
+	for (std::thread& t : workers)
+		t.join();
+}
+
+// queues a job on the calling thread's queue
+void JobSystem::run(JobCounter& counter, std::function<void()> fn)
+{
+	counter.pending++;
+
+	unsigned int self = currentThread < queues.size() ? currentThread : 0;
+	{
+		std::lock_guard<std::mutex> guard(queues[self]->lock);
+		queues[self]->jobs.push_back({ fn, &counter });
+	}
+	queued++;
+
+	// take the sleep lock so a worker can't miss the wake up between
+	// checking the queue count and starting to wait
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+// runs other jobs until every job of the counter is done, sleeps while
+// the last ones run on other threads
+void JobSystem::wait(JobCounter& counter)
+{
+	unsigned int self = currentThread < queues.size() ? currentThread : 0;
+	while (counter.pending > 0)
+	{
+		if (runOne(self))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [this, &counter]() { return counter.pending == 0 || queued > 0; });
+	}
+}
+
+void JobSystem::parallelFor(unsigned int count, unsigned int grain,
+	std::function<void(unsigned int begin, unsigned int end)> fn)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// nothing to split, skip the queues entirely
+	if (count <= grain)
+	{
+		fn(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (unsigned int begin = 0; begin < count; begin += grain)
+	{
+		unsigned int end = begin + grain < count ? begin + grain : count;
+		run(counter, [fn, begin, end]() { fn(begin, end); });
+	}
+	wait(counter);
+}
+
+unsigned int JobSystem::getNumThreads()
+{
+	return (unsigned int)queues.size();
+}
+
+unsigned int JobSystem::threadIndex()
+{
+	return currentThread;
+}
+
+// newest job first from our own queue, it's the one most likely in cache
+bool JobSystem::popLocal(unsigned int self, Job& job)
+{
+	std::lock_guard<std::mutex> guard(queues[self]->lock);
+	if (queues[self]->jobs.empty())
+		return false;
+
+	job = queues[self]->jobs.back();
+	queues[self]->jobs.pop_back();
+	return true;
+}
+
+// oldest job from somebody else's queue, those tend to be the big ones
+bool JobSystem::steal(unsigned int self, Job& job)
+{
+	unsigned int n = (unsigned int)queues.size();
+	for (unsigned int i = 1; i < n; i++)
+	{
+		WorkQueue& victim = *queues[(self + i) % n];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (victim.jobs.empty())
+			continue;
+
+		job = victim.jobs.front();
+		victim.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::runOne(unsigned int self)
+{
+	Job job;
+	if (!popLocal(self, job) && !steal(self, job))
+		return false;
+
+	queued--;
+	job.fn();
+
+	// a thread may be asleep in wait on this counter
+	if (--job.counter->pending == 0)
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		wake.notify_all();
+	}
+	return true;
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+	currentThread = index;
+
+	while (running)
+	{
+		if (runOne(index))
+			continue;
+
+		// nothing to do anywhere, sleep until a job gets queued
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [this]() { return queued > 0 || !running; });
+	}
+}
+
+// each node multiplies a chain of matrices, about what a transform update
+// costs, and subtrees split into four jobs like the scene graph's
+void JobSystem::benchmarkSubtree(JobSystem* jobs, unsigned int first, unsigned int count,
+	std::vector<float>& out)
+{
+	if (count <= 64)
+	{
+		for (unsigned int n = first; n < first + count; n++)
+		{
+			float m[16], r[16];
+			for (int i = 0; i < 16; i++)
+				m[i] = (i % 5 == 0 ? 1.f : 0.f) + (n + i) * 1e-6f;
+			for (int k = 0; k < 8; k++)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						r[c * 4 + row] = m[row] * m[c * 4] + m[4 + row] * m[c * 4 + 1] +
+							m[8 + row] * m[c * 4 + 2] + m[12 + row] * m[c * 4 + 3];
+					}
+				}
+				std::copy(r, r + 16, m);
+			}
+			out[n] = m[0] + m[5] + m[10] + m[15];
+		}
+		return;
+	}
+
+	JobCounter counter;
+	unsigned int part = (count + 3) / 4;
+	for (unsigned int begin = first; begin < first + count; begin += part)
+	{
+		unsigned int size = std::min(part, first + count - begin);
+		jobs->run(counter, [jobs, begin, size, &out]() { benchmarkSubtree(jobs, begin, size, out); });
+	}
+	jobs->wait(counter);
+}
+
+void JobSystem::benchmark(unsigned int nodeCount, unsigned int maxThreads)
+{
+	if (nodeCount == 0)
+		return;
+
+	// the pools below make their own threads, the caller is their thread 0
+	unsigned int caller = currentThread;
+	currentThread = 0;
+
+	const int RUNS = 20;
+	std::vector<float> out(nodeCount);
+	double single = 0;
+	for (unsigned int threads = 1; threads <= std::max(maxThreads, 1u); threads *= 2)
+	{
+		JobSystem jobs(threads);
+		benchmarkSubtree(&jobs, 0, nodeCount, out);
+
+		// the best run, the others are the os getting in the way
+		double best = 1e9;
+		for (int r = 0; r < RUNS; r++)
+		{
+			double start = glfwGetTime();
+			benchmarkSubtree(&jobs, 0, nodeCount, out);
+			best = std::min(best, glfwGetTime() - start);
+		}
+		if (threads == 1)
+			single = best;
+
+		char line[160];
+		snprintf(line, sizeof(line), "jobs: %u nodes on %2u threads in %.3f ms, %.2fx one thread",
+			nodeCount, threads, best * 1000.0, single / best);
+		std::cerr << line << std::endl;
+	}
+
+	currentThread = caller;
+}
@@ -0,0 +1,79 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Counts the jobs of a group that haven't finished yet, wait on it to join
+// the group.
+struct JobCounter
+{
+	std::atomic<int> pending;
+
+	JobCounter() : pending(0) {}
+};
+
+// Work-stealing thread pool. Every thread (the main thread is index 0) owns
+// a queue, pushes and pops its own jobs from the back and steals from the
+// front of other threads' queues when it runs dry. Threads waiting on a
+// counter run queued jobs while there are any, so jobs can spawn jobs, and
+// sleep once there are none until the counter is done or more jobs come.
+class JobSystem
+{
+private:
+	struct Job
+	{
+		std::function<void()> fn;
+		JobCounter* counter;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::atomic<bool> running;
+	std::atomic<int> queued; // jobs sitting in any queue
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+
+	bool popLocal(unsigned int self, Job& job);
+	bool steal(unsigned int self, Job& job);
+	bool runOne(unsigned int self);
+	void workerLoop(unsigned int index);
+
+	static void benchmarkSubtree(JobSystem* jobs, unsigned int first, unsigned int count,
+		std::vector<float>& out);
+
+public:
+	// numThreads includes the calling thread, 0 picks one per hardware thread
+	JobSystem(unsigned int numThreads);
+	~JobSystem();
+
+	void run(JobCounter& counter, std::function<void()> fn);
+	void wait(JobCounter& counter);
+
+	// splits [0, count) into chunks of at most grain and runs them in parallel
+	void parallelFor(unsigned int count, unsigned int grain,
+		std::function<void(unsigned int begin, unsigned int end)> fn);
+
+	unsigned int getNumThreads();
+	static unsigned int threadIndex();
+
+	// updates a tree of nodeCount nodes split into nested jobs, in a pool of
+	// 1, 2, 4 ... maxThreads threads, and prints the times and speedups
+	static void benchmark(unsigned int nodeCount, unsigned int maxThreads);
+};
+
+#endif
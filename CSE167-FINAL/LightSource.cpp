@@ -1,25 +1,42 @@
 #include "LightSource.h"
+#include "RenderQueue.h"
+#include "SceneMemory.h"
 
 unsigned int LightSource::depthShader;
 
 LightSource::LightSource(std::string path, glm::mat4 C)
 {
-	lightModel = new Model(path, C);
+	lightModel = SceneMemory::create<Model>(path, C);
 	position = C;
 }
 
+LightSource::~LightSource()
+{
+	SceneMemory::destroy(lightModel);
+}
+
 void LightSource::draw(glm::mat4 C, unsigned int shaderProgram)
 {
 	// don't render depth for light sources
 	if (shaderProgram == depthShader)
 		return;
-	glUniform1i(glGetUniformLocation(shaderProgram, "ignoreLight"), true);
 	lightModel->draw(C, shaderProgram);
-	glUniform1i(glGetUniformLocation(shaderProgram, "ignoreLight"), false);
-
 }
 
 void LightSource::update(glm::mat4 C)
 {
 	lightModel->update(C);
 }
+
+// light sources are drawn without lighting and don't cast shadows
+void LightSource::collect(glm::mat4 C, std::vector<DrawItem>& items)
+{
+	size_t first = items.size();
+	lightModel->collect(C, items);
+
+	for (size_t i = first; i < items.size(); i++)
+	{
+		items[i].unlit = true;
+		items[i].castShadow = false;
+	}
+}
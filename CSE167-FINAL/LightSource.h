@@ -33,10 +33,11 @@ public:
 	glm::mat4 position;
 
 	LightSource(std::string path, glm::mat4 C);
+	~LightSource();
 
 	void draw(glm::mat4 C, unsigned int shaderProgram);
 	void update(glm::mat4 C);
-
+	void collect(glm::mat4 C, std::vector<DrawItem>& items);
 
 
 };
@@ -0,0 +1,922 @@
+#include "Lightmaps.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "Bvh.h"
+#include "TextureCache.h"
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+static const char CACHE_MAGIC[4] = { 'L', 'M', 'A', 'P' };
+static const unsigned int CACHE_VERSION = 1;
+
+// a triangle joins a chart while its normal is within about 37 degrees of
+// the first one's
+static const float CHART_COS = 0.8f;
+// empty texels around each chart, so filtering and the 4x4 blocks of the
+// compression don't mix neighbouring charts
+static const int PADDING = 2;
+// a mesh's square gets this many texels per triangle, rounded up to a
+// power of two between the sizes below
+static const int TEXELS_PER_TRIANGLE = 64;
+static const int MIN_SIZE = 64, MAX_SIZE = 2048;
+// the items' squares are laid out in rows this wide
+static const int ATLAS_WIDTH = 4096;
+
+// shadow rays per texel, to points on the light
+static const int LIGHT_SAMPLES = 16;
+// the hemisphere rays are a grid of this many squared strata
+static const int HEMISPHERE_STRATA = 8;
+// the point light is a sphere this big for the soft shadows
+static const float LIGHT_RADIUS = 1.f;
+// occluders further away don't darken the ambient
+static const float AO_DISTANCE = 8.f;
+// the flat ambient of texture_shader.frag, baked with its occlusion
+static const float AMBIENT = 0.25f;
+// the baked light is stored as the square root of it over this, must
+// match texture_shader.frag
+static const float LIGHTMAP_RANGE = 2.f;
+// rays start this far off the surface so they don't hit it
+static const float RAY_OFFSET = 2e-3f;
+
+// passes of the a-trous filter, each doubles its step
+static const int DENOISE_PASSES = 3;
+// how much a difference in brightness stops the filter
+static const float DENOISE_LUMA = 0.2f;
+// texels grown into the empty ones around the charts
+static const int DILATE_PASSES = PADDING + 1;
+
+static const float PI = 3.14159265f;
+
+struct LightmapHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int width, height, count;
+};
+
+struct LightmapEntry
+{
+	unsigned long long key;
+	glm::vec4 rect;
+};
+
+// one draw item's square while it's baked
+struct BakeItem
+{
+	const DrawItem* item;
+	int size, x, y; // the square and where it is in the atlas
+	float texelWorld; // world size of a texel, roughly
+
+	// per texel, the surface it covers in world space. face is the
+	// triangle's own normal on the side of the interpolated one.
+	std::vector<char> covered;
+	std::vector<glm::vec3> position, normal, face;
+	// rgb is the light, a how much of the light is unblocked
+	std::vector<glm::vec4> light;
+};
+
+// small hash based generator, one per texel so a bake comes out the same
+// however its texels are split between the threads
+struct BakeRandom
+{
+	unsigned int state;
+
+	float next()
+	{
+		state = state * 747796405u + 2891336453u;
+		unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (((word >> 22u) ^ word) >> 8) * (1.f / 16777216.f);
+	}
+};
+
+// two directions perpendicular to n and each other
+static void basis(glm::vec3 n, glm::vec3& u, glm::vec3& v)
+{
+	u = glm::normalize(glm::cross(n, glm::abs(n.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+	v = glm::cross(n, u);
+}
+
+static float cross2(glm::vec2 a, glm::vec2 b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+static float luminance(glm::vec4 c)
+{
+	return c.r * 0.2126f + c.g * 0.7152f + c.b * 0.0722f;
+}
+
+// average of the squared color of the mesh's first diffuse texture, which
+// texture_shader.frag multiplies the light by, from its smallest mip
+static glm::vec3 reflectance(const Mesh* mesh)
+{
+	for (const Texture& t : mesh->textures)
+	{
+		if (t.type != "texture_diffuse")
+			continue;
+
+		// streamed textures leave out their finest levels, so look at all
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		GLint level = -1, width = 0, height = 0;
+		for (GLint l = 0; l < 16; l++)
+		{
+			GLint w = 0, h = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_WIDTH, &w);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_HEIGHT, &h);
+			if (w > 0 && h > 0)
+			{
+				level = l;
+				width = w;
+				height = h;
+			}
+		}
+		if (level < 0)
+			break;
+
+		std::vector<float> pixels((size_t)width * height * 4);
+		glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_FLOAT, pixels.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glm::vec3 sum(0);
+		for (size_t i = 0; i < pixels.size(); i += 4)
+		{
+			glm::vec3 c(pixels[i], pixels[i + 1], pixels[i + 2]);
+			sum += c * c;
+		}
+		return sum / (float)(width * height);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return glm::vec3(0.25f);
+}
+
+// finds the texels of the item's square its triangles cover. Texels whose
+// center is just outside every triangle take the closest point of one, so
+// the filtering at chart edges doesn't pick up the empty gutters.
+static void rasterize(BakeItem& b)
+{
+	const Mesh* mesh = b.item->mesh;
+	glm::mat4 model = b.item->model;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	int n = b.size;
+	size_t texels = (size_t)n * n;
+	b.covered.assign(texels, 0);
+	b.position.assign(texels, glm::vec3(0));
+	b.normal.assign(texels, glm::vec3(0));
+	b.face.assign(texels, glm::vec3(0));
+	b.light.assign(texels, glm::vec4(0));
+	std::vector<float> distance(texels, FLT_MAX);
+
+	float worldArea = 0, texelArea = 0;
+	for (size_t i = 0; i + 2 < mesh->indices.size(); i += 3)
+	{
+		glm::vec2 uv[3];
+		glm::vec3 p[3], normal[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const Vertex& v = mesh->vertices[mesh->indices[i + k]];
+			uv[k] = v.LightmapCoords * (float)n;
+			p[k] = glm::vec3(model * glm::vec4(v.Position, 1.f));
+			normal[k] = normalMatrix * v.Normal;
+		}
+		glm::vec3 face = glm::cross(p[1] - p[0], p[2] - p[0]);
+		float faceLength = glm::length(face);
+		float area = cross2(uv[1] - uv[0], uv[2] - uv[0]);
+		if (faceLength <= 0 || glm::abs(area) < 1e-8f)
+			continue;
+		face /= faceLength;
+		worldArea += faceLength * 0.5f;
+		texelArea += glm::abs(area) * 0.5f;
+
+		glm::vec2 lo = glm::min(uv[0], glm::min(uv[1], uv[2]));
+		glm::vec2 hi = glm::max(uv[0], glm::max(uv[1], uv[2]));
+		int x0 = std::max((int)std::floor(lo.x - 1.f), 0), x1 = std::min((int)std::ceil(hi.x + 1.f), n - 1);
+		int y0 = std::max((int)std::floor(lo.y - 1.f), 0), y1 = std::min((int)std::ceil(hi.y + 1.f), n - 1);
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				glm::vec2 c(x + 0.5f, y + 0.5f);
+				glm::vec3 w;
+				w.x = cross2(uv[1] - c, uv[2] - c) / area;
+				w.y = cross2(uv[2] - c, uv[0] - c) / area;
+				w.z = 1.f - w.x - w.y;
+
+				float d = 0;
+				if (w.x < 0 || w.y < 0 || w.z < 0)
+				{
+					w = glm::max(w, glm::vec3(0));
+					w /= w.x + w.y + w.z;
+					d = glm::length(uv[0] * w.x + uv[1] * w.y + uv[2] * w.z - c);
+					if (d > 0.75f)
+						continue;
+				}
+				size_t t = (size_t)y * n + x;
+				if (d >= distance[t])
+					continue;
+				distance[t] = d;
+
+				glm::vec3 shading = normal[0] * w.x + normal[1] * w.y + normal[2] * w.z;
+				float length = glm::length(shading);
+				shading = length > 0 ? shading / length : face;
+				b.covered[t] = 1;
+				b.position[t] = p[0] * w.x + p[1] * w.y + p[2] * w.z;
+				b.normal[t] = shading;
+				b.face[t] = glm::dot(face, shading) < 0 ? -face : face;
+			}
+		}
+	}
+	b.texelWorld = texelArea > 0 ? glm::sqrt(worldArea / texelArea) : 1.f;
+}
+
+// direct light, one bounce and ambient occlusion at one texel, returns
+// the light and its visibility. rays counts what was traced.
+static glm::vec4 trace(const SceneBvh& bvh, const std::unordered_map<const Mesh*, glm::vec3>& reflectances,
+	glm::vec3 lightPos, glm::vec3 position, glm::vec3 normal, glm::vec3 face, BakeRandom& random,
+	unsigned long long& rays)
+{
+	glm::vec3 origin = position + face * RAY_OFFSET;
+
+	// points all over the light's sphere, the ones behind it are blocked
+	// by its front anyway
+	float direct = 0;
+	int seen = 0;
+	for (int s = 0; s < LIGHT_SAMPLES; s++)
+	{
+		float z = 1.f - 2.f * random.next();
+		float r = glm::sqrt(glm::max(1.f - z * z, 0.f));
+		float phi = 2.f * PI * random.next();
+		glm::vec3 target = lightPos + LIGHT_RADIUS * glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+		glm::vec3 toLight = target - origin;
+		float distance = glm::length(toLight);
+		toLight /= distance;
+		float cosine = glm::dot(normal, toLight);
+		if (cosine <= 0 || glm::dot(face, toLight) <= 0)
+			continue;
+		rays++;
+		if (!bvh.occluded(origin, toLight, distance))
+		{
+			direct += cosine;
+			seen++;
+		}
+	}
+
+	// cosine weighted directions over the hemisphere, stratified. What's
+	// hit nearby occludes the ambient, and the light it gets bounces back.
+	glm::vec3 u, v;
+	basis(normal, u, v);
+	float open = 0;
+	glm::vec3 bounce(0);
+	for (int sy = 0; sy < HEMISPHERE_STRATA; sy++)
+	{
+		for (int sx = 0; sx < HEMISPHERE_STRATA; sx++)
+		{
+			float a = (sx + random.next()) / HEMISPHERE_STRATA;
+			float phi = 2.f * PI * (sy + random.next()) / HEMISPHERE_STRATA;
+			float r = glm::sqrt(a);
+			glm::vec3 dir = u * (r * glm::cos(phi)) + v * (r * glm::sin(phi)) + normal * glm::sqrt(1.f - a);
+			// below the triangle where the shading normal leans over it
+			float below = glm::dot(dir, face);
+			if (below <= 0)
+				dir -= 2.f * below * face;
+
+			rays++;
+			RayHit hit;
+			if (!bvh.raycast(origin, dir, FLT_MAX, hit))
+			{
+				open += 1.f;
+				continue;
+			}
+			if (hit.distance >= AO_DISTANCE)
+				open += 1.f;
+
+			glm::vec3 start = hit.position + hit.normal * RAY_OFFSET;
+			glm::vec3 toLight = lightPos - start;
+			float distance = glm::length(toLight);
+			toLight /= distance;
+			float cosine = glm::dot(hit.normal, toLight);
+			if (cosine <= 0)
+				continue;
+			rays++;
+			if (!bvh.occluded(start, toLight, distance))
+			{
+				std::unordered_map<const Mesh*, glm::vec3>::const_iterator found = reflectances.find(hit.mesh);
+				bounce += found->second * cosine;
+			}
+		}
+	}
+	float numDirections = (float)(HEMISPHERE_STRATA * HEMISPHERE_STRATA);
+
+	// the shader's diffuse is color squared times the light, the light
+	// coming back over the hemisphere adds up to pi times the average
+	glm::vec3 light = glm::vec3(direct / LIGHT_SAMPLES) + bounce * (PI / numDirections) +
+		glm::vec3(AMBIENT * open / numDirections);
+	return glm::vec4(light, (float)seen / LIGHT_SAMPLES);
+}
+
+// edge stopping a-trous filter over the square, texels only mix with ones
+// of the same surface at about the same brightness
+static void denoise(JobSystem* jobs, BakeItem& b)
+{
+	static const float kernel[3] = { 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+	int n = b.size;
+	std::vector<glm::vec4> filtered(b.light.size());
+	for (int pass = 0; pass < DENOISE_PASSES; pass++)
+	{
+		int step = 1 << pass;
+		float sigma = b.texelWorld * step * 2.f;
+		float positionScale = 1.f / (2.f * sigma * sigma);
+		jobs->parallelFor((unsigned int)n, 16, [&](unsigned int begin, unsigned int end)
+		{
+			for (int y = (int)begin; y < (int)end; y++)
+			{
+				for (int x = 0; x < n; x++)
+				{
+					size_t i = (size_t)y * n + x;
+					if (!b.covered[i])
+					{
+						filtered[i] = b.light[i];
+						continue;
+					}
+					float luma = luminance(b.light[i]);
+					glm::vec4 sum(0);
+					float weights = 0;
+					for (int dy = -2; dy <= 2; dy++)
+					{
+						int yy = y + dy * step;
+						if (yy < 0 || yy >= n)
+							continue;
+						for (int dx = -2; dx <= 2; dx++)
+						{
+							int xx = x + dx * step;
+							if (xx < 0 || xx >= n)
+								continue;
+							size_t j = (size_t)yy * n + xx;
+							if (!b.covered[j])
+								continue;
+
+							float facing = glm::max(glm::dot(b.normal[i], b.normal[j]), 0.f);
+							facing *= facing;
+							facing *= facing;
+							facing *= facing;
+							glm::vec3 d = b.position[i] - b.position[j];
+							float w = kernel[std::abs(dx)] * kernel[std::abs(dy)] * facing *
+								glm::exp(-glm::dot(d, d) * positionScale -
+									glm::abs(luminance(b.light[j]) - luma) / DENOISE_LUMA);
+							sum += b.light[j] * w;
+							weights += w;
+						}
+					}
+					filtered[i] = weights > 0 ? sum / weights : b.light[i];
+				}
+			}
+		});
+		b.light.swap(filtered);
+	}
+}
+
+// grows the charts into the gutters around them, so bilinear filtering and
+// the compression blocks at their edges see the chart's light
+static void dilate(BakeItem& b)
+{
+	int n = b.size;
+	std::vector<char> covered;
+	for (int pass = 0; pass < DILATE_PASSES; pass++)
+	{
+		covered = b.covered;
+		for (int y = 0; y < n; y++)
+		{
+			for (int x = 0; x < n; x++)
+			{
+				size_t i = (size_t)y * n + x;
+				if (covered[i])
+					continue;
+				glm::vec4 sum(0);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int xx = x + dx, yy = y + dy;
+						if (xx < 0 || yy < 0 || xx >= n || yy >= n || !covered[(size_t)yy * n + xx])
+							continue;
+						sum += b.light[(size_t)yy * n + xx];
+						count++;
+					}
+				}
+				if (count > 0)
+				{
+					b.light[i] = sum / (float)count;
+					b.covered[i] = 1;
+				}
+			}
+		}
+	}
+}
+
+int Lightmaps::unwrap(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0 || indices.size() % 3 != 0)
+		return 0;
+
+	TriangleAdjacency adjacency;
+	adjacency.build(vertices, indices);
+	const std::vector<unsigned int>& weld = adjacency.weld;
+	const std::vector<unsigned int>& first = adjacency.first;
+	const std::vector<unsigned int>& around = adjacency.around;
+
+	std::vector<glm::vec3> normals(numTriangles);
+	for (size_t t = 0; t < numTriangles; t++)
+	{
+		glm::vec3 a = vertices[indices[t * 3]].Position;
+		glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+		glm::vec3 c = vertices[indices[t * 3 + 2]].Position;
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		normals[t] = length > 0 ? n / length : glm::vec3(0);
+	}
+
+	// charts grow from the first triangle not in one yet across shared
+	// vertices, then are flattened along their average normal
+	struct Chart
+	{
+		glm::vec3 u, v;
+		glm::vec2 lo, hi;
+		int x, y; // in the square, in texels
+	};
+	std::vector<unsigned int> chartOf(numTriangles, ~0u);
+	std::vector<Chart> charts;
+	std::vector<unsigned int> grown;
+	for (unsigned int seed = 0; seed < numTriangles; seed++)
+	{
+		if (chartOf[seed] != ~0u)
+			continue;
+		unsigned int id = (unsigned int)charts.size();
+		glm::vec3 axis = normals[seed];
+		glm::vec3 normalSum(0);
+		grown.assign(1, seed);
+		chartOf[seed] = id;
+		for (size_t q = 0; q < grown.size(); q++)
+		{
+			unsigned int t = grown[q];
+			normalSum += normals[t];
+			// a degenerate triangle is a chart of its own
+			if (axis == glm::vec3(0))
+				break;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int w = weld[indices[t * 3 + k]];
+				for (unsigned int j = first[w]; j < first[w + 1]; j++)
+				{
+					unsigned int other = around[j];
+					if (chartOf[other] == ~0u && glm::dot(normals[other], axis) >= CHART_COS)
+					{
+						chartOf[other] = id;
+						grown.push_back(other);
+					}
+				}
+			}
+		}
+
+		Chart chart;
+		float length = glm::length(normalSum);
+		basis(length > 0 ? normalSum / length : glm::vec3(0, 1, 0), chart.u, chart.v);
+		chart.lo = glm::vec2(FLT_MAX);
+		chart.hi = glm::vec2(-FLT_MAX);
+		for (unsigned int t : grown)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				glm::vec3 p = vertices[indices[t * 3 + k]].Position;
+				glm::vec2 flat(glm::dot(p, chart.u), glm::dot(p, chart.v));
+				chart.lo = glm::min(chart.lo, flat);
+				chart.hi = glm::max(chart.hi, flat);
+			}
+		}
+		chart.x = chart.y = 0;
+		charts.push_back(chart);
+	}
+
+	// rows of charts, tallest first, at the largest scale that fits. The
+	// square grows if the gutters alone don't fit.
+	std::vector<unsigned int> packOrder(charts.size());
+	float area = 0;
+	for (unsigned int c = 0; c < charts.size(); c++)
+	{
+		packOrder[c] = c;
+		glm::vec2 extent = charts[c].hi - charts[c].lo;
+		area += extent.x * extent.y;
+	}
+	std::sort(packOrder.begin(), packOrder.end(), [&](unsigned int a, unsigned int b)
+	{
+		return charts[a].hi.y - charts[a].lo.y > charts[b].hi.y - charts[b].lo.y;
+	});
+
+	int size = MIN_SIZE;
+	while (size < MAX_SIZE && (size_t)size * size < numTriangles * TEXELS_PER_TRIANGLE)
+		size *= 2;
+
+	auto pack = [&](float scale) -> bool
+	{
+		int x = 0, y = 0, rowHeight = 0;
+		for (unsigned int c : packOrder)
+		{
+			Chart& chart = charts[c];
+			glm::vec2 extent = (chart.hi - chart.lo) * scale;
+			int w = (int)std::ceil(extent.x) + 1 + 2 * PADDING;
+			int h = (int)std::ceil(extent.y) + 1 + 2 * PADDING;
+			if (w > size)
+				return false;
+			if (x + w > size)
+			{
+				x = 0;
+				y += rowHeight;
+				rowHeight = 0;
+			}
+			if (y + h > size)
+				return false;
+			chart.x = x;
+			chart.y = y;
+			x += w;
+			rowHeight = std::max(rowHeight, h);
+		}
+		return true;
+	};
+
+	// texels per local unit, starting from half the square covered
+	float scale = area > 0 ? glm::sqrt(size * (float)size * 0.5f / area) : 1.f;
+	int tries = 0;
+	while (!pack(scale))
+	{
+		scale *= 0.9f;
+		if (++tries < 40)
+			continue;
+		if (size == MAX_SIZE)
+		{
+			std::cerr << "lightmap: " << charts.size() << " charts don't fit in " << MAX_SIZE
+				<< " texels" << std::endl;
+			return 0;
+		}
+		size *= 2;
+		scale = area > 0 ? glm::sqrt(size * (float)size * 0.5f / area) : 1.f;
+		tries = 0;
+	}
+
+	// a vertex on a seam is copied once per chart it's in
+	std::vector<Vertex> split;
+	split.reserve(vertices.size());
+	std::vector<unsigned int> splitIndices(indices.size());
+	std::unordered_map<unsigned long long, unsigned int> copies;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int c = chartOf[i / 3];
+		unsigned long long key = ((unsigned long long)indices[i] << 32) | c;
+		std::unordered_map<unsigned long long, unsigned int>::iterator found = copies.find(key);
+		if (found != copies.end())
+		{
+			splitIndices[i] = found->second;
+			continue;
+		}
+
+		const Chart& chart = charts[c];
+		Vertex v = vertices[indices[i]];
+		glm::vec2 flat(glm::dot(v.Position, chart.u), glm::dot(v.Position, chart.v));
+		glm::vec2 texel = (flat - chart.lo) * scale + glm::vec2(chart.x, chart.y) + (PADDING + 0.5f);
+		v.LightmapCoords = texel / (float)size;
+		copies[key] = (unsigned int)split.size();
+		splitIndices[i] = (unsigned int)split.size();
+		split.push_back(v);
+	}
+	vertices.swap(split);
+	indices.swap(splitIndices);
+	return size;
+}
+
+Lightmaps::Lightmaps()
+{
+	texture = 0;
+	width = height = 0;
+	bytes = 0;
+	texelsBaked = raysTraced = 0;
+	bakeTime = 0;
+	bakeThreads = 0;
+}
+
+Lightmaps::~Lightmaps()
+{
+	if (texture)
+		MemoryStats::deleteTextures(1, &texture);
+}
+
+// the mesh's geometry and the world matrix, hashed the same way every run
+unsigned long long Lightmaps::itemKey(const DrawItem& item)
+{
+	unsigned long long hash = item.mesh->geometryHash;
+	const unsigned char* matrix = (const unsigned char*)glm::value_ptr(item.model);
+	for (size_t i = 0; i < sizeof(glm::mat4); i++)
+		hash = (hash ^ matrix[i]) * 1099511628211ull;
+	return hash;
+}
+
+bool Lightmaps::bake(JobSystem* jobs, const std::vector<DrawItem>& items, glm::vec3 lightPos,
+	const std::string& path)
+{
+	double start = glfwGetTime();
+
+	// the light sources would block their own light, and skinned meshes
+	// don't stay where they'd be baked
+	std::vector<DrawItem> statics;
+	for (const DrawItem& item : items)
+	{
+		if (!item.unlit && item.pose == nullptr)
+			statics.push_back(item);
+	}
+
+	std::vector<BakeItem> baked;
+	for (const DrawItem& item : statics)
+	{
+		if (item.mesh->lightmapSize == 0)
+			continue;
+		BakeItem b;
+		b.item = &item;
+		b.size = item.mesh->lightmapSize;
+		b.x = b.y = 0;
+		b.texelWorld = 1;
+		baked.push_back(b);
+	}
+	if (baked.empty())
+	{
+		std::cerr << "lightmap: nothing static to bake" << std::endl;
+		return false;
+	}
+
+	// the squares are powers of two, largest first, so rows of them fill
+	// the width exactly
+	std::stable_sort(baked.begin(), baked.end(), [](const BakeItem& a, const BakeItem& b)
+	{
+		return a.size > b.size;
+	});
+	// rows narrower than the usual width when gl can't take it
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	int atlasWidth = std::min(std::max(ATLAS_WIDTH, baked[0].size), (int)maxSize);
+	int x = 0, y = 0, rowHeight = 0;
+	for (BakeItem& b : baked)
+	{
+		if (x + b.size > atlasWidth)
+		{
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+		b.x = x;
+		b.y = y;
+		x += b.size;
+		rowHeight = std::max(rowHeight, b.size);
+	}
+	int atlasHeight = y + rowHeight;
+	if (baked[0].size > atlasWidth || atlasHeight > maxSize)
+	{
+		std::cerr << "lightmap: the atlas needs " << std::max(baked[0].size, atlasWidth) << "x"
+			<< atlasHeight << " texels, gl allows " << maxSize << std::endl;
+		return false;
+	}
+
+	// what the bounce light takes the color of, read back on this thread
+	glActiveTexture(GL_TEXTURE0);
+	std::unordered_map<const Mesh*, glm::vec3> reflectances;
+	for (const DrawItem& item : statics)
+	{
+		if (reflectances.find(item.mesh) == reflectances.end())
+			reflectances[item.mesh] = reflectance(item.mesh);
+	}
+
+	SceneBvh bvh;
+	bvh.update(jobs, statics);
+
+	jobs->parallelFor((unsigned int)baked.size(), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+			rasterize(baked[i]);
+	});
+
+	// every covered texel of every square, traced in one go so the threads
+	// stay busy to the end
+	std::vector<std::pair<unsigned int, unsigned int> > texels;
+	for (unsigned int b = 0; b < baked.size(); b++)
+	{
+		for (unsigned int i = 0; i < baked[b].covered.size(); i++)
+		{
+			if (baked[b].covered[i])
+				texels.push_back(std::make_pair(b, i));
+		}
+	}
+	std::cerr << "lightmap: tracing " << texels.size() << " texels of " << baked.size() << " items on "
+		<< jobs->getNumThreads() << " threads" << std::endl;
+
+	std::atomic<unsigned long long> rays(0);
+	double traceStart = glfwGetTime();
+	jobs->parallelFor((unsigned int)texels.size(), 64, [&](unsigned int begin, unsigned int end)
+	{
+		unsigned long long traced = 0;
+		for (unsigned int t = begin; t < end; t++)
+		{
+			BakeItem& b = baked[texels[t].first];
+			unsigned int i = texels[t].second;
+			BakeRandom random;
+			random.state = t * 2654435761u + 1u;
+			b.light[i] = trace(bvh, reflectances, lightPos, b.position[i], b.normal[i], b.face[i], random,
+				traced);
+		}
+		rays += traced;
+	});
+	double traceTime = glfwGetTime() - traceStart;
+
+	for (BakeItem& b : baked)
+	{
+		denoise(jobs, b);
+		dilate(b);
+	}
+
+	// rgb as the square root of the light over its range, more precision
+	// in the dark, alpha the visibility of the light for the specular
+	std::vector<unsigned char> pixels((size_t)atlasWidth * atlasHeight * 4, 0);
+	for (const BakeItem& b : baked)
+	{
+		for (int ty = 0; ty < b.size; ty++)
+		{
+			for (int tx = 0; tx < b.size; tx++)
+			{
+				size_t i = (size_t)ty * b.size + tx;
+				if (!b.covered[i])
+					continue;
+				glm::vec3 rgb = glm::sqrt(glm::clamp(glm::vec3(b.light[i]) / LIGHTMAP_RANGE, 0.f, 1.f));
+				unsigned char* out = &pixels[((size_t)(b.y + ty) * atlasWidth + b.x + tx) * 4];
+				out[0] = (unsigned char)(rgb.r * 255.f + 0.5f);
+				out[1] = (unsigned char)(rgb.g * 255.f + 0.5f);
+				out[2] = (unsigned char)(rgb.b * 255.f + 0.5f);
+				out[3] = (unsigned char)(glm::clamp(b.light[i].a, 0.f, 1.f) * 255.f + 0.5f);
+			}
+		}
+	}
+	std::vector<char> blocks((size_t)((atlasWidth + 3) / 4) * ((atlasHeight + 3) / 4) * 16);
+	TextureCache::encode(pixels, atlasWidth, atlasHeight, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, blocks.data());
+
+	width = atlasWidth;
+	height = atlasHeight;
+	rects.clear();
+	std::vector<LightmapEntry> entries;
+	for (const BakeItem& b : baked)
+	{
+		LightmapEntry e;
+		e.key = itemKey(*b.item);
+		e.rect = glm::vec4((float)b.size / width, (float)b.size / height, (float)b.x / width,
+			(float)b.y / height);
+		rects[e.key] = e.rect;
+		entries.push_back(e);
+	}
+	upload(blocks.data(), blocks.size());
+
+	texelsBaked += texels.size();
+	raysTraced += rays;
+	bakeTime += traceTime;
+	bakeThreads = (int)jobs->getNumThreads();
+
+	char line[256];
+	snprintf(line, sizeof(line), "lightmap: %llu rays in %.2f s (%.2f Mrays/s), %.2f s in all",
+		(unsigned long long)rays, traceTime, rays / std::max(traceTime, 1e-6) / 1e6, glfwGetTime() - start);
+	std::cerr << line << std::endl;
+
+	LightmapHeader header;
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.count = (unsigned int)entries.size();
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "lightmap: can't write " << path << std::endl;
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)entries.data(), entries.size() * sizeof(LightmapEntry));
+	file.write(blocks.data(), blocks.size());
+	return true;
+}
+
+bool Lightmaps::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	size_t size = (size_t)file.tellg();
+	std::vector<char> data(size);
+	file.seekg(0);
+	file.read(data.data(), size);
+
+	LightmapHeader header;
+	if (size < sizeof(header))
+	{
+		std::cerr << "lightmap: " << path << " is cut short" << std::endl;
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION)
+	{
+		std::cerr << "lightmap: " << path << " is from another version, bake it again" << std::endl;
+		return false;
+	}
+	size_t blockBytes = (size_t)((header.width + 3) / 4) * ((header.height + 3) / 4) * 16;
+	size_t entryBytes = header.count * sizeof(LightmapEntry);
+	if (size != sizeof(header) + entryBytes + blockBytes)
+	{
+		std::cerr << "lightmap: " << path << " is cut short" << std::endl;
+		return false;
+	}
+
+	width = (int)header.width;
+	height = (int)header.height;
+	rects.clear();
+	for (unsigned int i = 0; i < header.count; i++)
+	{
+		LightmapEntry e;
+		memcpy(&e, data.data() + sizeof(header) + i * sizeof(LightmapEntry), sizeof(e));
+		rects[e.key] = e.rect;
+	}
+	upload(data.data() + sizeof(header) + entryBytes, blockBytes);
+	return true;
+}
+
+void Lightmaps::upload(const char* blocks, size_t size)
+{
+	if (!texture)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	MemoryStats::compressedTexImage2D(texture, MemoryTag::TEXTURES, GL_TEXTURE_2D, 0,
+		GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, width, height, (GLsizei)size, blocks);
+	// one level, the squares' gutters only cover bilinear filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	bytes = size;
+}
+
+bool Lightmaps::assign(std::vector<DrawItem>& items) const
+{
+	bool all = true;
+	for (DrawItem& item : items)
+	{
+		item.lightmap = glm::vec4(0);
+		if (item.unlit)
+			continue;
+		if (texture && item.pose == nullptr)
+		{
+			std::unordered_map<unsigned long long, glm::vec4>::const_iterator found = rects.find(itemKey(item));
+			if (found != rects.end())
+			{
+				item.lightmap = found->second;
+				continue;
+			}
+		}
+		all = false;
+	}
+	return all;
+}
+
+GLuint Lightmaps::getTexture() const
+{
+	return texture;
+}
+
+void Lightmaps::report()
+{
+	char line[256];
+	if (texelsBaked > 0)
+	{
+		snprintf(line, sizeof(line), "lightmap: baked %llu texels with %llu rays in %.2f s on %d threads, "
+			"%.2f Mrays/s", texelsBaked, raysTraced, bakeTime, bakeThreads,
+			raysTraced / std::max(bakeTime, 1e-6) / 1e6);
+		std::cerr << line << std::endl;
+	}
+	if (texture)
+	{
+		snprintf(line, sizeof(line), "lightmap: %dx%d atlas, %.2f MB, %u items", width, height,
+			bytes / (1024.0 * 1024.0), (unsigned int)rects.size());
+		std::cerr << line << std::endl;
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef _LIGHTMAPS_H_
+#define _LIGHTMAPS_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <unordered_map>
+
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
+#include "MemoryStats.h"
+
+// Baked lighting for the static meshes. At load every one gets its own
+// lightmap coordinates: its triangles are grouped into charts facing about
+// the same way, each is flattened along that direction and they are packed
+// into a square.
+//
+// bake lays out a square per draw item in one atlas and path traces its
+// texels on all the job system's threads against a bvh of the scene: the
+// point light with soft shadows, one bounce of it off the other surfaces
+// and the ambient with its occlusion. The result is smoothed by an edge
+// stopping filter, grown into the gutters between charts and saved BC3
+// compressed. load puts a saved bake in a texture, then assign points the
+// items it was baked for at their squares. Items are matched by their
+// mesh's geometry and world matrix, one that moved or changed goes back to
+// the runtime lighting until the next bake.
+class Lightmaps
+{
+public:
+	// the texture unit the atlas is bound to in the camera pass
+	static const int TEXTURE_UNIT = 9;
+
+	// splits the vertices along the chart seams and sets their
+	// LightmapCoords, returns the size of the square in texels. 0 leaves
+	// the mesh as it was, when it has no triangles or its charts don't fit.
+	static int unwrap(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	Lightmaps();
+	~Lightmaps();
+
+	// bakes the lit static items of the scene with the point light at
+	// lightPos, uses the result and saves it to path. Reads the textures
+	// back from gl, so it runs on the render thread.
+	bool bake(JobSystem* jobs, const std::vector<DrawItem>& items, glm::vec3 lightPos, const std::string& path);
+	// false when there's no bake at path or it can't be read
+	bool load(const std::string& path);
+
+	// sets the lightmap of every item that was baked, false if a lit item
+	// wasn't and still needs the runtime lighting
+	bool assign(std::vector<DrawItem>& items) const;
+
+	// 0 until something was loaded
+	GLuint getTexture() const;
+
+	// prints the rays and time of the bakes and the atlas in memory
+	void report();
+
+private:
+	GLuint texture;
+	int width, height;
+	size_t bytes; // of the atlas's blocks
+	std::unordered_map<unsigned long long, glm::vec4> rects; // by item key
+
+	unsigned long long texelsBaked, raysTraced;
+	double bakeTime;
+	int bakeThreads;
+
+	static unsigned long long itemKey(const DrawItem& item);
+	void upload(const char* blocks, size_t size);
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "MemoryStats.h"
+
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+MemoryStats::Counter MemoryStats::cpu[NUM_TAGS];
+MemoryStats::Counter MemoryStats::gpu[NUM_TAGS];
+std::unordered_map<GLuint, MemoryStats::ObjectRecord> MemoryStats::buffers;
+std::unordered_map<GLuint, MemoryStats::ObjectRecord> MemoryStats::renderbuffers;
+std::unordered_map<GLuint, MemoryStats::TextureRecord> MemoryStats::textures;
+
+// bytes per texel, three channel formats are stored as four
+static size_t texelSize(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_RED:
+	case GL_R8:
+		return 1;
+	case GL_RG:
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RG16F:
+	case GL_R32F:
+		return 4;
+	case GL_RGB16F:
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGB32F:
+	case GL_RGBA32F:
+		return 16;
+	default:
+		// rgb8, rgba8, srgb and the depth formats
+		return 4;
+	}
+}
+
+void MemoryStats::add(Counter& c, long long bytes)
+{
+	long long live = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	long long peak = c.peak.load(std::memory_order_relaxed);
+	while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+}
+
+void MemoryStats::allocate(MemoryTag tag, size_t bytes)
+{
+	add(cpu[(int)tag], (long long)bytes);
+}
+
+void MemoryStats::release(MemoryTag tag, size_t bytes)
+{
+	add(cpu[(int)tag], -(long long)bytes);
+}
+
+void MemoryStats::setObject(std::unordered_map<GLuint, ObjectRecord>& objects, GLuint name,
+	size_t bytes, MemoryTag tag)
+{
+	ObjectRecord& r = objects[name];
+	if (r.bytes > 0)
+		add(gpu[(int)r.tag], -(long long)r.bytes);
+	r.tag = tag;
+	r.bytes = bytes;
+	add(gpu[(int)tag], (long long)bytes);
+}
+
+void MemoryStats::bufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data,
+	GLenum usage, MemoryTag tag)
+{
+	glBufferData(target, size, data, usage);
+	setObject(buffers, buffer, (size_t)size, tag);
+}
+
+#ifndef __APPLE__
+void MemoryStats::bufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, const void* data,
+	GLbitfield flags, MemoryTag tag)
+{
+	glBufferStorage(target, size, data, flags);
+	setObject(buffers, buffer, (size_t)size, tag);
+}
+#endif
+
+void MemoryStats::deleteBuffers(GLsizei n, const GLuint* names)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		std::unordered_map<GLuint, ObjectRecord>::iterator found = buffers.find(names[i]);
+		if (found == buffers.end())
+			continue;
+		add(gpu[(int)found->second.tag], -(long long)found->second.bytes);
+		buffers.erase(found);
+	}
+	glDeleteBuffers(n, names);
+}
+
+void MemoryStats::setLevel(GLuint texture, MemoryTag tag, GLenum target, GLint level, size_t bytes)
+{
+	if (level < 0 || level >= MAX_LEVELS)
+		return;
+
+	std::unordered_map<GLuint, TextureRecord>::iterator found = textures.find(texture);
+	if (found == textures.end())
+	{
+		TextureRecord r = {};
+		r.tag = tag;
+		found = textures.insert(std::make_pair(texture, r)).first;
+	}
+
+	TextureRecord& r = found->second;
+	int face = target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z ?
+		target - GL_TEXTURE_CUBE_MAP_POSITIVE_X : 0;
+	add(gpu[(int)r.tag], (long long)bytes - (long long)r.levels[face][level]);
+	r.levels[face][level] = bytes;
+}
+
+void MemoryStats::texImage2D(GLuint texture, MemoryTag tag, GLenum target, GLint level,
+	GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data)
+{
+	glTexImage2D(target, level, internalFormat, width, height, 0, format, type, data);
+	setLevel(texture, tag, target, level, (size_t)width * height * texelSize(internalFormat));
+
+	if (level == 0)
+	{
+		TextureRecord& r = textures[texture];
+		r.internalFormat = internalFormat;
+		r.width = width;
+		r.height = height;
+	}
+}
+
+void MemoryStats::compressedTexImage2D(GLuint texture, MemoryTag tag, GLenum target, GLint level,
+	GLenum internalFormat, GLsizei width, GLsizei height, GLsizei size, const void* data)
+{
+	glCompressedTexImage2D(target, level, internalFormat, width, height, 0, size, data);
+	setLevel(texture, tag, target, level, (size_t)size);
+}
+
+void MemoryStats::generateMipmap(GLuint texture, GLenum target)
+{
+	glGenerateMipmap(target);
+
+	std::unordered_map<GLuint, TextureRecord>::iterator found = textures.find(texture);
+	if (found == textures.end())
+		return;
+
+	TextureRecord r = found->second;
+	int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	for (int face = 0; face < faces; face++)
+	{
+		GLenum faceTarget = faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+		GLsizei width = r.width, height = r.height;
+		for (int level = 1; level < MAX_LEVELS && (width > 1 || height > 1); level++)
+		{
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			setLevel(texture, r.tag, faceTarget, level, (size_t)width * height * texelSize(r.internalFormat));
+		}
+	}
+}
+
+void MemoryStats::deleteTextures(GLsizei n, const GLuint* names)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		std::unordered_map<GLuint, TextureRecord>::iterator found = textures.find(names[i]);
+		if (found == textures.end())
+			continue;
+		for (int face = 0; face < 6; face++)
+		{
+			for (int level = 0; level < MAX_LEVELS; level++)
+				add(gpu[(int)found->second.tag], -(long long)found->second.levels[face][level]);
+		}
+		textures.erase(found);
+	}
+	glDeleteTextures(n, names);
+}
+
+void MemoryStats::renderbufferStorage(GLuint renderbuffer, MemoryTag tag, GLenum internalFormat,
+	GLsizei width, GLsizei height)
+{
+	glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+	setObject(renderbuffers, renderbuffer, (size_t)width * height * texelSize(internalFormat), tag);
+}
+
+void MemoryStats::deleteRenderbuffers(GLsizei n, const GLuint* names)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		std::unordered_map<GLuint, ObjectRecord>::iterator found = renderbuffers.find(names[i]);
+		if (found == renderbuffers.end())
+			continue;
+		add(gpu[(int)found->second.tag], -(long long)found->second.bytes);
+		renderbuffers.erase(found);
+	}
+	glDeleteRenderbuffers(n, names);
+}
+
+long long MemoryStats::getCpu(MemoryTag tag)
+{
+	return cpu[(int)tag].live.load(std::memory_order_relaxed);
+}
+
+long long MemoryStats::getGpu(MemoryTag tag)
+{
+	return gpu[(int)tag].live.load(std::memory_order_relaxed);
+}
+
+const char* MemoryStats::tagName(int tag)
+{
+	const char* names[NUM_TAGS] = { "meshes", "textures", "render_targets", "scene_graph", "import",
+		"staging", "collision", "other" };
+	return names[tag];
+}
+
+void MemoryStats::report()
+{
+	std::cerr << "memory (MB)           cpu live   cpu peak   gpu live   gpu peak" << std::endl;
+	for (int i = 0; i < NUM_TAGS; i++)
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "  %-16s %10.2f %10.2f %10.2f %10.2f", tagName(i),
+			cpu[i].live.load() / 1048576.0, cpu[i].peak.load() / 1048576.0,
+			gpu[i].live.load() / 1048576.0, gpu[i].peak.load() / 1048576.0);
+		std::cerr << line << std::endl;
+	}
+}
+
+bool MemoryStats::dumpJson(const std::string& path)
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out)
+	{
+		std::cerr << "Can't write " << path << std::endl;
+		return false;
+	}
+
+	out << "{\n\t\"tags\": {\n";
+	for (int i = 0; i < NUM_TAGS; i++)
+	{
+		out << "\t\t\"" << tagName(i) << "\": { \"cpuLive\": " << cpu[i].live.load()
+			<< ", \"cpuPeak\": " << cpu[i].peak.load() << ", \"gpuLive\": " << gpu[i].live.load()
+			<< ", \"gpuPeak\": " << gpu[i].peak.load() << " }" << (i + 1 < NUM_TAGS ? "," : "") << "\n";
+	}
+	out << "\t},\n\t\"objects\": { \"buffers\": " << buffers.size() << ", \"textures\": "
+		<< textures.size() << ", \"renderbuffers\": " << renderbuffers.size() << " }\n}\n";
+	return (bool)out;
+}
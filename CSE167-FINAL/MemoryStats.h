@@ -0,0 +1,106 @@
+#ifndef _MEMORY_STATS_H_
+#define _MEMORY_STATS_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+
+enum class MemoryTag {
+	MESHES,
+	TEXTURES,
+	RENDER_TARGETS,
+	SCENE_GRAPH,
+	IMPORT, // assimp scenes between import and build
+	STAGING, // readback and upload buffers
+	COLLISION, // bvhs for ray and sweep queries
+	OTHER,
+	NUM_TAGS
+};
+
+// Counts memory by subsystem. Cpu bytes are reported by their owners as
+// they allocate and free, from any thread. Gpu bytes come from the wrappers
+// below, which make the gl call and remember what each buffer, texture
+// level and renderbuffer holds, so deleting one gives its bytes back. The
+// sizes are estimates from the formats, drivers pad and compress as they
+// like. It's a few atomics and a hash map lookup per gl allocation, so it
+// stays on in release builds.
+class MemoryStats
+{
+public:
+	static void allocate(MemoryTag tag, size_t bytes);
+	static void release(MemoryTag tag, size_t bytes);
+
+	// the gl wrappers are for the render thread only, texture and
+	// renderbuffer calls take the name that is bound to target
+	static void bufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data,
+		GLenum usage, MemoryTag tag);
+#ifndef __APPLE__
+	static void bufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, const void* data,
+		GLbitfield flags, MemoryTag tag);
+#endif
+	static void deleteBuffers(GLsizei n, const GLuint* buffers);
+
+	// replaces whatever the level held before, a 0x0 image frees it
+	static void texImage2D(GLuint texture, MemoryTag tag, GLenum target, GLint level,
+		GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type,
+		const void* data);
+	static void compressedTexImage2D(GLuint texture, MemoryTag tag, GLenum target, GLint level,
+		GLenum internalFormat, GLsizei width, GLsizei height, GLsizei size, const void* data);
+	// fills in the levels below level 0 of every face
+	static void generateMipmap(GLuint texture, GLenum target);
+	static void deleteTextures(GLsizei n, const GLuint* textures);
+
+	static void renderbufferStorage(GLuint renderbuffer, MemoryTag tag, GLenum internalFormat,
+		GLsizei width, GLsizei height);
+	static void deleteRenderbuffers(GLsizei n, const GLuint* renderbuffers);
+
+	static long long getCpu(MemoryTag tag);
+	static long long getGpu(MemoryTag tag);
+
+	// live and peak bytes of every tag
+	static void report();
+	static bool dumpJson(const std::string& path);
+
+private:
+	static const int NUM_TAGS = (int)MemoryTag::NUM_TAGS;
+	static const int MAX_LEVELS = 16;
+
+	struct Counter
+	{
+		std::atomic<long long> live, peak;
+	};
+
+	struct TextureRecord
+	{
+		MemoryTag tag;
+		size_t levels[6][MAX_LEVELS]; // by face, level
+		GLenum internalFormat;
+		GLsizei width, height; // of level 0
+	};
+
+	struct ObjectRecord
+	{
+		MemoryTag tag;
+		size_t bytes;
+	};
+
+	static Counter cpu[NUM_TAGS], gpu[NUM_TAGS];
+	static std::unordered_map<GLuint, ObjectRecord> buffers, renderbuffers;
+	static std::unordered_map<GLuint, TextureRecord> textures;
+
+	static void add(Counter& c, long long bytes);
+	static void setObject(std::unordered_map<GLuint, ObjectRecord>& objects, GLuint name,
+		size_t bytes, MemoryTag tag);
+	static void setLevel(GLuint texture, MemoryTag tag, GLenum target, GLint level, size_t bytes);
+	static const char* tagName(int tag);
+};
+
+#endif
@@ -1,13 +1,28 @@
 #include "Mesh.h"
 
 unsigned int Mesh::depthShader;
+bool Mesh::gpuSkinning = true;
+unsigned long long Mesh::nextUid = 1;
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
 {
 	Mesh::vertices = vertices;
 	Mesh::indices = indices;
 	Mesh::textures = textures;
+	boneVbo = 0;
+	skinnedVersion = 0;
+	cpuBytes = 0;
+	materialId = 0;
+	lightmapSize = 0;
+	uid = nextUid++;
+	for (const Texture& t : textures)
+		materialId = materialId * 31 + t.id + 1;
+	computeBounds();
+	computeUvDensity();
+	computeGeometryHash();
+	meshlets.build(Mesh::vertices, Mesh::indices);
 	setupMesh();
+	trackCpu();
 }
 
 void Mesh::draw(GLuint textureProgram, glm::mat4 C)
@@ -17,35 +32,290 @@ void Mesh::draw(GLuint textureProgram, glm::mat4 C)
 	// std::cerr << textures.size() << std::endl;
 	if (textureProgram != depthShader)
 	{
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++)
-		{
-			// activate proper texture before binding
-			glActiveTexture(GL_TEXTURE0 + i);
-			std::string number;
-			std::string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++);
-			// given textures in shader are organized as texture_diffuse#
-			// and texture_specular# for some # of textures
-			glUniform1i(glGetUniformLocation(textureProgram,
-				(name + number).c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
-
-		}
+		bindTextures(textureProgram);
 	}
 	// set parameters of the model for the vertex shader per geometry 
 	glUniformMatrix4fv(glGetUniformLocation(textureProgram, "model"), 1, GL_FALSE, 
 		glm::value_ptr(C * glm::mat4(1)));
 
+	drawElements();
+
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// binds this mesh's textures to the samplers of the given program
+void Mesh::bindTextures(GLuint textureProgram)
+{
+	unsigned int diffuseNr = 1;
+	unsigned int specularNr = 1;
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		// activate proper texture before binding
+		glActiveTexture(GL_TEXTURE0 + i);
+		std::string number;
+		std::string name = textures[i].type;
+		if (name == "texture_diffuse")
+			number = std::to_string(diffuseNr++);
+		else if (name == "texture_specular")
+			number = std::to_string(specularNr++);
+		// given textures in shader are organized as texture_diffuse#
+		// and texture_specular# for some # of textures
+		glUniform1i(glGetUniformLocation(textureProgram,
+			(name + number).c_str()), i);
+		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// issues the draw call, the program and uniforms must already be set
+void Mesh::drawElements()
+{
 	glBindVertexArray(vao);
 	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
 	glBindVertexArray(0);
+}
 
-	glActiveTexture(GL_TEXTURE0);
+void Mesh::drawRanges(const GLsizei* counts, const GLvoid** offsets, GLsizei n)
+{
+	glBindVertexArray(vao);
+	glMultiDrawElements(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, n);
+	glBindVertexArray(0);
+}
+
+unsigned int Mesh::getVao()
+{
+	return vao;
+}
+
+// uploads bone ids and weights as vertex attributes 3 and 4
+void Mesh::setBones(std::vector<VertexBones> bones)
+{
+	Mesh::bones = bones;
+	if (bones.empty())
+		return;
+
+	// the cones only hold for the bind pose
+	meshlets.clear();
+	computeBoneSpheres();
+
+	glBindVertexArray(vao);
+	glGenBuffers(1, &boneVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, boneVbo);
+	MemoryStats::bufferData(GL_ARRAY_BUFFER, boneVbo, sizeof(VertexBones) * bones.size(),
+		bones.data(), GL_STATIC_DRAW, MemoryTag::MESHES);
+
+	// bone ids stay integers in the shader
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 4, GL_INT, sizeof(VertexBones), (void*)0);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBones),
+		(void*)offsetof(VertexBones, weights));
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	trackCpu();
+}
+
+void Mesh::release()
+{
+	glDeleteVertexArrays(1, &vao);
+	MemoryStats::deleteBuffers(1, &vbo);
+	MemoryStats::deleteBuffers(1, &ebo);
+	if (boneVbo)
+		MemoryStats::deleteBuffers(1, &boneVbo);
+	vao = vbo = ebo = boneVbo = 0;
+
+	MemoryStats::release(MemoryTag::MESHES, cpuBytes);
+	cpuBytes = 0;
+}
+
+// the cpu copies stay after upload, for bounds, skinning and picking
+void Mesh::trackCpu()
+{
+	size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+		bones.capacity() * sizeof(VertexBones) + boneSpheres.capacity() * sizeof(glm::vec4) +
+		skinned.capacity() * sizeof(Vertex) +
+		textures.capacity() * sizeof(Texture) + meshlets.getBytes();
+	if (bytes > cpuBytes)
+		MemoryStats::allocate(MemoryTag::MESHES, bytes - cpuBytes);
+	else
+		MemoryStats::release(MemoryTag::MESHES, cpuBytes - bytes);
+	cpuBytes = bytes;
+}
+
+bool Mesh::isSkinned()
+{
+	return !bones.empty();
+}
+
+void Mesh::skinCpu(const std::vector<glm::mat4>& palette, unsigned long long version)
+{
+	// both passes draw the same pose, only skin it once
+	if (bones.empty() || version == skinnedVersion)
+		return;
+	skinnedVersion = version;
+
+	if (skinned.size() != vertices.size())
+	{
+		skinned.resize(vertices.size());
+		trackCpu();
+	}
+	for (unsigned int i = 0; i < vertices.size(); i++)
+	{
+		glm::mat4 skin(0);
+		for (int j = 0; j < 4; j++)
+		{
+			if (bones[i].weights[j] > 0)
+				skin += palette[bones[i].ids[j]] * bones[i].weights[j];
+		}
+
+		skinned[i] = vertices[i];
+		skinned[i].Position = glm::vec3(skin * glm::vec4(vertices[i].Position, 1.f));
+		skinned[i].Normal = glm::normalize(glm::mat3(skin) * vertices[i].Normal);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * skinned.size(), skinned.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// bounding sphere around the center of the vertices' bounding box
+void Mesh::computeBounds()
+{
+	center = glm::vec3(0);
+	radius = 0;
+	if (vertices.empty())
+		return;
+
+	glm::vec3 minPt = vertices[0].Position;
+	glm::vec3 maxPt = vertices[0].Position;
+	for (const Vertex& v : vertices)
+	{
+		minPt = glm::min(minPt, v.Position);
+		maxPt = glm::max(maxPt, v.Position);
+	}
+	center = (minPt + maxPt) * 0.5f;
+
+	for (const Vertex& v : vertices)
+		radius = glm::max(radius, glm::length(v.Position - center));
+}
+
+// a skinned vertex is a weighted average of where each of its bones puts
+// it, so it stays inside the spheres of its bones carried along by them
+void Mesh::computeBoneSpheres()
+{
+	boneSpheres.clear();
+	std::vector<glm::vec3> minPts, maxPts;
+	for (unsigned int i = 0; i < bones.size(); i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			if (bones[i].weights[j] <= 0)
+				continue;
+			unsigned int b = bones[i].ids[j];
+			if (b >= boneSpheres.size())
+			{
+				boneSpheres.resize(b + 1, glm::vec4(0, 0, 0, -1));
+				minPts.resize(b + 1);
+				maxPts.resize(b + 1);
+			}
+			glm::vec3 p = vertices[i].Position;
+			minPts[b] = boneSpheres[b].w < 0 ? p : glm::min(minPts[b], p);
+			maxPts[b] = boneSpheres[b].w < 0 ? p : glm::max(maxPts[b], p);
+			boneSpheres[b].w = 0;
+		}
+	}
+
+	for (unsigned int b = 0; b < boneSpheres.size(); b++)
+	{
+		if (boneSpheres[b].w < 0)
+			continue;
+		boneSpheres[b] = glm::vec4((minPts[b] + maxPts[b]) * 0.5f, 0);
+	}
+	for (unsigned int i = 0; i < bones.size(); i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			if (bones[i].weights[j] <= 0)
+				continue;
+			glm::vec4& s = boneSpheres[bones[i].ids[j]];
+			s.w = glm::max(s.w, glm::length(vertices[i].Position - glm::vec3(s)));
+		}
+	}
+}
+
+// the box around the bone spheres moved by the palette, then the sphere
+// around the box's center holding all of them
+void Mesh::posedBounds(const std::vector<glm::mat4>& palette, glm::vec3& posedCenter, float& posedRadius) const
+{
+	posedCenter = center;
+	posedRadius = radius;
+
+	unsigned int n = (unsigned int)glm::min(boneSpheres.size(), palette.size());
+	bool any = false;
+	glm::vec3 minPt(0), maxPt(0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (unsigned int b = 0; b < n; b++)
+		{
+			if (boneSpheres[b].w < 0)
+				continue;
+			const glm::mat4& P = palette[b];
+			float scale = glm::max(glm::length(glm::vec3(P[0])),
+				glm::max(glm::length(glm::vec3(P[1])), glm::length(glm::vec3(P[2]))));
+			glm::vec3 c = glm::vec3(P * glm::vec4(glm::vec3(boneSpheres[b]), 1.f));
+			float r = boneSpheres[b].w * scale;
+
+			if (pass == 0)
+			{
+				minPt = any ? glm::min(minPt, c - r) : c - r;
+				maxPt = any ? glm::max(maxPt, c + r) : c + r;
+				any = true;
+			}
+			else
+				posedRadius = glm::max(posedRadius, glm::length(c - posedCenter) + r);
+		}
+		if (!any)
+			return;
+		if (pass == 0)
+		{
+			posedCenter = (minPt + maxPt) * 0.5f;
+			posedRadius = 0;
+		}
+	}
+}
+
+// average over the surface, ratio of texture area to triangle area
+void Mesh::computeUvDensity()
+{
+	float uvArea = 0, area = 0;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex& a = vertices[indices[i]];
+		const Vertex& b = vertices[indices[i + 1]];
+		const Vertex& c = vertices[indices[i + 2]];
+		area += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+
+		glm::vec2 e1 = b.TexCoords - a.TexCoords, e2 = c.TexCoords - a.TexCoords;
+		uvArea += glm::abs(e1.x * e2.y - e1.y * e2.x);
+	}
+	uvDensity = area > 0 ? glm::sqrt(uvArea / area) : 0;
+}
+
+// fnv-1a over the bytes of the positions and indices
+void Mesh::computeGeometryHash()
+{
+	geometryHash = 14695981039346656037ull;
+	auto add = [this](const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+			geometryHash = (geometryHash ^ bytes[i]) * 1099511628211ull;
+	};
+	for (const Vertex& v : vertices)
+		add(&v.Position, sizeof(v.Position));
+	add(indices.data(), indices.size() * sizeof(unsigned int));
 }
 
 void Mesh::setupMesh()
@@ -64,8 +334,8 @@ void Mesh::setupMesh()
 	// Bind to the first VBO. We will use it to store the points.
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	// Pass in the data.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(),
-		&vertices[0], GL_STATIC_DRAW);
+	MemoryStats::bufferData(GL_ARRAY_BUFFER, vbo, sizeof(Vertex) * vertices.size(),
+		&vertices[0], GL_STATIC_DRAW, MemoryTag::MESHES);
 
 	// Enable vertex attribute 0. 
 	// We will be able to access points through it.
@@ -79,13 +349,16 @@ void Mesh::setupMesh()
 	// vertex texture coordinates
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	// lightmap coordinates, zero unless the mesh was unwrapped
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
 
 
 	// Bind EBO as an element array buffer
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-		indices.data(), GL_STATIC_DRAW);
+	MemoryStats::bufferData(GL_ELEMENT_ARRAY_BUFFER, ebo, sizeof(unsigned int) * indices.size(),
+		indices.data(), GL_STATIC_DRAW, MemoryTag::MESHES);
 
 	// Unbind from the VBO.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -14,10 +14,20 @@
 #include <string>
 #include <iostream>
 
+#include "MemoryStats.h"
+#include "Meshlets.h"
+
 struct Vertex {
 	glm::vec3 Position;
 	glm::vec3 Normal;
 	glm::vec2 TexCoords;
+	glm::vec2 LightmapCoords; // in the mesh's own lightmap square, see Lightmaps.h
+};
+
+// up to four bones influencing a vertex, unused slots have weight 0
+struct VertexBones {
+	glm::ivec4 ids;
+	glm::vec4 weights;
 };
 
 struct Texture {
@@ -31,16 +41,73 @@ class Mesh
 public:
 	static unsigned int depthShader;
 
+	// size of the bones uniform array in shaders/skinning.glsl
+	static const int MAX_BONES = 100;
+	// false when the vertex shader can't hold the bone palette
+	static bool gpuSkinning;
+	static unsigned long long nextUid;
+
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	std::vector<VertexBones> bones; // empty unless the mesh is skinned
+	// per bone slot, the bind pose sphere around the vertices it moves, w is
+	// the radius and negative for bones that move none
+	std::vector<glm::vec4> boneSpheres;
+
+	// local space bounding sphere, used for culling
+	glm::vec3 center;
+	float radius;
+
+	// texture coordinate units per local unit, for texture streaming
+	float uvDensity;
+
+	// hash of the texture ids, meshes with the same id share a material
+	unsigned int materialId;
+
+	// never reused, unlike addresses and gl names, copies of the geometry
+	// elsewhere are keyed by it
+	unsigned long long uid;
+
+	// clusters of the triangles for culling parts of the mesh, none once
+	// it's skinned
+	Meshlets meshlets;
+
+	// texels across the square its LightmapCoords span, 0 without them
+	int lightmapSize;
+	// of the positions and indices, the same from run to run unlike uid,
+	// baked lightmaps are matched to meshes by it
+	unsigned long long geometryHash;
 
 	Mesh(std::vector <Vertex> vertices, std::vector<unsigned int> indices,
 		std::vector<Texture> textures);
 	void draw(GLuint textureProgram, glm::mat4 C);
+
+	void bindTextures(GLuint textureProgram);
+	void drawElements();
+	// draws n ranges of the indices, offsets are in bytes
+	void drawRanges(const GLsizei* counts, const GLvoid** offsets, GLsizei n);
+	unsigned int getVao();
+	// deletes the gl buffers, the mesh can't be drawn after this
+	void release();
+
+	void setBones(std::vector<VertexBones> bones);
+	bool isSkinned();
+	// skins the vertices on the cpu into the vertex buffer, once per pose version
+	void skinCpu(const std::vector<glm::mat4>& palette, unsigned long long version);
+	// local space bounding sphere of the posed mesh, from its bone spheres
+	void posedBounds(const std::vector<glm::mat4>& palette, glm::vec3& posedCenter, float& posedRadius) const;
 private:
-	unsigned int vao, vbo, ebo;
+	unsigned int vao, vbo, ebo, boneVbo;
+	unsigned long long skinnedVersion;
+	std::vector<Vertex> skinned;
+	size_t cpuBytes; // of the vectors above, as told to MemoryStats
 
 	void setupMesh();
+	void trackCpu();
+	void computeBounds();
+	void computeBoneSpheres();
+	void computeUvDensity();
+	void computeGeometryHash();
 };
 #endif
@@ -0,0 +1,430 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "Mesh.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define MESHLET_SSE
+#endif
+
+// floats per block of four clusters
+static const int BLOCK_FLOATS = 32;
+
+// smallest cosine between a triangle's normal and its cluster's average.
+// Flatter clusters cull more of what faces away but come out smaller.
+static const float CONE_LIMIT = 0.7f;
+
+// how much model scales distances and if it keeps angles, else the cones
+// don't hold. facing is -1 when it mirrors, which flips the winding.
+static void modelScale(const glm::mat4& model, float& scale, bool& uniform, float& facing)
+{
+	float sx = glm::length(glm::vec3(model[0]));
+	float sy = glm::length(glm::vec3(model[1]));
+	float sz = glm::length(glm::vec3(model[2]));
+	scale = glm::max(sx, glm::max(sy, sz));
+	uniform = scale - glm::min(sx, glm::min(sy, sz)) <= scale * 0.01f;
+	facing = glm::determinant(glm::mat3(model)) < 0 ? -1.f : 1.f;
+}
+
+// bounding sphere around the center of the triangles' box, like Mesh's
+static void triangleBounds(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	const std::vector<unsigned int>& triangles, glm::vec3& center, float& radius)
+{
+	glm::vec3 minPt = vertices[indices[triangles[0] * 3]].Position;
+	glm::vec3 maxPt = minPt;
+	for (unsigned int t : triangles)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			minPt = glm::min(minPt, vertices[indices[t * 3 + k]].Position);
+			maxPt = glm::max(maxPt, vertices[indices[t * 3 + k]].Position);
+		}
+	}
+	center = (minPt + maxPt) * 0.5f;
+	radius = 0;
+	for (unsigned int t : triangles)
+	{
+		for (int k = 0; k < 3; k++)
+			radius = glm::max(radius, glm::length(vertices[indices[t * 3 + k]].Position - center));
+	}
+}
+
+// vertices at the same position are one, the meshes split them along uv
+// and normal seams
+void TriangleAdjacency::build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+	std::vector<unsigned int> order(vertices.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+	{
+		const glm::vec3& p = vertices[a].Position;
+		const glm::vec3& q = vertices[b].Position;
+		if (p.x != q.x)
+			return p.x < q.x;
+		if (p.y != q.y)
+			return p.y < q.y;
+		return p.z < q.z;
+	});
+	weld.resize(vertices.size());
+	numWelded = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		if (i > 0 && vertices[order[i]].Position != vertices[order[i - 1]].Position)
+			numWelded++;
+		weld[order[i]] = numWelded;
+	}
+	numWelded++;
+
+	// the triangles around each welded vertex
+	first.assign(numWelded + 1, 0);
+	for (unsigned int index : indices)
+		first[weld[index] + 1]++;
+	for (unsigned int w = 0; w < numWelded; w++)
+		first[w + 1] += first[w];
+	around.resize(indices.size());
+	std::vector<unsigned int> cursor(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		around[cursor[weld[indices[i]]]++] = (unsigned int)(i / 3);
+}
+
+// Grows each cluster from the first triangle not taken yet, adding the
+// neighbour closest to its center and facing its way most, so clusters come
+// out round and flat, which keeps the spheres and cones tight.
+void Meshlets::build(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	clear();
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles <= MAX_TRIANGLES || indices.size() % 3 != 0)
+		return;
+
+	TriangleAdjacency adjacency;
+	adjacency.build(vertices, indices);
+	const std::vector<unsigned int>& weld = adjacency.weld;
+	const std::vector<unsigned int>& first = adjacency.first;
+	const std::vector<unsigned int>& around = adjacency.around;
+
+	std::vector<glm::vec3> normals(numTriangles), centroids(numTriangles);
+	for (size_t t = 0; t < numTriangles; t++)
+	{
+		glm::vec3 a = vertices[indices[t * 3]].Position;
+		glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+		glm::vec3 c = vertices[indices[t * 3 + 2]].Position;
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		normals[t] = length > 0 ? n / length : glm::vec3(0);
+		centroids[t] = (a + b + c) / 3.f;
+	}
+
+	std::vector<char> used(numTriangles, 0);
+	std::vector<unsigned int> inCluster(adjacency.numWelded, ~0u); // last cluster grown over a vertex
+	std::vector<unsigned int> cluster, candidates, pending;
+	glm::vec3 pendingNormal(0);
+	std::vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+	unsigned int next = 0, grown = 0;
+
+	while (true)
+	{
+		while (next < numTriangles && used[next])
+			next++;
+		if (next == numTriangles)
+			break;
+
+		unsigned int id = grown++;
+		glm::vec3 centroidSum(0), normalSum(0);
+		cluster.clear();
+		candidates.clear();
+		unsigned int triangle = next;
+		while (true)
+		{
+			used[triangle] = 1;
+			cluster.push_back(triangle);
+			centroidSum += centroids[triangle];
+			normalSum += normals[triangle];
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int w = weld[indices[triangle * 3 + k]];
+				if (inCluster[w] == id)
+					continue;
+				inCluster[w] = id;
+				for (unsigned int j = first[w]; j < first[w + 1]; j++)
+				{
+					if (!used[around[j]])
+						candidates.push_back(around[j]);
+				}
+			}
+			if (cluster.size() == MAX_TRIANGLES)
+				break;
+
+			glm::vec3 centroid = centroidSum / (float)cluster.size();
+			float normalLength = glm::length(normalSum);
+			glm::vec3 axis = normalLength > 0 ? normalSum / normalLength : glm::vec3(0);
+
+			// sharing an edge beats sharing a corner
+			int best = -1;
+			float bestScore = 0;
+			for (size_t c = 0; c < candidates.size(); )
+			{
+				unsigned int t = candidates[c];
+				if (used[t])
+				{
+					candidates[c] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				// a cluster bent too far has no cone left to cull with
+				if (glm::dot(normals[t], axis) < CONE_LIMIT)
+				{
+					c++;
+					continue;
+				}
+				int shared = 0;
+				for (int k = 0; k < 3; k++)
+					shared += inCluster[weld[indices[t * 3 + k]]] == id;
+				float score = glm::length(centroids[t] - centroid) *
+					(2.f - glm::dot(normals[t], axis)) / shared;
+				if (best < 0 || score < bestScore)
+				{
+					best = (int)t;
+					bestScore = score;
+				}
+				c++;
+			}
+			// nothing next to it left that fits
+			if (best < 0)
+				break;
+			triangle = (unsigned int)best;
+		}
+
+		// small pieces of the mesh join the last cluster if they're next to
+		// it and the cone still holds
+		if (!pending.empty() && pending.size() + cluster.size() <= MAX_TRIANGLES)
+		{
+			glm::vec3 sum = pendingNormal + normalSum;
+			float length = glm::length(sum);
+			glm::vec3 axis = length > 0 ? sum / length : glm::vec3(0);
+			bool flat = length > 0;
+			for (size_t i = 0; i < pending.size() + cluster.size() && flat; i++)
+			{
+				unsigned int t = i < pending.size() ? pending[i] : cluster[i - pending.size()];
+				flat = normals[t] == glm::vec3(0) || glm::dot(normals[t], axis) >= CONE_LIMIT;
+			}
+			glm::vec3 center, pendingCenter;
+			float radius, pendingRadius;
+			triangleBounds(vertices, indices, cluster, center, radius);
+			triangleBounds(vertices, indices, pending, pendingCenter, pendingRadius);
+			if (flat && glm::length(center - pendingCenter) <= radius + pendingRadius)
+			{
+				pending.insert(pending.end(), cluster.begin(), cluster.end());
+				pendingNormal = sum;
+				continue;
+			}
+		}
+		if (!pending.empty())
+			emit(vertices, indices, pending, pendingNormal, reordered);
+		pending.swap(cluster);
+		pendingNormal = normalSum;
+	}
+	if (!pending.empty())
+		emit(vertices, indices, pending, pendingNormal, reordered);
+	indices.swap(reordered);
+
+	size_t numBlocks = (clusters.size() + 3) / 4;
+	blocks.assign(numBlocks * BLOCK_FLOATS, 0.f);
+	for (size_t i = 0; i < numBlocks * 4; i++)
+	{
+		float* block = &blocks[(i / 4) * BLOCK_FLOATS + i % 4];
+		if (i >= clusters.size())
+		{
+			// a radius no plane distance is above
+			block[12] = -1e30f;
+			continue;
+		}
+		const Meshlet& m = clusters[i];
+		block[0] = m.center.x;
+		block[4] = m.center.y;
+		block[8] = m.center.z;
+		block[12] = m.radius;
+		block[16] = m.coneAxis.x;
+		block[20] = m.coneAxis.y;
+		block[24] = m.coneAxis.z;
+		block[28] = m.coneCutoff;
+	}
+}
+
+// adds a cluster of triangles, its indices go to the end of reordered
+void Meshlets::emit(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	const std::vector<unsigned int>& triangles, glm::vec3 normalSum, std::vector<unsigned int>& reordered)
+{
+	Meshlet m;
+	m.firstIndex = (unsigned int)reordered.size();
+	m.indexCount = (unsigned int)triangles.size() * 3;
+	for (unsigned int t : triangles)
+	{
+		for (int k = 0; k < 3; k++)
+			reordered.push_back(indices[t * 3 + k]);
+	}
+	triangleBounds(vertices, indices, triangles, m.center, m.radius);
+
+	// the cone around the average normal, too wide a cone means some
+	// triangle always faces the camera
+	float normalLength = glm::length(normalSum);
+	m.coneAxis = normalLength > 0 ? normalSum / normalLength : glm::vec3(0, 0, 1);
+	float minDot = normalLength > 0 ? 1.f : -1.f;
+	for (unsigned int t : triangles)
+	{
+		const Vertex& a = vertices[indices[t * 3]];
+		const Vertex& b = vertices[indices[t * 3 + 1]];
+		const Vertex& c = vertices[indices[t * 3 + 2]];
+		glm::vec3 n = glm::cross(b.Position - a.Position, c.Position - a.Position);
+		if (n != glm::vec3(0))
+			minDot = glm::min(minDot, glm::dot(glm::normalize(n), m.coneAxis));
+	}
+	m.coneCutoff = minDot > 0.05f ? glm::sqrt(1.f - minDot * minDot) : 1.f;
+	clusters.push_back(m);
+}
+
+void Meshlets::clear()
+{
+	clusters.clear();
+	clusters.shrink_to_fit();
+	blocks.clear();
+	blocks.shrink_to_fit();
+}
+
+// Tests in the mesh's local space, the planes and the eye are moved there
+// once instead of moving every cluster out. A cluster faces away if the
+// whole cone does from every point of its sphere, conservatively
+// dot(axis, d) > cutoff * |d| + radius * (1 + cutoff) with d from the eye
+// to the center.
+void Meshlets::cull(const glm::mat4& model, const Frustum& frustum, glm::vec3 viewPos, bool backfaces,
+	std::vector<char>& visible, ClusterStats& stats) const
+{
+	size_t n = clusters.size();
+	visible.assign(n, 0);
+
+	float scale, facing;
+	bool uniform;
+	modelScale(model, scale, uniform, facing);
+	bool cones = backfaces && uniform;
+
+	// a plane of model's space whose distances are still in world units
+	glm::mat4 transposed = glm::transpose(model);
+	glm::vec4 planes[6];
+	for (int i = 0; i < 6; i++)
+		planes[i] = transposed * frustum.getPlanes()[i];
+	glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(viewPos, 1.f));
+
+	for (size_t b = 0; b * 4 < n; b++)
+	{
+		int outside = 0, away = 0;
+#ifdef MESHLET_SSE
+		const float* block = &blocks[b * BLOCK_FLOATS];
+		__m128 cx = _mm_loadu_ps(block);
+		__m128 cy = _mm_loadu_ps(block + 4);
+		__m128 cz = _mm_loadu_ps(block + 8);
+		__m128 r = _mm_loadu_ps(block + 12);
+
+		__m128 limit = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(r, _mm_set1_ps(scale)));
+		__m128 out = _mm_setzero_ps();
+		for (int i = 0; i < 6; i++)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[i].x)),
+				_mm_mul_ps(cy, _mm_set1_ps(planes[i].y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[i].z)), _mm_set1_ps(planes[i].w)));
+			out = _mm_or_ps(out, _mm_cmplt_ps(d, limit));
+		}
+		outside = _mm_movemask_ps(out);
+
+		if (cones)
+		{
+			__m128 dx = _mm_sub_ps(cx, _mm_set1_ps(eye.x));
+			__m128 dy = _mm_sub_ps(cy, _mm_set1_ps(eye.y));
+			__m128 dz = _mm_sub_ps(cz, _mm_set1_ps(eye.z));
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+				_mm_mul_ps(dz, dz)));
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(block + 16)),
+				_mm_mul_ps(dy, _mm_loadu_ps(block + 20))), _mm_mul_ps(dz, _mm_loadu_ps(block + 24)));
+			along = _mm_mul_ps(along, _mm_set1_ps(facing));
+			__m128 cutoff = _mm_loadu_ps(block + 28);
+			__m128 bound = _mm_add_ps(_mm_mul_ps(cutoff, length),
+				_mm_mul_ps(r, _mm_add_ps(_mm_set1_ps(1.f), cutoff)));
+			away = _mm_movemask_ps(_mm_cmpgt_ps(along, bound));
+		}
+#else
+		for (size_t j = 0; j < 4 && b * 4 + j < n; j++)
+		{
+			const Meshlet& m = clusters[b * 4 + j];
+			for (int i = 0; i < 6; i++)
+			{
+				if (glm::dot(glm::vec3(planes[i]), m.center) + planes[i].w < -m.radius * scale)
+					outside |= 1 << j;
+			}
+			if (cones)
+			{
+				glm::vec3 d = m.center - eye;
+				if (facing * glm::dot(m.coneAxis, d) >
+					m.coneCutoff * glm::length(d) + m.radius * (1.f + m.coneCutoff))
+					away |= 1 << j;
+			}
+		}
+#endif
+
+		for (size_t j = 0; j < 4 && b * 4 + j < n; j++)
+		{
+			const Meshlet& m = clusters[b * 4 + j];
+			unsigned int triangles = m.indexCount / 3;
+			stats.triangles += triangles;
+			if (outside & (1 << j))
+				stats.outside += triangles;
+			else if (away & (1 << j))
+				stats.backfacing += triangles;
+			else
+				visible[b * 4 + j] = 1;
+		}
+	}
+}
+
+void Meshlets::worldBounds(const glm::mat4& model, std::vector<glm::vec4>& spheres,
+	std::vector<glm::vec4>& cones) const
+{
+	float scale, facing;
+	bool uniform;
+	modelScale(model, scale, uniform, facing);
+	glm::mat3 rotation(model);
+
+	spheres.clear();
+	cones.clear();
+	for (const Meshlet& m : clusters)
+	{
+		spheres.push_back(glm::vec4(glm::vec3(model * glm::vec4(m.center, 1.f)), m.radius * scale));
+		if (uniform && m.coneCutoff < 1.f)
+			cones.push_back(glm::vec4(glm::normalize(rotation * m.coneAxis) * facing, m.coneCutoff));
+		else
+			cones.push_back(glm::vec4(0, 0, 0, 1));
+	}
+}
+
+size_t Meshlets::getBytes() const
+{
+	return clusters.capacity() * sizeof(Meshlet) + blocks.capacity() * sizeof(float);
+}
+
+void Meshlets::report(const char* name, const ClusterStats& stats)
+{
+	if (stats.triangles == 0)
+		return;
+
+	double total = (double)stats.triangles;
+	char line[256];
+	snprintf(line, sizeof(line), "%s: clusters rejected %.1f%% of %llu triangles, "
+		"%.1f%% outside the frustum, %.1f%% facing away, %.1f%% occluded", name,
+		(stats.outside + stats.backfacing + stats.occluded) * 100.0 / total, stats.triangles,
+		stats.outside * 100.0 / total, stats.backfacing * 100.0 / total, stats.occluded * 100.0 / total);
+	std::cerr << line << std::endl;
+}
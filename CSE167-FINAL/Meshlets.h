@@ -0,0 +1,83 @@
+#ifndef _MESHLETS_H_
+#define _MESHLETS_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Frustum.h"
+
+struct Vertex;
+
+// A cluster of neighbouring triangles, a range of its mesh's indices
+struct Meshlet
+{
+	// local space bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	// every face normal is within the cone around axis. cutoff is the sine
+	// of its half angle, 1 when the cluster can't all face away at once.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+
+	unsigned int firstIndex, indexCount;
+};
+
+// The triangles sharing each vertex of a mesh, counting the vertices at
+// the same position as one. The ones around welded vertex w are around
+// from first[w] up to first[w + 1].
+struct TriangleAdjacency
+{
+	std::vector<unsigned int> weld; // per vertex, its welded one
+	std::vector<unsigned int> first, around;
+	unsigned int numWelded;
+
+	void build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+};
+
+// triangles of the clustered meshes that got past the per object tests,
+// and how many of those the clusters threw away
+struct ClusterStats
+{
+	unsigned long long triangles, outside, backfacing, occluded;
+};
+
+// The clusters of one static mesh. Built once at load, they let a pass
+// draw only the parts of a big mesh inside the frustum and facing the
+// camera instead of all of it.
+class Meshlets
+{
+public:
+	static const int MAX_TRIANGLES = 124;
+
+	std::vector<Meshlet> clusters; // empty when the mesh is a single cluster
+
+	// groups the triangles into clusters and reorders indices so every
+	// cluster is a range of them
+	void build(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+	void clear();
+
+	// one flag per cluster of a mesh drawn with model, set if it's inside
+	// frustum and, with backfaces, if any of it faces viewPos
+	void cull(const glm::mat4& model, const Frustum& frustum, glm::vec3 viewPos, bool backfaces,
+		std::vector<char>& visible, ClusterStats& stats) const;
+
+	// the clusters' bounds under model, for culling them elsewhere
+	void worldBounds(const glm::mat4& model, std::vector<glm::vec4>& spheres,
+		std::vector<glm::vec4>& cones) const;
+
+	size_t getBytes() const;
+
+	static void report(const char* name, const ClusterStats& stats);
+
+private:
+	// the bounds again four clusters at a time, each block is the centers'
+	// x, y, z, radii, cone axes' x, y, z and cutoffs. The last block is
+	// padded with clusters that are always outside.
+	std::vector<float> blocks;
+
+	void emit(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		const std::vector<unsigned int>& triangles, glm::vec3 normalSum, std::vector<unsigned int>& reordered);
+};
+
+#endif
@@ -1,11 +1,56 @@
 #include "Model.h"
+#include "RenderQueue.h"
+#include "Lightmaps.h"
+
+// the vertex streams and faces of every mesh, close enough to what assimp
+// holds on to
+static size_t importBytes(const aiScene* scene)
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+		size_t streams = 1 + (mesh->HasNormals() ? 1 : 0) + (mesh->HasTangentsAndBitangents() ? 2 : 0) +
+			mesh->GetNumUVChannels();
+		bytes += mesh->mNumVertices * (streams * sizeof(aiVector3D) +
+			mesh->GetNumColorChannels() * sizeof(aiColor4D));
+		bytes += mesh->mNumFaces * (sizeof(aiFace) + 3 * sizeof(unsigned int));
+		for (unsigned int b = 0; b < mesh->mNumBones; b++)
+			bytes += sizeof(aiBone) + mesh->mBones[b]->mNumWeights * sizeof(aiVertexWeight);
+	}
+	return bytes;
+}
 
 Model::Model(std::string filePath, glm::mat4 model)
 {
+	skeleton = nullptr;
+	pose = nullptr;
 	loadModel(filePath);
 	Model::model = model;
 }
 
+Model::Model(std::string filePath, glm::mat4 model, const aiScene* scene)
+{
+	skeleton = nullptr;
+	pose = nullptr;
+	if (scene != nullptr)
+		build(scene, filePath);
+	Model::model = model;
+}
+
+Model::~Model()
+{
+	for (Mesh& m : meshes)
+		m.release();
+	// one load2D per path, the meshes share these
+	for (Texture& t : textures_loaded)
+		TextureCache::release2D(t.id);
+	delete pose;
+	for (AnimationClip* clip : clips)
+		delete clip;
+	delete skeleton;
+}
+
 // loops and draws each mesh
 void Model::draw(glm::mat4 C, unsigned int shaderProgram)
 {
@@ -20,9 +65,40 @@ void Model::update(glm::mat4 C)
 {
 }
 
-void Model::loadModel(std::string path)
+// one draw item per mesh, drawing is left to the render queues
+void Model::collect(glm::mat4 C, std::vector<DrawItem>& items)
+{
+	glm::mat4 M = C * model;
+
+	for (Mesh& m : meshes)
+	{
+		DrawItem item;
+		item.mesh = &m;
+		item.model = M;
+		item.unlit = false;
+		item.castShadow = true;
+		item.pose = m.isSkinned() ? pose : nullptr;
+		item.depth = 0;
+		item.key = 0;
+		item.firstRange = item.numRanges = 0;
+		item.lightmap = glm::vec4(0);
+
+		// animated meshes are bounded by where the pose put their bones
+		if (item.pose != nullptr)
+		{
+			glm::vec3 center;
+			float radius;
+			m.posedBounds(item.pose->palette, center, radius);
+			RenderQueue::computeBounds(item, center, radius);
+		}
+		else
+			RenderQueue::computeBounds(item);
+		items.push_back(item);
+	}
+}
+
+const aiScene* Model::import(Assimp::Importer& importer, const std::string& path)
 {
-	Assimp::Importer importer;
 	// draw model with only triangles, and flip textures reversed on y-axis
 	// where appropriate
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate |
@@ -32,12 +108,67 @@ void Model::loadModel(std::string path)
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
 		std::cerr << "Assimp Error::" << importer.GetErrorString() << std::endl;
-		return;
+		return nullptr;
 	}
+	MemoryStats::allocate(MemoryTag::IMPORT, importBytes(scene));
+	return scene;
+}
+
+void Model::releaseImport(const aiScene* scene)
+{
+	if (scene != nullptr)
+		MemoryStats::release(MemoryTag::IMPORT, importBytes(scene));
+}
+
+void Model::loadModel(std::string path)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = import(importer, path);
+	if (scene != nullptr)
+		build(scene, path);
+	releaseImport(scene);
+}
+
+// makes the meshes, textures and skeleton, must run on the render thread
+void Model::build(const aiScene* scene, const std::string& path)
+{
 	// get directory path of given file
 	directory = path.substr(0, path.find_last_of('/'));
 
+	// skinned meshes need the node hierarchy to find their bones in
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		if (scene->mMeshes[i]->HasBones())
+		{
+			skeleton = new Skeleton(scene);
+			break;
+		}
+	}
+
 	processNode(scene->mRootNode, scene);
+
+	if (skeleton != nullptr)
+	{
+		for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+			clips.push_back(new AnimationClip(scene->mAnimations[i], skeleton));
+
+		pose = new AnimationInstance(skeleton, clips.empty() ? nullptr : clips[0]);
+		pose->evaluate(0);
+	}
+}
+
+AnimationInstance* Model::getPose()
+{
+	return pose;
+}
+
+void Model::playClip(unsigned int index)
+{
+	if (pose == nullptr || index >= clips.size())
+		return;
+
+	pose->clip = clips[index];
+	pose->time = 0;
 }
 
 void Model::processNode(aiNode* node, const aiScene* scene)
@@ -91,6 +222,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		{
 			vertex.TexCoords = glm::vec2(0.f, 0.f);
 		}
+		vertex.LightmapCoords = glm::vec2(0.f, 0.f);
 
 		vertices.push_back(vertex);
 	}
@@ -119,7 +251,61 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 
 	}
 
-	return Mesh(vertices, indices, textures);
+	// static meshes get their own lightmap coordinates, skinned ones move
+	// out from under any baked light and keep the runtime lighting
+	bool skinned = skeleton != nullptr && mesh->HasBones();
+	int lightmapSize = skinned ? 0 : Lightmaps::unwrap(vertices, indices);
+
+	Mesh m(vertices, indices, textures);
+	m.lightmapSize = lightmapSize;
+	if (skinned)
+		m.setBones(processBones(mesh));
+	return m;
+}
+
+// keeps the four strongest influences per vertex, normalized to sum to 1
+std::vector<VertexBones> Model::processBones(aiMesh* mesh)
+{
+	VertexBones empty;
+	empty.ids = glm::ivec4(0);
+	empty.weights = glm::vec4(0);
+	std::vector<VertexBones> bones(mesh->mNumVertices, empty);
+
+	for (unsigned int b = 0; b < mesh->mNumBones; b++)
+	{
+		aiBone* bone = mesh->mBones[b];
+		int slot = skeleton->addBone(bone->mName.C_Str(), Skeleton::toGlm(bone->mOffsetMatrix));
+		if (slot < 0)
+			continue;
+
+		for (unsigned int w = 0; w < bone->mNumWeights; w++)
+		{
+			VertexBones& v = bones[bone->mWeights[w].mVertexId];
+			float weight = bone->mWeights[w].mWeight;
+
+			// replace the weakest influence if this one is stronger
+			int weakest = 0;
+			for (int j = 1; j < 4; j++)
+			{
+				if (v.weights[j] < v.weights[weakest])
+					weakest = j;
+			}
+			if (weight > v.weights[weakest])
+			{
+				v.ids[weakest] = slot;
+				v.weights[weakest] = weight;
+			}
+		}
+	}
+
+	for (VertexBones& v : bones)
+	{
+		float sum = v.weights.x + v.weights.y + v.weights.z + v.weights.w;
+		if (sum > 0)
+			v.weights /= sum;
+	}
+
+	return bones;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -157,50 +343,12 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
 }
 
 
+// compressed with mips through the texture cache
 unsigned int Model::TextureFromFile(const char* path, const std::string& directory)
 {
 	std::string filename = std::string(path);
 	filename = directory + '/' + filename;
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, numComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height,
-		&numComponents, 0);
-	if (data)
-	{
-		// load texture from image
-		// find color format of image
-		GLenum format;
-		if (numComponents == 1)
-			format = GL_RED;
-		else if (numComponents == 3)
-			format = GL_RGB;
-		else if (numComponents == 4)
-			format = GL_RGBA;
-
-		// bind texture
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-			GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// generate mipmap and set parameters of the texture
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-	
+	return TextureCache::load2D(filename);
 }
 
@@ -24,14 +24,30 @@
 
 #include "Mesh.h"
 #include "Node.h"
+#include "Animation.h"
+#include "TextureCache.h"
 
 class Model : public Node
 {
 public:
 	Model(std::string filePath, glm::mat4 model);
+	// builds from a scene imported earlier, possibly on another thread
+	Model(std::string filePath, glm::mat4 model, const aiScene* scene);
+	~Model();
+
+	// reads the file into the importer, safe off the render thread since it
+	// makes no gl calls. returns null on failure
+	static const aiScene* import(Assimp::Importer& importer, const std::string& path);
+	// give back what import counted, before the importer is deleted
+	static void releaseImport(const aiScene* scene);
 
 	void draw(glm::mat4 , unsigned int shaderProgram);
 	void update(glm::mat4 C);
+	void collect(glm::mat4 C, std::vector<DrawItem>& items);
+
+	// null unless the file has skinned meshes, register it with an Animator
+	AnimationInstance* getPose();
+	void playClip(unsigned int index);
 
 private:
 	std::vector<Mesh> meshes;
@@ -39,9 +55,15 @@ private:
 	std::vector<Texture> textures_loaded;
 	glm::mat4 model;
 
+	Skeleton* skeleton;
+	std::vector<AnimationClip*> clips;
+	AnimationInstance* pose;
+
 	void loadModel(std::string path);
+	void build(const aiScene* scene, const std::string& path);
 	void processNode(aiNode* node, const aiScene* scene);
 	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	std::vector<VertexBones> processBones(aiMesh* mesh);
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
 		std::string typeName);
 
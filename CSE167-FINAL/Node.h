@@ -9,15 +9,23 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <vector>
 
+struct DrawItem;
 
 class Node
 {
 
 public:
+	// the scene deletes paged out nodes through this
+	virtual ~Node() {}
+
 	virtual void draw(glm::mat4 C, unsigned int shaderProgram) = 0;
 
 	virtual void update(glm::mat4 C) = 0;
+
+	// adds a draw item for every mesh under this node, with C applied
+	virtual void collect(glm::mat4 C, std::vector<DrawItem>& items) {}
 };
 
 #endif
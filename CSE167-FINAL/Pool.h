@@ -0,0 +1,130 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <new>
+
+#include "MemoryStats.h"
+
+// Fixed size slots for one type, allocated a chunk at a time so objects of
+// the same type sit next to each other and never move. Freed slots go on a
+// free list and are reused first, while they're still in cache.
+//
+// Every slot has a generation that goes up when its object is destroyed, so
+// an index plus generation is a handle that can tell it went stale. Not
+// thread safe, create and destroy from one thread.
+template <class T, int CHUNK_SIZE = 256>
+class Pool
+{
+public:
+	// chunks are counted under tag in MemoryStats
+	explicit Pool(MemoryTag tag = MemoryTag::OTHER)
+		: tag(tag), freeList(-1), live(0), peak(0), created(0), destroyed(0) {}
+
+	// the owner destroys everything first, this only frees the memory
+	~Pool()
+	{
+		MemoryStats::release(tag, getBytes());
+	}
+
+	template <class... Args>
+	T* create(Args&&... args)
+	{
+		if (freeList < 0)
+			grow();
+
+		int index = freeList;
+		Slot& slot = at(index);
+		freeList = slot.nextFree;
+		slot.nextFree = LIVE;
+
+		T* object = new (&slot.storage) T(std::forward<Args>(args)...);
+		live++;
+		created++;
+		if (live > peak)
+			peak = live;
+		return object;
+	}
+
+	// object must have come from this pool
+	void destroy(T* object)
+	{
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		object->~T();
+		slot->generation++;
+		slot->nextFree = freeList;
+		freeList = slot->index;
+		live--;
+		destroyed++;
+	}
+
+	// null once the object was destroyed, even if the slot was reused
+	T* get(unsigned int index, unsigned int generation)
+	{
+		if (index >= chunks.size() * CHUNK_SIZE)
+			return nullptr;
+		Slot& slot = at(index);
+		if (slot.nextFree != LIVE || slot.generation != generation)
+			return nullptr;
+		return reinterpret_cast<T*>(&slot.storage);
+	}
+
+	void handleOf(T* object, unsigned int& index, unsigned int& generation)
+	{
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		index = slot->index;
+		generation = slot->generation;
+	}
+
+	size_t getLive() { return live; }
+	size_t getPeak() { return peak; }
+	unsigned long long getCreated() { return created; }
+	unsigned long long getDestroyed() { return destroyed; }
+	size_t getChunks() { return chunks.size(); }
+	size_t getBytes() { return chunks.size() * CHUNK_SIZE * sizeof(Slot); }
+
+private:
+	static const int LIVE = -2;
+
+	// storage comes first so an object's address is its slot's
+	struct Slot
+	{
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		unsigned int generation;
+		int index;
+		int nextFree; // LIVE while the slot holds an object
+	};
+
+	MemoryTag tag;
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	int freeList;
+	size_t live, peak;
+	unsigned long long created, destroyed;
+
+	Slot& at(int index)
+	{
+		return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+	}
+
+	void grow()
+	{
+		int first = (int)chunks.size() * CHUNK_SIZE;
+		chunks.push_back(std::unique_ptr<Slot[]>(new Slot[CHUNK_SIZE]));
+		MemoryStats::allocate(tag, CHUNK_SIZE * sizeof(Slot));
+
+		// lowest index on top so slots are handed out in address order
+		Slot* chunk = chunks.back().get();
+		for (int i = CHUNK_SIZE - 1; i >= 0; i--)
+		{
+			chunk[i].generation = 0;
+			chunk[i].index = first + i;
+			chunk[i].nextFree = freeList;
+			freeList = first + i;
+		}
+	}
+};
+
+#endif
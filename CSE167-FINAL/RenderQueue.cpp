@@ -0,0 +1,231 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+#include "TextureCache.h"
+
+RenderQueue::RenderQueue()
+{
+	clusterStats = ClusterStats();
+}
+
+// world space bounding sphere from the mesh's local one
+void RenderQueue::computeBounds(DrawItem& item)
+{
+	computeBounds(item, item.mesh->center, item.mesh->radius);
+}
+
+void RenderQueue::computeBounds(DrawItem& item, glm::vec3 center, float radius)
+{
+	item.center = glm::vec3(item.model * glm::vec4(center, 1.f));
+
+	// scale the radius by the largest axis scale of the model matrix
+	float scale = glm::max(glm::length(glm::vec3(item.model[0])),
+		glm::max(glm::length(glm::vec3(item.model[1])),
+			glm::length(glm::vec3(item.model[2]))));
+	item.radius = radius * scale;
+}
+
+void RenderQueue::cull(JobSystem* jobs, const std::vector<DrawItem>& scene,
+	glm::mat4 viewProj, glm::vec3 viewPos, glm::vec3 viewDir,
+	float pixelsPerUnit, float minPixels, ShaderVariant litVariant)
+{
+	bool shadowPass = litVariant == VARIANT_DEPTH;
+
+	Frustum frustum(viewProj);
+	visible.assign(scene.size(), 0);
+
+	// each job only writes its own range of the visible flags
+	jobs->parallelFor((unsigned int)scene.size(), 64,
+		[&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const DrawItem& item = scene[i];
+			if (shadowPass && !item.castShadow)
+				continue;
+			if (!frustum.checkSphere(item.center, item.radius))
+				continue;
+
+			// detail selection: there is only one level of detail per
+			// mesh, so anything projecting smaller than minPixels is dropped
+			float depth = glm::dot(item.center - viewPos, viewDir);
+			float dist = shadowPass ? 1.f : glm::max(depth, 0.001f);
+			if (item.radius * 2.f * pixelsPerUnit / dist < minPixels)
+				continue;
+
+			visible[i] = 1;
+		}
+	});
+
+	items.clear();
+	rangeCounts.clear();
+	rangeOffsets.clear();
+	for (unsigned int i = 0; i < scene.size(); i++)
+	{
+		if (!visible[i])
+			continue;
+
+		DrawItem item = scene[i];
+		item.firstRange = item.numRanges = 0;
+
+		// parts of a big mesh outside the frustum or, in the camera pass,
+		// facing away are left out. Neighbouring clusters are next to each
+		// other in the indices, so runs of them are one range.
+		const Meshlets& meshlets = item.mesh->meshlets;
+		if (!meshlets.clusters.empty())
+		{
+			meshlets.cull(item.model, frustum, viewPos, !shadowPass, clusterVisible, clusterStats);
+			item.firstRange = (unsigned int)rangeCounts.size();
+			bool extend = false;
+			for (size_t c = 0; c < meshlets.clusters.size(); c++)
+			{
+				if (!clusterVisible[c])
+				{
+					extend = false;
+					continue;
+				}
+				const Meshlet& m = meshlets.clusters[c];
+				if (extend)
+					rangeCounts.back() += m.indexCount;
+				else
+				{
+					rangeCounts.push_back(m.indexCount);
+					rangeOffsets.push_back((const GLvoid*)(m.firstIndex * sizeof(GLuint)));
+				}
+				extend = true;
+			}
+			item.numRanges = (unsigned int)rangeCounts.size() - item.firstRange;
+			if (item.numRanges == 0)
+				continue;
+		}
+
+		item.depth = glm::dot(item.center - viewPos, viewDir);
+
+		// texture detail from the screen pixels per texture coordinate unit
+		// at the nearest point of the bounding sphere
+		if (!shadowPass && item.mesh->uvDensity > 0)
+		{
+			float scale = item.radius / glm::max(item.mesh->radius, 1e-6f);
+			float pixels = pixelsPerUnit / glm::max(item.depth - item.radius, 0.1f);
+			float pixelsPerUV = pixels / (item.mesh->uvDensity * scale);
+			for (const Texture& t : item.mesh->textures)
+				TextureCache::request(t.id, pixelsPerUV);
+		}
+
+		// depth quantized to 24 bits, objects closer to the camera first
+		float d = glm::clamp(item.depth / 1000.f, 0.f, 1.f);
+		unsigned long long depthBits = (unsigned long long)(d * 0xFFFFFF);
+
+		if (shadowPass)
+		{
+			// no materials in the depth pass, only group by vertex array
+			item.key = ((unsigned long long)VARIANT_DEPTH << VARIANT_SHIFT) |
+				((unsigned long long)item.mesh->getVao() << 24) | depthBits;
+		}
+		else
+		{
+			// by shader variant, then by material so textures are bound once
+			ShaderVariant variant = pickVariant(item.unlit, item.lightmap.x > 0, litVariant);
+			item.key = ((unsigned long long)variant << VARIANT_SHIFT) |
+				((unsigned long long)(item.mesh->materialId & 0x1FFFFFFF) << 24) |
+				depthBits;
+		}
+		items.push_back(item);
+	}
+}
+
+void RenderQueue::sort()
+{
+	std::sort(items.begin(), items.end(),
+		[](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+}
+
+ShaderVariant RenderQueue::getVariant(const DrawItem& item)
+{
+	return (ShaderVariant)(item.key >> VARIANT_SHIFT);
+}
+
+ShaderVariant RenderQueue::pickVariant(bool unlit, bool baked, ShaderVariant litVariant)
+{
+	if (unlit)
+		return VARIANT_UNLIT;
+	if (baked && litVariant == VARIANT_LIT_SHADOW)
+		return VARIANT_LIT_BAKED;
+	if (baked && litVariant == VARIANT_LIT_TOON_SHADOW)
+		return VARIANT_LIT_TOON_BAKED;
+	return litVariant;
+}
+
+// draws the sorted items, only changing state when the next item needs it
+void RenderQueue::submit(const GLuint* programs, bool bindMaterials)
+{
+	GLuint program = 0;
+	GLint modelLoc = -1, skinnedLoc = -1, bonesLoc = -1, lightmapLoc = -1;
+
+	int lastVariant = -1;
+	int lastSkinned = -1;
+
+	unsigned int lastMaterial = 0;
+	bool firstMaterial = true;
+
+	for (DrawItem& item : items)
+	{
+		// items are sorted by variant, so this happens once per variant
+		int variant = getVariant(item);
+		if (variant != lastVariant)
+		{
+			if (lastSkinned == 1)
+				glUniform1i(skinnedLoc, false);
+
+			program = programs[variant];
+			glUseProgram(program);
+			modelLoc = glGetUniformLocation(program, "model");
+			skinnedLoc = glGetUniformLocation(program, "skinned");
+			bonesLoc = glGetUniformLocation(program, "bones");
+			lightmapLoc = variant == VARIANT_LIT_BAKED || variant == VARIANT_LIT_TOON_BAKED ?
+				glGetUniformLocation(program, "lightmapRect") : -1;
+
+			lastVariant = variant;
+			lastSkinned = -1;
+			firstMaterial = true;
+		}
+
+		if (bindMaterials && (firstMaterial || item.mesh->materialId != lastMaterial))
+		{
+			item.mesh->bindTextures(program);
+			lastMaterial = item.mesh->materialId;
+			firstMaterial = false;
+		}
+
+		// skin in the vertex shader when the palette fits, else on the cpu
+		bool gpuSkin = item.pose != nullptr && Mesh::gpuSkinning &&
+			item.pose->palette.size() <= Mesh::MAX_BONES;
+		if (item.pose != nullptr && !gpuSkin)
+			item.mesh->skinCpu(item.pose->palette, item.pose->version);
+		if ((int)gpuSkin != lastSkinned)
+		{
+			glUniform1i(skinnedLoc, gpuSkin);
+			lastSkinned = gpuSkin;
+		}
+		if (gpuSkin)
+		{
+			glUniformMatrix4fv(bonesLoc, (GLsizei)item.pose->palette.size(), GL_FALSE,
+				glm::value_ptr(item.pose->palette[0]));
+		}
+
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+		if (lightmapLoc >= 0)
+			glUniform4fv(lightmapLoc, 1, glm::value_ptr(item.lightmap));
+		if (item.numRanges > 0)
+		{
+			item.mesh->drawRanges(&rangeCounts[item.firstRange], &rangeOffsets[item.firstRange],
+				(GLsizei)item.numRanges);
+		}
+		else
+			item.mesh->drawElements();
+	}
+
+	if (lastSkinned == 1)
+		glUniform1i(skinnedLoc, false);
+}
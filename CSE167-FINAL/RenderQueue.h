@@ -0,0 +1,106 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+#include "Mesh.h"
+#include "Animation.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+
+// Builds of texture_shader with the lighting features compiled in or out
+// instead of branching on uniforms. The variant is the top of the sort key,
+// so each program is bound once per pass.
+enum ShaderVariant
+{
+	VARIANT_LIT,
+	VARIANT_LIT_SHADOW,
+	VARIANT_LIT_TOON,
+	VARIANT_LIT_TOON_SHADOW,
+	VARIANT_LIT_BAKED, // static meshes with a baked lightmap, see Lightmaps.h
+	VARIANT_LIT_TOON_BAKED, // same in the toon shading's steps
+	VARIANT_UNLIT, // light sources
+	VARIANT_DEPTH, // depth_shader, used for everything in the shadow pass
+	NUM_VARIANTS
+};
+
+// One mesh to draw with its world matrix, produced by walking the scene
+// graph and consumed by the render passes.
+struct DrawItem
+{
+	Mesh* mesh;
+	glm::mat4 model;
+
+	// world space bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	bool unlit; // light sources ignore lighting
+	bool castShadow;
+
+	AnimationInstance* pose; // bone palette of skinned meshes, else null
+
+	float depth; // distance along the view direction, filled in by cull
+	unsigned long long key; // sort key, filled in by cull
+
+	// the index ranges of the clusters cull kept, in the queue's range
+	// arrays. No ranges draws the whole mesh.
+	unsigned int firstRange, numRanges;
+
+	// scale and offset of the mesh's lightmap square in the atlas, zero
+	// when it has none baked
+	glm::vec4 lightmap;
+};
+
+// The draw list of one render pass. Culling, detail selection and sorting
+// run on the job system, submit does the GL calls on the render thread.
+class RenderQueue
+{
+public:
+	std::vector<DrawItem> items;
+
+	// what culling the clusters of big meshes saved, the camera pass also
+	// drops the clusters facing away
+	ClusterStats clusterStats;
+
+	RenderQueue();
+
+	// frustum, view position and direction and the minimum projected
+	// size an object must have to be kept. litVariant is used for every
+	// lit item, VARIANT_DEPTH makes this a shadow pass.
+	void cull(JobSystem* jobs, const std::vector<DrawItem>& scene,
+		glm::mat4 viewProj, glm::vec3 viewPos, glm::vec3 viewDir,
+		float pixelsPerUnit, float minPixels, ShaderVariant litVariant);
+	void sort();
+	// programs holds one program per variant
+	void submit(const GLuint* programs, bool bindMaterials);
+
+	static ShaderVariant getVariant(const DrawItem& item);
+	// baked items draw with their lightmap in place of the shadow map, so
+	// only while shadows are on, toon shaded or not
+	static ShaderVariant pickVariant(bool unlit, bool baked, ShaderVariant litVariant);
+
+	static void computeBounds(DrawItem& item);
+	// same from a local space sphere other than the mesh's, for posed meshes
+	static void computeBounds(DrawItem& item, glm::vec3 center, float radius);
+
+private:
+	static const int VARIANT_SHIFT = 61;
+
+	std::vector<char> visible;
+
+	// merged runs of visible clusters, for glMultiDrawElements
+	std::vector<GLsizei> rangeCounts;
+	std::vector<const GLvoid*> rangeOffsets;
+	std::vector<char> clusterVisible;
+};
+
+#endif
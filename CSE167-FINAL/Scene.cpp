@@ -0,0 +1,674 @@
+#include "Scene.h"
+
+#include <GLFW/glfw3.h>
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// finished imports turned into models per frame, each can take milliseconds
+static const int BUILDS_PER_FRAME = 1;
+
+struct JsonValue
+{
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type type;
+	bool boolean;
+	double number;
+	std::string string;
+	std::vector<JsonValue> items;
+	std::vector<std::pair<std::string, JsonValue>> members;
+
+	JsonValue() : type(NUL), boolean(false), number(0) {}
+
+	// null when missing or not an object
+	const JsonValue* get(const char* key) const
+	{
+		if (type != OBJECT)
+			return nullptr;
+		for (const std::pair<std::string, JsonValue>& m : members)
+		{
+			if (m.first == key)
+				return &m.second;
+		}
+		return nullptr;
+	}
+};
+
+// recursive descent over the whole file, reports the line of the first error
+class JsonParser
+{
+public:
+	JsonParser(const std::string& text, const std::string& path) : text(text), path(path), pos(0) {}
+
+	bool parse(JsonValue& out)
+	{
+		if (!value(out, 0))
+			return false;
+		skipSpace();
+		if (pos != text.size())
+			return fail("trailing characters");
+		return true;
+	}
+
+private:
+	static const int MAX_DEPTH = 64;
+
+	const std::string& text;
+	const std::string& path;
+	size_t pos;
+
+	bool fail(const char* what)
+	{
+		int line = 1 + (int)std::count(text.begin(), text.begin() + std::min(pos, text.size()), '\n');
+		std::cerr << path << ":" << line << ": " << what << std::endl;
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' ||
+			text[pos] == '\r'))
+			pos++;
+	}
+
+	bool literal(const char* word)
+	{
+		size_t length = strlen(word);
+		if (text.compare(pos, length, word) != 0)
+			return false;
+		pos += length;
+		return true;
+	}
+
+	bool value(JsonValue& out, int depth)
+	{
+		if (depth > MAX_DEPTH)
+			return fail("nested too deep");
+
+		skipSpace();
+		if (pos >= text.size())
+			return fail("unexpected end of file");
+
+		char c = text[pos];
+		if (c == '{')
+			return object(out, depth);
+		if (c == '[')
+			return array(out, depth);
+		if (c == '"')
+		{
+			out.type = JsonValue::STRING;
+			return string(out.string);
+		}
+		if (literal("true") || literal("false"))
+		{
+			out.type = JsonValue::BOOLEAN;
+			out.boolean = c == 't';
+			return true;
+		}
+		if (literal("null"))
+		{
+			out.type = JsonValue::NUL;
+			return true;
+		}
+
+		const char* start = text.c_str() + pos;
+		char* end;
+		out.number = strtod(start, &end);
+		if (end == start)
+			return fail("expected a value");
+		out.type = JsonValue::NUMBER;
+		pos += end - start;
+		return true;
+	}
+
+	bool string(std::string& out)
+	{
+		pos++;
+		while (pos < text.size() && text[pos] != '"')
+		{
+			char c = text[pos++];
+			if (c == '\\' && pos < text.size())
+			{
+				// paths and names only need the simple escapes
+				char e = text[pos++];
+				c = e == 'n' ? '\n' : e == 't' ? '\t' : e;
+			}
+			out += c;
+		}
+		if (pos >= text.size())
+			return fail("unterminated string");
+		pos++;
+		return true;
+	}
+
+	bool array(JsonValue& out, int depth)
+	{
+		out.type = JsonValue::ARRAY;
+		pos++;
+		skipSpace();
+		if (pos < text.size() && text[pos] == ']')
+		{
+			pos++;
+			return true;
+		}
+		while (true)
+		{
+			out.items.push_back(JsonValue());
+			if (!value(out.items.back(), depth + 1))
+				return false;
+			skipSpace();
+			if (pos < text.size() && text[pos] == ',')
+				pos++;
+			else if (pos < text.size() && text[pos] == ']')
+			{
+				pos++;
+				return true;
+			}
+			else
+				return fail("expected , or ]");
+		}
+	}
+
+	bool object(JsonValue& out, int depth)
+	{
+		out.type = JsonValue::OBJECT;
+		pos++;
+		skipSpace();
+		if (pos < text.size() && text[pos] == '}')
+		{
+			pos++;
+			return true;
+		}
+		while (true)
+		{
+			skipSpace();
+			if (pos >= text.size() || text[pos] != '"')
+				return fail("expected a key");
+			out.members.push_back(std::make_pair(std::string(), JsonValue()));
+			if (!string(out.members.back().first))
+				return false;
+			skipSpace();
+			if (pos >= text.size() || text[pos] != ':')
+				return fail("expected :");
+			pos++;
+			if (!value(out.members.back().second, depth + 1))
+				return false;
+			skipSpace();
+			if (pos < text.size() && text[pos] == ',')
+				pos++;
+			else if (pos < text.size() && text[pos] == '}')
+			{
+				pos++;
+				return true;
+			}
+			else
+				return fail("expected , or }");
+		}
+	}
+};
+
+static bool readVec3(const JsonValue& v, glm::vec3& out)
+{
+	if (v.type == JsonValue::NUMBER)
+	{
+		out = glm::vec3((float)v.number);
+		return true;
+	}
+	if (v.type != JsonValue::ARRAY || v.items.size() != 3)
+		return false;
+	for (int i = 0; i < 3; i++)
+	{
+		if (v.items[i].type != JsonValue::NUMBER)
+			return false;
+		out[i] = (float)v.items[i].number;
+	}
+	return true;
+}
+
+// the product of the steps in order, like writing them out with glm
+static bool readTransform(const JsonValue* steps, glm::mat4& out)
+{
+	out = glm::mat4(1);
+	if (steps == nullptr)
+		return true;
+	if (steps->type != JsonValue::ARRAY)
+		return false;
+
+	for (const JsonValue& step : steps->items)
+	{
+		const JsonValue* translate = step.get("translate");
+		const JsonValue* rotate = step.get("rotate");
+		const JsonValue* scale = step.get("scale");
+		glm::vec3 v;
+		if (translate != nullptr && readVec3(*translate, v))
+			out = out * glm::translate(v);
+		else if (scale != nullptr && readVec3(*scale, v))
+			out = out * glm::scale(v);
+		else if (rotate != nullptr && rotate->type == JsonValue::ARRAY && rotate->items.size() == 4)
+		{
+			float values[4];
+			for (int i = 0; i < 4; i++)
+				values[i] = (float)rotate->items[i].number;
+			out = out * glm::rotate(glm::radians(values[0]), glm::vec3(values[1], values[2], values[3]));
+		}
+		else
+			return false;
+	}
+	return true;
+}
+
+static long long cellKey(int x, int z)
+{
+	return (long long)(((unsigned long long)(unsigned int)x << 32) | (unsigned int)z);
+}
+
+Scene::Scene(Transform* root, Animator* animator)
+{
+	Scene::root = root;
+	Scene::animator = animator;
+	cellSize = 16;
+	loadRadius = 48;
+	pagedIn = pagedOut = dropped = 0;
+	buildTime = 0;
+	running = true;
+	loader = std::thread(&Scene::loaderLoop, this);
+}
+
+Scene::~Scene()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+	wake.notify_all();
+	loader.join();
+
+	for (Import& import : requests)
+		release(import);
+	for (Import& import : finished)
+		release(import);
+
+	for (int e : topLevel)
+	{
+		if (entries[e].state != UNLOADED)
+			unload(e);
+	}
+	lights.clear();
+}
+
+bool Scene::load(const std::string& path)
+{
+	std::ifstream in(path);
+	if (!in.is_open())
+	{
+		std::cerr << "Impossible to open " << path << ". "
+			<< "Check to make sure the file exists and you passed in the "
+			<< "right filepath!" << std::endl;
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+
+	JsonValue json;
+	std::string contents = text.str();
+	JsonParser parser(contents, path);
+	if (!parser.parse(json))
+		return false;
+
+	const JsonValue* size = json.get("cellSize");
+	const JsonValue* radius = json.get("loadRadius");
+	if (size != nullptr && size->number > 0)
+		cellSize = (float)size->number;
+	if (radius != nullptr && radius->number >= 0)
+		loadRadius = (float)radius->number;
+
+	const JsonValue* nodes = json.get("nodes");
+	if (nodes == nullptr || nodes->type != JsonValue::ARRAY)
+	{
+		std::cerr << path << ": expected a nodes array" << std::endl;
+		return false;
+	}
+
+	for (const JsonValue& n : nodes->items)
+	{
+		int e = parseNode(n, entries, path);
+		if (e < 0)
+			return false;
+		topLevel.push_back(e);
+	}
+
+	double start = glfwGetTime();
+	for (int e : topLevel)
+	{
+		Entry& entry = entries[e];
+		if (entry.light)
+		{
+			LightSource* light = SceneMemory::create<LightSource>(entry.model, entry.local);
+			lights.push_back(light);
+			root->addChild(light);
+			entry.node = SceneMemory::handleOf(light);
+			entry.state = LOADED;
+		}
+		else if (!entry.streamed)
+		{
+			// imported right here, the loader thread only serves the grid
+			Import import;
+			import.entry = e;
+			import.generation = entry.generation;
+			import.paths = entry.models;
+			for (const std::string& p : import.paths)
+			{
+				import.importers.push_back(new Assimp::Importer());
+				import.scenes.push_back(Model::import(*import.importers.back(), p));
+			}
+			build(import);
+			release(import);
+		}
+		else
+		{
+			glm::vec3 position = glm::vec3(entry.local[3]);
+			int x = (int)std::floor(position.x / cellSize);
+			int z = (int)std::floor(position.z / cellSize);
+			Cell& cell = cells[cellKey(x, z)];
+			cell.x = x;
+			cell.z = z;
+			cell.wanted = false;
+			cell.entries.push_back(e);
+		}
+	}
+	buildTime += glfwGetTime() - start;
+
+	if (lights.empty())
+	{
+		std::cerr << path << ": the scene needs at least one light" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int Scene::parseNode(const JsonValue& v, std::vector<Entry>& entries, const std::string& path)
+{
+	const JsonValue* name = v.get("name");
+	const JsonValue* model = v.get("model");
+	const JsonValue* light = v.get("light");
+	const JsonValue* stream = v.get("stream");
+	const JsonValue* children = v.get("children");
+
+	Entry e;
+	e.name = name != nullptr ? name->string : "";
+	e.model = model != nullptr ? model->string : "";
+	e.light = light != nullptr && light->boolean;
+	e.streamed = !e.light && (stream == nullptr || stream->type != JsonValue::BOOLEAN || stream->boolean);
+	e.state = UNLOADED;
+	e.generation = 0;
+
+	if (v.type != JsonValue::OBJECT || !readTransform(v.get("transform"), e.local))
+	{
+		std::cerr << path << ": bad transform on node " << e.name << std::endl;
+		return -1;
+	}
+	if (e.light && (e.model.empty() || children != nullptr))
+	{
+		std::cerr << path << ": light " << e.name << " needs a model and no children" << std::endl;
+		return -1;
+	}
+
+	int index = (int)entries.size();
+	entries.push_back(e);
+	if (!entries[index].model.empty())
+		entries[index].models.push_back(entries[index].model);
+
+	if (children != nullptr)
+	{
+		for (const JsonValue& c : children->items)
+		{
+			int child = parseNode(c, entries, path);
+			if (child < 0)
+				return -1;
+			if (entries[child].light)
+			{
+				std::cerr << path << ": light " << entries[child].name << " must be top level" << std::endl;
+				return -1;
+			}
+			entries[index].children.push_back(child);
+			// the subtree is imported in one go, in the order it's built
+			entries[index].models.insert(entries[index].models.end(), entries[child].models.begin(),
+				entries[child].models.end());
+		}
+	}
+	return index;
+}
+
+const std::vector<LightSource*>& Scene::getLights()
+{
+	return lights;
+}
+
+void Scene::update(const glm::vec3& eye)
+{
+	double start = glfwGetTime();
+
+	// a cell more than one cell size past the radius is dropped, in between
+	// it stays as it is so standing on the edge doesn't thrash
+	for (std::pair<const long long, Cell>& kv : cells)
+	{
+		Cell& cell = kv.second;
+		float dx = std::max(std::fabs(eye.x - (cell.x + .5f) * cellSize) - cellSize * .5f, 0.f);
+		float dz = std::max(std::fabs(eye.z - (cell.z + .5f) * cellSize) - cellSize * .5f, 0.f);
+		float distance = std::sqrt(dx * dx + dz * dz);
+		if (distance <= loadRadius)
+			cell.wanted = true;
+		else if (distance > loadRadius + cellSize)
+			cell.wanted = false;
+
+		for (int e : cell.entries)
+		{
+			if (cell.wanted && entries[e].state == UNLOADED)
+				request(e);
+			else if (!cell.wanted && entries[e].state != UNLOADED)
+			{
+				pagedOut += entries[e].state == LOADED;
+				unload(e);
+			}
+		}
+	}
+
+	buildFinished(BUILDS_PER_FRAME);
+
+	buildTime += glfwGetTime() - start;
+}
+
+void Scene::buildFinished(int max)
+{
+	for (int built = 0; built < max; )
+	{
+		Import import;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (finished.empty())
+				break;
+			import = std::move(finished.front());
+			finished.pop_front();
+		}
+
+		Entry& entry = entries[import.entry];
+		if (entry.state == LOADING && entry.generation == import.generation)
+		{
+			build(import);
+			pagedIn++;
+			built++;
+		}
+		else
+			dropped++;
+		release(import);
+	}
+}
+
+bool Scene::waitLoading()
+{
+	bool pending = false;
+	for (int e : topLevel)
+		pending = pending || entries[e].state == LOADING;
+	if (!pending)
+		return false;
+
+	std::unique_lock<std::mutex> guard(lock);
+	wake.wait(guard, [this]() { return !finished.empty(); });
+	return true;
+}
+
+void Scene::loadAround(const glm::vec3& eye)
+{
+	do
+		update(eye);
+	while (waitLoading());
+}
+
+void Scene::loadAll()
+{
+	double start = glfwGetTime();
+	for (int e : topLevel)
+	{
+		if (entries[e].state == UNLOADED)
+			request(e);
+	}
+	do
+		buildFinished((int)topLevel.size());
+	while (waitLoading());
+	buildTime += glfwGetTime() - start;
+}
+
+void Scene::request(int e)
+{
+	Entry& entry = entries[e];
+	entry.state = LOADING;
+
+	Import import;
+	import.entry = e;
+	import.generation = entry.generation;
+	import.paths = entry.models;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		requests.push_back(std::move(import));
+	}
+	wake.notify_all();
+}
+
+void Scene::loaderLoop()
+{
+	while (true)
+	{
+		Import import;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return !requests.empty() || !running; });
+			if (!running)
+				return;
+			import = std::move(requests.front());
+			requests.pop_front();
+		}
+
+		for (const std::string& p : import.paths)
+		{
+			import.importers.push_back(new Assimp::Importer());
+			import.scenes.push_back(Model::import(*import.importers.back(), p));
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			finished.push_back(std::move(import));
+		}
+		wake.notify_all();
+	}
+}
+
+// turns an import into nodes under the root, on the render thread
+void Scene::build(Import& import)
+{
+	Entry& entry = entries[import.entry];
+	size_t next = 0;
+	Node* node = buildNode(import.entry, import.scenes, next, entry, entry.local);
+	root->addChild(node);
+	entry.node = SceneMemory::handleOf(node);
+	entry.state = LOADED;
+}
+
+Node* Scene::buildNode(int e, std::vector<const aiScene*>& scenes, size_t& next, Entry& top,
+	const glm::mat4& local)
+{
+	const Entry& entry = entries[e];
+
+	Model* model = nullptr;
+	if (!entry.model.empty())
+	{
+		// a leaf keeps its matrix in the model like the hand written scenes
+		glm::mat4 M = entry.children.empty() ? local : glm::mat4(1);
+		model = SceneMemory::create<Model>(entry.model, M, scenes[next++]);
+		if (model->getPose() != nullptr)
+		{
+			animator->add(model->getPose());
+			top.poses.push_back(model->getPose());
+		}
+		if (entry.children.empty())
+			return model;
+	}
+
+	Transform* t = SceneMemory::create<Transform>(local);
+	if (model != nullptr)
+		t->addChild(model);
+	for (int c : entry.children)
+		t->addChild(buildNode(c, scenes, next, top, entries[c].local));
+	return t;
+}
+
+void Scene::unload(int e)
+{
+	Entry& entry = entries[e];
+	entry.generation++;
+	Node* node = SceneMemory::get(entry.node);
+	if (entry.state == LOADED && node != nullptr)
+	{
+		root->removeChild(node);
+		for (AnimationInstance* pose : entry.poses)
+			animator->remove(pose);
+		SceneMemory::destroy(node);
+	}
+	entry.node = NodeHandle();
+	entry.poses.clear();
+	entry.state = UNLOADED;
+}
+
+void Scene::release(Import& import)
+{
+	for (const aiScene* scene : import.scenes)
+		Model::releaseImport(scene);
+	for (Assimp::Importer* importer : import.importers)
+		delete importer;
+	import.importers.clear();
+	import.scenes.clear();
+}
+
+void Scene::report()
+{
+	int streamed = 0, resident = 0;
+	for (std::pair<const long long, Cell>& kv : cells)
+	{
+		for (int e : kv.second.entries)
+		{
+			streamed++;
+			resident += entries[e].state == LOADED;
+		}
+	}
+
+	char line[192];
+	snprintf(line, sizeof(line),
+		"scene: %d cells, %d of %d streamed nodes resident, %llu paged in, %llu out, %llu dropped, %.1f ms building",
+		(int)cells.size(), resident, streamed, pagedIn, pagedOut, dropped, buildTime * 1000.0);
+	std::cerr << line << std::endl;
+}
@@ -0,0 +1,143 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <assimp/Importer.hpp>
+
+#include "Transform.h"
+#include "Model.h"
+#include "LightSource.h"
+#include "Animation.h"
+#include "SceneMemory.h"
+
+struct JsonValue;
+
+// Builds the scene graph from a json file instead of code:
+//
+//   {
+//     "cellSize": 16, "loadRadius": 48,
+//     "nodes": [
+//       { "name": "sofa", "model": "models/sofa/scene.gltf",
+//         "transform": [ { "translate": [0, 0.2, 3] }, { "scale": 0.5 } ] },
+//       { "name": "moon", "model": "models/moon/scene.gltf", "light": true,
+//         "transform": [ { "rotate": [90, 1, 0, 0] } ] }
+//     ]
+//   }
+//
+// Transform steps multiply left to right, rotations are in degrees around
+// an axis. A node can have "children" of its own. Lights and nodes with
+// "stream": false load with the scene and stay.
+//
+// Every other top level node is put in a square grid cell by its position.
+// Cells within loadRadius of the camera are paged in: a loader thread reads
+// the model files with assimp and the render thread turns one finished
+// node a frame into meshes and textures. Cells further than a cell past
+// the radius are taken out of the graph and destroyed.
+class Scene
+{
+public:
+	// nodes go under root, skinned models get their poses on the animator
+	Scene(Transform* root, Animator* animator);
+	// unloads every node it made
+	~Scene();
+
+	bool load(const std::string& path);
+
+	// once a frame on the render thread before the graph is walked
+	void update(const glm::vec3& eye);
+	// loads every cell near eye before returning, for the first frame
+	void loadAround(const glm::vec3& eye);
+	// loads every node wherever the camera is, for baking the whole scene.
+	// The next update pages the far ones back out.
+	void loadAll();
+
+	const std::vector<LightSource*>& getLights();
+
+	// prints the cells and nodes resident and the time spent paging
+	void report();
+
+private:
+	enum EntryState { UNLOADED, LOADING, LOADED };
+
+	// a node of the file and everything under it
+	struct Entry
+	{
+		std::string name, model;
+		glm::mat4 local;
+		bool light, streamed;
+		std::vector<int> children; // indices of the child entries
+		std::vector<std::string> models; // of the whole subtree, in build order
+
+		// top level entries only
+		EntryState state;
+		unsigned int generation; // bumped on unload so late imports are dropped
+		NodeHandle node; // the subtree under the root, owned by SceneMemory
+		std::vector<AnimationInstance*> poses;
+	};
+
+	struct Cell
+	{
+		int x, z;
+		std::vector<int> entries;
+		bool wanted;
+	};
+
+	struct Import
+	{
+		int entry;
+		unsigned int generation;
+		std::vector<std::string> paths;
+		std::vector<Assimp::Importer*> importers; // one per path, null scenes on failure
+		std::vector<const aiScene*> scenes;
+	};
+
+	Transform* root;
+	Animator* animator;
+	float cellSize, loadRadius;
+
+	std::vector<Entry> entries;
+	std::vector<int> topLevel;
+	std::unordered_map<long long, Cell> cells;
+	std::vector<LightSource*> lights;
+
+	std::thread loader;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<Import> requests, finished;
+	bool running;
+
+	unsigned long long pagedIn, pagedOut, dropped;
+	double buildTime; // render thread, seconds
+
+	// adds the node and its children, returns its index or -1 on a bad node
+	static int parseNode(const JsonValue& v, std::vector<Entry>& entries, const std::string& path);
+
+	void loaderLoop();
+	void request(int entry);
+	// builds up to max of the imports the loader finished
+	void buildFinished(int max);
+	// waits for the loader while any top level node is loading
+	bool waitLoading();
+	void build(Import& import);
+	Node* buildNode(int entry, std::vector<const aiScene*>& scenes, size_t& next, Entry& top,
+		const glm::mat4& local);
+	void unload(int entry);
+	void release(Import& import);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "SceneMemory.h"
+
+#include <cstdio>
+
+Pool<Transform> SceneMemory::transforms(MemoryTag::SCENE_GRAPH);
+Pool<Model> SceneMemory::models(MemoryTag::SCENE_GRAPH);
+Pool<LightSource> SceneMemory::lights(MemoryTag::SCENE_GRAPH);
+
+void SceneMemory::destroy(Node* node)
+{
+	LightSource* light = dynamic_cast<LightSource*>(node);
+	if (light != nullptr)
+	{
+		lights.destroy(light);
+		return;
+	}
+
+	Model* model = dynamic_cast<Model*>(node);
+	if (model != nullptr)
+	{
+		models.destroy(model);
+		return;
+	}
+
+	Transform* t = dynamic_cast<Transform*>(node);
+	if (t != nullptr)
+	{
+		for (Node* child : t->getChildren())
+			destroy(child);
+		transforms.destroy(t);
+		return;
+	}
+
+	std::cerr << "SceneMemory: can't destroy a node that isn't from a pool" << std::endl;
+}
+
+NodeHandle SceneMemory::handleOf(Node* node)
+{
+	NodeHandle h;
+	if (dynamic_cast<LightSource*>(node) != nullptr)
+	{
+		h.type = NodeType::LIGHT;
+		lights.handleOf((LightSource*)node, h.index, h.generation);
+	}
+	else if (dynamic_cast<Model*>(node) != nullptr)
+	{
+		h.type = NodeType::MODEL;
+		models.handleOf((Model*)node, h.index, h.generation);
+	}
+	else if (dynamic_cast<Transform*>(node) != nullptr)
+	{
+		h.type = NodeType::TRANSFORM;
+		transforms.handleOf((Transform*)node, h.index, h.generation);
+	}
+	return h;
+}
+
+Node* SceneMemory::get(NodeHandle handle)
+{
+	switch (handle.type)
+	{
+	case NodeType::TRANSFORM:
+		return transforms.get(handle.index, handle.generation);
+	case NodeType::MODEL:
+		return models.get(handle.index, handle.generation);
+	case NodeType::LIGHT:
+		return lights.get(handle.index, handle.generation);
+	default:
+		return nullptr;
+	}
+}
+
+template <class T>
+static void reportPool(const char* name, Pool<T>& pool)
+{
+	char line[160];
+	snprintf(line, sizeof(line), "  %-10s %6d live, %6d peak, %8llu created, %4d chunks, %.1f KB",
+		name, (int)pool.getLive(), (int)pool.getPeak(), pool.getCreated(), (int)pool.getChunks(),
+		pool.getBytes() / 1024.0);
+	std::cerr << line << std::endl;
+}
+
+void SceneMemory::report()
+{
+	std::cerr << "scene nodes:" << std::endl;
+	reportPool("transforms", transforms);
+	reportPool("models", models);
+	reportPool("lights", lights);
+}
@@ -0,0 +1,64 @@
+#ifndef _SCENE_MEMORY_H_
+#define _SCENE_MEMORY_H_
+
+#include <iostream>
+#include <utility>
+
+#include "Pool.h"
+#include "Node.h"
+#include "Transform.h"
+#include "Model.h"
+#include "LightSource.h"
+
+enum class NodeType {
+	NONE,
+	TRANSFORM,
+	MODEL,
+	LIGHT
+};
+
+// refers to a node without keeping it alive, get returns null once the node
+// is destroyed
+struct NodeHandle
+{
+	NodeType type;
+	unsigned int index, generation;
+
+	NodeHandle() : type(NodeType::NONE), index(0), generation(0) {}
+};
+
+// Owns every scene graph node. Nodes of one type come from one pool, and a
+// Transform owns its children: destroying it destroys the whole subtree,
+// which frees the meshes' gl buffers and gives their textures back to the
+// TextureCache, which deletes the ones nothing else uses. Only the render
+// thread creates or destroys nodes.
+class SceneMemory
+{
+public:
+	template <class T, class... Args>
+	static T* create(Args&&... args)
+	{
+		return poolOf((T*)nullptr).create(std::forward<Args>(args)...);
+	}
+
+	// destroys the node and everything under it, detach it from its parent first
+	static void destroy(Node* node);
+
+	static NodeHandle handleOf(Node* node);
+	static Node* get(NodeHandle handle);
+
+	// live, peak and total nodes per type and the pool memory, anything
+	// still live at exit was leaked by its owner
+	static void report();
+
+private:
+	static Pool<Transform> transforms;
+	static Pool<Model> models;
+	static Pool<LightSource> lights;
+
+	static Pool<Transform>& poolOf(Transform*) { return transforms; }
+	static Pool<Model>& poolOf(Model*) { return models; }
+	static Pool<LightSource>& poolOf(LightSource*) { return lights; }
+};
+
+#endif
@@ -0,0 +1,442 @@
+#include "ShaderManager.h"
+
+#include <GLFW/glfw3.h>
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+static const int MAX_INCLUDE_DEPTH = 8;
+static const char CACHE_MAGIC[4] = { 'S', 'P', 'B', 'C' };
+
+static unsigned long long hashString(const std::string& s, unsigned long long h)
+{
+	// fnv-1a
+	for (unsigned char c : s)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// modification time of a file, -1 if it can't be read
+static long long fileTime(const std::string& path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return -1;
+	return (long long)st.st_mtime;
+}
+
+static std::string directoryOf(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+ShaderManager::ShaderManager(const std::string& cacheDir)
+{
+	ShaderManager::cacheDir = cacheDir;
+	makeDirectory(cacheDir);
+
+	// a binary is only valid for the exact driver that made it
+	const GLubyte* strings[3] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER),
+		glGetString(GL_VERSION) };
+	for (const GLubyte* s : strings)
+	{
+		if (s)
+			driver += std::string((const char*)s) + "\n";
+	}
+
+#ifdef __APPLE__
+	binaryCache = false;
+#else
+	GLint formats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	binaryCache = formats > 0;
+#endif
+
+	// let the driver use as many compiler threads as it likes
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+	{
+		MaxShaderCompilerThreadsProc maxThreads =
+			(MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (maxThreads)
+			maxThreads(0xFFFFFFFF);
+	}
+
+	lastCheck = glfwGetTime();
+	checkInterval = 0.5;
+}
+
+ShaderManager::~ShaderManager()
+{
+	for (Program& p : programs)
+	{
+		if (p.id)
+			glDeleteProgram(p.id);
+	}
+}
+
+ShaderId ShaderManager::add(const std::string& vertexPath, const std::string& fragmentPath,
+	const std::vector<std::string>& defines)
+{
+	Program p;
+	p.vertexPath = vertexPath;
+	p.fragmentPath = fragmentPath;
+	p.defines = defines;
+	p.compute = false;
+	p.id = 0;
+	p.hash = 0;
+	p.pending = p.vertexShader = p.fragmentShader = 0;
+	programs.push_back(p);
+	return (ShaderId)programs.size() - 1;
+}
+
+ShaderId ShaderManager::addCompute(const std::string& computePath, const std::vector<std::string>& defines)
+{
+	ShaderId id = add(computePath, "", defines);
+	programs[id].compute = true;
+	return id;
+}
+
+bool ShaderManager::build()
+{
+	std::vector<int> which;
+	for (int i = 0; i < (int)programs.size(); i++)
+	{
+		if (!programs[i].id)
+			which.push_back(i);
+	}
+	return buildAll(which);
+}
+
+GLuint ShaderManager::get(ShaderId id)
+{
+	if (id < 0 || id >= (int)programs.size())
+		return 0;
+	return programs[id].id;
+}
+
+// size of the driver's binary for a program, 0 if it can't be queried. GL
+// has no instruction count, this is the closest thing to compare variants.
+GLint ShaderManager::getBinarySize(ShaderId id)
+{
+	GLuint program = get(id);
+	if (program == 0 || !binaryCache)
+		return 0;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	return length;
+}
+
+bool ShaderManager::reload()
+{
+	double now = glfwGetTime();
+	if (now - lastCheck < checkInterval)
+		return false;
+	lastCheck = now;
+
+	std::vector<int> which;
+	std::vector<GLuint> before;
+	for (int i = 0; i < (int)programs.size(); i++)
+	{
+		Program& p = programs[i];
+		for (size_t f = 0; f < p.files.size(); f++)
+		{
+			// a file that's gone for the moment, like mid save, isn't a change
+			long long time = fileTime(p.files[f]);
+			if (time >= 0 && time != p.times[f])
+			{
+				std::cerr << "Reloading " << p.vertexPath << " + " << p.fragmentPath << std::endl;
+				which.push_back(i);
+				before.push_back(p.id);
+				break;
+			}
+		}
+	}
+	if (which.empty())
+		return false;
+
+	buildAll(which);
+
+	bool changed = false;
+	for (size_t i = 0; i < which.size(); i++)
+		changed = changed || programs[which[i]].id != before[i];
+	return changed;
+}
+
+// submits every program before waiting on any of them
+bool ShaderManager::buildAll(std::vector<int>& which)
+{
+	double start = glfwGetTime();
+	int cacheHits = 0;
+	bool ok = true;
+
+	std::vector<bool> started(which.size());
+	for (size_t i = 0; i < which.size(); i++)
+	{
+		started[i] = ShaderManager::start(programs[which[i]], cacheHits);
+		ok = ok && started[i];
+	}
+
+	for (size_t i = 0; i < which.size(); i++)
+	{
+		if (started[i] && programs[which[i]].pending)
+			ok = finish(programs[which[i]]) && ok;
+	}
+
+	char line[128];
+	snprintf(line, sizeof(line), "shaders: %d programs, %d from cache, %.1f ms",
+		(int)which.size(), cacheHits, (glfwGetTime() - start) * 1000.0);
+	std::cerr << line << std::endl;
+
+	return ok;
+}
+
+// reads the sources and either loads the cached binary or starts compiling
+bool ShaderManager::start(Program& p, int& cacheHits)
+{
+	p.files.clear();
+	p.times.clear();
+	p.vertexSource.clear();
+	p.fragmentSource.clear();
+	if (!preprocess(p.vertexPath, p.defines, p.vertexSource, p, 0) ||
+		(!p.compute && !preprocess(p.fragmentPath, p.defines, p.fragmentSource, p, 0)))
+		return false;
+
+	p.hash = hashString(driver, 14695981039346656037ull);
+	p.hash = hashString(p.vertexSource + '\0', p.hash);
+	p.hash = hashString(p.fragmentSource, p.hash);
+
+#ifndef __APPLE__
+	if (binaryCache)
+	{
+		// opened at the end to know its size, a truncated or corrupt file
+		// is just compiled over
+		std::ifstream in(cachePath(p.hash), std::ios::binary | std::ios::ate);
+		std::streamoff size = in ? (std::streamoff)in.tellg() : 0;
+		in.seekg(0);
+		char magic[4];
+		GLenum format;
+		GLint length;
+		if (in.read(magic, 4) && memcmp(magic, CACHE_MAGIC, 4) == 0 &&
+			in.read((char*)&format, sizeof(format)) && in.read((char*)&length, sizeof(length)) &&
+			length > 0 && length <= size - (std::streamoff)in.tellg())
+		{
+			std::vector<char> data(length);
+			if (in.read(data.data(), length))
+			{
+				GLuint id = glCreateProgram();
+				glProgramBinary(id, format, data.data(), length);
+
+				// a driver update can reject old binaries, just compile then
+				GLint linked = GL_FALSE;
+				glGetProgramiv(id, GL_LINK_STATUS, &linked);
+				if (linked)
+				{
+					if (p.id)
+						glDeleteProgram(p.id);
+					p.id = id;
+					cacheHits++;
+					return true;
+				}
+				glDeleteProgram(id);
+			}
+		}
+	}
+#endif
+
+	// a compute program is built like a vertex shader without a fragment shader
+	const char* source = p.vertexSource.c_str();
+#ifdef __APPLE__
+	p.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+#else
+	p.vertexShader = glCreateShader(p.compute ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER);
+#endif
+	glShaderSource(p.vertexShader, 1, &source, NULL);
+	glCompileShader(p.vertexShader);
+
+	if (!p.compute)
+	{
+		source = p.fragmentSource.c_str();
+		p.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(p.fragmentShader, 1, &source, NULL);
+		glCompileShader(p.fragmentShader);
+	}
+
+	p.pending = glCreateProgram();
+	glAttachShader(p.pending, p.vertexShader);
+	if (!p.compute)
+		glAttachShader(p.pending, p.fragmentShader);
+#ifndef __APPLE__
+	if (binaryCache)
+		glProgramParameteri(p.pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+	glLinkProgram(p.pending);
+	return true;
+}
+
+// waits for a submitted program, reports errors and saves its binary
+bool ShaderManager::finish(Program& p)
+{
+	bool ok = checkShader(p.vertexShader, p.vertexPath);
+	if (!p.compute)
+		ok = checkShader(p.fragmentShader, p.fragmentPath) && ok;
+
+	if (ok)
+	{
+		GLint linked = GL_FALSE;
+		glGetProgramiv(p.pending, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			GLint length = 0;
+			glGetProgramiv(p.pending, GL_INFO_LOG_LENGTH, &length);
+			std::vector<char> log(length + 1);
+			glGetProgramInfoLog(p.pending, length, NULL, log.data());
+			std::cerr << "Linking " << p.vertexPath << " + " << p.fragmentPath << " failed:\n"
+				<< log.data() << std::endl;
+			ok = false;
+		}
+	}
+
+	glDetachShader(p.pending, p.vertexShader);
+	glDeleteShader(p.vertexShader);
+	if (!p.compute)
+	{
+		glDetachShader(p.pending, p.fragmentShader);
+		glDeleteShader(p.fragmentShader);
+	}
+	p.vertexShader = p.fragmentShader = 0;
+
+	if (!ok)
+	{
+		glDeleteProgram(p.pending);
+		p.pending = 0;
+		return false;
+	}
+
+#ifndef __APPLE__
+	if (binaryCache)
+	{
+		GLint length = 0;
+		glGetProgramiv(p.pending, GL_PROGRAM_BINARY_LENGTH, &length);
+		std::vector<char> data(length);
+		GLenum format = 0;
+		glGetProgramBinary(p.pending, length, NULL, &format, data.data());
+
+		// a missing cache file only costs a compile next time
+		std::ofstream out(cachePath(p.hash), std::ios::binary | std::ios::trunc);
+		out.write(CACHE_MAGIC, 4);
+		out.write((const char*)&format, sizeof(format));
+		out.write((const char*)&length, sizeof(length));
+		out.write(data.data(), length);
+	}
+#endif
+
+	if (p.id)
+		glDeleteProgram(p.id);
+	p.id = p.pending;
+	p.pending = 0;
+	return true;
+}
+
+bool ShaderManager::checkShader(GLuint shader, const std::string& path)
+{
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled)
+		return true;
+
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	std::vector<char> log(length + 1);
+	glGetShaderInfoLog(shader, length, NULL, log.data());
+	std::cerr << "Compiling " << path << " failed:\n" << log.data() << std::endl;
+	return false;
+}
+
+// copies the file into out, expanding #include "file" and putting the
+// defines right after #version
+bool ShaderManager::preprocess(const std::string& path, const std::vector<std::string>& defines,
+	std::string& out, Program& program, int depth)
+{
+	if (depth > MAX_INCLUDE_DEPTH)
+	{
+		std::cerr << "Includes nested too deep at " << path << std::endl;
+		return false;
+	}
+
+	// watched even when it can't be opened, with a time of -1 the program is
+	// rebuilt as soon as the file shows up
+	program.files.push_back(path);
+	program.times.push_back(fileTime(path));
+
+	std::ifstream in(path);
+	if (!in.is_open())
+	{
+		std::cerr << "Impossible to open " << path << ". "
+			<< "Check to make sure the file exists and you passed in the "
+			<< "right filepath!" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+		{
+			size_t open = line.find('"', start);
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos)
+			{
+				std::cerr << "Bad #include in " << path << ": " << line << std::endl;
+				return false;
+			}
+
+			std::string name = line.substr(open + 1, close - open - 1);
+			if (!preprocess(directoryOf(path) + name, std::vector<std::string>(), out,
+				program, depth + 1))
+				return false;
+			continue;
+		}
+
+		out += line;
+		out += '\n';
+
+		if (depth == 0 && start != std::string::npos && line.compare(start, 8, "#version") == 0)
+		{
+			for (const std::string& d : defines)
+				out += "#define " + d + "\n";
+		}
+	}
+	return true;
+}
+
+std::string ShaderManager::cachePath(unsigned long long hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", hash);
+	return cacheDir + "/" + name;
+}
@@ -0,0 +1,83 @@
+#ifndef _SHADER_MANAGER_H_
+#define _SHADER_MANAGER_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+// index of a program in the manager, stays the same when the program is
+// rebuilt, unlike the GL name
+typedef int ShaderId;
+
+// Builds and owns every shader program. Sources can #include other files
+// relative to themselves and get a list of #defines injected after #version,
+// so one source can be built as several variants. Linked programs are saved
+// with glGetProgramBinary, keyed by a hash of the preprocessed sources and
+// the driver, and later runs load those instead of compiling. All programs
+// of a build are submitted before any status is read so drivers with
+// KHR_parallel_shader_compile compile them side by side. reload rebuilds the
+// programs whose files changed.
+class ShaderManager
+{
+public:
+	ShaderManager(const std::string& cacheDir);
+	~ShaderManager();
+
+	// nothing is compiled until build
+	ShaderId add(const std::string& vertexPath, const std::string& fragmentPath,
+		const std::vector<std::string>& defines);
+	// a compute program, needs GL 4.3
+	ShaderId addCompute(const std::string& computePath, const std::vector<std::string>& defines);
+
+	// builds every program that hasn't been built yet, false if any failed
+	bool build();
+
+	GLuint get(ShaderId id);
+	GLint getBinarySize(ShaderId id);
+
+	// rebuilds programs whose source or include files changed on disk, at
+	// most every checkInterval seconds. A program that fails keeps its old
+	// version. Returns true if any GL program name changed.
+	bool reload();
+
+private:
+	struct Program
+	{
+		std::string vertexPath, fragmentPath; // vertexPath is the compute shader of compute programs
+		std::vector<std::string> defines;
+		bool compute;
+		GLuint id;
+
+		// every file read for this program and its time when read
+		std::vector<std::string> files;
+		std::vector<long long> times;
+
+		// state of a build in progress
+		std::string vertexSource, fragmentSource;
+		unsigned long long hash;
+		GLuint pending, vertexShader, fragmentShader;
+	};
+
+	std::vector<Program> programs;
+	std::string cacheDir;
+	std::string driver;
+	bool binaryCache;
+	double lastCheck, checkInterval;
+
+	bool preprocess(const std::string& path, const std::vector<std::string>& defines,
+		std::string& out, Program& program, int depth);
+	bool start(Program& p, int& cacheHits);
+	bool finish(Program& p);
+	bool buildAll(std::vector<int>& which);
+
+	std::string cachePath(unsigned long long hash);
+	bool checkShader(GLuint shader, const std::string& path);
+};
+
+#endif
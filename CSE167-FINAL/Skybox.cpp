@@ -1,4 +1,5 @@
 #include "Skybox.h"
+#include "MemoryStats.h"
 
 Skybox::Skybox(float size) 
 {
@@ -72,8 +73,8 @@ Skybox::Skybox(float size)
 	// Bind to the first VBO. We will use it to store the vertices.
 	glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
 	// Pass in the data.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), 
-		vertices.data(), GL_STATIC_DRAW);
+	MemoryStats::bufferData(GL_ARRAY_BUFFER, vbos[0], sizeof(glm::vec3) * vertices.size(),
+		vertices.data(), GL_STATIC_DRAW, MemoryTag::OTHER);
 	// Enable vertex attribute 0. 
 	// We will be able to access vertices through it.
 	glEnableVertexAttribArray(0);
@@ -82,8 +83,8 @@ Skybox::Skybox(float size)
 	// Bind to the second VBO. We will use it to store the indices.
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos[1]);
 	// Pass in the data.
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::ivec3) * indices.size(), 
-		indices.data(), GL_STATIC_DRAW);
+	MemoryStats::bufferData(GL_ELEMENT_ARRAY_BUFFER, vbos[1], sizeof(glm::ivec3) * indices.size(),
+		indices.data(), GL_STATIC_DRAW, MemoryTag::OTHER);
 
 	// Unbind from the VBOs.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -94,7 +95,7 @@ Skybox::Skybox(float size)
 Skybox::~Skybox()
 {
 	// Delete the VBOs and the VAO.
-	glDeleteBuffers(2, vbos);
+	MemoryStats::deleteBuffers(2, vbos);
 	glDeleteVertexArrays(1, &vao);
 }
 
@@ -119,36 +120,8 @@ void Skybox::update()
 
 unsigned int Skybox::loadCubemap(std::vector<std::string> faces)
 {
-	// generate and bind texture to ID value
-	glGenTextures(1, &cubemapTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		// set texture targets for each of the 6 faces of the cube
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-		// make sure no bytes are padded
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		// specify wrapping and filtering methods of the textures
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	}
-	cubemapTexture = cubemapTexture;
+	// faces are compressed and mipmapped like every other texture
+	cubemapTexture = TextureCache::loadCubemap(faces);
 	return cubemapTexture;
 }
 
@@ -14,6 +14,7 @@
 #include <iostream>
 
 #include "stb_image.h"
+#include "TextureCache.h"
 
 class Skybox
 {
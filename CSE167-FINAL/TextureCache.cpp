@@ -0,0 +1,1116 @@
+#include "TextureCache.h"
+
+#include <GLFW/glfw3.h>
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <emmintrin.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "stb_image.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+
+static const char CACHE_MAGIC[4] = { 'B', 'T', 'E', 'X' };
+static const unsigned int CACHE_VERSION = 1;
+
+const char* TextureCache::CACHE_DIR = "cache";
+
+// largest mip a streamed texture always keeps resident
+static const unsigned int TAIL_SIZE = 64;
+// bytes uploaded per update at most, so streaming doesn't cause hitches
+static const size_t UPLOAD_PER_FRAME = 8 << 20;
+
+// the image's path flattened into one name inside CACHE_DIR, so the asset
+// folders stay free of generated files
+static std::string cacheName(const std::string& source)
+{
+	std::string name = source;
+	for (char& c : name)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+	return std::string(TextureCache::CACHE_DIR) + "/" + name + ".btex";
+}
+
+static void makeCacheDir()
+{
+#ifdef _WIN32
+	_mkdir(TextureCache::CACHE_DIR);
+#else
+	mkdir(TextureCache::CACHE_DIR, 0755);
+#endif
+}
+
+// start of a .btex file, followed by the blocks of every level of every
+// face, face by face and largest level first
+struct TextureHeader
+{
+	char magic[4];
+	unsigned int version;
+	long long sourceSize, sourceTime; // identifies the images it was made from
+	unsigned int format; // GL compressed internal format
+	unsigned int width, height, levels, faces;
+};
+
+JobSystem* TextureCache::jobs = nullptr;
+std::unordered_map<std::string, GLuint> TextureCache::loaded2D;
+std::unordered_map<GLuint, TextureCache::Cached2D> TextureCache::cached2D;
+size_t TextureCache::textureCount = 0, TextureCache::releasedCount = 0;
+
+bool TextureCache::streaming = false;
+size_t TextureCache::budget = 0, TextureCache::residentBytes = 0;
+unsigned long long TextureCache::frame = 0;
+std::vector<TextureCache::StreamedTexture> TextureCache::streamed;
+std::unordered_map<GLuint, int> TextureCache::streamedIndex;
+std::thread TextureCache::reader;
+std::mutex TextureCache::readLock;
+std::condition_variable TextureCache::readWake;
+std::deque<TextureCache::LevelRead> TextureCache::reads, TextureCache::done;
+size_t TextureCache::compressedBytes = 0, TextureCache::uncompressedBytes = 0;
+double TextureCache::loadTime = 0;
+
+// Read only view of a whole file.
+class MappedFile
+{
+private:
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int file;
+#endif
+	const char* data;
+	size_t size;
+
+public:
+	MappedFile(const std::string& filename)
+	{
+		data = nullptr;
+		size = 0;
+#ifdef _WIN32
+		mapping = nullptr;
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER length;
+		GetFileSizeEx(file, &length);
+		size = (size_t)length.QuadPart;
+		if (size == 0)
+			return;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		file = open(filename.c_str(), O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat st;
+		fstat(file, &st);
+		size = (size_t)st.st_size;
+		if (size == 0)
+			return;
+
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		data = p == MAP_FAILED ? nullptr : (const char*)p;
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			close(file);
+#endif
+	}
+
+	bool isOpen() { return data != nullptr; }
+	const char* begin() { return data; }
+	size_t length() { return size; }
+};
+
+// sRGB to linear and back, the way back is fine enough for a byte to
+// survive the round trip
+struct GammaTables
+{
+	float toLinear[256];
+	unsigned char toSrgb[4096];
+
+	GammaTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++)
+		{
+			float l = i / 4095.f;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.f / 2.4f) - 0.055f;
+			toSrgb[i] = (unsigned char)(c * 255.f + 0.5f);
+		}
+	}
+};
+
+static const GammaTables gammaTables;
+
+// one mip level, four linear floats per pixel
+struct Level
+{
+	int width, height;
+	std::vector<float> pixels;
+};
+
+static void parallelRows(unsigned int count, unsigned int grain,
+	std::function<void(unsigned int begin, unsigned int end)> fn)
+{
+	if (TextureCache::jobs)
+		TextureCache::jobs->parallelFor(count, grain, fn);
+	else
+		fn(0, count);
+}
+
+static size_t levelSize(GLenum format, int width, int height)
+{
+	size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+static int levelCount(int width, int height)
+{
+	int levels = 1;
+	while ((width >> levels) > 0 || (height >> levels) > 0)
+		levels++;
+	return levels;
+}
+
+static bool readHeader(const char* data, size_t size, TextureHeader& header)
+{
+	if (size < sizeof(TextureHeader))
+		return false;
+	memcpy(&header, data, sizeof(TextureHeader));
+	if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION)
+		return false;
+	if (header.width == 0 || header.height == 0 || header.faces == 0 ||
+		(int)header.levels != levelCount(header.width, header.height))
+		return false;
+
+	size_t total = 0;
+	for (unsigned int l = 0; l < header.levels; l++)
+		total += levelSize(header.format, std::max(1u, header.width >> l), std::max(1u, header.height >> l));
+	return size == sizeof(TextureHeader) + total * header.faces;
+}
+
+// the streamed part of a texture ends at the first level within TAIL_SIZE
+static int tailLevel(const TextureHeader& header)
+{
+	int level = 0;
+	while (std::max(header.width >> level, header.height >> level) > TAIL_SIZE)
+		level++;
+	return level;
+}
+
+static Level toLinear(const std::vector<unsigned char>& bytes, int width, int height, bool srgb)
+{
+	Level level;
+	level.width = width;
+	level.height = height;
+	level.pixels.resize((size_t)width * height * 4);
+
+	for (size_t i = 0; i < level.pixels.size(); i++)
+	{
+		// alpha and non-color data are stored linear already
+		bool color = srgb && (i & 3) != 3;
+		level.pixels[i] = color ? gammaTables.toLinear[bytes[i]] : bytes[i] / 255.f;
+	}
+	return level;
+}
+
+static std::vector<unsigned char> toBytes(const Level& level, bool srgb)
+{
+	std::vector<unsigned char> bytes(level.pixels.size());
+
+	// colors index the gamma table, everything else becomes a byte directly
+	__m128 scale = srgb ? _mm_setr_ps(4095.f, 4095.f, 4095.f, 255.f) : _mm_set1_ps(255.f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.f);
+
+	parallelRows(level.height, 32, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < level.width; x++)
+			{
+				size_t i = ((size_t)y * level.width + x) * 4;
+				__m128 p = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&level.pixels[i]), zero), one);
+				int c[4];
+				_mm_storeu_si128((__m128i*)c, _mm_cvtps_epi32(_mm_mul_ps(p, scale)));
+
+				for (int k = 0; k < 4; k++)
+					bytes[i + k] = srgb && k < 3 ? gammaTables.toSrgb[c[k]] : (unsigned char)c[k];
+			}
+		}
+	});
+	return bytes;
+}
+
+// 2x2 box filter, odd edges repeat their last row or column
+static Level downsample(const Level& src)
+{
+	Level dst;
+	dst.width = std::max(1, src.width / 2);
+	dst.height = std::max(1, src.height / 2);
+	dst.pixels.resize((size_t)dst.width * dst.height * 4);
+
+	__m128 quarter = _mm_set1_ps(0.25f);
+
+	parallelRows(dst.height, 32, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int y = begin; y < end; y++)
+		{
+			const float* row0 = &src.pixels[(size_t)std::min(2 * (int)y, src.height - 1) * src.width * 4];
+			const float* row1 = &src.pixels[(size_t)std::min(2 * (int)y + 1, src.height - 1) * src.width * 4];
+			float* out = &dst.pixels[(size_t)y * dst.width * 4];
+
+			for (int x = 0; x < dst.width; x++)
+			{
+				int x0 = std::min(2 * x, src.width - 1) * 4;
+				int x1 = std::min(2 * x + 1, src.width - 1) * 4;
+				__m128 sum = _mm_add_ps(
+					_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+					_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+				_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+			}
+		}
+	});
+	return dst;
+}
+
+static unsigned short pack565(const unsigned char* c)
+{
+	return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 |
+		((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void unpack565(unsigned short v, int* c)
+{
+	int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block, the end points are the two colors furthest apart along
+// the principal axis of the block
+static void encodeColor(const unsigned char pixels[16][4], unsigned char* out)
+{
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			mean[k] += pixels[i][k] / 16.f;
+	}
+
+	// covariance, xx xy xz yy yz zz
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2] };
+		cov[0] += d[0] * d[0];
+		cov[1] += d[0] * d[1];
+		cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1];
+		cov[4] += d[1] * d[2];
+		cov[5] += d[2] * d[2];
+	}
+
+	// a few rounds of power iteration are plenty for a 3x3 matrix
+	float axis[3] = { 1, 1, 1 };
+	for (int it = 0; it < 8; it++)
+	{
+		float v[3] = {
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+		float m = std::max(fabsf(v[0]), std::max(fabsf(v[1]), fabsf(v[2])));
+		if (m == 0)
+			break;
+		for (int k = 0; k < 3; k++)
+			axis[k] = v[k] / m;
+	}
+
+	int lo = 0, hi = 0;
+	float minDot = 1e30f, maxDot = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float d = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+		if (d < minDot)
+		{
+			minDot = d;
+			lo = i;
+		}
+		if (d > maxDot)
+		{
+			maxDot = d;
+			hi = i;
+		}
+	}
+
+	// color0 > color1 selects the four color mode
+	unsigned short c0 = pack565(pixels[hi]), c1 = pack565(pixels[lo]);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	int palette[4][3];
+	unpack565(c0, palette[0]);
+	unpack565(c1, palette[1]);
+	for (int k = 0; k < 3; k++)
+	{
+		palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+		palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+	}
+
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestDist = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = pixels[i][0] - palette[p][0];
+				int dg = pixels[i][1] - palette[p][1];
+				int db = pixels[i][2] - palette[p][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (2 * i);
+		}
+	}
+
+	out[0] = c0 & 0xFF;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF;
+	out[3] = c1 >> 8;
+	for (int b = 0; b < 4; b++)
+		out[4 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+// BC3 alpha / BC4 block of one channel, eight values between min and max
+static void encodeChannel(const unsigned char pixels[16][4], int channel, unsigned char* out)
+{
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		a0 = std::max(a0, (int)pixels[i][channel]);
+		a1 = std::min(a1, (int)pixels[i][channel]);
+	}
+
+	unsigned long long bits = 0;
+	if (a0 > a1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			// 0 is a0, 7 is a1, the six between are indices 2 to 7
+			int pos = ((a0 - pixels[i][channel]) * 7 + (a0 - a1) / 2) / (a0 - a1);
+			int index = pos == 0 ? 0 : pos == 7 ? 1 : pos + 1;
+			bits |= (unsigned long long)index << (3 * i);
+		}
+	}
+
+	out[0] = (unsigned char)a0;
+	out[1] = (unsigned char)a1;
+	for (int b = 0; b < 6; b++)
+		out[2 + b] = (bits >> (8 * b)) & 0xFF;
+}
+
+static void encodeLevel(const std::vector<unsigned char>& bytes, int width, int height,
+	GLenum format, char* out)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+
+	parallelRows(blocksY, std::max(1, 256 / blocksX), [&](unsigned int begin, unsigned int end)
+	{
+		unsigned char pixels[16][4];
+		for (unsigned int by = begin; by < end; by++)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				// blocks past the edge repeat the last row or column
+				for (int i = 0; i < 16; i++)
+				{
+					int x = std::min(bx * 4 + (i & 3), width - 1);
+					int y = std::min((int)by * 4 + (i >> 2), height - 1);
+					memcpy(pixels[i], &bytes[((size_t)y * width + x) * 4], 4);
+				}
+
+				unsigned char* block = (unsigned char*)out + ((size_t)by * blocksX + bx) * blockBytes;
+				if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+				{
+					encodeColor(pixels, block);
+				}
+				else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+				{
+					encodeChannel(pixels, 3, block);
+					encodeColor(pixels, block + 8);
+				}
+				else
+				{
+					encodeChannel(pixels, 0, block);
+					encodeChannel(pixels, 1, block + 8);
+				}
+			}
+		}
+	});
+}
+
+void TextureCache::encode(const std::vector<unsigned char>& pixels, int width, int height,
+	GLenum format, char* out)
+{
+	encodeLevel(pixels, width, height, format, out);
+}
+
+// cubemaps clamp so the seams between faces don't show
+static void setParameters(GLenum target)
+{
+	GLenum wrap = target == GL_TEXTURE_CUBE_MAP ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+GLuint TextureCache::load2D(const std::string& path)
+{
+	// models paged back in share the textures they had
+	std::unordered_map<std::string, GLuint>::iterator found = loaded2D.find(path);
+	if (found != loaded2D.end())
+	{
+		cached2D[found->second].users++;
+		return found->second;
+	}
+
+	GLuint texture = load(std::vector<std::string>(1, path), GL_TEXTURE_2D);
+	if (texture)
+	{
+		loaded2D[path] = texture;
+		Cached2D c;
+		c.path = path;
+		c.users = 1;
+		cached2D[texture] = c;
+	}
+	return texture;
+}
+
+void TextureCache::release2D(GLuint texture)
+{
+	std::unordered_map<GLuint, Cached2D>::iterator found = cached2D.find(texture);
+	if (found == cached2D.end() || --found->second.users > 0)
+		return;
+
+	// a streamed texture's slot stays, reads still in flight refer to it by
+	// index, but it has nothing resident and is never read again
+	std::unordered_map<GLuint, int>::iterator s = streamedIndex.find(texture);
+	if (s != streamedIndex.end())
+	{
+		StreamedTexture& t = streamed[s->second];
+		for (unsigned int l = t.resident; l < t.sizes.size(); l++)
+			residentBytes -= t.sizes[l];
+		t.id = 0;
+		t.broken = true;
+		t.resident = t.wanted = t.tail;
+		streamedIndex.erase(s);
+	}
+
+	loaded2D.erase(found->second.path);
+	cached2D.erase(found);
+	MemoryStats::deleteTextures(1, &texture);
+	releasedCount++;
+}
+
+GLuint TextureCache::loadCubemap(const std::vector<std::string>& faces)
+{
+	return load(faces, GL_TEXTURE_CUBE_MAP);
+}
+
+void TextureCache::report()
+{
+	if (textureCount == 0)
+		return;
+
+	char line[160];
+	snprintf(line, sizeof(line), "textures: %d, %d released, %.1f MB uploaded at load, %.1f MB as rgba8, %.1f ms",
+		(int)textureCount, (int)releasedCount, compressedBytes / 1048576.0, uncompressedBytes / 1048576.0,
+		loadTime * 1000.0);
+	std::cerr << line << std::endl;
+
+	if (streamed.empty())
+		return;
+
+	int live = 0, full = 0;
+	for (const StreamedTexture& t : streamed)
+	{
+		if (t.id == 0)
+			continue;
+		live++;
+		if (t.resident == 0)
+			full++;
+	}
+	snprintf(line, sizeof(line), "streaming: %d textures, %d at full size, %.1f of %.1f MB resident",
+		live, full, residentBytes / 1048576.0, budget / 1048576.0);
+	std::cerr << line << std::endl;
+}
+
+GLuint TextureCache::load(const std::vector<std::string>& sources, GLenum target)
+{
+	double start = glfwGetTime();
+
+	// the cache is stale once any of its images changes
+	long long sourceSize = 0, sourceTime = 0;
+	for (const std::string& source : sources)
+	{
+		struct stat st;
+		if (stat(source.c_str(), &st) != 0)
+		{
+			std::cerr << "Texture failed to load at path: " << source << std::endl;
+			return 0;
+		}
+		sourceSize += (long long)st.st_size;
+		sourceTime = std::max(sourceTime, (long long)st.st_mtime);
+	}
+
+#ifndef __APPLE__
+	if (!GLEW_EXT_texture_compression_s3tc)
+	{
+		GLuint texture = loadUncompressed(sources, target);
+		loadTime += glfwGetTime() - start;
+		return texture;
+	}
+#endif
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+
+	std::string cachePath = cacheName(sources[0]);
+	TextureHeader header;
+	bool uploaded = false;
+	{
+		MappedFile file(cachePath);
+		if (file.isOpen() && readHeader(file.begin(), file.length(), header) &&
+			header.sourceSize == sourceSize && header.sourceTime == sourceTime &&
+			header.faces == sources.size())
+		{
+			int first = streaming && target == GL_TEXTURE_2D ? tailLevel(header) : 0;
+			uploaded = upload(texture, file.begin(), file.length(), target, first);
+		}
+	}
+
+	bool cached = uploaded;
+	if (!uploaded)
+	{
+		std::vector<char> data;
+		if (!build(sources, sourceSize, sourceTime, data))
+		{
+			MemoryStats::deleteTextures(1, &texture);
+			return 0;
+		}
+
+		// still usable from memory if the cache can't be written, but then
+		// there is nothing to stream from and every level goes up now
+		makeCacheDir();
+		std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+		out.write(data.data(), data.size());
+		out.close();
+		cached = !out.fail();
+		if (!cached)
+			std::cerr << "Failed to write " << cachePath << std::endl;
+
+		readHeader(data.data(), data.size(), header);
+		int first = cached && streaming && target == GL_TEXTURE_2D ? tailLevel(header) : 0;
+		upload(texture, data.data(), data.size(), target, first);
+	}
+
+	setParameters(target);
+
+	if (cached && streaming && target == GL_TEXTURE_2D && tailLevel(header) > 0)
+	{
+		StreamedTexture t;
+		t.id = texture;
+		t.path = cachePath;
+		t.format = header.format;
+		t.width = header.width;
+		t.height = header.height;
+
+		size_t offset = sizeof(TextureHeader);
+		for (unsigned int l = 0; l < header.levels; l++)
+		{
+			size_t bytes = levelSize(header.format, std::max(1u, header.width >> l),
+				std::max(1u, header.height >> l));
+			t.offsets.push_back(offset);
+			t.sizes.push_back(bytes);
+			offset += bytes;
+		}
+
+		t.tail = tailLevel(header);
+		t.resident = t.wanted = t.tail;
+		for (unsigned int l = t.tail; l < header.levels; l++)
+			residentBytes += t.sizes[l];
+		t.loading = -1;
+		t.broken = false;
+		t.pixelsPerUV = 0;
+		t.lastUsed = 0;
+
+		streamedIndex[texture] = (int)streamed.size();
+		streamed.push_back(t);
+	}
+
+	textureCount++;
+	loadTime += glfwGetTime() - start;
+	return texture;
+}
+
+// encodes every level of every face into a .btex image in memory
+bool TextureCache::build(const std::vector<std::string>& sources, long long sourceSize,
+	long long sourceTime, std::vector<char>& out)
+{
+	std::vector<unsigned char*> images;
+	int width = 0, height = 0, channels = 0;
+	bool ok = true;
+	for (const std::string& source : sources)
+	{
+		int w, h, n;
+		unsigned char* data = stbi_load(source.c_str(), &w, &h, &n, 4);
+		if (!data)
+		{
+			std::cerr << "Texture failed to load at path: " << source << std::endl;
+			ok = false;
+			break;
+		}
+		images.push_back(data);
+
+		if (images.size() == 1)
+		{
+			width = w;
+			height = h;
+		}
+		else if (w != width || h != height)
+		{
+			std::cerr << "Cubemap faces differ in size: " << source << std::endl;
+			ok = false;
+			break;
+		}
+		channels = std::max(channels, n);
+	}
+
+	if (!ok)
+	{
+		for (unsigned char* data : images)
+			stbi_image_free(data);
+		return false;
+	}
+
+	// opaque rgba fits in BC1 as well
+	bool opaque = true;
+	for (unsigned char* data : images)
+	{
+		for (size_t i = 3; opaque && i < (size_t)width * height * 4; i += 4)
+			opaque = data[i] == 255;
+	}
+
+	// one and two channel images are data, not colors
+	GLenum format = channels <= 2 ? GL_COMPRESSED_RG_RGTC2 :
+		opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	bool srgb = channels >= 3;
+	int levels = levelCount(width, height);
+
+	size_t total = 0;
+	for (int l = 0; l < levels; l++)
+		total += levelSize(format, std::max(1, width >> l), std::max(1, height >> l));
+
+	TextureHeader header;
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.format = format;
+	header.width = width;
+	header.height = height;
+	header.levels = levels;
+	header.faces = (unsigned int)images.size();
+
+	out.resize(sizeof(TextureHeader) + total * images.size());
+	memcpy(out.data(), &header, sizeof(TextureHeader));
+	char* dst = out.data() + sizeof(TextureHeader);
+
+	for (unsigned char* data : images)
+	{
+		std::vector<unsigned char> bytes(data, data + (size_t)width * height * 4);
+		stbi_image_free(data);
+
+		// stb expands grey to rgb, keep it in red like GL_RED did and put
+		// the alpha of grey + alpha images in green
+		if (channels <= 2)
+		{
+			for (size_t i = 0; i < bytes.size(); i += 4)
+			{
+				bytes[i + 1] = channels == 2 ? bytes[i + 3] : 0;
+				bytes[i + 2] = 0;
+				bytes[i + 3] = 255;
+			}
+		}
+
+		// level 0 is encoded from the original bytes, the rest are
+		// filtered in linear space
+		Level level = toLinear(bytes, width, height, srgb);
+		for (int l = 0; l < levels; l++)
+		{
+			if (l > 0)
+			{
+				level = downsample(level);
+				bytes = toBytes(level, srgb);
+			}
+			encodeLevel(bytes, level.width, level.height, format, dst);
+			dst += levelSize(format, level.width, level.height);
+		}
+	}
+	return true;
+}
+
+// uploads a .btex image from firstLevel on, one call per level and face
+bool TextureCache::upload(GLuint texture, const char* data, size_t size, GLenum target, int firstLevel)
+{
+	TextureHeader header;
+	if (!readHeader(data, size, header))
+		return false;
+
+	const char* blocks = data + sizeof(TextureHeader);
+	for (unsigned int face = 0; face < header.faces; face++)
+	{
+		GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ?
+			GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+		for (unsigned int l = 0; l < header.levels; l++)
+		{
+			int width = std::max(1u, header.width >> l);
+			int height = std::max(1u, header.height >> l);
+			size_t bytes = levelSize(header.format, width, height);
+
+			if ((int)l >= firstLevel)
+			{
+				MemoryStats::compressedTexImage2D(texture, MemoryTag::TEXTURES, faceTarget, l,
+					header.format, width, height, (GLsizei)bytes, blocks);
+				compressedBytes += bytes;
+			}
+			blocks += bytes;
+			uncompressedBytes += (size_t)width * height * 4;
+		}
+	}
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+	return true;
+}
+
+// the old path for drivers without S3TC, mips are made by the driver
+GLuint TextureCache::loadUncompressed(const std::vector<std::string>& sources, GLenum target)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (unsigned int i = 0; i < sources.size(); i++)
+	{
+		int width, height, numComponents;
+		unsigned char* data = stbi_load(sources[i].c_str(), &width, &height, &numComponents, 0);
+		if (!data)
+		{
+			std::cerr << "Texture failed to load at path: " << sources[i] << std::endl;
+			continue;
+		}
+
+		GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		GLenum format = formats[numComponents - 1];
+		GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : target;
+		MemoryStats::texImage2D(texture, MemoryTag::TEXTURES, faceTarget, 0, format, width, height,
+			format, GL_UNSIGNED_BYTE, data);
+		stbi_image_free(data);
+
+		uncompressedBytes += (size_t)width * height * 4 * 4 / 3;
+		compressedBytes += (size_t)width * height * 4 * 4 / 3;
+	}
+	MemoryStats::generateMipmap(texture, target);
+
+	setParameters(target);
+
+	textureCount++;
+	return texture;
+}
+
+void TextureCache::startStreaming(size_t budget)
+{
+	if (streaming)
+		return;
+	TextureCache::budget = budget;
+	streaming = true;
+	reader = std::thread(readerLoop);
+}
+
+void TextureCache::stopStreaming()
+{
+	if (!streaming)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(readLock);
+		streaming = false;
+	}
+	readWake.notify_all();
+	reader.join();
+
+	reads.clear();
+	done.clear();
+}
+
+// only the camera cull job calls this, so nothing else touches pixelsPerUV
+void TextureCache::request(GLuint texture, float pixelsPerUV)
+{
+	std::unordered_map<GLuint, int>::const_iterator it = streamedIndex.find(texture);
+	if (it == streamedIndex.end())
+		return;
+
+	StreamedTexture& t = streamed[it->second];
+	t.pixelsPerUV = std::max(t.pixelsPerUV, pixelsPerUV);
+}
+
+void TextureCache::update()
+{
+	if (!streaming)
+		return;
+	frame++;
+
+	for (StreamedTexture& t : streamed)
+	{
+		if (t.pixelsPerUV > 0)
+		{
+			// one texel per pixel, finer mips would only alias
+			float texels = std::max(t.width, t.height) / t.pixelsPerUV;
+			t.wanted = texels <= 1.f ? 0 : std::min((int)log2f(texels), t.tail);
+			t.lastUsed = frame;
+			t.pixelsPerUV = 0;
+		}
+	}
+
+	std::deque<LevelRead> finished;
+	{
+		std::lock_guard<std::mutex> guard(readLock);
+		finished.swap(done);
+	}
+
+	// streamed levels are bound on unit 0, the passes rebind what they use
+	glActiveTexture(GL_TEXTURE0);
+
+	size_t uploaded = 0;
+	while (!finished.empty() && uploaded < UPLOAD_PER_FRAME)
+	{
+		LevelRead& r = finished.front();
+		StreamedTexture& t = streamed[r.texture];
+		t.loading = -1;
+
+		// a texture released while it was read wants no levels, so the
+		// read is just dropped
+		if (t.id != 0 && r.data.empty())
+		{
+			std::cerr << "Failed to stream " << r.path << std::endl;
+			t.broken = true;
+		}
+		// levels only go up right above the resident ones, and only while
+		// they are still wanted and fit
+		else if (r.level == t.resident - 1 && r.level >= t.wanted && evictFor(r.size, r.texture))
+		{
+			glBindTexture(GL_TEXTURE_2D, t.id);
+			MemoryStats::compressedTexImage2D(t.id, MemoryTag::TEXTURES, GL_TEXTURE_2D, r.level,
+				t.format, std::max(1u, t.width >> r.level), std::max(1u, t.height >> r.level),
+				(GLsizei)r.size, r.data.data());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, r.level);
+
+			t.resident = r.level;
+			residentBytes += r.size;
+			uploaded += r.size;
+		}
+		finished.pop_front();
+	}
+
+	// whatever didn't fit in this frame goes first next frame
+	if (!finished.empty())
+	{
+		std::lock_guard<std::mutex> guard(readLock);
+		done.insert(done.begin(), finished.begin(), finished.end());
+	}
+
+	std::vector<LevelRead> queued;
+	for (int i = 0; i < (int)streamed.size(); i++)
+	{
+		StreamedTexture& t = streamed[i];
+		// only what is on screen now streams in
+		if (t.broken || t.loading >= 0 || t.lastUsed != frame || t.wanted >= t.resident)
+			continue;
+
+		// don't read what couldn't be uploaded anyway
+		int level = t.resident - 1;
+		if (residentBytes + t.sizes[level] > budget + evictable(i))
+			continue;
+
+		LevelRead r;
+		r.texture = i;
+		r.level = level;
+		r.path = t.path;
+		r.offset = t.offsets[level];
+		r.size = t.sizes[level];
+		queued.push_back(r);
+		t.loading = level;
+	}
+
+	if (!queued.empty())
+	{
+		{
+			std::lock_guard<std::mutex> guard(readLock);
+			reads.insert(reads.end(), queued.begin(), queued.end());
+		}
+		readWake.notify_one();
+	}
+}
+
+// bytes that could be freed for texture keep, the levels of textures not
+// seen this frame and the levels finer than wanted
+size_t TextureCache::evictable(int keep)
+{
+	size_t bytes = 0;
+	for (int i = 0; i < (int)streamed.size(); i++)
+	{
+		const StreamedTexture& t = streamed[i];
+		if (i == keep)
+			continue;
+
+		int keepLevel = t.lastUsed == frame ? t.wanted : t.tail;
+		for (int l = t.resident; l < keepLevel; l++)
+			bytes += t.sizes[l];
+	}
+	return bytes;
+}
+
+// makes room for bytes more by dropping the finest levels of the least
+// recently seen textures, false if it can't
+bool TextureCache::evictFor(size_t bytes, int keep)
+{
+	if (residentBytes + bytes > budget + evictable(keep))
+		return false;
+
+	while (residentBytes + bytes > budget)
+	{
+		// textures finer than they need go before unseen ones
+		int victim = -1;
+		for (int i = 0; i < (int)streamed.size(); i++)
+		{
+			const StreamedTexture& t = streamed[i];
+			if (i == keep)
+				continue;
+			bool excess = t.lastUsed == frame ? t.resident < t.wanted : t.resident < t.tail;
+			if (!excess)
+				continue;
+
+			if (victim < 0)
+			{
+				victim = i;
+				continue;
+			}
+			const StreamedTexture& v = streamed[victim];
+			bool vUnseen = v.lastUsed != frame, tUnseen = t.lastUsed != frame;
+			if (tUnseen < vUnseen || (tUnseen == vUnseen && t.lastUsed < v.lastUsed))
+				victim = i;
+		}
+		if (victim < 0)
+			return false;
+		evictLevel(streamed[victim]);
+	}
+	return true;
+}
+
+void TextureCache::evictLevel(StreamedTexture& t)
+{
+	glBindTexture(GL_TEXTURE_2D, t.id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t.resident + 1);
+
+	// a 0x0 image frees the level, it is below the base level so the
+	// texture stays complete
+	MemoryStats::texImage2D(t.id, MemoryTag::TEXTURES, GL_TEXTURE_2D, t.resident, GL_RGBA, 0, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	residentBytes -= t.sizes[t.resident];
+	t.resident++;
+}
+
+// reads one level at a time from the .btex files, GL stays on the render thread
+void TextureCache::readerLoop()
+{
+	while (true)
+	{
+		LevelRead r;
+		{
+			std::unique_lock<std::mutex> lock(readLock);
+			readWake.wait(lock, []() { return !reads.empty() || !streaming; });
+			if (!streaming)
+				return;
+			r = reads.front();
+			reads.pop_front();
+		}
+
+		std::ifstream in(r.path, std::ios::binary);
+		r.data.resize(r.size);
+		if (!in.seekg(r.offset) || !in.read(r.data.data(), r.size))
+			r.data.clear();
+
+		std::lock_guard<std::mutex> guard(readLock);
+		done.push_back(r);
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "JobSystem.h"
+#include "MemoryStats.h"
+
+// Loads textures as block compressed mip chains. The first time an image is
+// loaded its mips are filtered on the cpu (in linear space for colors), then
+// encoded to BC1 (rgb, opaque rgba), BC3 (rgba) or BC5 (one and two channel
+// images) and saved in CACHE_DIR as a .btex file. Later loads map that file
+// and hand the blocks straight to glCompressedTexImage2D. A cache older than
+// its image is rebuilt.
+//
+// While streaming, 2D textures only get their mips up to 64 pixels at load.
+// Culling reports how large each texture shows on screen, update picks the
+// mip each one needs and a reader thread pulls the finer levels out of the
+// .btex file one at a time. Residency stays under a byte budget by dropping
+// the finest mips of the textures that were seen longest ago.
+class TextureCache
+{
+public:
+	// encodes on the job system when set, else on the calling thread
+	static JobSystem* jobs;
+	// where the .btex files go, relative to the working directory
+	static const char* CACHE_DIR;
+
+	// returns the GL texture, 0 if the image can't be read. an image loaded
+	// before gives the same texture again, every load needs a release2D
+	static GLuint load2D(const std::string& path);
+	// the texture is deleted when the last user of it releases it
+	static void release2D(GLuint texture);
+	// faces in +x, -x, +y, -y, +z, -z order, all the same size
+	static GLuint loadCubemap(const std::vector<std::string>& faces);
+
+	// prints texture memory against uncompressed rgba8 and the load time
+	static void report();
+
+	// 2D textures loaded after this stream their mips under budget bytes
+	static void startStreaming(size_t budget);
+	static void stopStreaming();
+	// from the camera cull, the texture covers pixelsPerUV screen pixels per
+	// texture coordinate unit somewhere this frame
+	static void request(GLuint texture, float pixelsPerUV);
+	// once a frame on the render thread, uploads finished reads, evicts and
+	// queues the next reads
+	static void update();
+
+	// block compresses rgba8 pixels into out with the encoders of the
+	// cache, format is the GL name of BC1, BC3 or BC5
+	// (GL_COMPRESSED_RGBA_S3TC_DXT5_EXT for BC3)
+	static void encode(const std::vector<unsigned char>& pixels, int width, int height,
+		GLenum format, char* out);
+
+private:
+	struct StreamedTexture
+	{
+		GLuint id;
+		std::string path;
+		GLenum format;
+		unsigned int width, height;
+		std::vector<size_t> offsets, sizes; // of each level in the file
+
+		int tail; // coarsest level that is streamed, everything past stays
+		int resident; // finest level uploaded
+		int wanted; // finest level the last time it was seen
+		int loading; // level being read, -1 if none
+		bool broken; // the file couldn't be read, stop trying
+
+		float pixelsPerUV; // largest requested this frame
+		unsigned long long lastUsed; // frame it was last seen
+	};
+
+	struct LevelRead
+	{
+		int texture, level;
+		std::string path;
+		size_t offset, size;
+		std::vector<char> data; // empty when the read failed
+	};
+
+	static bool streaming;
+	static size_t budget, residentBytes;
+	static unsigned long long frame;
+	static std::vector<StreamedTexture> streamed;
+	static std::unordered_map<GLuint, int> streamedIndex;
+
+	static std::thread reader;
+	static std::mutex readLock;
+	static std::condition_variable readWake;
+	static std::deque<LevelRead> reads, done;
+
+	static void readerLoop();
+	static size_t evictable(int keep);
+	static bool evictFor(size_t bytes, int keep);
+	static void evictLevel(StreamedTexture& t);
+
+	// the 2D textures by path, and each one's path and users
+	struct Cached2D
+	{
+		std::string path;
+		unsigned int users;
+	};
+	static std::unordered_map<std::string, GLuint> loaded2D;
+	static std::unordered_map<GLuint, Cached2D> cached2D;
+
+	static size_t textureCount, releasedCount;
+	static size_t compressedBytes, uncompressedBytes;
+	static double loadTime;
+
+	static bool build(const std::vector<std::string>& sources, long long sourceSize,
+		long long sourceTime, std::vector<char>& out);
+	static bool upload(GLuint texture, const char* data, size_t size, GLenum target, int firstLevel);
+	static GLuint loadUncompressed(const std::vector<std::string>& sources, GLenum target);
+	static GLuint load(const std::vector<std::string>& sources, GLenum target);
+};
+
+#endif
@@ -1,14 +1,22 @@
 #include "Transform.h"
 #include "Window.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+TransformSystem* Transform::system = nullptr;
 
 Transform::Transform(glm::mat4 M)
 {
-	Transform::M = M;
+	if (system == nullptr)
+		system = new TransformSystem();
+
+	handle = system->create(M);
 }
 
 Transform::~Transform()
 {
-	children.empty();
+	system->release(handle);
 }
 
 void Transform::draw(glm::mat4 C, unsigned int shaderProgram)
@@ -19,7 +27,7 @@ void Transform::draw(glm::mat4 C, unsigned int shaderProgram)
 	*/
 
 	// modify transform by this object's transform matrix
-	glm::mat4 tf = C * M;
+	glm::mat4 tf = C * system->getLocal(handle);
 
 	// for each children, draw with the new transform matrix
 	for each  (Node* child in children)
@@ -33,19 +41,79 @@ void Transform::update(glm::mat4 C)
 	
 	for each (Node* child in children)
 	{
-		child->update(C * M);
+		child->update(C * system->getLocal(handle));
 	
 	}
 }
 
+void Transform::collect(glm::mat4 C, std::vector<DrawItem>& items)
+{
+	const glm::mat4& tf = system->getWorld(handle);
+
+	for each (Node* child in children)
+	{
+		child->collect(tf, items);
+	}
+}
+
+void Transform::updateParallel(JobSystem* jobs, glm::mat4 C)
+{
+	glm::mat4 tf = C * system->getLocal(handle);
+	JobCounter counter;
+
+	for each (Node* child in children)
+	{
+		jobs->run(counter, [child, tf]() { child->update(tf); });
+	}
+	jobs->wait(counter);
+}
+
+void Transform::collectParallel(JobSystem* jobs, glm::mat4 C, std::vector<DrawItem>& items)
+{
+	glm::mat4 tf = system->getWorld(handle);
+	JobCounter counter;
+
+	// every subtree fills its own list so jobs never share a vector
+	std::vector<std::vector<DrawItem>> lists(children.size());
+	unsigned int i = 0;
+	for each (Node* child in children)
+	{
+		std::vector<DrawItem>* list = &lists[i++];
+		jobs->run(counter, [child, tf, list]() { child->collect(tf, *list); });
+	}
+	jobs->wait(counter);
+
+	// merge in child order so the result doesn't depend on scheduling
+	for (std::vector<DrawItem>& list : lists)
+		items.insert(items.end(), list.begin(), list.end());
+}
 
 // adds new child to list of children
 void Transform::addChild(Node* child)
 {
 	children.push_back(child);
+
+	// mirror the edge in the transform system when the child is a Transform
+	Transform* t = dynamic_cast<Transform*>(child);
+	if (t != nullptr)
+		system->setParent(t->handle, handle);
 }
 
 
+const std::vector<Node*>& Transform::getChildren()
+{
+	return children;
+}
+
+void Transform::removeChild(Node* child)
+{
+	children.erase(std::remove(children.begin(), children.end(), child), children.end());
+
+	Transform* t = dynamic_cast<Transform*>(child);
+	if (t != nullptr)
+		system->setParent(t->handle, -1);
+}
+
  /*void Transform::setBound(BoundingSphere* s)
 {
 	bsphere = s;
@@ -53,5 +121,10 @@ void Transform::addChild(Node* child)
 
 void Transform::setTransform(glm::mat4 mat)
 {
-	M = mat;
+	system->setLocal(handle, mat);
+}
+
+const glm::mat4& Transform::getWorld()
+{
+	return system->getWorld(handle);
 }
@@ -9,21 +9,27 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
-#include <list>
 #include <glm/gtx/euler_angles.hpp>
 
 #include "Node.h"
+#include "JobSystem.h"
+#include "TransformSystem.h"
 #include <iostream>
 
 class Transform : public Node
 {
 private:
-	std::list<Node*> children;
-	glm::mat4 M;
+	// owned, SceneMemory::destroy takes the subtree down with this node
+	std::vector<Node*> children;
+
+	// slot of this node in the transform system, holds the local matrix
+	int handle;
 
 	// BoundingSphere* bsphere; 
 
 public:
+	// world matrices of every Transform live here instead of in the nodes
+	static TransformSystem* system;
 
 	Transform(glm::mat4 M);
 	~Transform();
@@ -32,11 +38,23 @@ public:
 
 	void update(glm::mat4 C);
 
+	// collect reads the cached world matrix, so C must be the parent's world
+	// matrix, call system->update() after changing transforms
+	void collect(glm::mat4 C, std::vector<DrawItem>& items);
+
+	// same as update and collect, but every child subtree runs as a job
+	void updateParallel(JobSystem* jobs, glm::mat4 C);
+	void collectParallel(JobSystem* jobs, glm::mat4 C, std::vector<DrawItem>& items);
+
 	void addChild(Node* child);
+	// the child is detached, not destroyed
+	void removeChild(Node* child);
+	const std::vector<Node*>& getChildren();
 
 	// void setBound(BoundingSphere* s);
 
 	void setTransform(glm::mat4 mat);
+	const glm::mat4& getWorld();
 };
 
 #endif
@@ -0,0 +1,294 @@
+#include "TransformSystem.h"
+
+#include <glm/gtx/transform.hpp>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+TransformSystem::TransformSystem()
+{
+	needsSort = false;
+	anyDirty = false;
+}
+
+// adds a root node, new nodes go to the end which keeps the order valid
+int TransformSystem::create(glm::mat4 local)
+{
+	int handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (int)indices.size();
+		indices.push_back(-1);
+		childHandles.emplace_back();
+		childPositions.push_back(-1);
+	}
+
+	indices[handle] = (int)parents.size();
+	parents.push_back(-1);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+	handles.push_back(handle);
+	anyDirty = true;
+
+	return handle;
+}
+
+// the slot is only removed on the next sort, its children become roots
+void TransformSystem::release(int handle)
+{
+	int i = indices[handle];
+	unlink(handle);
+
+	for (int c : childHandles[handle])
+	{
+		int ci = indices[c];
+		parents[ci] = -1;
+		dirty[ci] = 1;
+		childPositions[c] = -1;
+	}
+	childHandles[handle].clear();
+
+	handles[i] = -1;
+	indices[handle] = -1;
+	freeHandles.push_back(handle);
+	needsSort = true;
+	anyDirty = true;
+}
+
+// takes the node out of its parent's list, the last child fills the gap
+void TransformSystem::unlink(int handle)
+{
+	int i = indices[handle];
+	if (parents[i] < 0)
+		return;
+
+	std::vector<int>& siblings = childHandles[handles[parents[i]]];
+	int position = childPositions[handle];
+	siblings[position] = siblings.back();
+	childPositions[siblings[position]] = position;
+	siblings.pop_back();
+	childPositions[handle] = -1;
+	parents[i] = -1;
+}
+
+void TransformSystem::setParent(int handle, int parentHandle)
+{
+	unlink(handle);
+
+	int i = indices[handle];
+	int p = parentHandle < 0 ? -1 : indices[parentHandle];
+
+	parents[i] = p;
+	dirty[i] = 1;
+	anyDirty = true;
+	if (p >= 0)
+	{
+		childPositions[handle] = (int)childHandles[parentHandle].size();
+		childHandles[parentHandle].push_back(handle);
+	}
+
+	// a parent stored after its child breaks the single pass update
+	if (p > i)
+		needsSort = true;
+}
+
+void TransformSystem::setLocal(int handle, glm::mat4 local)
+{
+	int i = indices[handle];
+	locals[i] = local;
+	dirty[i] = 1;
+	anyDirty = true;
+}
+
+glm::mat4 TransformSystem::getLocal(int handle)
+{
+	return locals[indices[handle]];
+}
+
+const glm::mat4& TransformSystem::getWorld(int handle)
+{
+	return worlds[indices[handle]];
+}
+
+// recomputes world matrices of dirty nodes and everything below them
+void TransformSystem::update()
+{
+	if (needsSort)
+		sortTopological();
+	if (!anyDirty)
+		return;
+
+	unsigned int n = (unsigned int)parents.size();
+	for (unsigned int i = 0; i < n; i++)
+	{
+		int p = parents[i];
+
+		// a changed parent dirties the whole subtree below it
+		if (p >= 0 && dirty[p])
+			dirty[i] = 1;
+		if (!dirty[i])
+			continue;
+
+		if (p >= 0)
+			multiply(worlds[p], locals[i], worlds[i]);
+		else
+			worlds[i] = locals[i];
+	}
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+	anyDirty = false;
+}
+
+unsigned int TransformSystem::size()
+{
+	return (unsigned int)parents.size();
+}
+
+// orders nodes by depth in the tree and drops released slots
+void TransformSystem::sortTopological()
+{
+	unsigned int n = (unsigned int)parents.size();
+
+	std::vector<int> depth(n, -1);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		// walk up until a node with a known depth, then fill in on the way back
+		std::vector<int> chain;
+		int c = (int)i;
+		while (c >= 0 && depth[c] < 0)
+		{
+			chain.push_back(c);
+			c = parents[c];
+		}
+		int d = c >= 0 ? depth[c] : -1;
+		for (int k = (int)chain.size() - 1; k >= 0; k--)
+			depth[chain[k]] = ++d;
+	}
+
+	std::vector<int> order;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		if (handles[i] >= 0)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&depth](int a, int b) { return depth[a] < depth[b]; });
+
+	std::vector<int> remap(n, -1);
+	for (unsigned int i = 0; i < order.size(); i++)
+		remap[order[i]] = i;
+
+	std::vector<int> newParents(order.size());
+	std::vector<glm::mat4> newLocals(order.size()), newWorlds(order.size());
+	std::vector<int> newHandles(order.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		int old = order[i];
+		newParents[i] = parents[old] >= 0 ? remap[parents[old]] : -1;
+		newLocals[i] = locals[old];
+		newWorlds[i] = worlds[old];
+		newHandles[i] = handles[old];
+		indices[handles[old]] = i;
+	}
+
+	parents.swap(newParents);
+	locals.swap(newLocals);
+	worlds.swap(newWorlds);
+	handles.swap(newHandles);
+
+	// everything moved, recompute it all once
+	dirty.assign(order.size(), 1);
+	anyDirty = true;
+	needsSort = false;
+}
+
+void TransformSystem::multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#ifdef TRANSFORM_SSE
+	const float* pa = &a[0][0];
+	const float* pb = &b[0][0];
+	float* po = &out[0][0];
+
+	__m128 a0 = _mm_loadu_ps(pa);
+	__m128 a1 = _mm_loadu_ps(pa + 4);
+	__m128 a2 = _mm_loadu_ps(pa + 8);
+	__m128 a3 = _mm_loadu_ps(pa + 12);
+
+	// column j of the result is a's columns weighted by column j of b
+	for (int j = 0; j < 4; j++)
+	{
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(pb[4 * j]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(pb[4 * j + 1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(pb[4 * j + 2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(pb[4 * j + 3])));
+		_mm_storeu_ps(po + 4 * j, r);
+	}
+#else
+	out = a * b;
+#endif
+}
+
+void TransformSystem::benchmark(unsigned int nodeCount)
+{
+	if (nodeCount == 0)
+		return;
+
+	// every node hangs off a random earlier one, a few levels deep on average
+	TransformSystem system;
+	std::mt19937 rng(167);
+	std::vector<int> nodes(nodeCount);
+	double start = glfwGetTime();
+	for (unsigned int i = 0; i < nodeCount; i++)
+	{
+		nodes[i] = system.create(glm::translate(glm::vec3((float)(i % 7), 0.f, 0.f)));
+		if (i > 0)
+			system.setParent(nodes[i], nodes[rng() % i]);
+	}
+	system.update();
+	double built = glfwGetTime() - start;
+
+	// everything moved, then one node in a hundred
+	const int RUNS = 10;
+	start = glfwGetTime();
+	for (int r = 0; r < RUNS; r++)
+	{
+		system.setLocal(nodes[0], glm::translate(glm::vec3(0.f, (float)r, 0.f)));
+		system.update();
+	}
+	double full = (glfwGetTime() - start) / RUNS;
+	start = glfwGetTime();
+	for (int r = 0; r < RUNS; r++)
+	{
+		for (unsigned int i = 1; i < nodeCount; i += 100)
+			system.setLocal(nodes[i], glm::translate(glm::vec3(0.f, 0.f, (float)r)));
+		system.update();
+	}
+	double partial = (glfwGetTime() - start) / RUNS;
+
+	// children before parents, the way SceneMemory::destroy goes
+	start = glfwGetTime();
+	for (unsigned int i = nodeCount; i-- > 0; )
+		system.release(nodes[i]);
+	system.update();
+	double teardown = glfwGetTime() - start;
+
+	char line[256];
+	snprintf(line, sizeof(line), "transforms: %u nodes built in %.1f ms, update %.2f ms all dirty, "
+		"%.2f ms 1%% dirty, teardown %.1f ms", nodeCount, built * 1000.0, full * 1000.0,
+		partial * 1000.0, teardown * 1000.0);
+	std::cerr << line << std::endl;
+}
@@ -0,0 +1,60 @@
+#ifndef _TRANSFORM_SYSTEM_H_
+#define _TRANSFORM_SYSTEM_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Stores the local and world matrices of every Transform in flat arrays
+// sorted so a parent always comes before its children. Updating world
+// matrices is then one linear pass, and nodes whose local matrix and
+// parents didn't change since the last update are skipped.
+//
+// Nodes are referred to by handles, indices change whenever the arrays are
+// re-sorted after a reparent.
+class TransformSystem
+{
+private:
+	// indexed by position in topological order
+	std::vector<int> parents; // index of the parent, -1 for roots
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned char> dirty;
+	std::vector<int> handles; // handle owning each slot, -1 once released
+
+	// indexed by handle
+	std::vector<int> indices;
+	std::vector<int> freeHandles;
+	// handles below each node and where a node is in its parent's list, -1
+	// for roots. By handle so sorting doesn't touch them.
+	std::vector<std::vector<int>> childHandles;
+	std::vector<int> childPositions;
+
+	bool needsSort;
+	bool anyDirty;
+
+	void sortTopological();
+	void unlink(int handle);
+
+public:
+	TransformSystem();
+
+	int create(glm::mat4 local);
+	void release(int handle);
+
+	void setParent(int handle, int parentHandle);
+	void setLocal(int handle, glm::mat4 local);
+	glm::mat4 getLocal(int handle);
+	const glm::mat4& getWorld(int handle);
+
+	void update();
+	unsigned int size();
+
+	// out = a * b using SSE when available, out must not alias a
+	static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+
+	// builds a random tree of nodeCount nodes in a system of its own, times
+	// full and partial updates and tearing it down, prints the results
+	static void benchmark(unsigned int nodeCount);
+};
+
+#endif
@@ -19,7 +19,57 @@ bool Window::normalColor;
 
 GLfloat Window::modelSize;
 
-double Window::prevTime;
+FrameScheduler* Window::scheduler;
+JobSystem* Window::jobs;
+Animator* Window::animator;
+Scene* Window::scene;
+
+std::vector<DrawItem> Window::sceneItems;
+RenderQueue Window::shadowQueue, Window::cameraQueue;
+double Window::transformTime = 0, Window::collectTime = 0, Window::cullTime = 0, Window::submitTime = 0;
+unsigned long long Window::framesBuilt = 0;
+
+GpuCulling* Window::gpuCulling = nullptr;
+bool Window::gpuDriven = true; // F9 goes back to the cpu queues, for comparison
+std::vector<DrawItem> Window::cpuItems;
+float Window::pathTime = -1;
+SceneBvh* Window::sceneBvh;
+bool Window::cameraCollision = true; // C lets the camera fly through walls
+Lightmaps* Window::lightmaps;
+bool Window::useLightmaps = true; // L goes back to runtime lighting, for comparison
+bool Window::shadowPass = true;
+unsigned long long Window::shadowPassesSkipped = 0;
+
+// where F12 saves the bake of the scene
+static const char* LIGHTMAP_PATH = "scenes/room.lightmap";
+
+// size of the camera as a sphere, for collision
+static const float CAMERA_RADIUS = 0.5f;
+
+// the loop F10 flies the camera along, past the big meshes up close and
+// from across the room, and what it looks at on the way
+static const int PATH_POINTS = 6;
+static const float PATH_SECONDS = 24.f;
+static const glm::vec3 pathEyes[PATH_POINTS] = {
+	glm::vec3(0, 8, 10), glm::vec3(18, 6, 18), glm::vec3(36, 7, 6),
+	glm::vec3(24, 9, -18), glm::vec3(-6, 6, -10), glm::vec3(-4, 10, 14)
+};
+static const glm::vec3 pathTargets[PATH_POINTS] = {
+	glm::vec3(0, 4, -22), glm::vec3(26, 4, 10), glm::vec3(46, 2, -8),
+	glm::vec3(0, 3, -22), glm::vec3(4, 3.7f, 25), glm::vec3(26, 4, 10)
+};
+
+// catmull-rom through the points of a closed loop, t from 0 to 1 between
+// point i and the next
+static glm::vec3 pathPoint(const glm::vec3* points, int i, float t)
+{
+	glm::vec3 p0 = points[(i + PATH_POINTS - 1) % PATH_POINTS];
+	glm::vec3 p1 = points[i % PATH_POINTS];
+	glm::vec3 p2 = points[(i + 1) % PATH_POINTS];
+	glm::vec3 p3 = points[(i + 2) % PATH_POINTS];
+	return 0.5f * (2.f * p1 + (p2 - p0) * t + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t * t +
+		(3.f * p1 - p0 - 3.f * p2 + p3) * t * t * t);
+}
 
 PlayerControl Window::xControl = PlayerControl::NONE, 
 			  Window::yControl = PlayerControl::NONE, 
@@ -33,6 +83,16 @@ bool Window::displayShadowmap = false;
 bool Window::displayShadows = true;
 bool Window::displayBloom = true;
 bool Window::toonShading = true;
+bool Window::bruteForcePcf = false; // 6x6 shadow filter everywhere, for comparison
+
+GLuint Window::cameraQueries[NUM_QUERIES];
+int Window::queryFilter[NUM_QUERIES];
+unsigned long long Window::queryFrame = 0;
+double Window::cameraGpuTime[2] = { 0, 0 };
+unsigned long long Window::cameraGpuFrames[2] = { 0, 0 };
+
+FrameCapture* Window::capture = nullptr;
+bool Window::captureAll = false;
 
 GLuint Window::mode = 1; // mouse mode for rotation
 
@@ -50,6 +110,7 @@ GLuint Window::pingpongBuffer[2];
 glm::vec3 Window::eye(0, 8, 10); // Camera position.
 glm::vec3 Window::front(0, 0, -1.f); // The direction of the front of the camera.
 glm::vec3 Window::up(0, 1, 0); // The up direction of the camera.
+glm::vec3 Window::prevEye = Window::eye; // Camera position at the previous tick.
 
 // View matrix, defined by eye, center and up.
 glm::mat4 Window::view = glm::lookAt(Window::eye, Window::eye + Window::front, 
@@ -58,8 +119,19 @@ std::vector<LightSource*> Window::lights;
 
 GLuint Window::program;
 GLuint Window::texProgram, Window::depthProgram; // The shader program ids
+GLuint Window::variantPrograms[NUM_VARIANTS]; // texture_shader builds, by variant
+GLuint Window::gpuVariantPrograms[NUM_VARIANTS];
 GLuint Window::skyboxProgram;
 
+// builds the programs above and rebuilds them when their files change
+ShaderManager* Window::shaders;
+ShaderId Window::programId, Window::depthProgramId, Window::depthDebugId;
+ShaderId Window::variantIds[NUM_VARIANTS];
+ShaderId Window::bruteShadowIds[2];
+ShaderId Window::gpuVariantIds[NUM_VARIANTS];
+ShaderId Window::gpuBruteShadowIds[2];
+ShaderId Window::blurProgramId, Window::bloomProgramId, Window::skyboxProgramId;
+
 GLuint Window::projectionLoc; // Location of projection in shader.
 GLuint Window::viewLoc; // Location of view in shader.
 GLuint Window::eyeLoc; // Location of the viewer in shader.
@@ -69,25 +141,72 @@ bool Window::initializeProgram() {
 	// glDebugMessageCallback((GLDEBUGPROC)MessageCallback, 0);
 
 	// Create a shader program with a vertex shader and a fragment shader.
-	program = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
-	texProgram = LoadShaders("shaders/texture_shader.vert", "shaders/texture_shader.frag");
-	depthProgram = LoadShaders("shaders/depth_shader.vert", "shaders/depth_shader.frag");
-	depthDebug = LoadShaders("shaders/depth_debug.vert", "shaders/depth_debug.frag");
-	blurProgram = LoadShaders("shaders/blur_shader.vert", "shaders/blur_shader.frag");
-	bloomProgram = LoadShaders("shaders/bloom_shader.vert", "shaders/bloom_shader.frag");
-	skyboxProgram = LoadShaders("shaders/skybox_shader.vert", "shaders/bloom_shader.frag");
+	shaders = new ShaderManager("shaders/cache");
+	programId = shaders->add("shaders/shader.vert", "shaders/shader.frag", {});
+	depthProgramId = shaders->add("shaders/depth_shader.vert", "shaders/depth_shader.frag", {});
+
+	// one build of the texture shader per combination of lighting features
+	const char* texVert = "shaders/texture_shader.vert";
+	const char* texFrag = "shaders/texture_shader.frag";
+	variantIds[VARIANT_LIT] = shaders->add(texVert, texFrag, { "LIT" });
+	variantIds[VARIANT_LIT_SHADOW] = shaders->add(texVert, texFrag, { "LIT", "SHADOWS" });
+	variantIds[VARIANT_LIT_TOON] = shaders->add(texVert, texFrag, { "LIT", "TOON" });
+	variantIds[VARIANT_LIT_TOON_SHADOW] = shaders->add(texVert, texFrag, { "LIT", "TOON", "SHADOWS" });
+	variantIds[VARIANT_LIT_BAKED] = shaders->add(texVert, texFrag, { "LIT", "LIGHTMAP" });
+	variantIds[VARIANT_LIT_TOON_BAKED] = shaders->add(texVert, texFrag, { "LIT", "TOON", "LIGHTMAP" });
+	variantIds[VARIANT_UNLIT] = shaders->add(texVert, texFrag, {});
+	variantIds[VARIANT_DEPTH] = depthProgramId;
+	bruteShadowIds[0] = shaders->add(texVert, texFrag, { "LIT", "SHADOWS", "PCF_BRUTE" });
+	bruteShadowIds[1] = shaders->add(texVert, texFrag, { "LIT", "TOON", "SHADOWS", "PCF_BRUTE" });
+	depthDebugId = shaders->add("shaders/depth_debug.vert", "shaders/depth_debug.frag", {});
+	blurProgramId = shaders->add("shaders/blur_shader.vert", "shaders/blur_shader.frag", {});
+	bloomProgramId = shaders->add("shaders/bloom_shader.vert", "shaders/bloom_shader.frag", {});
+	skyboxProgramId = shaders->add("shaders/skybox_shader.vert", "shaders/bloom_shader.frag", {});
+
+	// with compute shaders the static meshes are culled and drawn by the
+	// gpu, with builds that read their model matrices from its buffers
+	if (GpuCulling::isSupported())
+	{
+		gpuCulling = new GpuCulling(shaders);
+		gpuVariantIds[VARIANT_LIT] = shaders->add(texVert, texFrag, { "LIT", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_LIT_SHADOW] = shaders->add(texVert, texFrag, { "LIT", "SHADOWS", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_LIT_TOON] = shaders->add(texVert, texFrag, { "LIT", "TOON", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_LIT_TOON_SHADOW] = shaders->add(texVert, texFrag,
+			{ "LIT", "TOON", "SHADOWS", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_LIT_BAKED] = shaders->add(texVert, texFrag, { "LIT", "LIGHTMAP", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_LIT_TOON_BAKED] = shaders->add(texVert, texFrag,
+			{ "LIT", "TOON", "LIGHTMAP", "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_UNLIT] = shaders->add(texVert, texFrag, { "GPU_DRIVEN" });
+		gpuVariantIds[VARIANT_DEPTH] = shaders->add("shaders/depth_shader.vert", "shaders/depth_shader.frag",
+			{ "GPU_DRIVEN" });
+		gpuBruteShadowIds[0] = shaders->add(texVert, texFrag, { "LIT", "SHADOWS", "PCF_BRUTE", "GPU_DRIVEN" });
+		gpuBruteShadowIds[1] = shaders->add(texVert, texFrag,
+			{ "LIT", "TOON", "SHADOWS", "PCF_BRUTE", "GPU_DRIVEN" });
+	}
+	else
+		std::cerr << "no compute shaders, culling on the cpu" << std::endl;
 
 	// Check the shader program.
-	if (!program || !texProgram || !depthProgram || !depthDebug ||
-		!blurProgram || !bloomProgram)
+	if (!shaders->build())
 	{
 		std::cerr << "Failed to initialize shader program" << std::endl;
 		return false;
 	}
+	updatePrograms();
+
+	// the driver's binary size is the only per variant cost GL exposes
+	const char* variantNames[NUM_VARIANTS] = { "lit", "lit+shadow", "lit+toon",
+		"lit+toon+shadow", "lit+lightmap", "lit+toon+lightmap", "unlit", "depth" };
+	for (int i = 0; i < NUM_VARIANTS; i++)
+	{
+		std::cerr << "variant " << variantNames[i] << ": "
+			<< shaders->getBinarySize(variantIds[i]) << " bytes" << std::endl;
+	}
+	std::cerr << "variant lit+shadow brute force pcf: " << shaders->getBinarySize(bruteShadowIds[0])
+		<< " bytes, lit+toon+shadow: " << shaders->getBinarySize(bruteShadowIds[1]) << " bytes" << std::endl;
 
 	cameraPitch = 0;
 	cameraYaw = -90;
-	prevTime = glfwGetTime();
 
 	// Activate the shader program.
 	glUseProgram(texProgram);
@@ -98,15 +217,21 @@ bool Window::initializeProgram() {
 	glGenTextures(1, &depthmap);
 	glBindTexture(GL_TEXTURE_2D, depthmap);
 	// gen with dimensions 1024x1024
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		1024, 1024, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	MemoryStats::texImage2D(depthmap, MemoryTag::RENDER_TARGETS, GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
+		1024, 1024, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// sampled with depth compares, linear filtering blends the results of
+	// the four nearest texels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	float borderColor[] = { 1.f, 1.f, 1.f, 1.f };
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
 
+	glGenQueries(NUM_QUERIES, cameraQueries);
+
 	// attach generated texture to depth buffer
 	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthmap, 0);
@@ -129,8 +254,8 @@ bool Window::initializeProgram() {
 	for (unsigned int i = 0; i < 2; i++)
 	{
 		glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-		glTexImage2D(
-			GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL
+		MemoryStats::texImage2D(colorBuffers[i], MemoryTag::RENDER_TARGETS,
+			GL_TEXTURE_2D, 0, GL_RGB16F, width, height, GL_RGB, GL_FLOAT, NULL
 		);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -143,7 +268,7 @@ bool Window::initializeProgram() {
 	// render buffer for hdr frame buffer
 	glGenRenderbuffers(1, &rboDepth); // create and attach depth buffer
 	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+	MemoryStats::renderbufferStorage(rboDepth, MemoryTag::RENDER_TARGETS, GL_DEPTH_COMPONENT, width, height);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
 
 
@@ -159,8 +284,8 @@ bool Window::initializeProgram() {
 	{
 		glBindFramebuffer(GL_FRAMEBUFFER, pingpongfbo[i]);
 		glBindTexture(GL_TEXTURE_2D, pingpongBuffer[i]);
-		glTexImage2D(
-			GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL
+		MemoryStats::texImage2D(pingpongBuffer[i], MemoryTag::RENDER_TARGETS,
+			GL_TEXTURE_2D, 0, GL_RGB16F, width, height, GL_RGB, GL_FLOAT, NULL
 		);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -180,6 +305,15 @@ bool Window::initializeObjects()
 
 	modelSize = 1.0f;
 
+	// simulate at 120 ticks per second, render capped at 144 fps by default
+	scheduler = new FrameScheduler(120.0, 144.0, PresentMode::CAPPED);
+
+	// one worker per hardware thread, the render thread is one of them
+	jobs = new JobSystem(0);
+	TextureCache::jobs = jobs;
+	// model textures load with small mips and stream the rest in
+	TextureCache::startStreaming(256 << 20);
+
 	debugQuad = new DepthQuad();
 
 	// create skybox
@@ -197,84 +331,31 @@ bool Window::initializeObjects()
 	// skybox = new Skybox(1);
 	// skybox->loadCubemap(faces);
 
-	// initialize models and materials of the objects
-	projectionLoc = glGetUniformLocation(texProgram, "projection");
-	viewLoc = glGetUniformLocation(texProgram, "view");
-	eyeLoc = glGetUniformLocation(texProgram, "eye");
-
-	Mesh::depthShader = depthProgram;
+	// the bone palette plus the other matrices must fit in the vertex uniforms
+	GLint vertexUniforms;
+	glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, &vertexUniforms);
+	Mesh::gpuSkinning = vertexUniforms >= (Mesh::MAX_BONES + 8) * 16;
 	// initial world transform with identity matrix
-	world = new Transform(glm::mat4(1));
-	// Model* testModel = new Model("models/test/nanosuit.obj");
-
-	// adjusting transform matrix and loading models
-	glm::mat4 boxMat = glm::translate(glm::vec3(0, -3.f, 0));
-
-	Model* box = new Model("models/box/scene.gltf", boxMat);
-
-	glm::mat4 roomMat = glm::scale(glm::vec3(.05f));
-
-	Model* room = new Model("models/room/scene.gltf", roomMat);
-
-	glm::mat4 tvMat = glm::translate(glm::vec3(4.f, 3.7f, 25.f)) * 
-		glm::rotate(glm::mat4(1), glm::radians(90.f), glm::vec3(1, 0, 0)) *
-		glm::rotate(glm::mat4(1), glm::radians(180.f), glm::vec3(0, 1, 0)) *
-		glm::scale(glm::vec3(1.f));
-	Model* tv = new Model("models/tv/scene.gltf", tvMat);
-
-	glm::mat4 tv_tableMat = glm::translate(glm::vec3(0.f, 2.7f, 25.f)) *
-		glm::rotate(glm::mat4(1), glm::radians(180.f), glm::vec3(1, 0, 0)) * 
-		glm::rotate(glm::mat4(1), glm::radians(90.f), glm::vec3(0, 1, 0)) *
-		glm::scale(glm::vec3(.05f));
-	Model* tv_table = new Model("models/tv_table/scene.gltf", tv_tableMat);
-
-	glm::mat4 sofaMat = glm::translate(glm::vec3(0.f, 0.2f, 3.f)) *
-		glm::scale(glm::vec3(0.5f));
-	Model* sofa = new Model("models/sofa/scene.gltf", sofaMat);
-
-	glm::mat4 lightMat = glm::translate(glm::vec3(6.f, 8.f, -50.f)) *
-		glm::rotate(glm::radians(90.f), glm::vec3(1, 0, 0)) *
-		glm::scale(glm::vec3(3.f));
-
-	glm::mat4 nightstandMat = glm::translate(glm::vec3(26.f, 4.f, 10.f)) *
-		glm::rotate(glm::radians(-90.f), glm::vec3(1, 0, 0)) *
-		glm::rotate(glm::radians(-90.f), glm::vec3(0, 0, 1)) *
-		glm::scale(glm::vec3(10.f));
-	Model* nightstand = new Model("models/nightstand/scene.gltf", nightstandMat);
-
-	glm::mat4 dining_tableMat = glm::translate(glm::vec3(0.f, 0.f, -22.f)) *
-		glm::scale(glm::vec3(5.5f));
-	Model* dining_table = new Model("models/dining_table/scene.gltf", dining_tableMat);
-
-	glm::mat4 bedMat = glm::translate(glm::vec3(46.f, 0.f, -8.f)) * 
-		glm::rotate(glm::radians(-90.f), glm::vec3(1, 0, 0)) *
-		glm::scale(glm::vec3(1));
-	Model* bed = new Model("models/bed/scene.gltf", bedMat);
-
-	glm::mat4 flamingoMat = glm::translate(glm::vec3(-8.f, -5.f, -20.f)) *
-		glm::rotate(glm::radians(-90.f), glm::vec3(1, 0, 0)) *
-		glm::scale(glm::vec3(1));
-	Model* flamingo = new Model("models/flamingo/scene.gltf", flamingoMat);
-
-	glm::mat4 plantMat = glm::translate(glm::vec3(-2.f, 3.5f, -22.f)) *
-		glm::scale(glm::vec3(1));
-	Model* plant = new Model("models/plant/scene.gltf", plantMat);
-		
-	LightSource::depthShader = depthProgram;
+	world = SceneMemory::create<Transform>(glm::mat4(1));
 
-	LightSource* light = new LightSource("models/moon/scene.gltf", lightMat);
-	lights.push_back(light);
+	// models with skinned meshes get their pose evaluated every tick
+	animator = new Animator();
 
-	world->addChild(room);
-	world->addChild(light);
-	world->addChild(tv_table);
-	world->addChild(tv);
-	world->addChild(sofa);
-	world->addChild(nightstand);
-	world->addChild(bed);
-	world->addChild(dining_table);
-	world->addChild(flamingo);
-	world->addChild(plant);
+	sceneBvh = new SceneBvh();
+
+	// the last bake, if the scene was baked before
+	lightmaps = new Lightmaps();
+	if (!lightmaps->load(LIGHTMAP_PATH))
+		std::cerr << "no baked lighting, F12 bakes it" << std::endl;
+
+	// the room and its furniture, pieces near the camera page in and out
+	scene = new Scene(world, animator);
+	if (!scene->load("scenes/room.json"))
+		return false;
+	lights = scene->getLights();
+	scene->loadAround(eye);
+
+	TextureCache::report();
 
 	return true;
 }
@@ -282,10 +363,104 @@ bool Window::initializeObjects()
 void Window::cleanUp()
 {
 	// Deallcoate the objects.
-	delete world;
+	scene->report();
+	delete scene;
+	SceneMemory::destroy(world);
+	SceneMemory::report();
+	if (gpuCulling)
+	{
+		gpuCulling->report();
+		delete gpuCulling;
+	}
+	// what's still live here besides render targets and textures leaked
+	MemoryStats::report();
+
+	// print frame pacing statistics for the session
+	scheduler->report();
+	delete scheduler;
+
+	if (framesBuilt > 0)
+	{
+		std::cerr << "avg ms per frame on " << jobs->getNumThreads() << " threads: transforms "
+			<< transformTime * 1000.0 / framesBuilt << " (" << Transform::system->size()
+			<< " nodes), collect " << collectTime * 1000.0 / framesBuilt << ", cull + sort "
+			<< cullTime * 1000.0 / framesBuilt << ", submit "
+			<< submitTime * 1000.0 / framesBuilt << std::endl;
+	}
+	// the whole graph is gone, so is every transform
+	delete Transform::system;
+	Transform::system = nullptr;
+	Meshlets::report("camera queue", cameraQueue.clusterStats);
+	sceneBvh->report();
+	delete sceneBvh;
+	lightmaps->report();
+	if (shadowPassesSkipped > 0)
+		std::cerr << "shadow pass skipped for baked lighting on " << shadowPassesSkipped << " frames" << std::endl;
+	delete lightmaps;
+	delete animator;
+	delete jobs;
+
+	const char* filters[2] = { "adaptive", "brute force" };
+	for (int i = 0; i < 2; i++)
+	{
+		if (cameraGpuFrames[i] > 0)
+		{
+			std::cerr << "camera pass with " << filters[i] << " pcf: " << cameraGpuTime[i] / cameraGpuFrames[i]
+				<< " gpu ms avg over " << cameraGpuFrames[i] << " frames" << std::endl;
+		}
+	}
+	glDeleteQueries(NUM_QUERIES, cameraQueries);
+
+	delete capture;
+
+	TextureCache::report();
+	TextureCache::stopStreaming();
 
-	// Delete the shader program.
-	glDeleteProgram(program);
+	// Delete the shader programs.
+	delete shaders;
+}
+
+// picks up the current program names after a build or reload
+void Window::updatePrograms()
+{
+	program = shaders->get(programId);
+	depthProgram = shaders->get(depthProgramId);
+	depthDebug = shaders->get(depthDebugId);
+	blurProgram = shaders->get(blurProgramId);
+	bloomProgram = shaders->get(bloomProgramId);
+	skyboxProgram = shaders->get(skyboxProgramId);
+
+	for (int i = 0; i < NUM_VARIANTS; i++)
+		variantPrograms[i] = shaders->get(variantIds[i]);
+	if (bruteForcePcf)
+	{
+		variantPrograms[VARIANT_LIT_SHADOW] = shaders->get(bruteShadowIds[0]);
+		variantPrograms[VARIANT_LIT_TOON_SHADOW] = shaders->get(bruteShadowIds[1]);
+	}
+	texProgram = variantPrograms[VARIANT_LIT_TOON_SHADOW];
+
+	if (gpuCulling)
+	{
+		for (int i = 0; i < NUM_VARIANTS; i++)
+			gpuVariantPrograms[i] = shaders->get(gpuVariantIds[i]);
+		if (bruteForcePcf)
+		{
+			gpuVariantPrograms[VARIANT_LIT_SHADOW] = shaders->get(gpuBruteShadowIds[0]);
+			gpuVariantPrograms[VARIANT_LIT_TOON_SHADOW] = shaders->get(gpuBruteShadowIds[1]);
+		}
+		gpuCulling->updatePrograms();
+	}
+
+	Mesh::depthShader = depthProgram;
+	LightSource::depthShader = depthProgram;
+}
+
+// the variant lit items are drawn with, from the lighting toggles
+ShaderVariant Window::litVariant()
+{
+	if (toonShading)
+		return displayShadows ? VARIANT_LIT_TOON_SHADOW : VARIANT_LIT_TOON;
+	return displayShadows ? VARIANT_LIT_SHADOW : VARIANT_LIT;
 }
 
 GLFWwindow* Window::createWindow(int width, int height)
@@ -337,7 +512,7 @@ GLFWwindow* Window::createWindow(int width, int height)
 	}
 #endif
 
-	// Set swap interval to 1.
+	// Swap interval is set by the frame scheduler's present mode.
 	glfwSwapInterval(0);
 
 	// Call the resize callback to make sure things get drawn immediately.
@@ -354,6 +529,15 @@ void Window::resizeCallback(GLFWwindow* window, int width, int height)
 #endif
 	Window::width = width;
 	Window::height = height;
+
+	// the capture buffers are sized for the old window
+	if (capture)
+	{
+		delete capture;
+		capture = nullptr;
+		std::cerr << "capture stopped by resize" << std::endl;
+	}
+
 	// Set the viewport size.
 	glViewport(0, 0, width, height);
 
@@ -362,17 +546,19 @@ void Window::resizeCallback(GLFWwindow* window, int width, int height)
 		double(width) / (double)height, nearDist, farDist);
 }
 
-void Window::idleCallback()
+void Window::idleCallback(float dt)
 {
-	// Perform any updates as necessary. 
-	world->update(glm::mat4(1));
-
-	double delta_time = glfwGetTime() - prevTime;
+	// Perform any updates as necessary, one job per subtree of the world.
+	world->updateParallel(jobs, glm::mat4(1));
+	animator->update(jobs, dt);
 
 	float velocity = 12;
 
-	// determines speed of which camera moves
-	float cameraVel = velocity * (float)delta_time;
+	// determines speed of which camera moves, dt is the fixed tick length
+	float cameraVel = velocity * dt;
+
+	// keep last tick's position so rendering can interpolate between them
+	prevEye = eye;
 
 	// control x, y, z coord of camera control
 	if (xControl == PlayerControl::LEFT)
@@ -399,13 +585,53 @@ void Window::idleCallback()
 	{
 		eye += -cameraVel * front;
 	}
-	view = glm::lookAt(eye, eye + front, up);
-	prevTime = glfwGetTime();
 
+	// the camera slides along what it runs into instead of going through
+	if (cameraCollision && eye != prevEye)
+		eye = sceneBvh->slide(prevEye, eye - prevEye, CAMERA_RADIUS);
+
+	// the scripted path takes over the camera until it's done
+	if (pathTime >= 0)
+		followPath(dt);
+}
+
+void Window::followPath(float dt)
+{
+	pathTime += dt;
+	if (pathTime >= PATH_SECONDS)
+	{
+		pathTime = -1;
+		std::cerr << "camera path done with " << (gpuCulling && gpuDriven ? "gpu" : "cpu")
+			<< " culling" << std::endl;
+		Meshlets::report("camera queue", cameraQueue.clusterStats);
+		if (gpuCulling)
+			Meshlets::report("gpu culling", gpuCulling->clusterStats);
+		return;
+	}
+
+	float t = pathTime / PATH_SECONDS * PATH_POINTS;
+	int i = (int)t;
+	eye = pathPoint(pathEyes, i, t - i);
+	front = glm::normalize(pathPoint(pathTargets, i, t - i) - eye);
+
+	// mouse look carries on from where the path left the camera, its pitch
+	// is positive looking down
+	cameraPitch = -glm::degrees(glm::asin(front.y));
+	cameraYaw = glm::degrees(glm::atan(front.z, front.x));
 }
 
-void Window::displayCallback(GLFWwindow* window)
+void Window::displayCallback(GLFWwindow* window, float alpha)
 {	
+	// shader files edited while running are rebuilt here
+	if (shaders->reload())
+		updatePrograms();
+
+	// render the camera between the last two simulation ticks
+	glm::vec3 renderEye = glm::mix(prevEye, eye, alpha);
+	view = glm::lookAt(renderEye, renderEye + front, up);
+
+	// pages scene cells around the camera before the graph is walked
+	scene->update(renderEye);
 
 	glEnable(GL_CULL_FACE);
 	glUseProgram(depthProgram);
@@ -427,13 +653,26 @@ void Window::displayCallback(GLFWwindow* window)
 	// glm::mat4 lightView = glm::lookAt(eye,eye + front, up);
 
 	glm::mat4 lightSpaceMatrix = lightProj * lightView;
+
+	// world matrices, culling and sorting for both passes run as jobs
+	buildFrame(lightSpaceMatrix, lightPos, renderEye);
+	TextureCache::update();
+	double submitStart = glfwGetTime();
 	
 	glUniformMatrix4fv(glGetUniformLocation(depthProgram, "lightMat"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
 
 
 	glClear(GL_DEPTH_BUFFER_BIT);
 	glCullFace(GL_FRONT);
-	world->draw(glm::mat4(1), depthProgram);
+	shadowQueue.submit(variantPrograms, false);
+	bool gpu = gpuCulling && gpuDriven;
+	if (gpu && shadowPass)
+	{
+		glUseProgram(gpuVariantPrograms[VARIANT_DEPTH]);
+		glUniformMatrix4fv(glGetUniformLocation(gpuVariantPrograms[VARIANT_DEPTH], "lightMat"), 1, GL_FALSE,
+			glm::value_ptr(lightSpaceMatrix));
+		gpuCulling->draw(CullPass::SHADOW, gpuVariantPrograms, VARIANT_DEPTH, false);
+	}
 
 	glCullFace(GL_BACK);
 
@@ -445,29 +684,34 @@ void Window::displayCallback(GLFWwindow* window)
 	// Clear the color and depth buffers.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	
 	
-	glUseProgram(texProgram);
-
-	// Specify the values of the uniform variables we are going to use.
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniform3fv(eyeLoc, 1, glm::value_ptr(eye));
-
-	glUniform3fv(glGetUniformLocation(texProgram, "lightPos"), 1, glm::value_ptr(lightPos));
-	glUniform3fv(glGetUniformLocation(texProgram, "viewPos"), 1, glm::value_ptr(eye));
-
-	glUniform1i(glGetUniformLocation(texProgram, "ignoreLight"), false);
-
-	glUniform1i(glGetUniformLocation(texProgram, "toonShading"), toonShading);
-
-	glUniformMatrix4fv(glGetUniformLocation(texProgram, "lightMat"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-	// glUniform1i(glGetUniformLocation(program, "normalColor"), normalColor);
+	// Specify the values of the uniform variables we are going to use, in
+	// every variant the camera pass can draw with.
+	ShaderVariant baked = RenderQueue::pickVariant(false, true, litVariant());
+	GLuint cameraPrograms[6] = { variantPrograms[litVariant()], variantPrograms[baked],
+		variantPrograms[VARIANT_UNLIT], gpuVariantPrograms[litVariant()], gpuVariantPrograms[baked],
+		gpuVariantPrograms[VARIANT_UNLIT] };
+	for (GLuint p : cameraPrograms)
+	{
+		if (!p)
+			continue;
+		glUseProgram(p);
+		glUniformMatrix4fv(glGetUniformLocation(p, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		glUniformMatrix4fv(glGetUniformLocation(p, "view"), 1, GL_FALSE, glm::value_ptr(view));
+		glUniform3fv(glGetUniformLocation(p, "eye"), 1, glm::value_ptr(renderEye));
+
+		glUniform3fv(glGetUniformLocation(p, "lightPos"), 1, glm::value_ptr(lightPos));
+		glUniform3fv(glGetUniformLocation(p, "viewPos"), 1, glm::value_ptr(renderEye));
+
+		glUniformMatrix4fv(glGetUniformLocation(p, "lightMat"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+		glUniform1i(glGetUniformLocation(p, "shadowMap"), 5);
+		glUniform1i(glGetUniformLocation(p, "lightmap"), Lightmaps::TEXTURE_UNIT);
+	}
 
+	glActiveTexture(GL_TEXTURE0 + Lightmaps::TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, lightmaps->getTexture());
 	glActiveTexture(GL_TEXTURE5);
 	// bind depth map to draw with scene
 	glBindTexture(GL_TEXTURE_2D, depthmap);
-
-	glUniform1i(glGetUniformLocation(texProgram, "shadowMap"), 5);
 	
 	if (displayBloom)
 	{
@@ -476,10 +720,37 @@ void Window::displayCallback(GLFWwindow* window)
 	}
 
 
-	// Render the scenegraph, initially passing in identity matrix.
-	world->draw(glm::mat4(1), texProgram);
+	// time the camera pass, the result is read NUM_QUERIES frames later
+	// when it's long done
+	int slot = queryFrame % NUM_QUERIES;
+	if (queryFrame >= NUM_QUERIES)
+	{
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(cameraQueries[slot], GL_QUERY_RESULT, &elapsed);
+		if (queryFilter[slot] >= 0)
+		{
+			cameraGpuTime[queryFilter[slot]] += elapsed / 1e6;
+			cameraGpuFrames[queryFilter[slot]]++;
+		}
+	}
+	queryFilter[slot] = shadowPass ? bruteForcePcf : -1;
+	queryFrame++;
+
+	// Render what the camera can see, sorted by variant and material.
+	glBeginQuery(GL_TIME_ELAPSED, cameraQueries[slot]);
+	cameraQueue.submit(variantPrograms, true);
+	if (gpu)
+		gpuCulling->draw(CullPass::CAMERA, gpuVariantPrograms, litVariant(), true);
+	glEndQuery(GL_TIME_ELAPSED);
+	glActiveTexture(GL_TEXTURE0);
+
+	// next frame's occlusion culling tests against this depth, the default
+	// framebuffer is multisampled so there is none without bloom
+	if (gpu && displayBloom)
+		gpuCulling->buildHiZ(hdrfbo, width, height, projection * view);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	submitTime += glfwGetTime() - submitStart;
 	
 	
 
@@ -532,8 +803,11 @@ void Window::displayCallback(GLFWwindow* window)
 
 	if (displayShadowmap)
 	{
+		// read the depths themselves, not compare results
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
 		glViewport(0, 0, width / 2, height / 2);
 		debugQuad->draw();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
 	}
 	/* bruh how do you render skybox
 	glDepthMask(GL_FALSE);
@@ -550,6 +824,17 @@ void Window::displayCallback(GLFWwindow* window)
 	*/
 
 	glDisable(GL_CULL_FACE);
+
+	if (capture)
+	{
+		capture->capture(CaptureSource::COLOR, 0, GL_BACK);
+		if (captureAll && displayBloom)
+		{
+			capture->capture(CaptureSource::DEPTH, hdrfbo, GL_NONE);
+			capture->capture(CaptureSource::HDR, hdrfbo, GL_COLOR_ATTACHMENT0);
+			capture->capture(CaptureSource::BRIGHT, hdrfbo, GL_COLOR_ATTACHMENT1);
+		}
+	}
 	
 	// Gets events, including input such as keyboard and mouse or window resizing.
 	glfwPollEvents();
@@ -558,6 +843,94 @@ void Window::displayCallback(GLFWwindow* window)
 	
 }
 
+// Walks the scene graph into draw items, then culls and sorts them for the
+// shadow and camera passes in parallel. Only GL submission is left for the
+// render thread afterwards.
+void Window::buildFrame(glm::mat4 lightSpaceMatrix, glm::vec3 lightPos, glm::vec3 renderEye)
+{
+	double start = glfwGetTime();
+
+	// one linear pass over the flat transform arrays, unchanged nodes skipped
+	Transform::system->update();
+
+	double propagated = glfwGetTime();
+
+	sceneItems.clear();
+	world->collectParallel(jobs, glm::mat4(1), sceneItems);
+
+	// with every lit item baked they all read the lightmap, toon shaded or
+	// not, and nothing needs the shadow map
+	bool allBaked = useLightmaps && lightmaps->assign(sceneItems);
+	shadowPass = displayShadows && !allBaked;
+	shadowPassesSkipped += displayShadows && !shadowPass;
+
+	double collected = glfwGetTime();
+
+	// projected size of one world unit at distance 1, in pixels
+	float pixelsPerUnit = (float)height / (2.f * glm::tan(glm::radians((float)FOV) / 2.f));
+	// shadow map texels per world unit, the light box is 70 units wide
+	float texelsPerUnit = 1024.f / 70.f;
+	glm::vec3 lightDir = glm::normalize(glm::vec3(glm::transpose(lightSpaceMatrix)[2]));
+
+	// the gpu culling takes the static meshes, the queues get the rest
+	bool gpu = gpuCulling && gpuDriven;
+	if (gpu)
+		gpuCulling->prepare(sceneItems, cpuItems, renderEye, front, pixelsPerUnit);
+	const std::vector<DrawItem>& queueItems = gpu ? cpuItems : sceneItems;
+
+	JobCounter counter;
+	jobs->run(counter, [&]()
+	{
+		// nothing goes into the shadow map while shadows are off
+		if (!shadowPass)
+		{
+			shadowQueue.items.clear();
+			return;
+		}
+		shadowQueue.cull(jobs, queueItems, lightSpaceMatrix, lightPos, lightDir,
+			texelsPerUnit, 1.f, VARIANT_DEPTH);
+		shadowQueue.sort();
+	});
+	jobs->run(counter, [&]()
+	{
+		cameraQueue.cull(jobs, queueItems, projection * view, renderEye, front,
+			pixelsPerUnit, 1.f, litVariant());
+		cameraQueue.sort();
+	});
+	jobs->run(counter, [&]()
+	{
+		sceneBvh->update(jobs, sceneItems);
+	});
+
+	// the compute passes are queued while the jobs run
+	if (gpu)
+	{
+		if (shadowPass)
+			gpuCulling->cull(CullPass::SHADOW, lightSpaceMatrix, lightPos, lightDir, texelsPerUnit, 1.f);
+		gpuCulling->cull(CullPass::CAMERA, projection * view, renderEye, front, pixelsPerUnit, 1.f);
+	}
+	jobs->wait(counter);
+
+	transformTime += propagated - start;
+	collectTime += collected - propagated;
+	cullTime += glfwGetTime() - collected;
+	framesBuilt++;
+}
+
+// pages in the whole scene and bakes it, the result is used from the next
+// frame on and loaded at startup after this
+void Window::bakeLightmaps()
+{
+	scene->loadAll();
+	Transform::system->update();
+	std::vector<DrawItem> items;
+	world->collectParallel(jobs, glm::mat4(1), items);
+
+	glm::vec3 lightPos = lights[0]->position[3];
+	if (lightmaps->bake(jobs, items, lightPos, LIGHTMAP_PATH))
+		std::cerr << "baked lighting saved to " << LIGHTMAP_PATH << std::endl;
+}
+
 void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	/*
@@ -623,6 +996,87 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 			// render toon or not
 			toonShading = !toonShading;
 			break;
+		case GLFW_KEY_F5:
+			// cycle vsync / adaptive vsync / capped / uncapped
+			scheduler->cycleMode();
+			break;
+		case GLFW_KEY_F6:
+			// adaptive or brute force shadow filtering, see the gpu times on exit
+			bruteForcePcf = !bruteForcePcf;
+			updatePrograms();
+			std::cerr << (bruteForcePcf ? "brute force pcf" : "adaptive pcf") << std::endl;
+			break;
+		case GLFW_KEY_F7:
+			// start or stop recording, a y4m video or with shift png frames
+			// plus depth, hdr colors and the bloom bright pass
+			if (capture)
+			{
+				delete capture;
+				capture = nullptr;
+			}
+			else
+			{
+				char directory[64];
+				snprintf(directory, sizeof(directory), "captures_%lld", (long long)time(nullptr));
+				captureAll = (mods & GLFW_MOD_SHIFT) != 0;
+				capture = new FrameCapture(directory, width, height,
+					captureAll ? CaptureFormat::PNG : CaptureFormat::Y4M);
+				std::cerr << "capturing to " << directory << std::endl;
+			}
+			break;
+		case GLFW_KEY_F8:
+			// live and peak memory per subsystem, to the console and a file
+			{
+				char path[64];
+				snprintf(path, sizeof(path), "memory_%lld.json", (long long)time(nullptr));
+				MemoryStats::report();
+				if (MemoryStats::dumpJson(path))
+					std::cerr << "memory written to " << path << std::endl;
+			}
+			break;
+		case GLFW_KEY_F9:
+			// gpu or cpu culling of the static meshes
+			if (gpuCulling)
+			{
+				gpuDriven = !gpuDriven;
+				std::cerr << (gpuDriven ? "gpu culling" : "cpu culling") << std::endl;
+			}
+			break;
+		case GLFW_KEY_F10:
+			// fly the scripted camera path, what culling the clusters saved
+			// along it is printed at the end
+			pathTime = 0;
+			cameraQueue.clusterStats = ClusterStats();
+			if (gpuCulling)
+				gpuCulling->clusterStats = ClusterStats();
+			std::cerr << "flying the camera path" << std::endl;
+			break;
+		case GLFW_KEY_F11:
+			// rays and sphere sweeps from the camera against the bvh
+			sceneBvh->benchmark(jobs, eye, (float)farDist);
+			break;
+		case GLFW_KEY_F12:
+			// bakes the lighting of the whole scene, seconds to minutes
+			bakeLightmaps();
+			break;
+		case GLFW_KEY_T:
+			// updates and teardown of a big transform tree, apart from the scene
+			TransformSystem::benchmark(100000);
+			break;
+		case GLFW_KEY_J:
+			// scaling of nested jobs over a node tree, from 1 to 32 threads
+			JobSystem::benchmark(50000, 32);
+			break;
+		case GLFW_KEY_L:
+			// baked or runtime lighting of the static meshes
+			useLightmaps = !useLightmaps;
+			std::cerr << (useLightmaps ? "baked lighting" : "runtime lighting") << std::endl;
+			break;
+		case GLFW_KEY_C:
+			// walk through walls or not
+			cameraCollision = !cameraCollision;
+			std::cerr << (cameraCollision ? "camera collision on" : "camera collision off") << std::endl;
+			break;
 		default:
 			break;
 		}
@@ -652,7 +1106,21 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 
 void Window::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
-
+	// picks what's under the crosshair, the cursor is kept at the center
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+	{
+		RayHit hit;
+		if (!sceneBvh->raycast(eye, front, (float)farDist, hit))
+		{
+			std::cerr << "picked nothing" << std::endl;
+			return;
+		}
+		const char* name = hit.mesh->textures.empty() ? "untextured" : hit.mesh->textures[0].path.c_str();
+		char line[256];
+		snprintf(line, sizeof(line), "picked mesh %llu (%s) triangle %u at %.2f: (%.2f, %.2f, %.2f)",
+			hit.mesh->uid, name, hit.triangle, hit.distance, hit.position.x, hit.position.y, hit.position.z);
+		std::cerr << line << std::endl;
+	}
 }
 
 void Window::mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
@@ -15,6 +15,8 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <cstdio>
+#include <ctime>
 
 #include "Transform.h"
 #include "shader.h"
@@ -24,6 +26,18 @@
 #include "Mesh.h"
 #include "DepthQuad.h"
 #include "Skybox.h"
+#include "FrameScheduler.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+#include "Animation.h"
+#include "ShaderManager.h"
+#include "FrameCapture.h"
+#include "Scene.h"
+#include "SceneMemory.h"
+#include "MemoryStats.h"
+#include "GpuCulling.h"
+#include "Bvh.h"
+#include "Lightmaps.h"
 
 enum class PlayerControl {
 	NONE,
@@ -46,10 +60,21 @@ public:
 	static glm::mat4 projection;
 	static glm::mat4 view;
 	static glm::vec3 eye, front, up;
+	static glm::vec3 prevEye;
 	static GLuint program, projectionLoc, viewLoc, modelLoc, objColorLoc, eyeLoc;
 	static GLuint texProgram, depthProgram, depthDebug;
+	static GLuint variantPrograms[NUM_VARIANTS];
 	static GLuint blurProgram, bloomProgram;
 	static GLuint skyboxProgram;
+	static ShaderManager* shaders;
+	static ShaderId programId, depthProgramId, depthDebugId;
+	static ShaderId variantIds[NUM_VARIANTS];
+	static ShaderId bruteShadowIds[2];
+	// the same builds reading their model matrices from the gpu culling
+	static GLuint gpuVariantPrograms[NUM_VARIANTS];
+	static ShaderId gpuVariantIds[NUM_VARIANTS];
+	static ShaderId gpuBruteShadowIds[2];
+	static ShaderId blurProgramId, bloomProgramId, skyboxProgramId;
 	static GLdouble FOV;
 
 	static GLuint depthFBO, depthmap;
@@ -62,7 +87,37 @@ public:
 
 	static GLuint mode;
 
-	static double prevTime;
+	static FrameScheduler* scheduler;
+	static JobSystem* jobs;
+	static Animator* animator;
+	static Scene* scene; // pages the models in and out
+
+	// every mesh in the scene this frame, and what each pass draws of it
+	static std::vector<DrawItem> sceneItems;
+	static RenderQueue shadowQueue, cameraQueue;
+	static double transformTime, collectTime, cullTime, submitTime;
+
+	// culls and draws the static meshes with compute shaders, null before
+	// GL 4.3. cpuItems is what it leaves to the queues.
+	static GpuCulling* gpuCulling;
+	static bool gpuDriven;
+	static std::vector<DrawItem> cpuItems;
+	static unsigned long long framesBuilt;
+
+	// seconds along the scripted camera path, negative when it's not flown
+	static float pathTime;
+
+	// the static meshes for picking and camera collision, updated with the
+	// culling every frame
+	static SceneBvh* sceneBvh;
+	static bool cameraCollision;
+
+	// baked light of the static meshes, the shadow pass is skipped while
+	// every lit item has it
+	static Lightmaps* lightmaps;
+	static bool useLightmaps;
+	static bool shadowPass; // this frame's, set by buildFrame
+	static unsigned long long shadowPassesSkipped;
 
 	static GLfloat modelSize;
 	
@@ -80,14 +135,32 @@ public:
 	static std::vector<LightSource*> lights;
 
 	static bool displayShadowmap, displayShadows, displayBloom;
+	static bool bruteForcePcf;
+
+	// gpu time of the camera pass, split by shadow filter
+	static const int NUM_QUERIES = 4;
+	static GLuint cameraQueries[NUM_QUERIES];
+	static int queryFilter[NUM_QUERIES]; // -1 without shadows
+	static unsigned long long queryFrame;
+	static double cameraGpuTime[2];
+	static unsigned long long cameraGpuFrames[2];
+
+	// recording, null when off
+	static FrameCapture* capture;
+	static bool captureAll; // depth and hdr colors too
 
 	static bool initializeProgram();
+	static void updatePrograms();
+	static ShaderVariant litVariant();
 	static bool initializeObjects();
 	static void cleanUp();
 	static GLFWwindow* createWindow(int width, int height);
 	static void resizeCallback(GLFWwindow* window, int width, int height);
-	static void idleCallback();
-	static void displayCallback(GLFWwindow*);
+	static void idleCallback(float dt);
+	static void followPath(float dt);
+	static void displayCallback(GLFWwindow*, float alpha);
+	static void buildFrame(glm::mat4 lightSpaceMatrix, glm::vec3 lightPos, glm::vec3 renderEye);
+	static void bakeLightmaps();
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 	static void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
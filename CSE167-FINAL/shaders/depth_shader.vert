@@ -3,12 +3,16 @@
 
 layout (location = 0) in vec3 position;
 
+#include "skinning.glsl"
+#include "draw_model.glsl"
+
 // Uniform variables can be updated by fetching their location and passing values to that location
 uniform mat4 lightMat;
-uniform mat4 model;
 
 void main()
 {
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
-    gl_Position = lightMat * model * vec4(position, 1.0);
+	mat4 M = skinnedModel(drawModel());
+
+    gl_Position = lightMat * M * vec4(position, 1.0);
 }
\ No newline at end of file
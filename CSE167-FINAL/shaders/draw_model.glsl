@@ -0,0 +1,37 @@
+// model matrix and lightmap square of the draw, shared by texture_shader.vert and depth_shader.vert
+
+#ifdef GPU_DRIVEN
+// draws from the gpu culling read theirs from the matrix buffer, the draw's
+// index is an instanced attribute offset by the command's base instance
+layout (location = 5) in int drawIndex;
+
+uniform samplerBuffer modelMatrices;
+
+mat4 drawModel()
+{
+	int i = drawIndex * 4;
+	return mat4(texelFetch(modelMatrices, i), texelFetch(modelMatrices, i + 1),
+		texelFetch(modelMatrices, i + 2), texelFetch(modelMatrices, i + 3));
+}
+
+// scale and offset into the lightmap atlas, see Lightmaps.h
+uniform samplerBuffer lightmapRects;
+
+vec4 drawLightmapRect()
+{
+	return texelFetch(lightmapRects, drawIndex);
+}
+#else
+uniform mat4 model;
+uniform vec4 lightmapRect;
+
+mat4 drawModel()
+{
+	return model;
+}
+
+vec4 drawLightmapRect()
+{
+	return lightmapRect;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+// bone skinning shared by texture_shader.vert and depth_shader.vert
+
+layout (location = 3) in ivec4 boneIds;
+layout (location = 4) in vec4 boneWeights;
+
+// must match Mesh::MAX_BONES
+const int MAX_BONES = 100;
+
+uniform mat4 bones[MAX_BONES];
+uniform bool skinned;
+
+// blends the bone matrices of skinned meshes into the model matrix
+mat4 skinnedModel(mat4 model)
+{
+	if (!skinned)
+		return model;
+
+	mat4 skin = bones[boneIds.x] * boneWeights.x + bones[boneIds.y] * boneWeights.y +
+		bones[boneIds.z] * boneWeights.z + bones[boneIds.w] * boneWeights.w;
+	return model * skin;
+}
@@ -7,87 +7,143 @@ in vec3 normalOutput;
 in vec3 posOutput;
 in vec2 texOutput;
 in vec4 lightFragOutput;
+#ifdef LIGHTMAP
+in vec2 lightmapOutput;
+#endif
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
-uniform sampler2D shadowMap;
+uniform sampler2DShadow shadowMap;
+uniform sampler2D lightmap;
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
-uniform bool ignoreLight;
-uniform bool toonShading;
+
+// built as variants by defining LIT, TOON and SHADOWS, see ShaderVariant in
+// RenderQueue.h, without LIT the texture is drawn as is. PCF_BRUTE swaps the
+// adaptive shadow filter for a fixed 6x6 one to compare their cost.
+// LIGHTMAP reads the diffuse light from the baked lightmap instead, with
+// TOON cut into the same steps as the runtime light.
+
+#ifdef LIGHTMAP
+// the baked light is stored as the square root of it over this, must
+// match Lightmaps.cpp
+const float LIGHTMAP_RANGE = 2.0;
+#endif
 
 // You can output many things. The first vec4 type output determines the color of the fragment
 layout (location = 0) out vec4 fragColor;
 layout (location = 1) out vec4 brightColor;
 
+#ifdef SHADOWS
+// penumbra taps around the fragment, scaled by the kernel radius
+const vec2 poissonDisk[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+	vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+	vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+	vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+	vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+
+// fraction of the fragment in shadow. The hardware compares the depth of
+// the four nearest texels and filters the results, so each tap is a 2x2 pcf.
 float ShadowCalc(vec4 lightFragPos, float bias)
 {
 	// perspective divide
 	vec3 projCoord = (lightFragPos.xyz) / (lightFragPos.w);
 	// want to normalaize coords to range [0, 1]
 	projCoord = projCoord * 0.5 + 0.5;
-	// get closest depth value from light's perspective
-	float closestDepth = texture(shadowMap, projCoord.xy).r;
-	// get depth of current fragment from light's perspective
-	float currentDepth = projCoord.z;
-	// check if current frag pos is in shadow
-	float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-	return shadow;
+	// compare against the depth of the current fragment from the light
+	float ref = projCoord.z - bias;
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+
+#ifdef PCF_BRUTE
+	// 36 taps on every fragment
+	float lit = 0.0;
+	for (int y = -3; y < 3; y++)
+	{
+		for (int x = -3; x < 3; x++)
+			lit += texture(shadowMap, vec3(projCoord.xy + (vec2(x, y) + 0.5) * texel, ref));
+	}
+	return 1.0 - lit / 36.0;
+#else
+	// four taps cover the 4x4 texels around the fragment
+	float lit = texture(shadowMap, vec3(projCoord.xy + vec2(-1.0, -1.0) * texel, ref)) +
+		texture(shadowMap, vec3(projCoord.xy + vec2(1.0, -1.0) * texel, ref)) +
+		texture(shadowMap, vec3(projCoord.xy + vec2(-1.0, 1.0) * texel, ref)) +
+		texture(shadowMap, vec3(projCoord.xy + vec2(1.0, 1.0) * texel, ref));
+
+	// fully lit or fully shadowed, the wide kernel would agree
+	if (lit < 0.001 || lit > 3.999)
+		return 1.0 - lit * 0.25;
+
+	// on a shadow edge, widen the kernel
+	for (int i = 0; i < 16; i++)
+		lit += texture(shadowMap, vec3(projCoord.xy + poissonDisk[i] * 3.0 * texel, ref));
+	return 1.0 - lit / 20.0;
+#endif
 }
+#endif
 
 void main()
 {
-	if(ignoreLight)
-	{
-		fragColor = texture(texture_diffuse1, texOutput) + 
-		texture(texture_specular1, texOutput) * .5;
-	}
-	else
-	{
-		vec3 color = texture(texture_diffuse1, texOutput).rgb;
-		vec3 normal = normalize(normalOutput);
-		vec3 lightColor = vec3(1.0);
-		
-		vec3 ambient = 0.25 * color;
+#ifndef LIT
+	fragColor = texture(texture_diffuse1, texOutput) + 
+	texture(texture_specular1, texOutput) * .5;
+#else
+	vec3 color = texture(texture_diffuse1, texOutput).rgb;
+	vec3 normal = normalize(normalOutput);
 	
-		vec3 lightDir = normalize(lightPos - posOutput);
-		float diff = max(dot(normal, lightDir), 0.0);
-		vec3 diffuse = diff * color;
-		
-		float intensity = dot(lightDir, normal);
+	vec3 ambient = 0.25 * color;
+
+	vec3 lightDir = normalize(lightPos - posOutput);
+	float intensity = dot(lightDir, normal);
+	vec3 diffuse = max(intensity, 0.0) * color;
+
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(dot(normal, reflectDir), 0.0), 64);
 	
-		vec3 viewDir = normalize(viewPos - posOutput);
-		vec3 reflectDir = reflect(-lightDir, normal);
-		vec3 halfwayDir = normalize(lightDir + viewDir);
-		float spec = pow(max(dot(normal, reflectDir), 0.0), 64);
-		
-		vec3 specular = spec * texture(texture_diffuse1, texOutput).rgb;
-		
-		float bias = max(0.05 * (1 - dot(normal, lightDir)), 0.005);
-		// float bias = 0;
-		float shadow = ShadowCalc(lightFragOutput, bias);
-
-		fragColor = vec4((((1.0 - shadow) * (diffuse + specular)) * color), 1.0);
-		// fragColor = vec4(((ambient + diffuse + specular) * color), 1.0);
-		// fragColor = vec4(texture(shadowMap, texOutput).rgb, 1.0);
-		
-		if(toonShading)
-		{
-			if (intensity > 0.95)
-				fragColor = vec4(fragColor.rgb + ambient * color, 1.0);
-			else if (intensity > .75)
-				fragColor = vec4(fragColor.rgb * .75 + ambient * color, 1.0);
-			else if (intensity > .5)
-				fragColor = vec4(fragColor.rgb * .5 + ambient * color, 1.0);
-			else if (intensity > .25)
-				fragColor = vec4(fragColor.rgb * .25 + ambient * color, 1.0);
-			else
-				fragColor = vec4(ambient * color, 1.0);
-		}
-		else
-			fragColor = vec4(fragColor.rgb + ambient * color, 1.0);
-	}
+	vec3 specular = spec * color;
+
+#if defined(LIGHTMAP)
+	// rgb is the direct light with its soft shadows, one bounce of it and
+	// the occluded ambient, alpha how much of the light is unblocked
+	vec4 baked = texture(lightmap, lightmapOutput);
+	vec3 light = baked.rgb * baked.rgb * LIGHTMAP_RANGE;
+#ifdef TOON
+	// the baked brightness in quarters, never below the ambient
+	float level = dot(light, vec3(0.2126, 0.7152, 0.0722));
+	float band = level > 0.95 ? level : max(floor(level * 4.0) * 0.25, 0.25);
+	light *= band / max(level, 0.001);
+#endif
+	fragColor = vec4((light * color + baked.a * specular) * color, 1.0);
+#elif defined(SHADOWS)
+	float bias = max(0.05 * (1 - intensity), 0.005);
+	float shadow = ShadowCalc(lightFragOutput, bias);
+	fragColor = vec4((((1.0 - shadow) * (diffuse + specular)) * color), 1.0);
+#else
+	fragColor = vec4(((diffuse + specular) * color), 1.0);
+#endif
+
+#if defined(LIGHTMAP)
+	// the ambient is baked in
+#elif defined(TOON)
+	if (intensity > 0.95)
+		fragColor = vec4(fragColor.rgb + ambient * color, 1.0);
+	else if (intensity > .75)
+		fragColor = vec4(fragColor.rgb * .75 + ambient * color, 1.0);
+	else if (intensity > .5)
+		fragColor = vec4(fragColor.rgb * .5 + ambient * color, 1.0);
+	else if (intensity > .25)
+		fragColor = vec4(fragColor.rgb * .25 + ambient * color, 1.0);
+	else
+		fragColor = vec4(ambient * color, 1.0);
+#else
+	fragColor = vec4(fragColor.rgb + ambient * color, 1.0);
+#endif
+#endif
 	// check if output of fragment higher than arbitrary threshold
 	// float brightness = dot(fragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
 	float brightness = dot(fragColor.rgb, vec3(0.2452, 0.7591, 0.3493));
@@ -95,4 +151,4 @@ void main()
 		brightColor = vec4(fragColor.rgb, 1.0);
 	else
 		brightColor = vec4(0.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+}
@@ -9,11 +9,14 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoord;
+layout (location = 6) in vec2 lightmapCoord;
+
+#include "skinning.glsl"
+#include "draw_model.glsl"
 
 // Uniform variables can be updated by fetching their location and passing values to that location
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
 uniform mat4 lightMat;
 
 // Outputs of the vertex shader are the inputs of the same name of the fragment shader.
@@ -23,14 +26,24 @@ out vec3 normalOutput;
 out vec3 posOutput;
 out vec2 texOutput;
 out vec4 lightFragOutput;
+#ifdef LIGHTMAP
+out vec2 lightmapOutput;
+#endif
 
 void main()
 {
+	mat4 M = skinnedModel(drawModel());
+
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = projection * view * M * vec4(position, 1.0);
 	
 	texOutput = texCoord;
-	posOutput = vec3(model * vec4(position, 1.0));
-    normalOutput = mat3(transpose(inverse(model))) * normal;
+	posOutput = vec3(M * vec4(position, 1.0));
+    normalOutput = mat3(transpose(inverse(M))) * normal;
 	lightFragOutput = lightMat * vec4(posOutput, 1.0);
+#ifdef LIGHTMAP
+	// from the mesh's own square to where the draw's is in the atlas
+	vec4 rect = drawLightmapRect();
+	lightmapOutput = lightmapCoord * rect.xy + rect.zw;
+#endif
 }
\ No newline at end of file
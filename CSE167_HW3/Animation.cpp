@@ -0,0 +1,38 @@
+#include "Animation.h"
+
+ProceduralClip::ProceduralClip(glm::vec3 axis, float amplitude, float speed, float phase)
+{
+	ProceduralClip::axis = glm::normalize(axis);
+	ProceduralClip::amplitude = amplitude;
+	ProceduralClip::speed = speed;
+	ProceduralClip::phase = phase;
+}
+
+// rotation of the swing at the given time
+glm::mat4 ProceduralClip::sample(double time) const
+{
+	if (amplitude == 0)
+		return glm::mat4(1);
+
+	// one cycle sweeps the full range twice
+	double cycles = time * speed / (4.0 * glm::abs(amplitude)) + phase;
+
+	// triangle wave starting at 0 and rising first, in [-1, 1]
+	double f = cycles + 0.25;
+	f -= glm::floor(f);
+	float wave = (float)(1.0 - 4.0 * glm::abs(f - 0.5));
+
+	return glm::rotate(glm::radians(amplitude * wave), axis);
+}
+
+void Animator::add(Transform* target, const ProceduralClip* clip)
+{
+	bindings.push_back({ target, clip, target->getTransform() });
+}
+
+// sets every bound transform to its clip's pose on top of the rest pose
+void Animator::update(double time)
+{
+	for (Binding& b : bindings)
+		b.target->setTransform(b.clip->sample(time) * b.base);
+}
@@ -0,0 +1,46 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <vector>
+
+#include "Transform.h"
+
+// A clip whose pose is computed from time instead of keyframes: a swing
+// back and forth around an axis, like a walking limb. The pose only depends
+// on the absolute time, so nothing accumulates between frames.
+class ProceduralClip
+{
+private:
+	glm::vec3 axis;
+	float amplitude; // degrees, negative swings the other way first
+	float speed; // degrees per second
+	float phase; // in cycles
+
+public:
+	ProceduralClip(glm::vec3 axis, float amplitude, float speed, float phase);
+
+	glm::mat4 sample(double time) const;
+};
+
+// Poses every bound transform once per frame. Transforms are shared by all
+// robots, so one evaluation animates the whole army.
+class Animator
+{
+private:
+	struct Binding
+	{
+		Transform* target;
+		const ProceduralClip* clip;
+		glm::mat4 base; // the transform's rest pose
+	};
+
+	std::vector<Binding> bindings;
+
+public:
+	void add(Transform* target, const ProceduralClip* clip);
+	void update(double time);
+};
+
+#endif
@@ -19,18 +19,21 @@
 
 #include "Node.h"
 #include "Geometry.h"
-#include "WireSphere.h"
+#include "DebugDraw.h"
 
 class BoundingSphere : public Node
 {
 private:
 	GLfloat radius;
-	Geometry* sphere;
 	GLfloat curFOV;
 
 public:
-	static bool render;
-	BoundingSphere(Geometry* sphere, GLfloat radius);
+	// starts empty, enclose the parts it bounds
+	BoundingSphere();
+
+	// grows to hold a part whose origin is at offset, however the part
+	// turns about that origin
+	void enclose(Geometry* part, glm::vec3 offset);
 
 	void draw(GLuint shaderProgram, glm::mat4 C);
 	void update(glm::mat4 C);
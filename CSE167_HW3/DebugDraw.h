@@ -0,0 +1,78 @@
+#ifndef _DEBUG_DRAW_H_
+#define _DEBUG_DRAW_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <iostream>
+
+#include "StreamBuffer.h"
+
+// Collects wireframe shapes from anywhere during a frame and draws all of
+// them with a single call at the end. The shape functions are one branch
+// while disabled, so calls can stay in place in every build.
+class DebugDraw
+{
+public:
+	static bool enabled;
+
+	// program built from shaders/debug_shader.vert and .frag
+	static void init(GLuint program);
+	static void cleanUp();
+
+	static void line(glm::vec3 a, glm::vec3 b, glm::vec3 color)
+	{
+		if (enabled)
+			addLine(a, b, pack(color));
+	}
+
+	// three great circles
+	static void sphere(glm::vec3 center, float radius, glm::vec3 color)
+	{
+		if (enabled)
+			addSphere(center, radius, pack(color));
+	}
+
+	// axis aligned box
+	static void box(glm::vec3 min, glm::vec3 max, glm::vec3 color)
+	{
+		if (enabled)
+			addBox(min, max, pack(color));
+	}
+
+	// the volume seen by a projection * view matrix
+	static void frustum(glm::mat4 viewProjection, glm::vec3 color)
+	{
+		if (enabled)
+			addFrustum(viewProjection, pack(color));
+	}
+
+	// draws everything collected since the last flush and clears it
+	static void flush(glm::mat4 viewProjection, StreamBuffer* stream);
+
+private:
+	struct Vertex
+	{
+		glm::vec3 position;
+		GLuint color; // rgba8
+	};
+
+	static std::vector<Vertex> vertices;
+	static GLuint program, vao;
+	static GLint viewProjectionLoc;
+
+	static GLuint pack(glm::vec3 color);
+	static void addLine(glm::vec3 a, glm::vec3 b, GLuint color);
+	static void addSphere(glm::vec3 center, float radius, GLuint color);
+	static void addBox(glm::vec3 min, glm::vec3 max, GLuint color);
+	static void addFrustum(glm::mat4 viewProjection, GLuint color);
+	static void addCorners(const glm::vec3 corners[8], GLuint color);
+};
+
+#endif
@@ -2,108 +2,14 @@
 
 Geometry::Geometry(std::string filename)
 {
-	// store raw inputs of vertices and normals, and indices of vertices and normals
-	std::vector<glm::vec3> input_vertices, input_normals, input_textures;
-	std::vector<unsigned int> vertex_indices, texture_indices, normal_indices;
-
-
-
-	std::ifstream objFile(filename); // The obj file we are reading.
-
-	// Check whether the file can be opened.
-	if (objFile.is_open())
-	{
-		std::string line; // A line in the file.
-
-		// Read lines from the file.
-		while (std::getline(objFile, line))
-		{
-			// Turn the line into a string stream for processing.
-			std::stringstream ss;
-			ss << line;
-
-			// Read the first word of the line.
-			std::string label;
-			ss >> label;
-
-			// If the line is about vertex (starting with a "v").
-			if (label == "v")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 point;
-				ss >> point.x >> point.y >> point.z;
-
-				// Process the vertex.
-				input_vertices.push_back(point);
-			}
-			// If the line is about vertex normal (starting with a "vn").
-			else if (label == "vn")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 normal;
-				ss >> normal.x >> normal.y >> normal.z;
-
-				// Process the point.
-				input_normals.push_back(normal);
-			}
-			// If the line is about vertex texture (starting with a "vt").
-			else if (label == "vt")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 texture;
-				ss >> texture.x >> texture.y >> texture.z;
-
-				// Process the point.
-				input_textures.push_back(texture);
-			}
-			// If line is about a face (starting with "f")
-			else if (label == "f")
-			{
-				std::string face;
-
-				// add all 3 indices per line
-				while (ss >> face)
-				{
-					std::stringstream indices_string;
-					indices_string << face;
-					std::string index;
-
-					// get substring by delimiter of '/', giving us vertex index, texture index, then normal index
-					std::getline(indices_string, index, '/');
-					vertex_indices.push_back(std::stoi(index) - 1);
-					std::getline(indices_string, index, '/');
-					
-					// check if there was something actually extracted
-					
-					// texture_indices.push_back(std::stoi(index) - 1);
-
-					std::getline(indices_string, index, '/');
-					normal_indices.push_back(std::stoi(index) - 1);
-
-				}
-			}
-
-		}
-	}
-	else
-	{
-		std::cerr << "Can't open the file " << filename << std::endl;
-	}
-
-	std::cerr << "file " << filename << " read" << std::endl;
-
-	objFile.close();
-
-	// sort and align indices of the vertices and normals from the .obj file
-	for (unsigned int i = 0; i < vertex_indices.size(); i++)
-	{
-		vertices.push_back(input_vertices[vertex_indices[i]]);
-		normals.push_back(input_normals[normal_indices[i]]);
-		indices.push_back(i);
-	}
+	// corners with the same position and normal end up sharing one vertex
+	ObjMesh mesh;
+	if (ObjLoader::loadWelded(filename, mesh, ObjLoader::WELD_EPSILON))
+		std::cerr << "file " << filename << " read" << std::endl;
+
+	vertices = mesh.positions;
+	normals = mesh.normals;
+	indices = mesh.indices;
 
 	std::cerr << vertices.size() << " " << normals.size() << " " << indices.size() << std::endl;
 
@@ -195,6 +101,14 @@ void Geometry::update(glm::mat4 C)
 {
 }
 
+float Geometry::getRadius()
+{
+	float radius = 0;
+	for (const glm::vec3& v : vertices)
+		radius = glm::max(radius, glm::length(v));
+	return radius;
+}
+
 void Geometry::setColor(glm::vec3 c)
 {
 	Geometry::color = c;
@@ -12,11 +12,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
 #include "Node.h"
+#include "ObjLoader.h"
 
 class Geometry : public Node
 {
@@ -39,6 +38,8 @@ public:
 	void draw(GLuint shaderProgram, glm::mat4 C);
 	void update(glm::mat4 C);
 	void setColor(glm::vec3 c);
+	// distance of the farthest vertex from the geometry's origin
+	float getRadius();
 };
 
 #endif
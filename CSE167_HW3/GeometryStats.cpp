@@ -0,0 +1,524 @@
+#include "GeometryStats.h"
+
+#include <GLFW/glfw3.h>
+
+#include <thread>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <emmintrin.h>
+
+// below this many points per thread the threads cost more than they save
+static const size_t MIN_CHUNK = 1 << 16;
+
+// the float sums are folded into doubles this often so big arrays stay exact
+static const size_t SUM_BLOCK = 4096;
+
+// what one thread found in its part of the array
+struct Partial
+{
+	glm::vec3 min, max;
+	glm::dvec3 sum;
+
+	// the points with the smallest and largest value on each axis
+	glm::vec3 low[3], high[3];
+
+	// the starting sphere grown over this part in the second pass
+	glm::vec3 center;
+	float radius;
+};
+
+// starts the axis ends on the first point
+static void resetExtremes(Partial& out, const glm::vec3& first)
+{
+	for (int axis = 0; axis < 3; axis++)
+		out.low[axis] = out.high[axis] = first;
+}
+
+// updates the axis ends with p, only called for points past the current ones
+static void extremes(Partial& out, const glm::vec3& p)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (p[axis] < out.low[axis][axis])
+			out.low[axis] = p;
+		if (p[axis] > out.high[axis][axis])
+			out.high[axis] = p;
+	}
+}
+
+// runs fn(begin, end, chunk) on roughly equal parts of [0, count) in parallel
+template <typename F>
+static size_t parallelChunks(size_t count, F fn)
+{
+	size_t threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	size_t chunks = count / MIN_CHUNK + 1;
+	if (chunks > threads)
+		chunks = threads;
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < chunks; i++)
+		workers.push_back(std::thread(fn, count * i / chunks, count * (i + 1) / chunks, i));
+	fn(0, count / chunks, 0);
+	for (std::thread& t : workers)
+		t.join();
+
+	return chunks;
+}
+
+// moves the sphere just enough to take in p
+static void grow(glm::vec3& center, float& radius, const glm::vec3& p)
+{
+	glm::vec3 d = p - center;
+	float dist = sqrtf(glm::dot(d, d));
+	if (dist <= radius)
+		return;
+
+	float newRadius = (radius + dist) * 0.5f;
+	center += d * ((newRadius - radius) / dist);
+	radius = newRadius;
+}
+
+// Ritter's growing step for four points at once, the scalar update only
+// runs for the rare groups with a point outside the sphere
+static void growFour(__m128 x, __m128 y, __m128 z, glm::vec3& center, float& radius)
+{
+	__m128 dx = _mm_sub_ps(x, _mm_set1_ps(center.x));
+	__m128 dy = _mm_sub_ps(y, _mm_set1_ps(center.y));
+	__m128 dz = _mm_sub_ps(z, _mm_set1_ps(center.z));
+	__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+	if (_mm_movemask_ps(_mm_cmpgt_ps(dist2, _mm_set1_ps(radius * radius))) == 0)
+		return;
+
+	float px[4], py[4], pz[4];
+	_mm_storeu_ps(px, x);
+	_mm_storeu_ps(py, y);
+	_mm_storeu_ps(pz, z);
+	for (int l = 0; l < 4; l++)
+		grow(center, radius, glm::vec3(px[l], py[l], pz[l]));
+}
+
+// min, max and sum of x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 ... four points
+// at a time, every register keeps the same lane pattern the whole way. The
+// axis ends only change for the few groups with a value past the box so far.
+static void statsAoS(const float* f, size_t count, Partial& out)
+{
+	__m128 mn[3], mx[3], sum[3];
+	for (int r = 0; r < 3; r++)
+	{
+		mn[r] = _mm_set1_ps(FLT_MAX);
+		mx[r] = _mm_set1_ps(-FLT_MAX);
+		sum[r] = _mm_setzero_ps();
+	}
+	resetExtremes(out, count > 0 ? glm::vec3(f[0], f[1], f[2]) : glm::vec3(0));
+
+	float lanes[3][4];
+	glm::dvec3 total(0);
+	size_t i = 0;
+	while (i + 4 <= count)
+	{
+		size_t blockEnd = i + SUM_BLOCK < count ? i + SUM_BLOCK : count;
+		for (; i + 4 <= blockEnd; i += 4)
+		{
+			const float* p = f + i * 3;
+			__m128 past = _mm_setzero_ps();
+			for (int r = 0; r < 3; r++)
+			{
+				__m128 v = _mm_loadu_ps(p + r * 4);
+				past = _mm_or_ps(past, _mm_or_ps(_mm_cmplt_ps(v, mn[r]), _mm_cmpgt_ps(v, mx[r])));
+				mn[r] = _mm_min_ps(mn[r], v);
+				mx[r] = _mm_max_ps(mx[r], v);
+				sum[r] = _mm_add_ps(sum[r], v);
+			}
+			if (_mm_movemask_ps(past) != 0)
+			{
+				for (int l = 0; l < 4; l++)
+					extremes(out, glm::vec3(p[l * 3], p[l * 3 + 1], p[l * 3 + 2]));
+			}
+		}
+
+		for (int r = 0; r < 3; r++)
+		{
+			_mm_storeu_ps(lanes[r], sum[r]);
+			sum[r] = _mm_setzero_ps();
+			for (int l = 0; l < 4; l++)
+				total[(r * 4 + l) % 3] += lanes[r][l];
+		}
+	}
+
+	// lane l of register r holds component (r * 4 + l) % 3
+	out.min = glm::vec3(FLT_MAX);
+	out.max = glm::vec3(-FLT_MAX);
+	for (int r = 0; r < 3; r++)
+	{
+		float lo[4], hi[4];
+		_mm_storeu_ps(lo, mn[r]);
+		_mm_storeu_ps(hi, mx[r]);
+		for (int l = 0; l < 4; l++)
+		{
+			int axis = (r * 4 + l) % 3;
+			out.min[axis] = fminf(out.min[axis], lo[l]);
+			out.max[axis] = fmaxf(out.max[axis], hi[l]);
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		glm::vec3 p(f[i * 3], f[i * 3 + 1], f[i * 3 + 2]);
+		out.min = glm::min(out.min, p);
+		out.max = glm::max(out.max, p);
+		total += glm::dvec3(p);
+		extremes(out, p);
+	}
+	out.sum = total;
+}
+
+// same over three separate arrays, one register per axis
+static void statsSoA(const float* x, const float* y, const float* z, size_t count, Partial& out)
+{
+	const float* arrays[3] = { x, y, z };
+	__m128 mn[3], mx[3], sum[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mn[axis] = _mm_set1_ps(FLT_MAX);
+		mx[axis] = _mm_set1_ps(-FLT_MAX);
+		sum[axis] = _mm_setzero_ps();
+	}
+	resetExtremes(out, count > 0 ? glm::vec3(x[0], y[0], z[0]) : glm::vec3(0));
+
+	float lanes[4];
+	glm::dvec3 total(0);
+	size_t i = 0;
+	while (i + 4 <= count)
+	{
+		size_t blockEnd = i + SUM_BLOCK < count ? i + SUM_BLOCK : count;
+		for (; i + 4 <= blockEnd; i += 4)
+		{
+			__m128 past = _mm_setzero_ps();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 v = _mm_loadu_ps(arrays[axis] + i);
+				past = _mm_or_ps(past, _mm_or_ps(_mm_cmplt_ps(v, mn[axis]), _mm_cmpgt_ps(v, mx[axis])));
+				mn[axis] = _mm_min_ps(mn[axis], v);
+				mx[axis] = _mm_max_ps(mx[axis], v);
+				sum[axis] = _mm_add_ps(sum[axis], v);
+			}
+			if (_mm_movemask_ps(past) != 0)
+			{
+				for (size_t l = i; l < i + 4; l++)
+					extremes(out, glm::vec3(x[l], y[l], z[l]));
+			}
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			_mm_storeu_ps(lanes, sum[axis]);
+			sum[axis] = _mm_setzero_ps();
+			total[axis] += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float lo[4], hi[4];
+		_mm_storeu_ps(lo, mn[axis]);
+		_mm_storeu_ps(hi, mx[axis]);
+		out.min[axis] = fminf(fminf(lo[0], lo[1]), fminf(lo[2], lo[3]));
+		out.max[axis] = fmaxf(fmaxf(hi[0], hi[1]), fmaxf(hi[2], hi[3]));
+	}
+
+	for (; i < count; i++)
+	{
+		glm::vec3 p(x[i], y[i], z[i]);
+		out.min = glm::min(out.min, p);
+		out.max = glm::max(out.max, p);
+		total += glm::dvec3(p);
+		extremes(out, p);
+	}
+	out.sum = total;
+}
+
+// second pass, grows the starting sphere of a part over its points
+static void growAoS(const float* f, size_t count, glm::vec3& center, float& radius)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* p = f + i * 3;
+		growFour(_mm_setr_ps(p[0], p[3], p[6], p[9]), _mm_setr_ps(p[1], p[4], p[7], p[10]),
+			_mm_setr_ps(p[2], p[5], p[8], p[11]), center, radius);
+	}
+	for (; i < count; i++)
+		grow(center, radius, glm::vec3(f[i * 3], f[i * 3 + 1], f[i * 3 + 2]));
+}
+
+static void growSoA(const float* x, const float* y, const float* z, size_t count,
+	glm::vec3& center, float& radius)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		growFour(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i), center, radius);
+	for (; i < count; i++)
+		grow(center, radius, glm::vec3(x[i], y[i], z[i]));
+}
+
+// smallest sphere around two spheres
+static void merge(glm::vec3& center, float& radius, const glm::vec3& otherCenter, float otherRadius)
+{
+	glm::vec3 d = otherCenter - center;
+	float dist = sqrtf(glm::dot(d, d));
+	if (dist + otherRadius <= radius)
+		return;
+	if (dist + radius <= otherRadius)
+	{
+		center = otherCenter;
+		radius = otherRadius;
+		return;
+	}
+
+	float newRadius = (dist + radius + otherRadius) * 0.5f;
+	center += d * ((newRadius - radius) / dist);
+	radius = newRadius;
+}
+
+// the box and centroid of the whole array from the parts of the first pass.
+// The sphere starts around the box, with a sphere pass it is replaced by the
+// one on the farthest apart pair of axis ends.
+static GeometryStats combine(std::vector<Partial>& parts, size_t chunks, size_t count, bool sphere)
+{
+	GeometryStats stats;
+	stats.count = count;
+	stats.min = glm::vec3(FLT_MAX);
+	stats.max = glm::vec3(-FLT_MAX);
+	glm::dvec3 sum(0);
+	for (size_t i = 0; i < chunks; i++)
+	{
+		stats.min = glm::min(stats.min, parts[i].min);
+		stats.max = glm::max(stats.max, parts[i].max);
+		sum += parts[i].sum;
+	}
+	stats.centroid = count > 0 ? glm::vec3(sum / (double)count) : glm::vec3(0);
+
+	stats.sphereCenter = glm::vec3(0);
+	stats.sphereRadius = 0;
+	if (count == 0)
+		return stats;
+	stats.sphereCenter = stats.getCenter();
+	stats.sphereRadius = glm::length(stats.getHalfSize());
+	if (!sphere)
+		return stats;
+
+	// chunks too small to have points found no ends
+	glm::vec3 low[3], high[3];
+	bool first = true;
+	for (size_t i = 0; i < chunks; i++)
+	{
+		if (parts[i].min.x > parts[i].max.x)
+			continue;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (first || parts[i].low[axis][axis] < low[axis][axis])
+				low[axis] = parts[i].low[axis];
+			if (first || parts[i].high[axis][axis] > high[axis][axis])
+				high[axis] = parts[i].high[axis];
+		}
+		first = false;
+	}
+
+	int widest = 0;
+	float widestDist2 = -1;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 d = high[axis] - low[axis];
+		if (glm::dot(d, d) > widestDist2)
+		{
+			widest = axis;
+			widestDist2 = glm::dot(d, d);
+		}
+	}
+	glm::vec3 center = (low[widest] + high[widest]) * 0.5f;
+	float radius = sqrtf(widestDist2) * 0.5f;
+	for (size_t i = 0; i < chunks; i++)
+	{
+		parts[i].center = center;
+		parts[i].radius = radius;
+	}
+	return stats;
+}
+
+// every chunk grew its own copy of the starting sphere, the union of those
+// still holds every point
+static void mergeSpheres(GeometryStats& stats, std::vector<Partial>& parts, size_t chunks)
+{
+	if (stats.count == 0)
+		return;
+
+	glm::vec3 boxCenter = stats.sphereCenter;
+	float boxRadius = stats.sphereRadius;
+	stats.sphereCenter = parts[0].center;
+	stats.sphereRadius = parts[0].radius;
+	for (size_t i = 1; i < chunks; i++)
+		merge(stats.sphereCenter, stats.sphereRadius, parts[i].center, parts[i].radius);
+
+	// on a filled box the grown sphere can end up a bit larger than the
+	// box's own, both hold every point
+	if (boxRadius < stats.sphereRadius)
+	{
+		stats.sphereCenter = boxCenter;
+		stats.sphereRadius = boxRadius;
+	}
+}
+
+static GeometryStats computeAoS(const std::vector<glm::vec3>& points, bool sphere)
+{
+	size_t count = points.size();
+	const float* f = count > 0 ? &points[0].x : nullptr;
+	std::vector<Partial> parts(std::thread::hardware_concurrency() + 1);
+
+	size_t chunks = parallelChunks(count, [&](size_t begin, size_t end, size_t chunk) {
+		statsAoS(f + begin * 3, end - begin, parts[chunk]);
+	});
+	GeometryStats stats = combine(parts, chunks, count, sphere);
+	if (!sphere || count == 0)
+		return stats;
+
+	parallelChunks(count, [&](size_t begin, size_t end, size_t chunk) {
+		growAoS(f + begin * 3, end - begin, parts[chunk].center, parts[chunk].radius);
+	});
+	mergeSpheres(stats, parts, chunks);
+	return stats;
+}
+
+GeometryStats GeometryKernel::compute(const std::vector<glm::vec3>& points)
+{
+	return computeAoS(points, true);
+}
+
+GeometryStats GeometryKernel::compute(const float* x, const float* y, const float* z, size_t count)
+{
+	std::vector<Partial> parts(std::thread::hardware_concurrency() + 1);
+
+	size_t chunks = parallelChunks(count, [&](size_t begin, size_t end, size_t chunk) {
+		statsSoA(x + begin, y + begin, z + begin, end - begin, parts[chunk]);
+	});
+	GeometryStats stats = combine(parts, chunks, count, true);
+	if (count == 0)
+		return stats;
+
+	parallelChunks(count, [&](size_t begin, size_t end, size_t chunk) {
+		growSoA(x + begin, y + begin, z + begin, end - begin, parts[chunk].center, parts[chunk].radius);
+	});
+	mergeSpheres(stats, parts, chunks);
+	return stats;
+}
+
+void GeometryKernel::transform(std::vector<glm::vec3>& points, glm::vec3 center, float scale)
+{
+	if (points.empty())
+		return;
+	float* f = &points[0].x;
+
+	parallelChunks(points.size(), [&](size_t begin, size_t end, size_t) {
+		// same lane pattern as statsAoS
+		__m128 offset[3] = {
+			_mm_setr_ps(center.x, center.y, center.z, center.x),
+			_mm_setr_ps(center.y, center.z, center.x, center.y),
+			_mm_setr_ps(center.z, center.x, center.y, center.z) };
+		__m128 s = _mm_set1_ps(scale);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				float* p = f + i * 3 + r * 4;
+				_mm_storeu_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p), offset[r]), s));
+			}
+		}
+		for (; i < end; i++)
+			points[i] = (points[i] - center) * scale;
+	});
+}
+
+void GeometryKernel::transform(float* x, float* y, float* z, size_t count, glm::vec3 center, float scale)
+{
+	parallelChunks(count, [&](size_t begin, size_t end, size_t) {
+		float* arrays[3] = { x, y, z };
+		__m128 s = _mm_set1_ps(scale);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float* a = arrays[axis];
+			__m128 offset = _mm_set1_ps(center[axis]);
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+				_mm_storeu_ps(a + i, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(a + i), offset), s));
+			for (; i < end; i++)
+				a[i] = (a[i] - center[axis]) * scale;
+		}
+	});
+}
+
+// only the box is needed here, so the sphere isn't grown
+GeometryStats GeometryKernel::normalize(std::vector<glm::vec3>& points, float size)
+{
+	GeometryStats stats = computeAoS(points, false);
+	if (points.empty())
+		return stats;
+
+	glm::vec3 half = stats.getHalfSize();
+	float longest = fmaxf(half.x, fmaxf(half.y, half.z));
+	if (longest > 0)
+		transform(points, stats.getCenter(), size / longest);
+	return stats;
+}
+
+void GeometryKernel::benchmark(size_t count)
+{
+	// a blob thinning out to the sides of a box (the sum of three uniform
+	// values per axis), so the grown sphere can beat the box's
+	std::vector<glm::vec3> points;
+	try
+	{
+		points.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		std::cerr << "geometry: not enough memory for " << count << " points" << std::endl;
+		return;
+	}
+	unsigned int seed = 12345;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float v = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				v += (seed >> 8) / 16777216.f;
+			}
+			points[i][axis] = v / 3.f * 2.f - 1.f;
+		}
+	}
+	double bytes = (double)count * sizeof(glm::vec3);
+	char line[256];
+
+	double start = glfwGetTime();
+	GeometryStats stats = compute(points);
+	double elapsed = glm::max(glfwGetTime() - start, 1e-9);
+	snprintf(line, sizeof(line),
+		"geometry: stats of %zu points in %.1f ms, %.2f GB/s, sphere %.4f, box sphere %.4f",
+		count, elapsed * 1000.0, 2.0 * bytes / elapsed / 1e9, stats.sphereRadius,
+		glm::length(stats.getHalfSize()));
+	std::cerr << line << std::endl;
+
+	start = glfwGetTime();
+	normalize(points, 1.f);
+	elapsed = glm::max(glfwGetTime() - start, 1e-9);
+	snprintf(line, sizeof(line), "geometry: normalized %zu points in %.1f ms, %.2f GB/s",
+		count, elapsed * 1000.0, 3.0 * bytes / elapsed / 1e9);
+	std::cerr << line << std::endl;
+}
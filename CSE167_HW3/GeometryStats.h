@@ -0,0 +1,48 @@
+#ifndef _GEOMETRY_STATS_H_
+#define _GEOMETRY_STATS_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <iostream>
+
+// Bounds of a vertex array: axis aligned box, centroid and a bounding sphere
+// (Ritter's, a little larger than the smallest possible one). The sphere
+// starts on the farthest apart pair of the points at the ends of each axis
+// and grows to take in the rest.
+struct GeometryStats
+{
+	glm::vec3 min, max;
+	glm::vec3 centroid;
+	glm::vec3 sphereCenter;
+	float sphereRadius;
+	size_t count;
+
+	glm::vec3 getCenter() { return (min + max) * 0.5f; }
+	glm::vec3 getHalfSize() { return (max - min) * 0.5f; }
+};
+
+// SSE kernels over big vertex arrays, split across one thread per core.
+// Positions can be packed vec3s or three separate x, y, z arrays. The box,
+// centroid and the points at the ends of each axis come out of one pass over
+// the points, growing the sphere from those is a second one.
+class GeometryKernel
+{
+public:
+	static GeometryStats compute(const std::vector<glm::vec3>& points);
+	static GeometryStats compute(const float* x, const float* y, const float* z, size_t count);
+
+	// p = (p - center) * scale for every point
+	static void transform(std::vector<glm::vec3>& points, glm::vec3 center, float scale);
+	static void transform(float* x, float* y, float* z, size_t count, glm::vec3 center, float scale);
+
+	// centers the box on the origin and scales the longest half axis to size,
+	// returns the stats from before the change. One pass to read and one to
+	// write, the sphere is the box's rather than Ritter's.
+	static GeometryStats normalize(std::vector<glm::vec3>& points, float size);
+
+	// times compute and normalize over count random points, packed, and
+	// prints the rates and how much bigger the sphere is than the box's
+	static void benchmark(size_t count);
+};
+
+#endif
@@ -5,76 +5,13 @@ LightSource::LightSource(std::string objFilename, glm::vec3 lightPos, glm::vec3
 	LightSource::lightPos = lightPos;
 	LightSource::color = color;
 
-	std::ifstream objFile(objFilename); // The obj file we are reading.
+	ObjMesh mesh;
+	if (ObjLoader::load(objFilename, mesh))
+		std::cerr << "file " << objFilename << " read" << std::endl;
 
-	// Check whether the file can be opened.
-	if (objFile.is_open())
-	{
-		std::string line; // A line in the file.
-
-		// Read lines from the file.
-		while (std::getline(objFile, line))
-		{
-			// Turn the line into a string stream for processing.
-			std::stringstream ss;
-			ss << line;
-
-			// Read the first word of the line.
-			std::string label;
-			ss >> label;
-
-			// If the line is about vertex (starting with a "v").
-			if (label == "v")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 point;
-				ss >> point.x >> point.y >> point.z;
-
-				// Process the point. For example, you can save it to a.
-				points.push_back(point);
-			}
-			// If the line is about vertex normal (starting with a "vn").
-			else if (label == "vn")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 normal;
-				ss >> normal.x >> normal.y >> normal.z;
-
-				// Process the point.
-				normals.push_back(normal);
-			}
-			// If line is about a face (starting with "f")
-			else if (label == "f")
-			{
-				std::string face;
-
-				// add all 3 indices per line
-				while (ss >> face)
-				{
-					//std::string face1, face2, face3;
-					//ss >> face1 >> face2 >> face3;
-					std::string::size_type sz;
-
-					// get index of the face and store it as an int in faces
-					// subtract 1 since indices start at 1 in .obj file
-					faces.push_back((unsigned int)(std::stoul(face, &sz) - 1));
-					//faces.push_back((unsigned int)(std::stoul(face2, &sz)));
-					//faces.push_back((unsigned int)(std::stoul(face3, &sz)));
-				}
-			}
-
-		}
-	}
-	else
-	{
-		std::cerr << "Can't open the file " << objFilename << std::endl;
-	}
-
-	std::cerr << "file " << objFilename << " read" << std::endl;
-
-	objFile.close();
+	points = mesh.positions;
+	normals = mesh.normals;
+	faces = mesh.indices;
 
 	// Set the model matrix to an identity matrix. 
 	model = glm::mat4(1);
@@ -10,11 +10,10 @@
 #include <glm/gtx/transform.hpp>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
 #include "Object.h"
+#include "ObjLoader.h"
 
 class LightSource : public Object
 {
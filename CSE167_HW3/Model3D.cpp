@@ -8,159 +8,16 @@ Model3D::Model3D(std::string objFilename, glm::vec3 ambient, glm::vec3 diffuse,
 	Model3D::specular = specular;
 	Model3D::shininess = shininess;
 
-	// store raw inputs of vertices and normals, and indices of vertices and normals
-	std::vector<glm::vec3> input_vertices, input_normals;
-	std::vector<unsigned int> vertex_indices, normal_indices;
+	ObjMesh mesh;
+	if (ObjLoader::loadWelded(objFilename, mesh, ObjLoader::WELD_EPSILON))
+		std::cerr << "file " << objFilename << " read" << std::endl;
 
+	vertices = mesh.positions;
+	normals = mesh.normals;
+	indices = mesh.indices;
 
-
-	std::ifstream objFile(objFilename); // The obj file we are reading.
-
-	// Check whether the file can be opened.
-	if (objFile.is_open())
-	{
-		std::string line; // A line in the file.
-
-		// Read lines from the file.
-		while (std::getline(objFile, line))
-		{
-			// Turn the line into a string stream for processing.
-			std::stringstream ss;
-			ss << line;
-
-			// Read the first word of the line.
-			std::string label;
-			ss >> label;
-
-			// If the line is about vertex (starting with a "v").
-			if (label == "v")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 point;
-				ss >> point.x >> point.y >> point.z;
-
-				// Process the vertex.
-				input_vertices.push_back(point);
-			}
-			// If the line is about vertex normal (starting with a "vn").
-			else if (label == "vn")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 normal;
-				ss >> normal.x >> normal.y >> normal.z;
-
-				// Process the point.
-				input_normals.push_back(normal);
-			}
-			// If line is about a face (starting with "f")
-			else if (label == "f")
-			{
-				std::string face;
-
-				// add all 3 indices per line
-				while (ss >> face)
-				{
-					std::stringstream indices_string;
-					std::string index;
-
-					// get substring by delimiter of '/', giving us vertex index, texture index, then normal index
-					std::getline(indices_string, index, '/');
-					vertex_indices.push_back(std::stoi(index));
-					std::getline(indices_string, index, '/');
-
-					// insert texture here
-
-					std::getline(indices_string, index, '/');
-					normal_indices.push_back(std::stoi(index));
-					
-				}
-			}
-
-		}
-	}
-	else
-	{
-		std::cerr << "Can't open the file " << objFilename << std::endl;
-	}
-
-	std::cerr << "file " << objFilename <<" read" << std::endl;
-
-	objFile.close();
-
-	// sort and align indices of the vertices and normals from the .obj file
-	for (unsigned int i; i < vertex_indices.size(); i++)
-	{
-		vertices.push_back(input_vertices[vertex_indices[i]]);
-		normals.push_back(input_normals[normal_indices[i]]);
-		indices.push_back(i);
-	}
-
-	// set initial max & min values to 0th point in array
-	float max_x = vertices[0].x;
-	float max_y = vertices[0].y;
-	float max_z = vertices[0].z;
-
-	float min_x = max_x;
-	float min_y = max_y;
-	float min_z = max_z;
-
-	float max_dist_abs = fabs(max_x);
-
-	// iterate through all points and find min and max values of all the points
-	for (glm::vec3& point : vertices)
-	{
-		if (point.x > max_x)
-			max_x = point.x;
-		else if (point.x < min_x)
-			min_x = point.x;
-
-		if (point.y > max_y)
-			max_y = point.y;
-		else if (point.y < min_y)
-			min_y = point.y;
-
-		if (point.z > max_z)
-			max_z = point.z;
-		else if (point.z < min_z)
-			min_z = point.z;
-
-		float t_max = sqrtf(point.x * point.x + point.y * point.y + point.z * point.z);
-
-		if (t_max > max_dist_abs)
-		{
-			max_dist_abs = t_max;
-		}
-	}
-
-	// find midpoints of all the max and mins
-	float mid_x = (max_x + min_x) / 2;
-	float mid_y = (max_y + min_y) / 2;
-	float mid_z = (max_z + min_z) / 2;
-
-	glm::vec3 midpoint(mid_x, mid_y, mid_z);
-
-	// then iterate through all points again, and subtract midpoint
-	for (glm::vec3& point : vertices)
-	{
-		point -= midpoint;
-	}
-
-	// find how far away the furthest point is
-	float max_dist = fmax(fmax(fabs(max_x - mid_x), fabs(min_x - mid_x)),
-		fmax(fmax(fabs(max_y - mid_y), fabs(min_y - mid_y)),
-			fmax(fabs(max_z - mid_z), fabs(min_z - mid_z))));
-
-	// after normalizing points to a radius of 1, scale back up
-	float scaling_factor = 8.4f;
-
-	// iterate through all points, normalize all to a radius of 1 based on the pt furthest away, then scale back up
-	for (glm::vec3& point : vertices)
-	{
-		point /= max_dist;
-		point *= scaling_factor;
-	}
+	// center the box on the origin and scale its longest half axis to 8.4
+	GeometryKernel::normalize(vertices, 8.4f);
 
 
 	 // Set the model matrix to an identity matrix. 
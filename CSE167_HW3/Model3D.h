@@ -11,11 +11,11 @@
 #include <glm/gtx/transform.hpp>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
 #include "Object.h"
+#include "ObjLoader.h"
+#include "GeometryStats.h"
 
 class Model3D : public Object
 {
@@ -0,0 +1,781 @@
+#include "ObjLoader.h"
+
+#include <thread>
+#include <unordered_map>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glm/gtc/type_precision.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+// chunks smaller than this aren't worth a thread
+static const size_t MIN_CHUNK = 1 << 20;
+
+static const char CACHE_MAGIC[4] = { 'O', 'B', 'J', 'C' };
+static const unsigned int CACHE_VERSION = 2;
+static const unsigned int NONE = 0xffffffffu;
+
+// stands in for a 0 index, which obj doesn't have. Kept as a relative index
+// this far back, it stays out of range after the offsets are added.
+static const int BAD_INDEX = INT_MIN / 2;
+
+// a hundredth of a micron for models in meters, far below anything visible
+const float ObjLoader::WELD_EPSILON = 1e-5f;
+
+const char* ObjLoader::CACHE_DIR = "cache";
+
+// start of a cache file, the arrays follow in declaration order of ObjMesh
+struct CacheHeader
+{
+	char magic[4];
+	unsigned int version;
+	float epsilon;
+	long long objSize, objTime; // identifies the obj the cache was made from
+	unsigned int numPositions, numNormals, numTexCoords, numIndices;
+};
+
+// Read only view of a whole file.
+class MappedFile
+{
+private:
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int file;
+#endif
+	const char* data;
+	size_t size;
+
+public:
+	MappedFile(const std::string& filename)
+	{
+		data = nullptr;
+		size = 0;
+#ifdef _WIN32
+		mapping = nullptr;
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER length;
+		GetFileSizeEx(file, &length);
+		size = (size_t)length.QuadPart;
+		if (size == 0)
+			return;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		file = open(filename.c_str(), O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat st;
+		fstat(file, &st);
+		size = (size_t)st.st_size;
+		if (size == 0)
+			return;
+
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		data = p == MAP_FAILED ? nullptr : (const char*)p;
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			close(file);
+#endif
+	}
+
+	bool isOpen()
+	{
+		return data != nullptr || isEmpty();
+	}
+
+	bool isEmpty()
+	{
+#ifdef _WIN32
+		return file != INVALID_HANDLE_VALUE && size == 0;
+#else
+		return file >= 0 && size == 0;
+#endif
+	}
+
+	const char* begin() { return data; }
+	const char* end() { return data + size; }
+	size_t length() { return size; }
+};
+
+// one corner of a face, indices are 0 based or relative to the line
+struct Corner
+{
+	int v, vt, vn;
+	unsigned char relative; // bit 0 v, bit 1 vt, bit 2 vn
+};
+
+// everything parsed from one chunk, indices not yet made absolute
+struct Chunk
+{
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<Corner> corners; // three per triangle
+};
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpace(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p))
+		p++;
+	return p;
+}
+
+// parses a float the way strtof does. Up to 7 significant digits and small
+// exponents are exact in float arithmetic, so one multiply or divide gives
+// the correctly rounded result; anything longer goes to strtof.
+static const char* parseFloat(const char* p, const char* end, float& out)
+{
+	static const float powers[11] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+		1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	p = skipSpace(p, end);
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (mantissa != 0 || *p != '0')
+			digits++;
+		mantissa = mantissa * 10 + (*p++ - '0');
+		any = true;
+		if (digits > 18)
+			break;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (mantissa != 0 || *p != '0')
+				digits++;
+			mantissa = mantissa * 10 + (*p++ - '0');
+			exponent--;
+			any = true;
+			if (digits > 18)
+				break;
+		}
+	}
+	if (any && p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool expNegative = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			expNegative = *q++ == '-';
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int e = 0;
+			while (q < end && *q >= '0' && *q <= '9' && e < 10000)
+				e = e * 10 + (*q++ - '0');
+			exponent += expNegative ? -e : e;
+			p = q;
+		}
+	}
+
+	bool fast = any && mantissa < (1 << 24) && exponent >= -10 && exponent <= 10 &&
+		(p == end || !((*p >= '0' && *p <= '9') || *p == '.'));
+	if (fast)
+	{
+		float value = (float)mantissa;
+		value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// slow path: copy the token so strtof can't run past the chunk
+	char token[64];
+	size_t n = 0;
+	p = start;
+	while (p < end && !isSpace(*p) && *p != '\n' && n < sizeof(token) - 1)
+		token[n++] = *p++;
+	token[n] = 0;
+	out = n > 0 ? strtof(token, nullptr) : 0.f;
+	return p;
+}
+
+static const char* parseInt(const char* p, const char* end, int& out, bool& found)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	int value = 0;
+	found = false;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p++ - '0');
+		found = true;
+	}
+	out = negative ? -value : value;
+	return p;
+}
+
+// one "v", "v/vt", "v//vn" or "v/vt/vn" token
+static const char* parseCorner(const char* p, const char* end, Corner& c, bool& ok)
+{
+	int values[3] = { 0, 0, 0 };
+	bool found[3] = { false, false, false };
+
+	p = parseInt(p, end, values[0], found[0]);
+	for (int i = 1; i < 3 && p < end && *p == '/'; i++)
+		p = parseInt(p + 1, end, values[i], found[i]);
+
+	ok = found[0];
+	c.relative = 0;
+	int* out[3] = { &c.v, &c.vt, &c.vn };
+	for (int i = 0; i < 3; i++)
+	{
+		if (!found[i])
+			*out[i] = -1;
+		else if (values[i] == 0)
+		{
+			*out[i] = BAD_INDEX;
+			c.relative |= 1 << i;
+		}
+		else if (values[i] < 0)
+		{
+			*out[i] = values[i];
+			c.relative |= 1 << i;
+		}
+		else
+			*out[i] = values[i] - 1;
+	}
+	return p;
+}
+
+static void parseChunk(const char* p, const char* end, bool pointsOnly, Chunk& chunk)
+{
+	std::vector<Corner> polygon;
+
+	while (p < end)
+	{
+		p = skipSpace(p, end);
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+		{
+			glm::vec3 v;
+			const char* q = parseFloat(p + 2, lineEnd, v.x);
+			q = parseFloat(q, lineEnd, v.y);
+			parseFloat(q, lineEnd, v.z);
+			chunk.positions.push_back(v);
+		}
+		else if (pointsOnly)
+		{
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+		{
+			glm::vec3 n;
+			const char* q = parseFloat(p + 3, lineEnd, n.x);
+			q = parseFloat(q, lineEnd, n.y);
+			parseFloat(q, lineEnd, n.z);
+			chunk.normals.push_back(n);
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+		{
+			glm::vec2 t;
+			const char* q = parseFloat(p + 3, lineEnd, t.x);
+			parseFloat(q, lineEnd, t.y);
+			chunk.texCoords.push_back(t);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+		{
+			polygon.clear();
+			const char* q = p + 2;
+			while (true)
+			{
+				q = skipSpace(q, lineEnd);
+				if (q >= lineEnd)
+					break;
+
+				Corner c;
+				bool ok;
+				q = parseCorner(q, lineEnd, c, ok);
+				if (!ok)
+					break;
+
+				// relative indices count back from what this chunk has seen,
+				// store them relative to the chunk start for the merge
+				if (c.relative & 1)
+					c.v += (int)chunk.positions.size();
+				if (c.relative & 2)
+					c.vt += (int)chunk.texCoords.size();
+				if (c.relative & 4)
+					c.vn += (int)chunk.normals.size();
+				polygon.push_back(c);
+
+				// skip anything left of a malformed token
+				while (q < lineEnd && !isSpace(*q))
+					q++;
+			}
+
+			// triangle fan around the first corner
+			for (size_t i = 2; i < polygon.size(); i++)
+			{
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[i - 1]);
+				chunk.corners.push_back(polygon[i]);
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+// cuts the file at line breaks and parses the pieces in parallel
+static bool parseFile(const std::string& filename, bool pointsOnly, std::vector<Chunk>& chunks)
+{
+	MappedFile file(filename);
+	if (!file.isOpen())
+	{
+		std::cerr << "Can't open the file " << filename << std::endl;
+		return false;
+	}
+	if (file.isEmpty())
+		return true;
+
+	size_t threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	size_t count = file.length() / MIN_CHUNK + 1;
+	if (count > threads)
+		count = threads;
+
+	std::vector<const char*> bounds(count + 1);
+	bounds[0] = file.begin();
+	bounds[count] = file.end();
+	for (size_t i = 1; i < count; i++)
+	{
+		const char* p = file.begin() + file.length() * i / count;
+		if (p < bounds[i - 1])
+			p = bounds[i - 1];
+		const char* nl = (const char*)memchr(p, '\n', file.end() - p);
+		bounds[i] = nl ? nl + 1 : file.end();
+	}
+
+	chunks.resize(count);
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < count; i++)
+	{
+		workers.push_back(std::thread(parseChunk, bounds[i], bounds[i + 1], pointsOnly,
+			std::ref(chunks[i])));
+	}
+	parseChunk(bounds[0], bounds[1], pointsOnly, chunks[0]);
+	for (std::thread& t : workers)
+		t.join();
+
+	return true;
+}
+
+struct CornerHash
+{
+	size_t operator()(const glm::ivec3& c) const
+	{
+		return ((size_t)c.x * 73856093u) ^ ((size_t)c.y * 19349663u) ^ ((size_t)c.z * 83492791u);
+	}
+};
+
+bool ObjLoader::load(const std::string& filename, ObjMesh& mesh)
+{
+	std::vector<Chunk> chunks;
+	if (!parseFile(filename, false, chunks))
+		return false;
+
+	// concatenate the attribute arrays in file order
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<glm::ivec3> offsets(chunks.size());
+	size_t numCorners = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		offsets[i] = glm::ivec3((int)positions.size(), (int)texCoords.size(), (int)normals.size());
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		texCoords.insert(texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+		numCorners += chunks[i].corners.size();
+	}
+
+	mesh = ObjMesh();
+	mesh.indices.reserve(numCorners);
+
+	// one output vertex per distinct index tuple, numbered in first use order
+	std::unordered_map<glm::ivec3, unsigned int, CornerHash> vertexMap;
+	vertexMap.reserve(numCorners / 4 + 16);
+
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		for (const Corner& c : chunks[i].corners)
+		{
+			glm::ivec3 key(c.v, c.vt, c.vn);
+			if (c.relative & 1)
+				key.x += offsets[i].x;
+			if (c.relative & 2)
+				key.y += offsets[i].y;
+			if (c.relative & 4)
+				key.z += offsets[i].z;
+
+			// -1 is a missing vt or vn, a relative one reaching back past
+			// the start is out of range instead
+			if (key.x < 0 || key.x >= (int)positions.size() ||
+				key.y >= (int)texCoords.size() || key.z >= (int)normals.size() ||
+				((c.relative & 2) && key.y < 0) || ((c.relative & 4) && key.z < 0))
+			{
+				std::cerr << "Face index out of range in " << filename << std::endl;
+				return false;
+			}
+
+			std::pair<std::unordered_map<glm::ivec3, unsigned int, CornerHash>::iterator, bool> it =
+				vertexMap.insert(std::make_pair(key, (unsigned int)mesh.positions.size()));
+			if (it.second)
+			{
+				// corners without their own normal or texture coordinate take
+				// the one numbered like their position, as the old loaders did
+				// for "f v v v" faces in files that list them per vertex
+				int vn = key.z >= 0 ? key.z : key.x;
+				int vt = key.y >= 0 ? key.y : key.x;
+				mesh.positions.push_back(positions[key.x]);
+				if (!normals.empty())
+					mesh.normals.push_back(vn < (int)normals.size() ? normals[vn] : glm::vec3(0));
+				if (!texCoords.empty())
+					mesh.texCoords.push_back(vt < (int)texCoords.size() ? texCoords[vt] : glm::vec2(0));
+			}
+			mesh.indices.push_back(it.first->second);
+		}
+	}
+
+	return true;
+}
+
+bool ObjLoader::loadPoints(const std::string& filename, std::vector<glm::vec3>& points)
+{
+	std::vector<Chunk> chunks;
+	if (!parseFile(filename, true, chunks))
+		return false;
+
+	points.clear();
+	for (Chunk& c : chunks)
+		points.insert(points.end(), c.positions.begin(), c.positions.end());
+	return true;
+}
+
+// cell of the weld grid, cells are epsilon wide so a match is at most one
+// cell away. For exact welding any fixed size works, equal points share a cell.
+// 64 bit, at the default epsilon an int runs out past about 21k units.
+static glm::i64vec3 weldCell(const glm::vec3& p, float epsilon)
+{
+	double scale = epsilon > 0 ? 1.0 / epsilon : 1024.0;
+	return glm::i64vec3((long long)floor(p.x * scale), (long long)floor(p.y * scale),
+		(long long)floor(p.z * scale));
+}
+
+static unsigned long long cellKey(const glm::i64vec3& c)
+{
+	return ((unsigned long long)c.x * 73856093ull) ^
+		((unsigned long long)c.y * 19349663ull) ^
+		((unsigned long long)c.z * 83492791ull);
+}
+
+static bool nearlyEqual(const glm::vec3& a, const glm::vec3& b, float epsilon)
+{
+	return fabs(a.x - b.x) <= epsilon && fabs(a.y - b.y) <= epsilon && fabs(a.z - b.z) <= epsilon;
+}
+
+void ObjLoader::weld(ObjMesh& mesh, float epsilon)
+{
+	bool hasNormals = !mesh.normals.empty();
+	bool hasTexCoords = !mesh.texCoords.empty();
+	int reach = epsilon > 0 ? 1 : 0;
+
+	ObjMesh out;
+	std::vector<unsigned int> remap(mesh.positions.size());
+
+	// kept vertices are chained per cell through next, the map holds the head
+	std::unordered_map<unsigned long long, unsigned int> cells;
+	std::vector<unsigned int> next;
+	cells.reserve(mesh.positions.size());
+
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		const glm::vec3& p = mesh.positions[i];
+		glm::i64vec3 cell = weldCell(p, epsilon);
+
+		unsigned int found = NONE;
+		for (int dx = -reach; dx <= reach && found == NONE; dx++)
+		for (int dy = -reach; dy <= reach && found == NONE; dy++)
+		for (int dz = -reach; dz <= reach && found == NONE; dz++)
+		{
+			std::unordered_map<unsigned long long, unsigned int>::iterator it =
+				cells.find(cellKey(cell + glm::i64vec3(dx, dy, dz)));
+			if (it == cells.end())
+				continue;
+
+			for (unsigned int j = it->second; j != NONE; j = next[j])
+			{
+				if (!nearlyEqual(out.positions[j], p, epsilon))
+					continue;
+				if (hasNormals && !nearlyEqual(out.normals[j], mesh.normals[i], epsilon))
+					continue;
+				if (hasTexCoords && !nearlyEqual(glm::vec3(out.texCoords[j], 0),
+					glm::vec3(mesh.texCoords[i], 0), epsilon))
+					continue;
+
+				found = j;
+				break;
+			}
+		}
+
+		if (found == NONE)
+		{
+			found = (unsigned int)out.positions.size();
+			out.positions.push_back(p);
+			if (hasNormals)
+				out.normals.push_back(mesh.normals[i]);
+			if (hasTexCoords)
+				out.texCoords.push_back(mesh.texCoords[i]);
+
+			unsigned int& head = cells.insert(std::make_pair(cellKey(cell), NONE)).first->second;
+			next.push_back(head);
+			head = found;
+		}
+		remap[i] = found;
+	}
+
+	out.indices.reserve(mesh.indices.size());
+	for (unsigned int index : mesh.indices)
+		out.indices.push_back(remap[index]);
+
+	std::swap(mesh, out);
+}
+
+template <typename T>
+static bool readArray(std::ifstream& in, std::vector<T>& v, unsigned int count)
+{
+	v.resize(count);
+	in.read((char*)v.data(), sizeof(T) * count);
+	return (bool)in;
+}
+
+template <typename T>
+static void writeArray(std::ofstream& out, const std::vector<T>& v)
+{
+	out.write((const char*)v.data(), sizeof(T) * v.size());
+}
+
+// the obj's path flattened into one name inside CACHE_DIR, so the asset
+// folders stay free of generated files
+static std::string cachePath(const std::string& filename)
+{
+	std::string name = filename;
+	for (char& c : name)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+	return std::string(ObjLoader::CACHE_DIR) + "/" + name + ".cache";
+}
+
+static void makeCacheDir()
+{
+#ifdef _WIN32
+	_mkdir(ObjLoader::CACHE_DIR);
+#else
+	mkdir(ObjLoader::CACHE_DIR, 0755);
+#endif
+}
+
+bool ObjLoader::loadWelded(const std::string& filename, ObjMesh& mesh, float epsilon)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+	{
+		std::cerr << "Can't open the file " << filename << std::endl;
+		return false;
+	}
+
+	std::string cacheName = cachePath(filename);
+	CacheHeader header;
+
+	// use the cache if it was made from this exact obj with the same epsilon
+	std::ifstream in(cacheName, std::ios::binary);
+	if (in.read((char*)&header, sizeof(header)) &&
+		memcmp(header.magic, CACHE_MAGIC, 4) == 0 && header.version == CACHE_VERSION &&
+		header.epsilon == epsilon && header.objSize == (long long)st.st_size &&
+		header.objTime == (long long)st.st_mtime)
+	{
+		if (readArray(in, mesh.positions, header.numPositions) &&
+			readArray(in, mesh.normals, header.numNormals) &&
+			readArray(in, mesh.texCoords, header.numTexCoords) &&
+			readArray(in, mesh.indices, header.numIndices))
+			return true;
+
+		std::cerr << "Broken cache " << cacheName << ", reloading" << std::endl;
+	}
+	in.close();
+
+	if (!load(filename, mesh))
+		return false;
+
+	size_t corners = mesh.indices.size();
+	size_t before = mesh.positions.size();
+	weld(mesh, epsilon);
+	std::cerr << filename << ": " << corners << " corners, " << before << " unique tuples, "
+		<< mesh.positions.size() << " welded vertices" << std::endl;
+
+	// a missing cache only costs time, so failing to write it isn't an error.
+	// Zeroed first so the padding bytes are the same every time.
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.epsilon = epsilon;
+	header.objSize = (long long)st.st_size;
+	header.objTime = (long long)st.st_mtime;
+	header.numPositions = (unsigned int)mesh.positions.size();
+	header.numNormals = (unsigned int)mesh.normals.size();
+	header.numTexCoords = (unsigned int)mesh.texCoords.size();
+	header.numIndices = (unsigned int)mesh.indices.size();
+
+	makeCacheDir();
+	std::ofstream out(cacheName, std::ios::binary | std::ios::trunc);
+	if (out)
+	{
+		out.write((const char*)&header, sizeof(header));
+		writeArray(out, mesh.positions);
+		writeArray(out, mesh.normals);
+		writeArray(out, mesh.texCoords);
+		writeArray(out, mesh.indices);
+	}
+
+	return true;
+}
+
+// a grid of quads, each with its own texture coordinate and normal lines,
+// written once and kept in CACHE_DIR
+static bool writeBenchmarkFile(const std::string& filename, size_t bytes)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) == 0 && (size_t)st.st_size >= bytes)
+		return true;
+
+	makeCacheDir();
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == nullptr)
+	{
+		std::cerr << "Can't write the file " << filename << std::endl;
+		return false;
+	}
+
+	// rows of 1000 vertices, each row after the first adds 999 quads
+	const int ROW = 1000;
+	size_t written = 0;
+	char line[256];
+	for (int row = 0; written < bytes; row++)
+	{
+		for (int i = 0; i < ROW; i++)
+		{
+			float x = i * 0.01f, z = row * 0.01f, y = sinf(x * 3.f) * cosf(z * 2.f) * 0.25f;
+			written += fprintf(f, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+				x, y, z, i / (float)ROW, (row % ROW) / (float)ROW, 0.f, 1.f, 0.f);
+		}
+		if (row == 0)
+			continue;
+		for (int i = 0; i + 1 < ROW; i++)
+		{
+			int a = (row - 1) * ROW + i + 1, b = a + 1, c = a + ROW + 1, d = a + ROW;
+			int n = snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+				a, a, a, b, b, b, c, c, c, d, d, d);
+			fwrite(line, 1, n, f);
+			written += n;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+void ObjLoader::benchmark(size_t megabytes)
+{
+	std::string filename = std::string(CACHE_DIR) + "/benchmark.obj";
+	if (!writeBenchmarkFile(filename, megabytes << 20))
+		return;
+
+	struct stat st;
+	stat(filename.c_str(), &st);
+	double bytes = (double)st.st_size;
+	char line[256];
+
+	// the first parse also pulls the file into the page cache, the best of
+	// the rest is the parser's own rate
+	double best = 1e9;
+	for (int run = 0; run < 4; run++)
+	{
+		std::vector<Chunk> chunks;
+		double start = glfwGetTime();
+		if (!parseFile(filename, false, chunks))
+			return;
+		if (run > 0)
+			best = glm::min(best, glfwGetTime() - start);
+	}
+	snprintf(line, sizeof(line), "obj: parsed %.0f MB in %.1f ms, %.2f GB/s",
+		bytes / (1 << 20), best * 1000.0, bytes / best / 1e9);
+	std::cerr << line << std::endl;
+
+	ObjMesh mesh;
+	double start = glfwGetTime();
+	if (!load(filename, mesh))
+		return;
+	double elapsed = glm::max(glfwGetTime() - start, 1e-9);
+	snprintf(line, sizeof(line), "obj: loaded %.0f MB in %.1f ms, %.2f GB/s, %zu vertices %zu triangles",
+		bytes / (1 << 20), elapsed * 1000.0, bytes / elapsed / 1e9, mesh.positions.size(),
+		mesh.indices.size() / 3);
+	std::cerr << line << std::endl;
+}
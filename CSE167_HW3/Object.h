@@ -17,6 +17,8 @@ protected:
 	glm::mat4 model;
 	glm::vec3 color;
 public:
+	virtual ~Object() {}
+
 	glm::mat4 getModel() { return model; }
 	glm::vec3 getColor() { return color; }
 
@@ -0,0 +1,584 @@
+#include "PointOctree.h"
+
+#include <cstdio>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <thread>
+#include <functional>
+
+static const char MAGIC[4] = { 'P', 'C', 'O', 'T' };
+
+// nodes with more points than this are split by streaming them through
+// temporary files, smaller ones are built in memory. 16M points is 192 MB.
+static const unsigned long long MEMORY_POINTS = 1ull << 24;
+// points read or written at a time when streaming
+static const size_t BATCH_POINTS = 1 << 16;
+
+// nodes deeper than this keep all their points
+static const int MAX_DEPTH = 20;
+
+// a node's subsample takes one point per cell of a grid this fine
+static const int SAMPLE_GRID = 128;
+
+static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// plain decimal numbers without going through the locale like strtof,
+// anything else (inf, nan, hex) is left to strtof
+static char* parseFloat(char* p, float& value)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	char* start = p;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; *p >= '0' && *p <= '9'; p++, digits++)
+	{
+		// past 19 digits they can't change a float
+		if (digits < 19)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			exponent++;
+	}
+	if (*p == '.')
+	{
+		for (p++; *p >= '0' && *p <= '9'; p++, digits++)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0)
+	{
+		value = strtof(start, &p);
+		return p;
+	}
+	if (*p == 'e' || *p == 'E')
+	{
+		char* e = p + 1;
+		bool negativeExponent = *e == '-';
+		if (*e == '-' || *e == '+')
+			e++;
+		if (*e >= '0' && *e <= '9')
+		{
+			int n = 0;
+			for (; *e >= '0' && *e <= '9'; e++)
+				n = n < 1000 ? n * 10 + (*e - '0') : n;
+			exponent += negativeExponent ? -n : n;
+			p = e;
+		}
+	}
+
+	double v = (double)mantissa;
+	while (exponent > 22)
+	{
+		v *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22)
+	{
+		v /= 1e22;
+		exponent += 22;
+	}
+	v = exponent >= 0 ? v * POWERS_OF_TEN[exponent] : v / POWERS_OF_TEN[-exponent];
+	value = (float)(negative ? -v : v);
+	return p;
+}
+
+// the points of the "v" lines in [begin, end), which ends at a line end
+static void parseLines(char* begin, char* end, std::vector<glm::vec3>& points)
+{
+	char* line = begin;
+	while (line < end)
+	{
+		char* newline = (char*)memchr(line, '\n', end - line);
+		if (newline == nullptr)
+			newline = end;
+
+		if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+		{
+			glm::vec3 point;
+			char* p = parseFloat(line + 2, point.x);
+			p = parseFloat(p, point.y);
+			parseFloat(p, point.z);
+			points.push_back(point);
+		}
+		line = newline + 1;
+	}
+}
+
+// Reads the vertices of an obj file in big chunks, much faster than
+// getline and stringstream. Each chunk is split at line ends and parsed on
+// all cores, lines split between chunks are carried over.
+class ObjPointReader
+{
+private:
+	FILE* file;
+	std::vector<char> buffer;
+	size_t begin, end;
+	bool eof;
+	unsigned int threads;
+	std::vector<std::vector<glm::vec3>> parts;
+
+	void fill()
+	{
+		// move the unfinished line to the front and read after it
+		size_t left = end - begin;
+		memmove(buffer.data(), buffer.data() + begin, left);
+		begin = 0;
+		end = left;
+
+		size_t n = fread(buffer.data() + end, 1, buffer.size() - end - 1, file);
+		if (n == 0)
+			eof = true;
+		end += n;
+		buffer[end] = 0;
+	}
+
+public:
+	ObjPointReader(const std::string& filename) : buffer(1 << 23)
+	{
+		file = fopen(filename.c_str(), "rb");
+		begin = end = 0;
+		eof = file == nullptr;
+		buffer[0] = 0;
+		threads = glm::max(std::thread::hardware_concurrency(), 1u);
+		parts.resize(threads);
+	}
+
+	~ObjPointReader()
+	{
+		if (file)
+			fclose(file);
+	}
+
+	bool isOpen()
+	{
+		return file != nullptr;
+	}
+
+	// the points of the next chunk's complete lines, false at the end
+	bool nextBatch(std::vector<glm::vec3>& points)
+	{
+		points.clear();
+		while (points.empty())
+		{
+			if (!eof)
+				fill();
+
+			// up to the last line end, or everything left at the end
+			char* first = buffer.data() + begin;
+			char* last = buffer.data() + end;
+			if (!eof)
+			{
+				while (last > first && last[-1] != '\n')
+					last--;
+				// one line longer than the buffer, read on
+				if (last == first)
+					continue;
+			}
+			else if (first == last)
+				return false;
+
+			// one piece per thread, each ending at a line end
+			std::vector<char*> cuts(1, first);
+			size_t piece = (last - first) / threads + 1;
+			for (unsigned int t = 1; t < threads && cuts.back() + piece < last; t++)
+			{
+				char* cut = (char*)memchr(cuts.back() + piece, '\n', last - (cuts.back() + piece));
+				if (cut == nullptr)
+					break;
+				cuts.push_back(cut + 1);
+			}
+			cuts.push_back(last);
+
+			std::vector<std::thread> workers;
+			for (size_t t = 0; t + 1 < cuts.size(); t++)
+			{
+				parts[t].clear();
+				workers.emplace_back(parseLines, cuts[t], cuts[t + 1], std::ref(parts[t]));
+			}
+			for (size_t t = 0; t < workers.size(); t++)
+			{
+				workers[t].join();
+				points.insert(points.end(), parts[t].begin(), parts[t].end());
+			}
+			begin = last - buffer.data();
+		}
+		return true;
+	}
+};
+
+// the points spilled to a temporary file, read back in batches
+class PointFileReader
+{
+private:
+	FILE* file;
+
+public:
+	PointFileReader(const std::string& filename)
+	{
+		file = fopen(filename.c_str(), "rb");
+	}
+
+	~PointFileReader()
+	{
+		if (file)
+			fclose(file);
+	}
+
+	bool isOpen()
+	{
+		return file != nullptr;
+	}
+
+	bool nextBatch(std::vector<glm::vec3>& points)
+	{
+		points.resize(BATCH_POINTS);
+		size_t n = file ? fread(points.data(), sizeof(glm::vec3), BATCH_POINTS, file) : 0;
+		points.resize(n);
+		return n > 0;
+	}
+};
+
+// octant of a point relative to a center, bit 0 x, bit 1 y, bit 2 z
+static int octant(const glm::vec3& p, const glm::vec3& center)
+{
+	return (p.x >= center.x ? 1 : 0) | (p.y >= center.y ? 2 : 0) | (p.z >= center.z ? 4 : 0);
+}
+
+static glm::vec3 childCenter(const glm::vec3& center, float halfSize, int o)
+{
+	float q = halfSize * 0.5f;
+	return center + glm::vec3(o & 1 ? q : -q, o & 2 ? q : -q, o & 4 ? q : -q);
+}
+
+static OctreeNode makeNode(glm::vec3 center, float halfSize)
+{
+	OctreeNode node;
+	for (int i = 0; i < 8; i++)
+		node.children[i] = -1;
+	node.center[0] = center.x;
+	node.center[1] = center.y;
+	node.center[2] = center.z;
+	node.halfSize = halfSize;
+	node.spacing = 2.f * halfSize / SAMPLE_GRID;
+	node.pointCount = 0;
+	node.offset = 0;
+	return node;
+}
+
+static void writePoints(std::ofstream& out, OctreeNode& node, const std::vector<glm::vec3>& points)
+{
+	node.offset = (unsigned long long)out.tellp();
+	node.pointCount = (unsigned int)points.size();
+	out.write((const char*)points.data(), sizeof(glm::vec3) * points.size());
+}
+
+// spacing of a leaf that keeps all of its points
+static float leafSpacing(float halfSize, unsigned long long count)
+{
+	return 2.f * halfSize / glm::max(glm::pow((float)count, 1.f / 3.f), 1.f);
+}
+
+// The grid subsample of a node. Takes the first point in every cell up to
+// maxNodePoints, the others are handed back for the children.
+class NodeSampler
+{
+private:
+	std::unordered_set<unsigned long long> taken;
+	glm::vec3 corner;
+	float cell;
+	unsigned int maxNodePoints;
+
+public:
+	std::vector<glm::vec3> sample;
+
+	NodeSampler(glm::vec3 center, float halfSize, unsigned int maxNodePoints)
+		: corner(center - glm::vec3(halfSize)), cell(2.f * halfSize / SAMPLE_GRID),
+		maxNodePoints(maxNodePoints)
+	{
+	}
+
+	bool add(const glm::vec3& p)
+	{
+		if (sample.size() >= maxNodePoints)
+			return false;
+
+		glm::ivec3 c = glm::clamp(glm::ivec3((p - corner) / cell), 0, SAMPLE_GRID - 1);
+		unsigned long long key = ((unsigned long long)c.x << 42) |
+			((unsigned long long)c.y << 21) | (unsigned long long)c.z;
+		if (!taken.insert(key).second)
+			return false;
+		sample.push_back(p);
+		return true;
+	}
+};
+
+// builds the subtree of one cell in memory and returns its node index
+static int buildNode(std::ofstream& out, std::vector<OctreeNode>& nodes,
+	std::vector<glm::vec3>& points, glm::vec3 center, float halfSize, int depth,
+	unsigned int maxNodePoints)
+{
+	if (points.empty())
+		return -1;
+
+	int index = (int)nodes.size();
+	nodes.push_back(makeNode(center, halfSize));
+
+	if (points.size() <= maxNodePoints || depth >= MAX_DEPTH)
+	{
+		writePoints(out, nodes[index], points);
+		nodes[index].spacing = leafSpacing(halfSize, points.size());
+		return index;
+	}
+
+	// keep the first point in every grid cell, the rest goes to the children
+	std::vector<glm::vec3> rest[8];
+	{
+		NodeSampler sampler(center, halfSize, maxNodePoints);
+		for (const glm::vec3& p : points)
+		{
+			if (!sampler.add(p))
+				rest[octant(p, center)].push_back(p);
+		}
+		writePoints(out, nodes[index], sampler.sample);
+	}
+
+	// free the parent's copy before going deeper
+	std::vector<glm::vec3>().swap(points);
+
+	for (int o = 0; o < 8; o++)
+	{
+		int child = buildNode(out, nodes, rest[o], childCenter(center, halfSize, o),
+			halfSize * 0.5f, depth + 1, maxNodePoints);
+		nodes[index].children[o] = child;
+	}
+	return index;
+}
+
+// what the streamed build shares down the tree
+struct StreamedBuild
+{
+	std::ofstream* out;
+	std::vector<OctreeNode> nodes;
+	unsigned int maxNodePoints;
+	std::string tempName; // temporary files are this plus a number
+	unsigned int tempFiles;
+	bool failed;
+};
+
+// Builds the subtree of count points read from source. Nodes too big for
+// memory are sampled on the way through and the rest is spilled into one
+// temporary file per child, which are then built one after another.
+template <class Source>
+static int buildStreamed(StreamedBuild& b, Source& source, unsigned long long count,
+	glm::vec3 center, float halfSize, int depth)
+{
+	if (count == 0 || b.failed)
+		return -1;
+
+	std::vector<glm::vec3> batch;
+	if (count <= MEMORY_POINTS)
+	{
+		std::vector<glm::vec3> points;
+		points.reserve((size_t)count);
+		while (source.nextBatch(batch))
+			points.insert(points.end(), batch.begin(), batch.end());
+		return buildNode(*b.out, b.nodes, points, center, halfSize, depth, b.maxNodePoints);
+	}
+
+	int index = (int)b.nodes.size();
+	b.nodes.push_back(makeNode(center, halfSize));
+
+	// a pile of points this deep is copied through as one leaf
+	if (depth >= MAX_DEPTH)
+	{
+		b.nodes[index].offset = (unsigned long long)b.out->tellp();
+		unsigned long long written = 0;
+		while (source.nextBatch(batch))
+		{
+			b.out->write((const char*)batch.data(), sizeof(glm::vec3) * batch.size());
+			written += batch.size();
+		}
+		b.nodes[index].pointCount = (unsigned int)written;
+		b.nodes[index].spacing = leafSpacing(halfSize, written);
+		return index;
+	}
+
+	std::string names[8];
+	FILE* files[8];
+	for (int o = 0; o < 8; o++)
+	{
+		names[o] = b.tempName + std::to_string(b.tempFiles++);
+		files[o] = fopen(names[o].c_str(), "wb");
+		if (files[o] == nullptr)
+		{
+			std::cerr << "Can't create the temporary file " << names[o] << std::endl;
+			for (int k = 0; k < o; k++)
+			{
+				fclose(files[k]);
+				remove(names[k].c_str());
+			}
+			b.failed = true;
+			return -1;
+		}
+	}
+
+	NodeSampler sampler(center, halfSize, b.maxNodePoints);
+	std::vector<glm::vec3> rest[8];
+	unsigned long long counts[8] = { 0 };
+	while (source.nextBatch(batch))
+	{
+		for (const glm::vec3& p : batch)
+		{
+			if (sampler.add(p))
+				continue;
+			int o = octant(p, center);
+			rest[o].push_back(p);
+			counts[o]++;
+			if (rest[o].size() >= BATCH_POINTS)
+			{
+				fwrite(rest[o].data(), sizeof(glm::vec3), rest[o].size(), files[o]);
+				rest[o].clear();
+			}
+		}
+	}
+	writePoints(*b.out, b.nodes[index], sampler.sample);
+	for (int o = 0; o < 8; o++)
+	{
+		fwrite(rest[o].data(), sizeof(glm::vec3), rest[o].size(), files[o]);
+		if (ferror(files[o]))
+		{
+			std::cerr << "Failed to write the temporary file " << names[o] << std::endl;
+			b.failed = true;
+		}
+		fclose(files[o]);
+		std::vector<glm::vec3>().swap(rest[o]);
+	}
+
+	for (int o = 0; o < 8; o++)
+	{
+		{
+			PointFileReader reader(names[o]);
+			int child = buildStreamed(b, reader, counts[o], childCenter(center, halfSize, o),
+				halfSize * 0.5f, depth + 1);
+			b.nodes[index].children[o] = child;
+		}
+		remove(names[o].c_str());
+	}
+	return index;
+}
+
+bool PointOctree::convert(const std::string& objFilename, const std::string& outFilename,
+	unsigned int maxNodePoints)
+{
+	// first pass: bounds
+	glm::vec3 minPt(FLT_MAX), maxPt(-FLT_MAX);
+	unsigned long long total = 0;
+	{
+		ObjPointReader reader(objFilename);
+		if (!reader.isOpen())
+		{
+			std::cerr << "Can't open the file " << objFilename << std::endl;
+			return false;
+		}
+
+		std::vector<glm::vec3> batch;
+		while (reader.nextBatch(batch))
+		{
+			for (const glm::vec3& p : batch)
+			{
+				minPt = glm::min(minPt, p);
+				maxPt = glm::max(maxPt, p);
+			}
+			total += batch.size();
+		}
+	}
+	if (total == 0)
+	{
+		std::cerr << "No points in " << objFilename << std::endl;
+		return false;
+	}
+
+	// the octree is a cube around the bounding box, slightly padded
+	glm::vec3 center = (minPt + maxPt) * 0.5f;
+	float halfSize = glm::max(glm::max(maxPt.x - minPt.x, maxPt.y - minPt.y),
+		maxPt.z - minPt.z) * 0.5f * 1.001f + 1e-6f;
+
+	std::ofstream out(outFilename, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		std::cerr << "Can't write the file " << outFilename << std::endl;
+		return false;
+	}
+
+	// the header gets rewritten at the end once the table offset is known
+	OctreeHeader header;
+	memset(&header, 0, sizeof(header));
+	out.write((const char*)&header, sizeof(header));
+
+	// second pass: the root is built straight from the obj file
+	StreamedBuild b;
+	b.out = &out;
+	b.maxNodePoints = maxNodePoints;
+	b.tempName = outFilename + ".tmp";
+	b.tempFiles = 0;
+	b.failed = false;
+	{
+		ObjPointReader reader(objFilename);
+		buildStreamed(b, reader, total, center, halfSize, 0);
+	}
+	if (b.failed || !out)
+	{
+		std::cerr << "Failed to convert " << objFilename << std::endl;
+		return false;
+	}
+
+	memcpy(header.magic, MAGIC, 4);
+	header.version = VERSION;
+	header.numNodes = (unsigned int)b.nodes.size();
+	header.maxNodePoints = maxNodePoints;
+	header.totalPoints = total;
+	header.nodeTableOffset = (unsigned long long)out.tellp();
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = minPt[i];
+		header.boundsMax[i] = maxPt[i];
+	}
+	out.write((const char*)b.nodes.data(), sizeof(OctreeNode) * b.nodes.size());
+
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+
+	std::cerr << "Converted " << total << " points into " << b.nodes.size()
+		<< " octree nodes" << std::endl;
+	return true;
+}
+
+bool PointOctree::readTable(std::ifstream& file, OctreeHeader& header,
+	std::vector<OctreeNode>& nodes)
+{
+	file.seekg(0);
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION)
+	{
+		std::cerr << "Not a point octree file" << std::endl;
+		return false;
+	}
+
+	nodes.resize(header.numNodes);
+	file.seekg((std::streamoff)header.nodeTableOffset);
+	file.read((char*)nodes.data(), sizeof(OctreeNode) * nodes.size());
+	return (bool)file;
+}
@@ -0,0 +1,52 @@
+#ifndef _POINT_OCTREE_H_
+#define _POINT_OCTREE_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+// File layout of a converted point cloud: the header, the points of every
+// node back to back as 3 floats each, then the node table. Nodes are cubes;
+// each one holds an evenly spaced subsample of the points in its cube and
+// its children hold the rest, so drawing a node adds detail to its parent.
+
+struct OctreeHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int numNodes;
+	unsigned int maxNodePoints;
+	unsigned long long totalPoints;
+	unsigned long long nodeTableOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct OctreeNode
+{
+	int children[8]; // -1 when empty
+	float center[3];
+	float halfSize;
+	float spacing; // distance between the node's points
+	unsigned int pointCount;
+	unsigned long long offset; // of the node's points in the file
+};
+
+class PointOctree
+{
+public:
+	static const unsigned int VERSION = 1;
+
+	// reads the "v" lines of an obj file and writes an octree file. Nodes
+	// of more than 16M points are split through temporary files next to
+	// outFilename, so memory stays bounded for any size or distribution.
+	static bool convert(const std::string& objFilename, const std::string& outFilename,
+		unsigned int maxNodePoints);
+
+	static bool readTable(std::ifstream& file, OctreeHeader& header,
+		std::vector<OctreeNode>& nodes);
+};
+
+#endif
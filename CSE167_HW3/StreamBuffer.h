@@ -0,0 +1,64 @@
+#ifndef _STREAM_BUFFER_H_
+#define _STREAM_BUFFER_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <vector>
+#include <iostream>
+
+// where an allocation can be written and its offset in the buffer for
+// glVertexAttribPointer / glBindBufferRange, ptr is null when out of space
+struct StreamAllocation
+{
+	void* ptr;
+	GLintptr offset;
+};
+
+// One buffer for everything that is rewritten every frame. With
+// ARB_buffer_storage it is mapped once and split into three regions, each
+// frame writes the next region after waiting on the fence of the frame that
+// last used it. Without it the data is staged on the cpu and uploaded into
+// a freshly orphaned buffer, so nothing waits on the gpu either way.
+class StreamBuffer
+{
+public:
+	static const int NUM_REGIONS = 3;
+
+	// bytes that can be allocated per frame
+	StreamBuffer(GLsizeiptr frameSize);
+	~StreamBuffer();
+
+	void beginFrame();
+	StreamAllocation allocate(GLsizeiptr bytes, GLsizeiptr alignment);
+	// makes everything allocated so far visible to the gpu, call before
+	// drawing from it
+	void flush();
+	void endFrame();
+
+	GLuint getBuffer();
+	bool isPersistent();
+
+	void report();
+
+private:
+	GLuint buffer;
+	GLsizeiptr frameSize;
+	bool persistent;
+
+	char* mapped; // the whole buffer when persistent
+	std::vector<char> staging; // this frame's data otherwise
+
+	GLsync fences[NUM_REGIONS];
+	int region;
+	GLsizeiptr head, flushed;
+
+	// statistics for report
+	unsigned long long frames, stalls, overflows;
+	GLsizeiptr peak;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "StreamingPointCloud.h"
+
+#include <queue>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+StreamingPointCloud::StreamingPointCloud(std::string octreeFilename, GLfloat pointSize)
+	: pointSize(pointSize)
+{
+	maxDrawnPoints = 5000000;
+	maxResidentPoints = 20000000;
+	maxUploadPoints = 500000;
+	maxQueued = 16;
+	minNodePixels = 150.f;
+
+	residentPoints = 0;
+	frame = 0;
+	drawnPoints = 0;
+	pixelsPerUnit = 1;
+	running = true;
+
+	memset(&header, 0, sizeof(header));
+	file.open(octreeFilename, std::ios::binary);
+	if (!file.is_open())
+		std::cerr << "Can't open the file " << octreeFilename << std::endl;
+	else if (!PointOctree::readTable(file, header, nodes))
+		nodes.clear();
+
+	NodeData empty = { NodeState::ON_DISK, 0, 0, 0 };
+	data.assign(nodes.size(), empty);
+
+	// same normalization as PointCloud: centered, largest extent 8.4 wide
+	glm::vec3 minPt(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	glm::vec3 maxPt(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	float extent = glm::max(glm::max(maxPt.x - minPt.x, maxPt.y - minPt.y), maxPt.z - minPt.z);
+	float scale = extent > 0 ? 2.f * 8.4f / extent : 1.f;
+	model = glm::scale(glm::vec3(scale)) * glm::translate(-(minPt + maxPt) * 0.5f);
+
+	color = glm::vec3(1, 0, 0);
+
+	loader = std::thread(&StreamingPointCloud::loaderLoop, this);
+}
+
+StreamingPointCloud::~StreamingPointCloud()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+	wake.notify_all();
+	loader.join();
+
+	for (NodeData& d : data)
+	{
+		if (d.state == NodeState::RESIDENT)
+		{
+			glDeleteBuffers(1, &d.vbo);
+			glDeleteVertexArrays(1, &d.vao);
+		}
+	}
+}
+
+// reads requested nodes from disk, the only thread touching the file
+void StreamingPointCloud::loaderLoop()
+{
+	while (true)
+	{
+		int node;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return !requests.empty() || !running; });
+			if (!running)
+				return;
+			node = requests.front();
+			requests.pop_front();
+		}
+
+		LoadedNode result;
+		result.node = node;
+		result.points.resize(nodes[node].pointCount);
+		file.seekg((std::streamoff)nodes[node].offset);
+		file.read((char*)result.points.data(), sizeof(glm::vec3) * result.points.size());
+		if (!file)
+		{
+			std::cerr << "Failed to read octree node " << node << std::endl;
+			file.clear();
+			result.points.clear();
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		loaded.push_back(std::move(result));
+	}
+}
+
+void StreamingPointCloud::setView(glm::mat4 view, glm::mat4 projection, int height, float fovY)
+{
+	StreamingPointCloud::view = view;
+	StreamingPointCloud::projection = projection;
+	// projected size of one unit at distance 1, in pixels
+	pixelsPerUnit = height / (2.f * glm::tan(glm::radians(fovY) * 0.5f));
+}
+
+// moves finished loads to the gpu, at most maxUploadPoints per frame
+void StreamingPointCloud::uploadLoaded()
+{
+	unsigned int uploaded = 0;
+	while (uploaded < maxUploadPoints)
+	{
+		LoadedNode node;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (loaded.empty())
+				return;
+			node = std::move(loaded.front());
+			loaded.pop_front();
+		}
+
+		NodeData& d = data[node.node];
+		if (node.points.empty())
+		{
+			// read failed, try again when it's needed next
+			d.state = NodeState::ON_DISK;
+			continue;
+		}
+
+		glGenVertexArrays(1, &d.vao);
+		glGenBuffers(1, &d.vbo);
+		glBindVertexArray(d.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, d.vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * node.points.size(),
+			node.points.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+
+		d.state = NodeState::RESIDENT;
+		d.lastUsed = frame;
+		residentPoints += node.points.size();
+		uploaded += (unsigned int)node.points.size();
+	}
+}
+
+// picks the nodes to draw this frame, largest on screen first
+void StreamingPointCloud::selectNodes()
+{
+	drawList.clear();
+	drawnPoints = 0;
+	if (nodes.empty())
+		return;
+
+	glm::mat4 mv = view * model;
+	glm::mat4 mvp = projection * mv;
+	float scale = glm::length(glm::vec3(model[0]));
+
+	// frustum planes in octree space
+	glm::mat4 m = glm::transpose(mvp);
+	glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1],
+		m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+	for (glm::vec4& p : planes)
+		p /= glm::length(glm::vec3(p));
+
+	std::priority_queue<std::pair<float, int>> open;
+	open.push(std::make_pair(FLT_MAX, 0));
+	std::vector<int> wanted;
+
+	while (!open.empty())
+	{
+		int n = open.top().second;
+		open.pop();
+
+		// a node over the budget is skipped with its subtree, smaller ones
+		// further down the queue may still fit
+		const OctreeNode& node = nodes[n];
+		if (drawnPoints + node.pointCount > maxDrawnPoints)
+			continue;
+
+		// nodes not on disk yet are requested, their children wait for them
+		if (data[n].state != NodeState::RESIDENT)
+		{
+			if (data[n].state == NodeState::ON_DISK)
+				wanted.push_back(n);
+			continue;
+		}
+
+		data[n].lastUsed = frame;
+		drawList.push_back(n);
+		drawnPoints += node.pointCount;
+
+		for (int o = 0; o < 8; o++)
+		{
+			int c = node.children[o];
+			if (c < 0)
+				continue;
+
+			glm::vec3 center(nodes[c].center[0], nodes[c].center[1], nodes[c].center[2]);
+			float radius = nodes[c].halfSize * 1.7320508f;
+
+			bool inside = true;
+			for (const glm::vec4& p : planes)
+			{
+				if (glm::dot(glm::vec3(p), center) + p.w < -radius)
+				{
+					inside = false;
+					break;
+				}
+			}
+			if (!inside)
+				continue;
+
+			// projected diameter, anything at or behind the eye is huge
+			float dist = -(mv * glm::vec4(center, 1.f)).z;
+			float size = dist > radius * scale ?
+				2.f * radius * scale * pixelsPerUnit / dist : FLT_MAX;
+			if (size < minNodePixels)
+				continue;
+
+			open.push(std::make_pair(size, c));
+		}
+	}
+
+	// requests go out in priority order, a few at a time
+	std::lock_guard<std::mutex> guard(lock);
+	for (int n : wanted)
+	{
+		if (requests.size() >= maxQueued)
+			break;
+		data[n].state = NodeState::QUEUED;
+		requests.push_back(n);
+	}
+	if (!requests.empty())
+		wake.notify_one();
+}
+
+// frees the least recently drawn nodes until under the gpu budget
+void StreamingPointCloud::evict()
+{
+	if (residentPoints <= maxResidentPoints)
+		return;
+
+	std::vector<int> resident;
+	for (unsigned int i = 0; i < data.size(); i++)
+	{
+		// never the root or anything drawn this frame
+		if (data[i].state == NodeState::RESIDENT && i != 0 && data[i].lastUsed != frame)
+			resident.push_back(i);
+	}
+	std::sort(resident.begin(), resident.end(),
+		[this](int a, int b) { return data[a].lastUsed < data[b].lastUsed; });
+
+	for (int n : resident)
+	{
+		if (residentPoints <= maxResidentPoints)
+			break;
+
+		glDeleteBuffers(1, &data[n].vbo);
+		glDeleteVertexArrays(1, &data[n].vao);
+		data[n].state = NodeState::ON_DISK;
+		residentPoints -= nodes[n].pointCount;
+	}
+}
+
+void StreamingPointCloud::draw()
+{
+	frame++;
+
+	uploadLoaded();
+	selectNodes();
+
+	glPointSize(pointSize);
+	for (int n : drawList)
+	{
+		glBindVertexArray(data[n].vao);
+		glDrawArrays(GL_POINTS, 0, nodes[n].pointCount);
+	}
+	glBindVertexArray(0);
+
+	evict();
+}
+
+void StreamingPointCloud::update()
+{
+}
+
+void StreamingPointCloud::updatePointSize(GLfloat size)
+{
+	pointSize = size;
+}
+
+void StreamingPointCloud::setBudget(unsigned int drawnPoints, unsigned long long residentPoints)
+{
+	maxDrawnPoints = drawnPoints;
+	maxResidentPoints = residentPoints;
+}
+
+unsigned int StreamingPointCloud::getDrawnPoints()
+{
+	return drawnPoints;
+}
+
+unsigned long long StreamingPointCloud::getResidentPoints()
+{
+	return residentPoints;
+}
@@ -0,0 +1,107 @@
+#ifndef _STREAMING_POINT_CLOUD_H_
+#define _STREAMING_POINT_CLOUD_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "Object.h"
+#include "PointOctree.h"
+
+// Draws an octree file made by PointOctree::convert of any size. Every
+// frame the nodes are walked largest on screen first until the point
+// budget is used up; missing nodes are read by a loader thread and
+// uploaded a few per frame, and the least recently used nodes are freed
+// when the gpu budget is exceeded. The work per frame depends only on the
+// budgets, never on the size of the cloud.
+class StreamingPointCloud : public Object
+{
+private:
+	enum class NodeState
+	{
+		ON_DISK,
+		QUEUED,
+		RESIDENT
+	};
+
+	struct NodeData
+	{
+		NodeState state;
+		GLuint vao, vbo;
+		unsigned long long lastUsed; // frame the node was last drawn
+	};
+
+	struct LoadedNode
+	{
+		int node;
+		std::vector<glm::vec3> points;
+	};
+
+	OctreeHeader header;
+	std::vector<OctreeNode> nodes;
+	std::vector<NodeData> data;
+
+	GLfloat pointSize;
+
+	// budgets, in points
+	unsigned int maxDrawnPoints;
+	unsigned long long maxResidentPoints;
+	unsigned int maxUploadPoints; // per frame
+	unsigned int maxQueued;
+	float minNodePixels; // nodes smaller on screen aren't refined
+
+	unsigned long long residentPoints;
+	unsigned long long frame;
+	unsigned int drawnPoints;
+
+	glm::mat4 view, projection;
+	float pixelsPerUnit;
+
+	std::vector<int> drawList;
+
+	// loader thread state, everything below is guarded by lock
+	std::ifstream file;
+	std::thread loader;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<int> requests;
+	std::deque<LoadedNode> loaded;
+	bool running;
+
+	void loaderLoop();
+	void uploadLoaded();
+	void selectNodes();
+	void evict();
+
+public:
+	StreamingPointCloud(std::string octreeFilename, GLfloat pointSize);
+	~StreamingPointCloud();
+
+	// camera used to pick the level of detail for the next draw
+	void setView(glm::mat4 view, glm::mat4 projection, int height, float fovY);
+
+	void draw();
+	void update();
+
+	void updatePointSize(GLfloat size);
+	void setBudget(unsigned int drawnPoints, unsigned long long residentPoints);
+
+	unsigned int getDrawnPoints();
+	unsigned long long getResidentPoints();
+};
+
+#endif
@@ -4,9 +4,6 @@
 Transform::Transform(glm::mat4 M)
 {
 	Transform::M = M;
-	totRot = 0;
-	rotCW = false;
-	part = BodyPart::NONE;
 	bsphere = nullptr;
 }
 
@@ -37,33 +34,6 @@ void Transform::draw(GLuint shaderProgram, glm::mat4 C)
 
 void Transform::update(glm::mat4 C)
 {
-	float rotSpd = 0.01f;
-	float rot = 0; // how much to rotate the obj by
-	switch (part)
-	{
-		// rotate positive first, then negative
-		case BodyPart::ARM_L:
-		case BodyPart::LEG_R:
-			rot = (rotCW) ? rotSpd : -rotSpd;
-			// reverse rotation if passes certain angle threshold
-			break;
-		// rotate negative first, then positive
-		case BodyPart::ARM_R:
-		case BodyPart::LEG_L:
-			rot = (rotCW) ? -rotSpd : rotSpd;
-			// reverse rotation if passes certain angle threshold
-			break;
-		default:
-			break;
-	}
-
-	if (part != BodyPart::NONE)
-	{
-		totRot += rot;
-		if (glm::abs(totRot) >= 45)
-			rotCW = !rotCW;
-		M = glm::rotate(glm::radians(rot), glm::vec3(1, 0, 0)) * M;
-	}
 	for each (Node* child in children)
 	{
 		child->update(C * M);
@@ -78,9 +48,14 @@ void Transform::addChild(Node* child)
 	children.push_back(child);
 }
 
-void Transform::setPart(BodyPart p)
+void Transform::setTransform(glm::mat4 mat)
+{
+	M = mat;
+}
+
+glm::mat4 Transform::getTransform()
 {
-	part = p;
+	return M;
 }
 
 void Transform::setBound(BoundingSphere* s)
@@ -16,25 +16,12 @@
 #include "BoundingSphere.h"
 #include <iostream>
 
-enum class BodyPart
-{
-	ARM_L,
-	ARM_R,
-	LEG_L,
-	LEG_R,
-	NONE
-};
-
 class Transform : public Node
 {
 private:
 	std::list<Node*> children;
 	glm::mat4 M;
 
-	BodyPart part;
-	GLfloat totRot;
-	bool rotCW;
-
 	BoundingSphere* bsphere;
 
 
@@ -49,7 +36,8 @@ public:
 
 	void addChild(Node* child);
 
-	void setPart(BodyPart p);
+	void setTransform(glm::mat4 mat);
+	glm::mat4 getTransform();
 
 	void setBound(BoundingSphere* s);
 };
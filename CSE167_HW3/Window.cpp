@@ -7,12 +7,22 @@ GLdouble Window::nearDist = 1;
 GLdouble Window::farDist = 1000.0;
 
 GLdouble Window::FOV = 60.0; // fov of the projection
+GLdouble Window::cullFOV = 60.0;
 
 const char* Window::windowTitle = "Robot Army";
 
 // Objects to display
 Transform* Window::world;
 
+// walking animation of the limbs
+Animator* Window::animator;
+ProceduralClip* Window::swingFront;
+ProceduralClip* Window::swingBack;
+StreamBuffer* Window::stream;
+
+std::string Window::cloudFile;
+StreamingPointCloud* Window::cloud = nullptr;
+
 bool Window::normalColor;
 
 bool Window::enableCulling = true;
@@ -38,17 +48,21 @@ glm::vec3 Window::up(0, 1, 0); // The up direction of the camera.
 glm::mat4 Window::view = glm::lookAt(Window::eye, Window::center, Window::up);
 
 GLuint Window::program; // The shader program id.
+GLuint Window::debugProgram; // debug lines, see DebugDraw.
 
 GLuint Window::projectionLoc; // Location of projection in shader.
 GLuint Window::viewLoc; // Location of view in shader.
+GLuint Window::modelLoc; // Location of model in shader.
+GLuint Window::objColorLoc; // Location of color in shader.
 GLuint Window::eyeLoc; // Location of the viewer in shader.
 
 bool Window::initializeProgram() {
 	// Create a shader program with a vertex shader and a fragment shader.
 	program = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
+	debugProgram = LoadShaders("shaders/debug_shader.vert", "shaders/debug_shader.frag");
 
 	// Check the shader program.
-	if (!program)
+	if (!program || !debugProgram)
 	{
 		std::cerr << "Failed to initialize shader program" << std::endl;
 		return false;
@@ -70,6 +84,12 @@ bool Window::initializeObjects()
 	projectionLoc = glGetUniformLocation(program, "projection");
 	viewLoc = glGetUniformLocation(program, "view");
 	eyeLoc = glGetUniformLocation(program, "eye");
+	modelLoc = glGetUniformLocation(program, "model");
+	objColorLoc = glGetUniformLocation(program, "color");
+
+	// per frame vertex data, mostly debug lines: 200 bounding spheres are ~300kb
+	stream = new StreamBuffer(1024 * 1024);
+	DebugDraw::init(debugProgram);
 
 	// initial world transform with identity matrix
 	world = new Transform(glm::mat4(1));
@@ -85,12 +105,6 @@ bool Window::initializeObjects()
 	glm::mat4 eyeLMat = glm::translate(glm::vec3(0.3f, 1.5f, 1));
 	glm::mat4 eyeRMat = glm::translate(glm::vec3(-0.3f, 1.5f, 1));
 
-	float radius = 2.2f;
-
-	Geometry* boundGeo = new WireSphere("sphere.obj", radius);
-
-	BoundingSphere* boundSphere = new BoundingSphere(boundGeo, radius);
-
 
 	// create many robots by making many transforms
 	for (int i = -5; i < 5; i++)
@@ -118,7 +132,18 @@ bool Window::initializeObjects()
 	Geometry* eyeGeo = new Geometry("eyeball_s.obj");
 	
 	eyeGeo->setColor(glm::vec3(1));
-	boundGeo->setColor(glm::vec3(1, 0, 0));
+
+	// the limbs swing about their joints, so each part is bounded however
+	// it's turned about its own origin
+	BoundingSphere* boundSphere = new BoundingSphere();
+	boundSphere->enclose(bodyGeo, glm::vec3(0));
+	boundSphere->enclose(headGeo, glm::vec3(headMat[3]));
+	boundSphere->enclose(limbGeo, glm::vec3(armLMat[3]));
+	boundSphere->enclose(limbGeo, glm::vec3(armRMat[3]));
+	boundSphere->enclose(limbGeo, glm::vec3(legLMat[3]));
+	boundSphere->enclose(limbGeo, glm::vec3(legRMat[3]));
+	boundSphere->enclose(eyeGeo, glm::vec3(eyeLMat[3]));
+	boundSphere->enclose(eyeGeo, glm::vec3(eyeRMat[3]));
 
 	body->addChild(bodyGeo);
 	body->addChild(head);
@@ -132,10 +157,15 @@ bool Window::initializeObjects()
 	body->addChild(boundSphere);
 	body->setBound(boundSphere);
 
-	armL->setPart(BodyPart::ARM_L);
-	armR->setPart(BodyPart::ARM_R);
-	legL->setPart(BodyPart::LEG_L);
-	legR->setPart(BodyPart::LEG_R);
+	// opposite arm and leg swing together, 45 degrees each way
+	swingFront = new ProceduralClip(glm::vec3(1, 0, 0), 45.0f, 120.0f, 0);
+	swingBack = new ProceduralClip(glm::vec3(1, 0, 0), -45.0f, 120.0f, 0);
+
+	animator = new Animator();
+	animator->add(armL, swingBack);
+	animator->add(legR, swingBack);
+	animator->add(armR, swingFront);
+	animator->add(legL, swingFront);
 
 	head->addChild(headGeo);
 	armL->addChild(limbGeo);
@@ -147,6 +177,9 @@ bool Window::initializeObjects()
 
 	
 	
+	if (!cloudFile.empty())
+		cloud = new StreamingPointCloud(cloudFile, 1.0f);
+
 	moveType = Movement::NONE;
 	lastMousePoint = glm::vec3(0);
 
@@ -157,9 +190,18 @@ void Window::cleanUp()
 {
 	// Deallcoate the objects.
 	delete world;
+	delete animator;
+	delete swingFront;
+	delete swingBack;
+	delete cloud;
+
+	DebugDraw::cleanUp();
+	stream->report();
+	delete stream;
 
 	// Delete the shader program.
 	glDeleteProgram(program);
+	glDeleteProgram(debugProgram);
 }
 
 GLFWwindow* Window::createWindow(int width, int height)
@@ -239,12 +281,15 @@ void Window::resizeCallback(GLFWwindow* window, int width, int height)
 void Window::idleCallback()
 {
 	// Perform any updates as necessary. 
+	animator->update(glfwGetTime());
 	world->update(glm::mat4(1));
 
 }
 
 void Window::displayCallback(GLFWwindow* window)
 {	
+	stream->beginFrame();
+
 	// Clear the color and depth buffers.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	
 
@@ -261,8 +306,32 @@ void Window::displayCallback(GLFWwindow* window)
 	// Render the scenegraph, initially passing in identity matrix.
 	world->draw(program, glm::mat4(1));
 
+	// the streamed cloud picks its nodes for this camera
+	if (cloud != nullptr)
+	{
+		cloud->setView(view, projection, height, (float)FOV);
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(cloud->getModel()));
+		glUniform3fv(objColorLoc, 1, glm::value_ptr(cloud->getColor()));
+		cloud->draw();
+	}
+
+	// the frozen culling frustum, visible once the camera fov changes
+	if (enableCullingDebug)
+	{
+		glm::mat4 cullProjection = glm::perspective(glm::radians(cullFOV),
+			double(width) / (double)height, nearDist, farDist);
+		DebugDraw::frustum(cullProjection * view, glm::vec3(1, 1, 0));
+	}
+
+	// all debug shapes of the frame in one draw
+	DebugDraw::flush(projection * view, stream);
+	glUseProgram(program);
+	stream->endFrame();
+
 	// Set window title
 	std::string newTitle = "Number of robots rendered: " + std::to_string(objRendered);
+	if (cloud != nullptr)
+		newTitle += ", cloud points drawn: " + std::to_string(cloud->getDrawnPoints());
 
 	glfwSetWindowTitle(window, newTitle.c_str());
 
@@ -292,8 +361,8 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 			normalColor = !normalColor;
 			break;
 		case GLFW_KEY_B:
-			// toggle rendering of bounding spheres
-			BoundingSphere::render = !BoundingSphere::render;
+			// toggle debug drawing, bounding spheres and the culling frustum
+			DebugDraw::enabled = !DebugDraw::enabled;
 			break;
 		case GLFW_KEY_C:
 			// toggle frustrum culling
@@ -302,6 +371,15 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 		case GLFW_KEY_D:
 			// toggle culling debug
 			enableCullingDebug = !enableCullingDebug;
+			cullFOV = FOV;
+			break;
+		case GLFW_KEY_G:
+			// bounds and normalization of 100M points, 1.2 GB of them
+			GeometryKernel::benchmark(100000000);
+			break;
+		case GLFW_KEY_O:
+			// obj parsing and loading rate, writes a 512 MB obj to the cache once
+			ObjLoader::benchmark(512);
 			break;
 		default:
 			break;
@@ -19,10 +19,15 @@
 #include "Object.h"
 #include "Node.h"
 #include "Transform.h"
+#include "Animation.h"
 #include "shader.h"
 #include "Geometry.h"
 #include "BoundingSphere.h"
 #include "WireSphere.h"
+#include "StreamBuffer.h"
+#include "DebugDraw.h"
+#include "StreamingPointCloud.h"
+#include "GeometryStats.h"
 
 
 enum class Movement {
@@ -45,18 +50,28 @@ public:
 	static glm::mat4 view;
 	static glm::vec3 eye, center, up;
 	static GLuint program, projectionLoc, viewLoc, modelLoc, objColorLoc, eyeLoc;
+	static GLuint debugProgram;
 
 	static bool enableCulling;
 	static bool enableCullingDebug;
 	static GLuint objRendered;
 
 	static GLdouble FOV;
+	static GLdouble cullFOV; // fov the culling frustum was frozen at
 
 	static GLuint mode;
 
 	static GLfloat modelSize;
 	
 	static Transform* world;
+	static Animator* animator;
+	static ProceduralClip* swingFront;
+	static ProceduralClip* swingBack;
+	static StreamBuffer* stream;
+
+	// octree from --cloud, none when it's empty
+	static std::string cloudFile;
+	static StreamingPointCloud* cloud;
 
 	static glm::vec3 lastMousePoint, trackballPoint;
 
@@ -48,8 +48,21 @@ void print_versions()
 #endif
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+	// offline conversion of a point cloud for StreamingPointCloud:
+	// --convert <input.obj> <output.octree> [points per node]
+	if (argc >= 4 && std::string(argv[1]) == "--convert")
+	{
+		unsigned int maxNodePoints = argc >= 5 ? (unsigned int)atoi(argv[4]) : 20000;
+		bool ok = PointOctree::convert(argv[2], argv[3], maxNodePoints);
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	// streams a converted cloud into the scene: --cloud <file.octree>
+	if (argc >= 3 && std::string(argv[1]) == "--cloud")
+		Window::cloudFile = argv[2];
+
 	// Create the GLFW window.
 	GLFWwindow* window = Window::createWindow(640, 480);
 	if (!window) exit(EXIT_FAILURE);
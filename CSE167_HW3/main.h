@@ -11,6 +11,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string>
 #include "Window.h"
+#include "PointOctree.h"
 
 #endif
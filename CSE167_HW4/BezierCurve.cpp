@@ -25,100 +25,179 @@ BezierCurve::BezierCurve(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3,
 	c2->addChild(sphere);
 
 	// x(t) = [p0, p1, p2, p3] * Bernstein_polynomial * vec4(t^3, t^2, t, 1)
-	// where t is in range (1..N)/N
-	// N in this case is 150
-	// add calculated x(t)s to points and draw
-	// update them only when needed
+	// only the arc length table is kept here, the curve is drawn from the
+	// control points by CurveRenderer
+	buildArcTable();
+}
 
-	for (float i = 0; i <= 150; i++)
-	{
-		float t = i / 150.f;
-		glm::vec3 a = -1.f * p0 + 3.f * p1 - 3.f * p2 + p3;
-		glm::vec3 b = 3.f * p0 - 6.f * p1 + 3.f * p2;
-		glm::vec3 c = -3.f * p0 + 3.f * p1;
-		glm::vec3 d = p0;
+BezierCurve::~BezierCurve()
+{
+}
+
+// get point x(t) at time t
+glm::vec3 BezierCurve::getPoint(float t)
+{
+	glm::vec3 a = -1.f * p0 + 3.f * p1 - 3.f * p2 + p3;
+	glm::vec3 b = 3.f * p0 - 6.f * p1 + 3.f * p2;
+	glm::vec3 c = -3.f * p0 + 3.f * p1;
+	glm::vec3 d = p0;
 
-		glm::vec3 pt = a * t * t * t + b * t * t + c * t + d;
-	
-		// std::cerr << pt.x << " " << pt.y << " " << pt.z << std::endl;
+	return ((a * t + b) * t + c) * t + d;
+}
 
-		points.push_back(pt);
-	}
+// x'(t), its length is the speed along the curve per unit of t
+glm::vec3 BezierCurve::getTangent(float t)
+{
+	glm::vec3 a = -1.f * p0 + 3.f * p1 - 3.f * p2 + p3;
+	glm::vec3 b = 3.f * p0 - 6.f * p1 + 3.f * p2;
+	glm::vec3 c = -3.f * p0 + 3.f * p1;
+
+	return (3.f * a * t + 2.f * b) * t + c;
+}
+
+glm::vec3 BezierCurve::getSecondDerivative(float t)
+{
+	glm::vec3 a = -1.f * p0 + 3.f * p1 - 3.f * p2 + p3;
+	glm::vec3 b = 3.f * p0 - 6.f * p1 + 3.f * p2;
 
-	for (unsigned int i = 0; i < 150; i++)
+	return 6.f * a * t + 2.f * b;
+}
+
+void BezierCurve::getFrame(float t, glm::vec3& tangent, glm::vec3& normal, glm::vec3& binormal)
+{
+	glm::vec3 d1 = getTangent(t);
+	glm::vec3 d2 = getSecondDerivative(t);
+
+	tangent = glm::normalize(d1);
+	binormal = glm::cross(d1, d2);
+
+	// straight pieces have no curvature, keep the normal pointing up instead
+	if (glm::length(binormal) < 1e-6f)
 	{
-		indices.push_back(i);
-		indices.push_back(i + 1);
+		glm::vec3 up = glm::abs(tangent.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+		binormal = glm::cross(tangent, up);
 	}
+	binormal = glm::normalize(binormal);
+	normal = glm::cross(binormal, tangent);
+}
 
-	glGenVertexArrays(1, &vao);
-	glGenBuffers(1, &vbo);
-	glGenBuffers(1, &ebo);
-	// Bind to the VAO.
-	glBindVertexArray(vao);
-
-	// Bind to the first VBO. We will use it to store the points.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	// Pass in the data.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * points.size(),
-		points.data(), GL_STATIC_DRAW);
-	// Enable vertex attribute 0. 
-	// We will be able to access points through it.
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-	// bind to store indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	// Pass in data
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-		indices.data(), GL_STATIC_DRAW);
-
-	// Unbind from the VBO.
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Unbind from the VAO.
-	glBindVertexArray(0);
-
+float BezierCurve::getLength()
+{
+	return length;
 }
 
-BezierCurve::~BezierCurve()
+// 5 point gauss-legendre quadrature of |x'(t)| over [a, b]
+float BezierCurve::speedIntegral(float a, float b)
 {
-	glDeleteBuffers(1, &vbo);
-	glDeleteVertexArrays(1, &vao);
+	static const float nodes[5] = { 0.f, -0.5384693101f, 0.5384693101f,
+		-0.9061798459f, 0.9061798459f };
+	static const float weights[5] = { 0.5688888889f, 0.4786286705f, 0.4786286705f,
+		0.2369268851f, 0.2369268851f };
+
+	float half = (b - a) * 0.5f;
+	float mid = (a + b) * 0.5f;
+	float sum = 0;
+	for (int i = 0; i < 5; i++)
+		sum += weights[i] * glm::length(getTangent(mid + half * nodes[i]));
+	return sum * half;
 }
 
-// get point x(t) at time t
-glm::vec3 BezierCurve::getPoint(float t)
+// splits the interval until both halves agree with the whole
+float BezierCurve::adaptiveIntegral(float a, float b, float whole, int depth)
 {
-	return points[t];
+	float mid = (a + b) * 0.5f;
+	float left = speedIntegral(a, mid);
+	float right = speedIntegral(mid, b);
+
+	if (depth >= 8 || glm::abs(left + right - whole) <= 1e-6f * glm::max(whole, 1.f))
+		return left + right;
 
+	return adaptiveIntegral(a, mid, left, depth + 1) +
+		adaptiveIntegral(mid, b, right, depth + 1);
 }
 
-void BezierCurve::draw(GLuint shaderProgram, glm::mat4 C)
+void BezierCurve::buildArcTable()
 {
-	glUniform1i(glGetUniformLocation(shaderProgram, "normalColor"), true);
+	arcTable.assign(ARC_SAMPLES + 1, 0);
+	for (int i = 0; i < ARC_SAMPLES; i++)
+	{
+		float a = (float)i / ARC_SAMPLES;
+		float b = (float)(i + 1) / ARC_SAMPLES;
+		arcTable[i + 1] = arcTable[i] + adaptiveIntegral(a, b, speedIntegral(a, b), 0);
+	}
+	length = arcTable[ARC_SAMPLES];
+}
 
-	
-	// Get the locations of uniform variables.
-	GLuint modelLoc = glGetUniformLocation(shaderProgram, "model");
-	GLuint objColorLoc = glGetUniformLocation(shaderProgram, "color");
-	// change modelview matrix of the figure before drawing.
+// binary search for the table interval, then newton steps inside it
+float BezierCurve::distanceToT(float dist)
+{
+	if (dist <= 0)
+		return 0;
+	if (dist >= length)
+		return 1;
 
+	int lo = 0, hi = ARC_SAMPLES;
+	while (hi - lo > 1)
+	{
+		int mid = (lo + hi) / 2;
+		if (arcTable[mid] <= dist)
+			lo = mid;
+		else
+			hi = mid;
+	}
 
-	// set parameters of the model for the vertex shader per geometry 
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(C * glm::mat4(1)));
+	float t0 = (float)lo / ARC_SAMPLES;
+	float t1 = (float)hi / ARC_SAMPLES;
+	float t = t0 + (t1 - t0) * (dist - arcTable[lo]) / (arcTable[hi] - arcTable[lo]);
 
-	glUniform3fv(glGetUniformLocation(shaderProgram, "color"), 1, glm::value_ptr(color));
+	for (int i = 0; i < 3; i++)
+	{
+		float speed = glm::length(getTangent(t));
+		if (speed < 1e-6f)
+			break;
+		float error = arcTable[lo] + speedIntegral(t0, t) - dist;
+		t = glm::clamp(t - error / speed, t0, t1);
+	}
+	return t;
+}
 
-	// Bind to the VAO.
-	glBindVertexArray(vao);
-	// Set point size.
-	glLineWidth(2.5f);
+// a chord is never longer than the arc, it's shorter by about
+// step^3 / (24 r^2) on a bend of radius r, so the steps must be small next to
+// the tightest bend for the tolerance to hold
+bool BezierCurve::checkArcLength(int steps, float tolerance)
+{
+	if (steps <= 0 || length <= 0)
+		return true;
+
+	float step = length / steps;
+	float worst = 0;
+	int worstStep = 0;
+	glm::vec3 prev = getPoint(0);
+	for (int i = 1; i <= steps; i++)
+	{
+		glm::vec3 p = getPoint(distanceToT(step * i));
+		float error = glm::abs(glm::length(p - prev) - step) / step;
+		if (error > worst)
+		{
+			worst = error;
+			worstStep = i;
+		}
+		prev = p;
+	}
 
-	// Draw points 
-	glDrawElements(GL_LINES, indices.size(), GL_UNSIGNED_INT, 0);
-	// Unbind from the VAO.
-	glBindVertexArray(0);
+	if (worst > tolerance)
+	{
+		std::cerr << "arc length: chord " << worstStep << " of " << steps << " is off by "
+			<< worst * 100.f << "% of the step" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// draws the control points, the curve is drawn by CurveRenderer
+void BezierCurve::draw(GLuint shaderProgram, glm::mat4 C)
+{
+	glUniform1i(glGetUniformLocation(shaderProgram, "normalColor"), true);
 
 	sphere->setColor(c0Color);
 	c0->draw(shaderProgram, C);
@@ -129,10 +208,7 @@ void BezierCurve::draw(GLuint shaderProgram, glm::mat4 C)
 	sphere->setColor(c2Color);
 	c2->draw(shaderProgram, C);
 
-
 	glUniform1i(glGetUniformLocation(shaderProgram, "normalColor"), false);
-
-	
 }
 
 void BezierCurve::update(glm::mat4 C)
@@ -142,50 +218,9 @@ void BezierCurve::update(glm::mat4 C)
 	c2->setTransform(glm::scale(glm::translate(p2), glm::vec3(.1f)));
 }
 
-// clears all current points and recalculates them.
+// recalculates the arc length table.
 // should be called whenever changing control points.
 void BezierCurve::recalcPoints()
 {
-	points.clear();
-
-	for (float i = 0; i <= 150; i++)
-	{
-		float t = i / 150.f;
-		glm::vec3 a = -1.f * p0 + 3.f * p1 - 3.f * p2 + p3;
-		glm::vec3 b = 3.f * p0 - 6.f * p1 + 3.f * p2;
-		glm::vec3 c = -3.f * p0 + 3.f * p1;
-		glm::vec3 d = p0;
-
-		glm::vec3 pt = a * t * t * t + b * t * t + c * t + d;
-	
-		// std::cerr << pt.x << " " << pt.y << " " << pt.z << std::endl;
-
-		points.push_back(pt);
-	}
-
-
-	// Bind to the VAO.
-	glBindVertexArray(vao);
-
-	// Bind to the first VBO. We will use it to store the points.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	// Pass in the data.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * points.size(),
-		points.data(), GL_STATIC_DRAW);
-	// Enable vertex attribute 0. 
-	// We will be able to access points through it.
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-	// bind to store indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	// Pass in data
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-		indices.data(), GL_STATIC_DRAW);
-
-	// Unbind from the VBO.
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Unbind from the VAO.
-	glBindVertexArray(0);
+	buildArcTable();
 }
@@ -18,17 +18,24 @@
 #include "Geometry.h"
 #include "Transform.h"
 
+// One cubic segment of the track. Keeps the math on the cpu for moving the
+// cart, the line itself is drawn by CurveRenderer.
 class BezierCurve : public Node
 {
 protected:
-	std::vector<glm::vec3> points;
-	std::vector<unsigned int> indices;
 	glm::vec3 color;
 
 	Geometry* sphere;
 	Transform* c0, * c1, * c2;
 
-	GLuint vao, vbo, ebo;
+	// arc length from t = 0 to t = i / ARC_SAMPLES, for mapping distance to t
+	static const int ARC_SAMPLES = 32;
+	std::vector<float> arcTable;
+	float length;
+
+	float speedIntegral(float a, float b);
+	float adaptiveIntegral(float a, float b, float whole, int depth);
+	void buildArcTable();
 
 public:
 	glm::vec3 p0, p1, p2, p3;
@@ -37,7 +44,20 @@ public:
 	BezierCurve(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec3 color);
 	~BezierCurve();
 
-	glm::vec3  getPoint(float t);
+	// exact position and derivatives at t in [0, 1]
+	glm::vec3 getPoint(float t);
+	glm::vec3 getTangent(float t);
+	glm::vec3 getSecondDerivative(float t);
+	// unit tangent, normal and binormal
+	void getFrame(float t, glm::vec3& tangent, glm::vec3& normal, glm::vec3& binormal);
+
+	float getLength();
+	// parameter t at the given distance along the curve
+	float distanceToT(float dist);
+	// samples the curve at steps equal distances and checks that every
+	// chord between neighbouring samples is within tolerance (a fraction)
+	// of the step, prints the worst one and returns false if not
+	bool checkArcLength(int steps, float tolerance);
 
 	void draw(GLuint shaderProgram, glm::mat4 C);
 	void update(glm::mat4 C);
@@ -1,20 +1,20 @@
 #include "BoundingSphere.h"
 #include "Window.h"
 
-bool BoundingSphere::render = false;
+BoundingSphere::BoundingSphere()
+{
+	radius = 0;
+}
 
-BoundingSphere::BoundingSphere(Geometry* sphere, GLfloat radius)
+void BoundingSphere::enclose(Geometry* part, glm::vec3 offset)
 {
-	BoundingSphere::sphere = sphere;
-	BoundingSphere::radius = 2.2f; // magic number size of bounding sphere????
+	radius = glm::max(radius, glm::length(offset) + part->getRadius());
 }
 
-// copied from Geometry, but draw as a wireframe instead
+// queued with the other debug shapes, costs nothing while debug drawing is off
 void BoundingSphere::draw(GLuint shaderProgram, glm::mat4 C)
 {
-	// only render wireframe bounding sphere if toggled on
-	if (render)
-		sphere->draw(shaderProgram, C);
+	DebugDraw::sphere(glm::vec3(C[3]), radius * glm::length(glm::vec3(C[0])), glm::vec3(1, 0, 0));
 }
 
 void BoundingSphere::update(glm::mat4 C)
@@ -0,0 +1,124 @@
+#include "CurveRenderer.h"
+
+// the uniform buffer binding point of the ControlPoints block
+static const GLuint CONTROL_BINDING = 0;
+
+CurveRenderer::CurveRenderer(GLuint program, const std::vector<glm::vec3>& points)
+{
+	CurveRenderer::program = program;
+	CurveRenderer::points = points;
+
+	curveColor = glm::vec3(1, 1, 1);
+	handleColor = glm::vec3(0, 0, 1);
+
+	if (points.size() > MAX_POINTS)
+	{
+		std::cerr << "Curve has " << points.size() << " points, only drawing "
+			<< MAX_POINTS << std::endl;
+		CurveRenderer::points.resize(MAX_POINTS);
+	}
+	numSegments = ((int)CurveRenderer::points.size() - 1) / 3;
+
+	firsts.resize(numSegments);
+	counts.resize(numSegments);
+	samples.resize(numSegments);
+
+	uniformAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+
+	GLuint block = glGetUniformBlockIndex(program, "ControlPoints");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, CONTROL_BINDING);
+
+	// no attributes, but core profile still wants a vertex array bound
+	glGenVertexArrays(1, &vao);
+}
+
+CurveRenderer::~CurveRenderer()
+{
+	glDeleteVertexArrays(1, &vao);
+}
+
+// the next draw picks it up
+void CurveRenderer::setPoint(int index, glm::vec3 point)
+{
+	if (index < 0 || index >= (int)points.size())
+		return;
+
+	points[index] = point;
+}
+
+// number of lines for a segment so each covers about 4 pixels on screen,
+// the control polygon's length bounds the curve's
+int CurveRenderer::screenSamples(int segment, glm::mat4 mvp, int width, int height)
+{
+	glm::vec2 screen[4];
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec4 clip = mvp * glm::vec4(points[segment * 3 + i], 1);
+
+		// crossing the near plane, projected lengths are meaningless
+		if (clip.w <= 0.001f)
+			return MAX_SAMPLES - 1;
+
+		screen[i] = glm::vec2(clip) / clip.w * glm::vec2(width, height) * 0.5f;
+	}
+
+	float pixels = glm::length(screen[1] - screen[0]) + glm::length(screen[2] - screen[1]) +
+		glm::length(screen[3] - screen[2]);
+
+	return glm::clamp((int)glm::ceil(pixels / 4.f), 4, MAX_SAMPLES - 1);
+}
+
+void CurveRenderer::draw(glm::mat4 C, glm::mat4 view, glm::mat4 projection,
+	int width, int height, StreamBuffer* stream)
+{
+	// the whole block, std140 pads every array element to a vec4
+	GLsizeiptr bytes = sizeof(glm::vec4) * MAX_POINTS;
+	StreamAllocation controls = stream->allocate(bytes, uniformAlignment);
+	if (controls.ptr == nullptr)
+		return;
+	glm::vec4* data = (glm::vec4*)controls.ptr;
+	for (int i = 0; i < MAX_POINTS; i++)
+		data[i] = i < (int)points.size() ? glm::vec4(points[i], 1) : glm::vec4(0);
+	stream->flush();
+
+	glm::mat4 mvp = projection * view * C;
+
+	// segment i reads vertex ids [i * MAX_SAMPLES, i * MAX_SAMPLES + samples]
+	for (int i = 0; i < numSegments; i++)
+	{
+		samples[i] = screenSamples(i, mvp, width, height);
+		firsts[i] = i * MAX_SAMPLES;
+		counts[i] = samples[i] + 1;
+	}
+
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE,
+		glm::value_ptr(projection));
+	glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE,
+		glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE,
+		glm::value_ptr(C));
+	glUniform1iv(glGetUniformLocation(program, "samples"), numSegments, samples.data());
+	// the repeated last point isn't part of the handle loop
+	glUniform1i(glGetUniformLocation(program, "numControls"), (GLint)points.size() - 1);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, CONTROL_BINDING, stream->getBuffer(), controls.offset, bytes);
+	glBindVertexArray(vao);
+
+	// all curve segments in one call
+	glUniform1i(glGetUniformLocation(program, "handles"), false);
+	glUniform3fv(glGetUniformLocation(program, "color"), 1, glm::value_ptr(curveColor));
+	glLineWidth(2.5f);
+	glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(), numSegments);
+
+	// one handle per joint between segments
+	glUniform1i(glGetUniformLocation(program, "handles"), true);
+	glUniform3fv(glGetUniformLocation(program, "color"), 1, glm::value_ptr(handleColor));
+	glLineWidth(2.f);
+	glDrawArrays(GL_LINES, 0, numSegments * 2);
+
+	glBindVertexArray(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CONTROL_BINDING, 0);
+}
@@ -0,0 +1,58 @@
+#ifndef _CURVE_RENDERER_H_
+#define _CURVE_RENDERER_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <iostream>
+
+#include "StreamBuffer.h"
+
+// Draws a closed chain of cubic bezier segments and their handles straight
+// from the control points. Every frame the control points are written to
+// the stream buffer and bound as a uniform block, the vertex shader
+// evaluates the curve and the handle lines from gl_VertexID. There are no
+// vertex buffers, and 1 KB of points replaces what the old per segment and
+// per handle buffers reallocated each frame.
+class CurveRenderer
+{
+public:
+	// must match the constants in curve_shader.vert
+	static const int MAX_POINTS = 64;
+	static const int MAX_SEGMENTS = 21;
+	static const int MAX_SAMPLES = 256;
+
+	// points[3i .. 3i + 3] are segment i, the last point repeats the first
+	CurveRenderer(GLuint program, const std::vector<glm::vec3>& points);
+	~CurveRenderer();
+
+	void setPoint(int index, glm::vec3 point);
+
+	void draw(glm::mat4 C, glm::mat4 view, glm::mat4 projection,
+		int width, int height, StreamBuffer* stream);
+
+	glm::vec3 curveColor, handleColor;
+
+private:
+	GLuint program;
+	GLuint vao;
+	GLint uniformAlignment; // of uniform block offsets into the stream
+
+	std::vector<glm::vec3> points;
+	int numSegments;
+
+	// per segment draw ranges and line counts, rebuilt every draw
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	std::vector<GLint> samples;
+
+	int screenSamples(int segment, glm::mat4 mvp, int width, int height);
+};
+
+#endif
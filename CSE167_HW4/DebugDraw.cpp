@@ -0,0 +1,134 @@
+#include "DebugDraw.h"
+
+#include <cstring>
+
+// lines per sphere circle
+static const int CIRCLE_SEGMENTS = 16;
+
+bool DebugDraw::enabled = false;
+
+std::vector<DebugDraw::Vertex> DebugDraw::vertices;
+GLuint DebugDraw::program = 0;
+GLuint DebugDraw::vao = 0;
+GLint DebugDraw::viewProjectionLoc = -1;
+
+void DebugDraw::init(GLuint program)
+{
+	DebugDraw::program = program;
+	viewProjectionLoc = glGetUniformLocation(program, "viewProjection");
+
+	// the attributes point into the stream buffer, set up at every flush
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glBindVertexArray(0);
+}
+
+void DebugDraw::cleanUp()
+{
+	glDeleteVertexArrays(1, &vao);
+	vertices.clear();
+}
+
+GLuint DebugDraw::pack(glm::vec3 color)
+{
+	glm::uvec3 c = glm::uvec3(glm::clamp(color, 0.f, 1.f) * 255.f + 0.5f);
+	return c.r | (c.g << 8) | (c.b << 16) | (255u << 24);
+}
+
+void DebugDraw::addLine(glm::vec3 a, glm::vec3 b, GLuint color)
+{
+	vertices.push_back({ a, color });
+	vertices.push_back({ b, color });
+}
+
+void DebugDraw::addSphere(glm::vec3 center, float radius, GLuint color)
+{
+	// unit circle, computed once
+	static glm::vec2 circle[CIRCLE_SEGMENTS + 1];
+	static bool built = false;
+	if (!built)
+	{
+		for (int i = 0; i <= CIRCLE_SEGMENTS; i++)
+		{
+			float angle = 6.2831853f * i / CIRCLE_SEGMENTS;
+			circle[i] = glm::vec2(cosf(angle), sinf(angle));
+		}
+		built = true;
+	}
+
+	for (int i = 0; i < CIRCLE_SEGMENTS; i++)
+	{
+		glm::vec2 a = circle[i] * radius, b = circle[i + 1] * radius;
+		addLine(center + glm::vec3(a.x, a.y, 0), center + glm::vec3(b.x, b.y, 0), color);
+		addLine(center + glm::vec3(a.x, 0, a.y), center + glm::vec3(b.x, 0, b.y), color);
+		addLine(center + glm::vec3(0, a.x, a.y), center + glm::vec3(0, b.x, b.y), color);
+	}
+}
+
+// corners are ordered by bits, x is bit 0, y bit 1, z bit 2
+void DebugDraw::addCorners(const glm::vec3 corners[8], GLuint color)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		for (int bit = 1; bit < 8; bit <<= 1)
+		{
+			if (!(i & bit))
+				addLine(corners[i], corners[i | bit], color);
+		}
+	}
+}
+
+void DebugDraw::addBox(glm::vec3 min, glm::vec3 max, GLuint color)
+{
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+		corners[i] = glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+	addCorners(corners, color);
+}
+
+void DebugDraw::addFrustum(glm::mat4 viewProjection, GLuint color)
+{
+	// the ndc cube taken back to world space
+	glm::mat4 inverse = glm::inverse(viewProjection);
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 p = inverse * glm::vec4(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1, 1);
+		corners[i] = glm::vec3(p) / p.w;
+	}
+	addCorners(corners, color);
+}
+
+void DebugDraw::flush(glm::mat4 viewProjection, StreamBuffer* stream)
+{
+	if (vertices.empty())
+		return;
+
+	GLsizeiptr bytes = sizeof(Vertex) * vertices.size();
+	StreamAllocation data = stream->allocate(bytes, sizeof(Vertex));
+	if (!data.ptr)
+	{
+		vertices.clear();
+		return;
+	}
+	memcpy(data.ptr, vertices.data(), bytes);
+	stream->flush();
+
+	glUseProgram(program);
+	glUniformMatrix4fv(viewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream->getBuffer());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)data.offset);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+		(void*)(data.offset + sizeof(glm::vec3)));
+
+	glDrawArrays(GL_LINES, 0, (GLsizei)vertices.size());
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	vertices.clear();
+}
@@ -0,0 +1,235 @@
+#include "FrameScheduler.h"
+
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+const double FrameScheduler::BUCKET_WIDTH = 0.1;
+
+FrameScheduler::FrameScheduler(double tickRate, double targetFps, PresentMode mode)
+{
+	tickDelta = 1.0 / tickRate;
+	// never simulate more than a quarter second per frame
+	maxFrameDelta = 0.25;
+	FrameScheduler::targetFps = targetFps;
+
+	accumulator = 0;
+	frameStart = lastFrameStart = glfwGetTime();
+
+	histogram.assign(NUM_BUCKETS, 0);
+	frameCount = 0;
+	tickCount = 0;
+	totalTime = 0;
+	minTime = 1e9;
+	maxTime = 0;
+
+#ifdef _WIN32
+	// default sleep granularity on windows is ~15ms, which is useless for capping
+	timeBeginPeriod(1);
+#endif
+
+	setPresentMode(mode);
+}
+
+FrameScheduler::~FrameScheduler()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FrameScheduler::start()
+{
+	accumulator = 0;
+	frameStart = lastFrameStart = glfwGetTime();
+}
+
+// starts a new frame and feeds the elapsed time into the tick accumulator
+void FrameScheduler::beginFrame()
+{
+	frameStart = glfwGetTime();
+	double delta = frameStart - lastFrameStart;
+	lastFrameStart = frameStart;
+
+	// record the full frame to frame time in ms, this is what the user sees
+	double ms = delta * 1000.0;
+	int bucket = (int)(ms / BUCKET_WIDTH);
+	if (bucket >= NUM_BUCKETS)
+		bucket = NUM_BUCKETS - 1;
+	histogram[bucket]++;
+	frameCount++;
+	totalTime += ms;
+	if (ms < minTime)
+		minTime = ms;
+	if (ms > maxTime)
+		maxTime = ms;
+
+	if (delta > maxFrameDelta)
+		delta = maxFrameDelta;
+	accumulator += delta;
+}
+
+// returns true while there is enough accumulated time for one more tick
+bool FrameScheduler::tick()
+{
+	if (accumulator < tickDelta)
+		return false;
+
+	accumulator -= tickDelta;
+	tickCount++;
+	return true;
+}
+
+// waits out the rest of the frame when the fps is capped
+void FrameScheduler::endFrame()
+{
+	if (mode == PresentMode::CAPPED && targetFps > 0)
+		waitUntil(frameStart + 1.0 / targetFps);
+}
+
+float FrameScheduler::getTickDelta()
+{
+	return (float)tickDelta;
+}
+
+// how far between the last two ticks the rendered frame is, in [0, 1)
+float FrameScheduler::getAlpha()
+{
+	return (float)(accumulator / tickDelta);
+}
+
+void FrameScheduler::setPresentMode(PresentMode m)
+{
+	mode = m;
+
+	switch (mode)
+	{
+	case PresentMode::VSYNC:
+		glfwSwapInterval(1);
+		break;
+	case PresentMode::ADAPTIVE_VSYNC:
+		// tear instead of waiting a whole interval when a frame is late
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+			glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+			glfwSwapInterval(-1);
+		else
+			glfwSwapInterval(1);
+		break;
+	case PresentMode::CAPPED:
+	case PresentMode::UNCAPPED:
+		glfwSwapInterval(0);
+		break;
+	default:
+		break;
+	}
+}
+
+void FrameScheduler::setTargetFps(double fps)
+{
+	targetFps = fps;
+}
+
+// switches to the next present mode
+void FrameScheduler::cycleMode()
+{
+	switch (mode)
+	{
+	case PresentMode::VSYNC:
+		setPresentMode(PresentMode::ADAPTIVE_VSYNC);
+		break;
+	case PresentMode::ADAPTIVE_VSYNC:
+		setPresentMode(PresentMode::CAPPED);
+		break;
+	case PresentMode::CAPPED:
+		setPresentMode(PresentMode::UNCAPPED);
+		break;
+	default:
+		setPresentMode(PresentMode::VSYNC);
+		break;
+	}
+	std::cerr << "present mode: " << getModeName() << std::endl;
+}
+
+std::string FrameScheduler::getModeName()
+{
+	switch (mode)
+	{
+	case PresentMode::VSYNC:
+		return "vsync";
+	case PresentMode::ADAPTIVE_VSYNC:
+		return "adaptive vsync";
+	case PresentMode::CAPPED:
+		return "capped " + std::to_string((int)targetFps) + " fps";
+	default:
+		return "uncapped";
+	}
+}
+
+// prints frame time percentiles and the non-empty part of the histogram
+void FrameScheduler::report()
+{
+	if (frameCount == 0)
+		return;
+
+	std::cerr << "frames: " << frameCount << ", ticks: " << tickCount
+		<< ", mode: " << getModeName() << std::endl;
+
+	char line[128];
+	snprintf(line, sizeof(line),
+		"frame time ms  min %.2f  avg %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f",
+		minTime, totalTime / frameCount, percentile(0.5), percentile(0.95),
+		percentile(0.99), maxTime);
+	std::cerr << line << std::endl;
+
+	// fold the fine buckets into 1ms rows so the output stays readable
+	const int perRow = (int)(1.0 / BUCKET_WIDTH);
+	for (int row = 0; row < NUM_BUCKETS / perRow; row++)
+	{
+		unsigned int count = 0;
+		for (int i = 0; i < perRow; i++)
+			count += histogram[row * perRow + i];
+		if (count == 0)
+			continue;
+
+		int bar = (int)(60.0 * count / frameCount + 0.5);
+		snprintf(line, sizeof(line), "%4d ms %8u ", row, count);
+		std::cerr << line << std::string(bar, '#') << std::endl;
+	}
+}
+
+double FrameScheduler::percentile(double p)
+{
+	unsigned long long target = (unsigned long long)(p * frameCount);
+	unsigned long long seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++)
+	{
+		seen += histogram[i];
+		if (seen > target)
+			return (i + 0.5) * BUCKET_WIDTH;
+	}
+	return NUM_BUCKETS * BUCKET_WIDTH;
+}
+
+// sleeps in 1ms steps while far away, then yields for the last bit
+void FrameScheduler::waitUntil(double time)
+{
+	while (true)
+	{
+		double remaining = time - glfwGetTime();
+		if (remaining <= 0)
+			break;
+
+		if (remaining > 0.002)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef _OBJ_LOADER_H_
+#define _OBJ_LOADER_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <iostream>
+
+// An indexed triangle mesh read from an obj file. Every distinct
+// position/texture/normal combination used by a face becomes one vertex;
+// texCoords and normals are empty when the file has none. Corners that
+// leave out their normal or texture index use the one at their position's
+// index.
+struct ObjMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<unsigned int> indices;
+};
+
+// Shared obj reader. The file is memory mapped and cut into chunks at line
+// breaks that are parsed on separate threads, then merged in file order, so
+// the result doesn't depend on the number of threads.
+class ObjLoader
+{
+public:
+	// default weld distance, in the units of the file
+	static const float WELD_EPSILON;
+	// where loadWelded keeps its results, relative to the working directory
+	static const char* CACHE_DIR;
+
+	// polygons are split into triangle fans
+	static bool load(const std::string& filename, ObjMesh& mesh);
+
+	// loads the mesh and welds it, the result is kept in CACHE_DIR and read
+	// from there on later runs as long as the obj file hasn't changed
+	static bool loadWelded(const std::string& filename, ObjMesh& mesh, float epsilon);
+
+	// merges vertices whose position, normal and texture coordinate are all
+	// within epsilon of each other, 0 only merges exact copies
+	static void weld(ObjMesh& mesh, float epsilon);
+
+	// only the "v" lines, in file order
+	static bool loadPoints(const std::string& filename, std::vector<glm::vec3>& points);
+
+	// writes an obj of about megabytes to CACHE_DIR once, then prints how
+	// fast it parses (warm, without building the mesh) and loads
+	static void benchmark(size_t megabytes);
+};
+
+#endif
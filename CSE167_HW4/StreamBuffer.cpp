@@ -0,0 +1,164 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer(GLsizeiptr frameSize)
+{
+	StreamBuffer::frameSize = frameSize;
+	mapped = nullptr;
+	region = 0;
+	head = flushed = 0;
+	frames = stalls = overflows = 0;
+	peak = 0;
+	for (int i = 0; i < NUM_REGIONS; i++)
+		fences[i] = 0;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+#ifdef __APPLE__
+	persistent = false;
+#else
+	persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	if (persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, frameSize * NUM_REGIONS, nullptr, flags);
+		mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, frameSize * NUM_REGIONS, flags);
+		if (mapped == nullptr)
+		{
+			// the storage is immutable now, start over with a new buffer
+			std::cerr << "Persistent mapping failed, using orphaning" << std::endl;
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			persistent = false;
+		}
+	}
+#endif
+
+	if (!persistent)
+	{
+		glBufferData(GL_ARRAY_BUFFER, frameSize, nullptr, GL_STREAM_DRAW);
+		staging.resize(frameSize);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (int i = 0; i < NUM_REGIONS; i++)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+	}
+
+	if (persistent)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void StreamBuffer::beginFrame()
+{
+	frames++;
+	head = flushed = 0;
+
+	if (!persistent)
+	{
+		// hand the old storage to the driver, it stays alive until the gpu is
+		// done with it and we get a fresh block without waiting
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, frameSize, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	region = (region + 1) % NUM_REGIONS;
+	GLsync& fence = fences[region];
+	if (!fence)
+		return;
+
+	// normally the gpu finished this region two frames ago
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		stalls++;
+		do
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+StreamAllocation StreamBuffer::allocate(GLsizeiptr bytes, GLsizeiptr alignment)
+{
+	StreamAllocation allocation = { nullptr, 0 };
+
+	GLsizeiptr start = (head + alignment - 1) / alignment * alignment;
+	if (start + bytes > frameSize)
+	{
+		// only complain once, this would repeat every frame
+		if (overflows++ == 0)
+			std::cerr << "Stream buffer full, " << frameSize << " bytes per frame" << std::endl;
+		return allocation;
+	}
+
+	head = start + bytes;
+	if (head > peak)
+		peak = head;
+
+	if (persistent)
+	{
+		allocation.offset = region * frameSize + start;
+		allocation.ptr = mapped + allocation.offset;
+	}
+	else
+	{
+		allocation.offset = start;
+		allocation.ptr = staging.data() + start;
+	}
+	return allocation;
+}
+
+void StreamBuffer::flush()
+{
+	// the persistent mapping is coherent, writes are already visible
+	if (persistent || flushed == head)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, flushed, head - flushed, staging.data() + flushed);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	flushed = head;
+}
+
+void StreamBuffer::endFrame()
+{
+	if (persistent)
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint StreamBuffer::getBuffer()
+{
+	return buffer;
+}
+
+bool StreamBuffer::isPersistent()
+{
+	return persistent;
+}
+
+void StreamBuffer::report()
+{
+	std::cerr << "stream buffer: " << (persistent ? "persistent" : "orphaning")
+		<< ", peak " << peak << " of " << frameSize << " bytes per frame, "
+		<< stalls << " stalls in " << frames << " frames";
+	if (overflows > 0)
+		std::cerr << ", " << overflows << " failed allocations";
+	std::cerr << std::endl;
+}
@@ -1,17 +1,24 @@
 #include "Track.h"
+#include "Window.h"
 
+#include <cfloat>
+#include <cstdio>
 
-Track::Track(std::vector<glm::vec3> points, Transform* sphere, glm::vec3 start)
+Track::Track(std::vector<glm::vec3> points, Transform* sphere, glm::vec3 start,
+	GLuint curveProgram)
 {
 	position = start;
+	prevPosition = start;
+	renderPosition = start;
 
 	moving = true;
 
 	currentPoint = 0;
 	currentTrack = 0;
-	curT = 0;
-	velocity = 5.f;
-	prevTime = glfwGetTime();
+	distance = 0;
+	minSpeed = 2.f;
+	gravity = 9.8f;
+	velocity = minSpeed;
 
 	Track::sphere = sphere;
 
@@ -25,20 +32,18 @@ Track::Track(std::vector<glm::vec3> points, Transform* sphere, glm::vec3 start)
 		curves.push_back(c);
 	}
 
-	for (unsigned int i = 0; i < 7; i++)
-	{
-		Line* l = new Line(points[i * 3 + 2], points[i * 3 + 4]);
-		handles.push_back(l);
-	}
+	// handles go from p2 of every curve to p1 of the next
+	renderer = new CurveRenderer(curveProgram, points);
 
-	Line* l = new Line(points[points.size() - 2], points[1]);
-	handles.push_back(l);
+	findTopHeight();
 
-	
+	for (BezierCurve* c : curves)
+		c->checkArcLength(ARC_CHECK_STEPS, ARC_CHECK_TOLERANCE);
 }
 
 Track::~Track()
 {
+	delete renderer;
 }
 
 void Track::nextLine(bool left)
@@ -133,22 +138,23 @@ void Track::moveControl(char axis, bool positive)
 			curves[prevCurve]->p2 += move;
 			curves[prevCurve]->p3 += move;
 			curves[curCurve]->p1 += move;
-			handles[prevCurve]->p0 += move;
-			handles[prevCurve]->p1 += move;
+			movePoint(curCurve * 3, move);
+			movePoint(prevCurve * 3 + 2, move);
+			movePoint(curCurve * 3 + 1, move);
 			break;
 		// if moving p1: move previous curve's p2 in opposite direction, p0 remains unchanged
 		case 1:
 			curves[curCurve]->p1 += move;
 			curves[prevCurve]->p2 -= move;
-			handles[prevCurve]->p0 -= move;
-			handles[prevCurve]->p1 += move;
+			movePoint(curCurve * 3 + 1, move);
+			movePoint(prevCurve * 3 + 2, -move);
 			break;
 		// if moving p2: move next curve's p1 in opposite direction
 		case 2:
 			curves[curCurve]->p2 += move;
 			curves[nextCurve]->p1 -= move;
-			handles[curCurve]->p0 += move;
-			handles[curCurve]->p1 -= move;
+			movePoint(curCurve * 3 + 2, move);
+			movePoint(nextCurve * 3 + 1, -move);
 			break;
 		default:
 			break;
@@ -158,22 +164,38 @@ void Track::moveControl(char axis, bool positive)
 	curves[curCurve]->recalcPoints();
 	curves[nextCurve]->recalcPoints();
 
+	// the curve the car is on may have become shorter
+	distance = glm::min(distance, curves[currentTrack]->getLength());
+	findTopHeight();
+
 }
 
 void Track::draw(GLuint shaderProgram, glm::mat4 C)
 {
-	// something with drawing handles
+	// curve lines and handles, evaluated on the gpu
+	renderer->draw(C, Window::view, Window::projection, Window::width, Window::height, Window::stream);
+	glUseProgram(shaderProgram);
 
+	// control points
 	for each (BezierCurve* c in curves)
 	{
 		c->draw(shaderProgram, C);
 	}
 
-	for each (Line * l in handles)
+	sphere->draw(shaderProgram, C);
+
+	// the cart's frenet frame, only worth evaluating when it will be drawn
+	if (DebugDraw::enabled)
 	{
-		l->draw(shaderProgram, C);
+		glm::vec3 tangent, normal, binormal;
+		BezierCurve* curve = curves[currentTrack];
+		curve->getFrame(curve->distanceToT(distance), tangent, normal, binormal);
+
+		glm::vec3 p = glm::vec3(C * glm::vec4(renderPosition, 1));
+		DebugDraw::line(p, p + glm::mat3(C) * tangent, glm::vec3(1, 0, 0));
+		DebugDraw::line(p, p + glm::mat3(C) * normal, glm::vec3(0, 1, 0));
+		DebugDraw::line(p, p + glm::mat3(C) * binormal, glm::vec3(0, 0, 1));
 	}
-	sphere->draw(shaderProgram, C);
 }
 
 void Track::update(glm::mat4 C)
@@ -182,57 +204,99 @@ void Track::update(glm::mat4 C)
 	{
 		c->update(C);
 	}
+}
 
-	for each (Line * l in handles)
-	{
-		l->update(C);
-	}
+// moves the cart along the track by one simulation tick of length dt
+void Track::step(float dt)
+{
+	prevPosition = position;
 
 	if (!moving)
-	{
-		prevTime = glfwGetTime();
 		return;
-	}
 	
-	// movement of the rollercoaster
-
-	double delta_t = glfwGetTime() - prevTime;
+	// movement of the rollercoaster, speed from energy conservation:
+	// 1/2 v^2 + g h stays the same as at the top of the track
+	float drop = glm::max(topHeight - position.y, 0.f);
+	velocity = glm::sqrt(minSpeed * minSpeed + 2.f * gravity * drop);
 
 	// distance cart travels
-	float dist = velocity * (float)(delta_t);
-	
-	glm::vec3 end = curves[currentTrack]->getPoint(curT);
-	
-	// if moves further than current line segment, advance to next segment. 
-	while (glm::abs(glm::length(end) - glm::length(position)) < dist)
+	distance += velocity * dt;
+
+	// changing curves, possibly more than one on a very short curve. Curves
+	// with no length are passed over, at most one lap of them per tick so
+	// a track that collapsed to a point can't hang here
+	for (size_t passed = 0; passed < curves.size(); passed++)
 	{
-		curT++;
+		float length = curves[currentTrack]->getLength();
+		if (length > 0 && distance < length)
+			break;
+		distance = glm::max(distance - length, 0.f);
+		currentTrack = currentTrack < (int)curves.size() - 1 ? currentTrack + 1 : 0;
+	}
+	distance = glm::min(distance, curves[currentTrack]->getLength());
 
-		end = curves[currentTrack]->getPoint(curT);
+	BezierCurve* curve = curves[currentTrack];
+	position = curve->getPoint(curve->distanceToT(distance));
+}
 
-		if (curT >= 150)
-		{
-			curT = 0;
-			currentTrack = currentTrack < curves.size() - 1 ? currentTrack + 1 : 0;
-		}
+void Track::benchmark()
+{
+	bool ok = true;
+	for (BezierCurve* c : curves)
+		ok = c->checkArcLength(ARC_CHECK_STEPS, ARC_CHECK_TOLERANCE) && ok;
+	std::cerr << (ok ? "arc length: chords within " : "arc length: chords not within ")
+		<< ARC_CHECK_TOLERANCE * 100.f << "% of the step" << std::endl;
+
+	// the same lookup step does per tick, spread over every curve
+	const int EVALS = 1000000;
+	glm::vec3 sum(0);
+	double start = glfwGetTime();
+	for (int i = 0; i < EVALS; i++)
+	{
+		BezierCurve* c = curves[i % curves.size()];
+		sum += c->getPoint(c->distanceToT(c->getLength() * (i % 997) / 997.f));
 	}
-	// changing curves
-	if (curT >= 150)
+	double elapsed = glm::max(glfwGetTime() - start, 1e-9);
+
+	char line[256];
+	snprintf(line, sizeof(line), "arc length: %d lookups in %.1f ms, %.2f M/s (%.1f)",
+		EVALS, elapsed * 1000.0, EVALS / elapsed / 1e6, sum.x + sum.y + sum.z);
+	std::cerr << line << std::endl;
+}
+
+// moves one control point, the first and last point are the same one
+void Track::movePoint(int index, glm::vec3 move)
+{
+	points[index] += move;
+	renderer->setPoint(index, points[index]);
+
+	if (index == 0)
 	{
-		curT = 0;
-		currentTrack = currentTrack < curves.size() - 1 ? currentTrack + 1 : 0;
+		points.back() += move;
+		renderer->setPoint((int)points.size() - 1, points.back());
 	}
+}
 
-	// travel distance over length to end of line segment 
-	position += (glm::normalize(end - position) * dist);
+// highest point of the track, sampled along every curve
+void Track::findTopHeight()
+{
+	topHeight = -FLT_MAX;
+	for (BezierCurve* c : curves)
+	{
+		for (int i = 0; i <= 64; i++)
+			topHeight = glm::max(topHeight, c->getPoint(i / 64.f).y);
+	}
+}
 
-	sphere->setTransform(glm::translate(position));
+// places the cart between the previous and current tick for drawing
+void Track::interpolate(float alpha)
+{
+	renderPosition = glm::mix(prevPosition, position, alpha);
 
-	prevTime = glfwGetTime();
-	
+	sphere->setTransform(glm::translate(renderPosition));
 }
 
 glm::vec3 Track::getPosition()
 {
-	return position;
+	return renderPosition;
 }
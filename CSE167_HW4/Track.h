@@ -19,7 +19,7 @@
 #include "Node.h"
 #include "Geometry.h"
 #include "BezierCurve.h"
-#include "Line.h"
+#include "CurveRenderer.h"
 
 class Track : public Node
 {
@@ -27,33 +27,53 @@ protected:
 	
 	std::vector<BezierCurve*> curves;
 	std::vector<glm::vec3> points;
-	std::vector<Line*> handles;
+	CurveRenderer* renderer; // draws the curves and handles on the gpu
+
+	// samples per curve and allowed chord error of the arc length check
+	static const int ARC_CHECK_STEPS = 200;
+	static constexpr float ARC_CHECK_TOLERANCE = 0.01f;
 
 	int currentPoint;
 
 	int currentTrack;
 
-	int curT;
-	float velocity; // velocity of car
+	float distance; // distance of the car along the current curve
+	float velocity; // velocity of car, from its height
+
+	// the car keeps minSpeed at the highest point of the track and trades
+	// height for speed everywhere else
+	float topHeight;
+	float minSpeed;
+	float gravity;
+
+	void findTopHeight();
+	void movePoint(int index, glm::vec3 move);
 
 	glm::vec3 position; // position of car
+	glm::vec3 prevPosition; // position of car at the previous tick
+	glm::vec3 renderPosition; // interpolated position that gets drawn
 	Transform* sphere; // car
 
-	double prevTime;
-
 public:
 
 	bool moving;
 
-	Track(std::vector<glm::vec3> points, Transform* sphere, glm::vec3 start);
+	Track(std::vector<glm::vec3> points, Transform* sphere, glm::vec3 start,
+		GLuint curveProgram);
 	~Track();
 
 	void nextLine(bool left);
 	void moveControl(char axis, bool positive);
 	void draw(GLuint shaderProgram, glm::mat4 C);
 	void update(glm::mat4 C);
+	void step(float dt);
+	void interpolate(float alpha);
 	glm::vec3 getPosition();
 
+	// arc length check of every curve, then distance to position lookups
+	// per second
+	void benchmark();
+
 };
 
 #endif
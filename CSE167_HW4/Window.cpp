@@ -15,6 +15,8 @@ Transform* Window::world;
 Skybox* Window::skybox;
 BezierCurve* Window::testCurve;
 Track* Window::track;
+FrameScheduler* Window::scheduler;
+StreamBuffer* Window::stream;
 
 bool Window::normalColor;
 
@@ -44,6 +46,8 @@ glm::mat4 Window::view = glm::lookAt(Window::eye, Window::center, Window::up);
 
 GLuint Window::program; // The shader program id.
 GLuint Window::skyboxProgram; // skybox shader program id.
+GLuint Window::curveProgram; // evaluates the track curves on the gpu.
+GLuint Window::debugProgram; // debug lines, see DebugDraw.
 
 GLuint Window::projectionLoc; // Location of projection in shader.
 GLuint Window::viewLoc; // Location of view in shader.
@@ -53,9 +57,11 @@ bool Window::initializeProgram() {
 	// Create a shader program with a vertex shader and a fragment shader.
 	program = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
 	skyboxProgram = LoadShaders("shaders/skybox_shader.vert", "shaders/skybox_shader.frag");
+	curveProgram = LoadShaders("shaders/curve_shader.vert", "shaders/curve_shader.frag");
+	debugProgram = LoadShaders("shaders/debug_shader.vert", "shaders/debug_shader.frag");
 
 	// Check the shader program.
-	if (!program || !skyboxProgram)
+	if (!program || !skyboxProgram || !curveProgram || !debugProgram)
 	{
 		std::cerr << "Failed to initialize shader program" << std::endl;
 		return false;
@@ -73,6 +79,13 @@ bool Window::initializeObjects()
 
 	modelSize = 1.0f;
 
+	// simulate at 120 ticks per second, render capped at 144 fps by default
+	scheduler = new FrameScheduler(120.0, 144.0, PresentMode::CAPPED);
+
+	// everything rewritten per frame goes through here, 256kb a frame
+	stream = new StreamBuffer(256 * 1024);
+	DebugDraw::init(debugProgram);
+
 	// initialize models and materials of the objects
 	projectionLoc = glGetUniformLocation(program, "projection");
 	viewLoc = glGetUniformLocation(program, "view");
@@ -130,7 +143,7 @@ bool Window::initializeObjects()
 
 	sphere_trans->addChild(sphere);
 
-	track = new Track(points, sphere_trans, glm::vec3(1, -2, 10));
+	track = new Track(points, sphere_trans, glm::vec3(1, -2, 10), curveProgram);
 
 	world->addChild(track);
 	
@@ -158,8 +171,18 @@ void Window::cleanUp()
 	// Deallcoate the objects.
 	delete world;
 
+	// print frame pacing statistics for the session
+	scheduler->report();
+	delete scheduler;
+
+	DebugDraw::cleanUp();
+	stream->report();
+	delete stream;
+
 	// Delete the shader program.
 	glDeleteProgram(program);
+	glDeleteProgram(curveProgram);
+	glDeleteProgram(debugProgram);
 }
 
 GLFWwindow* Window::createWindow(int width, int height)
@@ -211,7 +234,7 @@ GLFWwindow* Window::createWindow(int width, int height)
 	}
 #endif
 
-	// Set swap interval to 1.
+	// Swap interval is set by the frame scheduler's present mode.
 	glfwSwapInterval(0);
 
 	// Call the resize callback to make sure things get drawn immediately.
@@ -236,15 +259,21 @@ void Window::resizeCallback(GLFWwindow* window, int width, int height)
 		double(width) / (double)height, nearDist, farDist);
 }
 
-void Window::idleCallback()
+void Window::idleCallback(float dt)
 {
 	// Perform any updates as necessary. 
 	world->update(glm::mat4(1));
 
+	// advance the cart by one fixed tick
+	track->step(dt);
 }
 
-void Window::displayCallback(GLFWwindow* window)
+void Window::displayCallback(GLFWwindow* window, float alpha)
 {	
+	// place the cart between the last two simulation ticks
+	track->interpolate(alpha);
+
+	stream->beginFrame();
 
 	if (firstPersonView)
 	{
@@ -291,6 +320,11 @@ void Window::displayCallback(GLFWwindow* window)
 	// Render the scenegraph, initially passing in identity matrix.
 	world->draw(program, glm::mat4(1));
 
+	// all debug shapes of the frame in one draw
+	DebugDraw::flush(projection * view, stream);
+	glUseProgram(program);
+	stream->endFrame();
+
 	// Gets events, including input such as keyboard and mouse or window resizing.
 	glfwPollEvents();
 	// Swap buffers.
@@ -317,8 +351,8 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 			normalColor = !normalColor;
 			break;
 		case GLFW_KEY_B:
-			// toggle rendering of bounding spheres
-			BoundingSphere::render = !BoundingSphere::render;
+			// toggle debug drawing
+			DebugDraw::enabled = !DebugDraw::enabled;
 			break;
 		case GLFW_KEY_C:
 			// toggle first person POV
@@ -352,6 +386,18 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 		case GLFW_KEY_P:
 			track->moving = !track->moving;
 			break;
+		case GLFW_KEY_V:
+			// cycle vsync / adaptive vsync / capped / uncapped
+			scheduler->cycleMode();
+			break;
+		case GLFW_KEY_L:
+			// arc length check and lookups per second of the track
+			track->benchmark();
+			break;
+		case GLFW_KEY_O:
+			// obj parsing and loading rate, writes a 512 MB obj to the cache once
+			ObjLoader::benchmark(512);
+			break;
 		default:
 			break;
 		}
@@ -24,6 +24,9 @@
 #include "Track.h"
 #include "BoundingSphere.h"
 #include "Skybox.h"
+#include "FrameScheduler.h"
+#include "StreamBuffer.h"
+#include "DebugDraw.h"
 
 
 enum class Movement {
@@ -47,6 +50,8 @@ public:
 	static glm::vec3 eye, center, up;
 	static GLuint program, projectionLoc, viewLoc, modelLoc, objColorLoc, eyeLoc;
 	static GLuint skyboxProgram;
+	static GLuint curveProgram;
+	static GLuint debugProgram;
 
 	static bool enableCulling;
 	static bool enableCullingDebug;
@@ -63,6 +68,8 @@ public:
 	static Skybox* skybox;
 	static BezierCurve* testCurve;
 	static Track* track;
+	static FrameScheduler* scheduler;
+	static StreamBuffer* stream;
 
 	static glm::vec3 lastMousePoint, trackballPoint;
 
@@ -74,8 +81,8 @@ public:
 	static void cleanUp();
 	static GLFWwindow* createWindow(int width, int height);
 	static void resizeCallback(GLFWwindow* window, int width, int height);
-	static void idleCallback();
-	static void displayCallback(GLFWwindow*);
+	static void idleCallback(float dt);
+	static void displayCallback(GLFWwindow*, float alpha);
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 	static void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
@@ -65,14 +65,24 @@ int main(void)
 	// Initialize objects/pointers for rendering; exit if initialization fails.
 	if (!Window::initializeObjects()) exit(EXIT_FAILURE);
 	
+	FrameScheduler* scheduler = Window::scheduler;
+	scheduler->start();
+
 	// Loop while GLFW window should stay open.
 	while (!glfwWindowShouldClose(window))
 	{
+		scheduler->beginFrame();
+
+		// Idle callback. Updating objects, etc. is done here in fixed ticks
+		// so movement doesn't depend on how long a frame took.
+		while (scheduler->tick())
+			Window::idleCallback(scheduler->getTickDelta());
+
 		// Main render display callback. Rendering of objects is done here.
-		Window::displayCallback(window);
+		Window::displayCallback(window, scheduler->getAlpha());
 
-		// Idle callback. Updating objects, etc. can be done here.
-		Window::idleCallback();
+		// Sleep off the rest of the frame if the frame rate is capped.
+		scheduler->endFrame();
 	}
 
 	Window::cleanUp();
@@ -0,0 +1,50 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+
+// Evaluates the bezier track from its control points, no vertex buffers.
+// Curve segment i is drawn with vertex ids starting at i * MAX_SAMPLES,
+// handles with vertex ids 0 .. 2 * segments.
+
+// must match the constants in CurveRenderer.h
+const int MAX_POINTS = 64;
+const int MAX_SEGMENTS = 21;
+const int MAX_SAMPLES = 256;
+
+layout (std140) uniform ControlPoints
+{
+	vec4 controls[MAX_POINTS];
+};
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+uniform bool handles;
+uniform int samples[MAX_SEGMENTS]; // lines per segment
+uniform int numControls; // control points without the repeated last one
+
+void main()
+{
+	vec3 p;
+	if (handles)
+	{
+		// a handle joins p2 of one segment with p1 of the next
+		int handle = gl_VertexID / 2;
+		int end = gl_VertexID - handle * 2;
+		p = controls[(handle * 3 + 2 + end * 2) % numControls].xyz;
+	}
+	else
+	{
+		int segment = gl_VertexID / MAX_SAMPLES;
+		float t = float(gl_VertexID - segment * MAX_SAMPLES) / float(samples[segment]);
+		float s = 1.0 - t;
+
+		// bernstein form of the cubic
+		p = s * s * s * controls[segment * 3].xyz +
+			3.0 * s * s * t * controls[segment * 3 + 1].xyz +
+			3.0 * s * t * t * controls[segment * 3 + 2].xyz +
+			t * t * t * controls[segment * 3 + 3].xyz;
+	}
+
+	gl_Position = projection * view * model * vec4(p, 1.0);
+}
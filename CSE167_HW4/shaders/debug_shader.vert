@@ -0,0 +1,16 @@
+#version 330 core
+
+// debug lines are already in world space
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 color;
+
+uniform mat4 viewProjection;
+
+out vec4 lineColor;
+
+void main()
+{
+	gl_Position = viewProjection * vec4(position, 1.0);
+	lineColor = color;
+}